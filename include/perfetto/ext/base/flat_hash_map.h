@@ -142,6 +142,7 @@ class FlatHashMap {
     values_ = std::move(other.values_);
     capacity_ = other.capacity_;
     size_ = other.size_;
+    tombstones_ = other.tombstones_;
     max_probe_length_ = other.max_probe_length_;
     load_limit_ = other.load_limit_;
     load_limit_percent_ = other.load_limit_percent_;
@@ -214,9 +215,20 @@ class FlatHashMap {
 
       // If we got to this point the key does not exist (otherwise we would have
       // hit the the return above) and we are going to insert a new entry.
-      // Before doing so, ensure we stay under the target load limit.
-      if (PERFETTO_UNLIKELY(size_ >= load_limit_)) {
-        MaybeGrowAndRehash(/*grow=*/true);
+      // Before doing so, ensure we stay under the target load limit. Tombstones
+      // count towards the load: they are never turned back into free slots
+      // until the next rehash and, if left to accumulate (e.g. in maps with a
+      // steady stream of Insert() and Erase()), they would turn every lookup
+      // miss into a scan of the whole table. Reusing a tombstone doesn't change
+      // the number of non-free slots, so it never needs a rehash.
+      const bool reuses_tombstone = insertion_slot != kSlotNotFound &&
+                                    tags_[insertion_slot] == kTombstone;
+      if (PERFETTO_UNLIKELY(!reuses_tombstone &&
+                            size_ + tombstones_ >= load_limit_)) {
+        // Grow only if live entries are a sizeable part of the load. If the
+        // pressure comes mostly from tombstones, rehashing at the same capacity
+        // is enough to get rid of them.
+        MaybeGrowAndRehash(/*grow=*/size_ * 2 >= load_limit_);
         continue;
       }
       PERFETTO_DCHECK(insertion_slot != kSlotNotFound);
@@ -226,6 +238,10 @@ class FlatHashMap {
     PERFETTO_CHECK(insertion_slot < capacity_);
 
     // We found a free slot (or a tombstone). Proceed with the insertion.
+    if (!AppendOnly && tags_[insertion_slot] == kTombstone) {
+      PERFETTO_DCHECK(tombstones_ > 0);
+      tombstones_--;
+    }
     Value* value_idx = &values_[insertion_slot];
     new (&keys_[insertion_slot]) Key(std::move(key));
     new (value_idx) Value(std::move(value));
@@ -313,6 +329,7 @@ class FlatHashMap {
     keys_[idx].~Key();
     values_[idx].~Value();
     size_--;
+    tombstones_++;
   }
 
   PERFETTO_NO_INLINE void MaybeGrowAndRehash(bool grow) {
@@ -357,6 +374,7 @@ class FlatHashMap {
     capacity_ = n;
     max_probe_length_ = 0;
     size_ = 0;
+    tombstones_ = 0;
     load_limit_ = n * static_cast<size_t>(load_limit_percent_) / 100;
     load_limit_ = std::min(load_limit_, n);
 
@@ -376,6 +394,7 @@ class FlatHashMap {
 
   size_t capacity_ = 0;
   size_t size_ = 0;
+  size_t tombstones_ = 0;  // Number of slots tagged as kTombstone.
   size_t max_probe_length_ = 0;
   size_t load_limit_ = 0;  // Updated every time |capacity_| changes.
   int load_limit_percent_ =
@@ -127,6 +127,18 @@ struct PERFETTO_EXPORT_COMPONENT Config {
   //
   // The flag has no impact on non-proto traces.
   bool analyze_trace_proto_content = false;
+
+  // When set to true, RUN_METRIC calls are memoized by (file, arguments) for
+  // the lifetime of the trace processor instance, across metric computations
+  // and queries, and the views created by these files are materialized into
+  // native tables the first time they are created.
+  //
+  // A file is run again when any object it defines or reads from (directly or
+  // through a view or function) was redefined or modified since it last ran.
+  // These references are found by a lexical scan of the SQL, so objects only
+  // reached through dynamically built SQL are not tracked. When false (the
+  // default), every RUN_METRIC call runs its file.
+  bool reuse_metric_outputs = false;
 };
 
 // Represents a dynamically typed value returned by SQL.
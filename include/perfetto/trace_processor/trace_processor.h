@@ -17,6 +17,7 @@
 #ifndef INCLUDE_PERFETTO_TRACE_PROCESSOR_TRACE_PROCESSOR_H_
 #define INCLUDE_PERFETTO_TRACE_PROCESSOR_TRACE_PROCESSOR_H_
 
+#include <functional>
 #include <memory>
 #include <vector>
 
@@ -94,6 +95,15 @@ class PERFETTO_EXPORT_COMPONENT TraceProcessor : public TraceProcessorStorage {
   // Interrupts the current query. Typically used by Ctrl-C handler.
   virtual void InterruptQuery() = 0;
 
+  // Sets a function which is periodically invoked, on the thread executing
+  // the query, while SQLite executes queries (including the work done inside
+  // ExecuteQuery() and Iterator::Next()). |vm_steps| is the (approximate)
+  // number of SQLite VM instructions executed by this instance so far.
+  // Returning false interrupts the running query, which then fails with an
+  // "interrupted" error. Passing an empty function removes the callback.
+  using QueryProgressCallback = std::function<bool(uint64_t vm_steps)>;
+  virtual void SetQueryProgressCallback(QueryProgressCallback) = 0;
+
   // Deletes all tables and views that have been created (by the UI or user)
   // after the trace was loaded. It preserves the built-in tables/view created
   // by the ingestion process. Returns the number of table/views deleted.
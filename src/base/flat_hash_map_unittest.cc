@@ -191,6 +191,31 @@ TYPED_TEST(FlatHashMapTest, FillWithTombstones) {
   }
 }
 
+// Keeps a steady number of live entries while inserting and erasing keys.
+// Tombstones must be reclaimed without growing the table unboundedly.
+TYPED_TEST(FlatHashMapTest, SteadyChurn) {
+  FlatHashMap<uint64_t, uint64_t, std::hash<uint64_t>,
+              typename TestFixture::Probe>
+      fmap;
+  const uint64_t kLive = 100;
+  for (uint64_t i = 0; i < kLive; i++)
+    ASSERT_TRUE(fmap.Insert(i, i).second);
+  const size_t initial_capacity = fmap.capacity();
+
+  for (uint64_t i = kLive; i < 100 * 1000; i++) {
+    ASSERT_TRUE(fmap.Erase(i - kLive));
+    ASSERT_TRUE(fmap.Insert(i, i).second);
+    ASSERT_EQ(fmap.size(), kLive);
+  }
+  EXPECT_EQ(fmap.capacity(), initial_capacity);
+
+  for (uint64_t i = 100 * 1000 - kLive; i < 100 * 1000; i++) {
+    ASSERT_NE(fmap.Find(i), nullptr);
+    ASSERT_EQ(*fmap.Find(i), i);
+  }
+  ASSERT_EQ(fmap.Find(0), nullptr);
+}
+
 TYPED_TEST(FlatHashMapTest, Collisions) {
   FlatHashMap<int, int, CollidingHasher, typename TestFixture::Probe> fmap(
       /*initial_capacity=*/0, /*load_limit_pct=*/100);
@@ -28,12 +28,45 @@ namespace profiling {
 GlobalCallstackTrie::Node* GlobalCallstackTrie::GetOrCreateChild(
     Node* self,
     const Interned<Frame>& loc) {
-  Node* child = self->GetChild(loc);
-  if (!child)
-    child = self->AddChild(loc, ++next_callstack_id_, self);
+  Node* child = self->GetChild(loc.id());
+  if (!child) {
+    child = node_allocator_.New(loc, ++next_callstack_id_, self);
+    self->AddChild(child);
+  }
   return child;
 }
 
+void GlobalCallstackTrie::DeleteChildren(Node* node) {
+  // Iterative rather than recursive, as callstacks can be hundreds of frames
+  // deep.
+  std::vector<Node*> to_delete;
+  auto push_child = [&to_delete](Node* child) { to_delete.push_back(child); };
+  node->ForEachChild(push_child);
+  while (!to_delete.empty()) {
+    Node* cur = to_delete.back();
+    to_delete.pop_back();
+    cur->ForEachChild(push_child);
+    node_allocator_.Delete(cur);
+  }
+  if (node->children_table_capacity_)
+    delete[] node->children_.table;
+  node->children_ = {};
+  node->children_table_capacity_ = 0;
+  node->num_children_ = 0;
+}
+
+size_t GlobalCallstackTrie::EstimateNodeMemoryUsage() const {
+  size_t total = node_allocator_.allocated_bytes();
+  std::vector<const Node*> to_visit{&root_};
+  while (!to_visit.empty()) {
+    const Node* cur = to_visit.back();
+    to_visit.pop_back();
+    total += cur->children_table_capacity_ * sizeof(Node*);
+    cur->ForEachChild([&to_visit](Node* child) { to_visit.push_back(child); });
+  }
+  return total;
+}
+
 std::vector<Interned<Frame>> GlobalCallstackTrie::BuildInverseCallstack(
     const Node* node) const {
   std::vector<Interned<Frame>> res;
@@ -87,8 +120,11 @@ void GlobalCallstackTrie::DecrementNode(Node* node) {
   bool delete_prev = false;
   Node* prev = nullptr;
   while (node != nullptr) {
-    if (delete_prev)
+    if (delete_prev) {
       node->RemoveChild(prev);
+      DeleteChildren(prev);
+      node_allocator_.Delete(prev);
+    }
     node->ref_count_ -= 1;
     delete_prev = node->ref_count_ == 0;
     prev = node;
@@ -126,29 +162,114 @@ Interned<Frame> GlobalCallstackTrie::MakeRootFrame() {
   return frame_interner_.Intern(frame);
 }
 
-GlobalCallstackTrie::Node* GlobalCallstackTrie::Node::AddChild(
-    const Interned<Frame>& loc,
-    uint64_t callstack_id,
-    Node* parent) {
-  auto it = children_.emplace(loc, callstack_id, parent);
-  return const_cast<Node*>(&(*it.first));
+GlobalCallstackTrie::Node* GlobalCallstackTrie::Node::GetChild(
+    InternID frame_id) const {
+  if (!children_table_capacity_) {
+    for (uint32_t i = 0; i < num_children_; ++i) {
+      if (children_.inline_children[i]->frame_id_ == frame_id)
+        return children_.inline_children[i];
+    }
+    return nullptr;
+  }
+  const uint32_t mask = children_table_capacity_ - 1;
+  for (uint32_t i = TableSlot(frame_id, children_table_capacity_);;
+       i = (i + 1) & mask) {
+    Node* child = children_.table[i];
+    if (!child || child->frame_id_ == frame_id)
+      return child;
+  }
 }
-void GlobalCallstackTrie::Node::RemoveChild(Node* node) {
-  children_.erase(*node);
+
+void GlobalCallstackTrie::Node::AddChild(Node* child) {
+  PERFETTO_DCHECK(!GetChild(child->frame_id_));
+  if (!children_table_capacity_) {
+    if (num_children_ < kInlineChildren) {
+      children_.inline_children[num_children_++] = child;
+      return;
+    }
+    RebuildTable(kMinTableCapacity);
+  } else if ((num_children_ + 1) * 4 > children_table_capacity_ * 3) {
+    // Keep the load factor under 75%.
+    RebuildTable(children_table_capacity_ * 2);
+  }
+  InsertIntoTable(child);
+  num_children_++;
 }
 
-GlobalCallstackTrie::Node* GlobalCallstackTrie::Node::GetChild(
-    const Interned<Frame>& loc) {
-  // This will be nicer with C++14 transparent comparators.
-  // Then we will be able to look up by just the key using a sutiable
-  // comparator.
-  //
-  // For now we need to allow to construct Node from the key.
-  Node node(loc);
-  auto it = children_.find(node);
-  if (it == children_.end())
-    return nullptr;
-  return const_cast<Node*>(&(*it));
+void GlobalCallstackTrie::Node::RemoveChild(Node* child) {
+  PERFETTO_DCHECK(num_children_ > 0);
+  if (!children_table_capacity_) {
+    for (uint32_t i = 0; i < num_children_; ++i) {
+      if (children_.inline_children[i] == child) {
+        children_.inline_children[i] =
+            children_.inline_children[num_children_ - 1];
+        children_.inline_children[--num_children_] = nullptr;
+        return;
+      }
+    }
+    PERFETTO_DFATAL("Child not found");
+    return;
+  }
+
+  const uint32_t mask = children_table_capacity_ - 1;
+  uint32_t hole = TableSlot(child->frame_id_, children_table_capacity_);
+  while (children_.table[hole] != child) {
+    PERFETTO_DCHECK(children_.table[hole]);
+    hole = (hole + 1) & mask;
+  }
+  children_.table[hole] = nullptr;
+  num_children_--;
+
+  // Backward shift deletion: move back entries of the probe chain that follows
+  // the hole, so that lookups never need tombstones.
+  for (uint32_t i = (hole + 1) & mask; children_.table[i]; i = (i + 1) & mask) {
+    uint32_t ideal = TableSlot(children_.table[i]->frame_id_,
+                               children_table_capacity_);
+    // The entry can fill the hole only if its ideal slot is not cyclically in
+    // (hole, i].
+    bool stays = hole <= i ? (hole < ideal && ideal <= i)
+                           : (hole < ideal || ideal <= i);
+    if (stays)
+      continue;
+    children_.table[hole] = children_.table[i];
+    children_.table[i] = nullptr;
+    hole = i;
+  }
+
+  if (num_children_ <= kInlineChildren)
+    RebuildTable(0);
+}
+
+void GlobalCallstackTrie::Node::InsertIntoTable(Node* child) {
+  const uint32_t mask = children_table_capacity_ - 1;
+  uint32_t i = TableSlot(child->frame_id_, children_table_capacity_);
+  while (children_.table[i])
+    i = (i + 1) & mask;
+  children_.table[i] = child;
+}
+
+// Moves all the children into a table of |new_capacity| slots, or back inline
+// if |new_capacity| is 0.
+void GlobalCallstackTrie::Node::RebuildTable(uint32_t new_capacity) {
+  PERFETTO_DCHECK(new_capacity == 0 || num_children_ < new_capacity);
+  PERFETTO_DCHECK(new_capacity != 0 || num_children_ <= kInlineChildren);
+  std::vector<Node*> children;
+  children.reserve(num_children_);
+  ForEachChild([&children](Node* child) { children.push_back(child); });
+
+  if (children_table_capacity_)
+    delete[] children_.table;
+  children_ = {};
+  children_table_capacity_ = new_capacity;
+
+  if (!new_capacity) {
+    for (size_t i = 0; i < children.size(); ++i)
+      children_.inline_children[i] = children[i];
+    return;
+  }
+  children_.table = new Node*[new_capacity]();
+  for (Node* child : children)
+    InsertIntoTable(child);
 }
 
 }  // namespace profiling
@@ -17,7 +17,6 @@
 #ifndef SRC_PROFILING_COMMON_CALLSTACK_TRIE_H_
 #define SRC_PROFILING_COMMON_CALLSTACK_TRIE_H_
 
-#include <set>
 #include <string>
 #include <typeindex>
 #include <vector>
@@ -25,6 +24,7 @@
 #include <unwindstack/Unwinder.h>
 
 #include "src/profiling/common/interner.h"
+#include "src/profiling/common/slab_allocator.h"
 #include "src/profiling/common/unwind_support.h"
 
 namespace perfetto {
@@ -82,6 +82,11 @@ struct Frame {
 // reconstructed from a GlobalCallstackTrie::Node by walking down the parent
 // chain.
 //
+// Nodes are allocated from a slab owned by the trie. Most nodes have very few
+// children, so they are stored inline in the node and only promoted to an
+// open-addressing table, keyed by the 32-bit interned frame id, for nodes with
+// many children.
+//
 // For the following two callstacks:
 //  * libc_init -> main -> foo -> alloc_buf
 //  * libc_init -> main -> bar -> alloc_buf
@@ -105,47 +110,76 @@ class GlobalCallstackTrie {
     // This is opaque except to GlobalCallstackTrie.
     friend class GlobalCallstackTrie;
 
-    // Allow building a node out of a frame for GetChild.
-    explicit Node(Interned<Frame> frame) : Node(frame, 0, nullptr) {}
-    Node(const Node&) = default;
-    Node(Node&&) = default;
-
     Node(Interned<Frame> frame, uint64_t id)
         : Node(std::move(frame), id, nullptr) {}
     Node(Interned<Frame> frame, uint64_t id, Node* parent)
-        : id_(id), parent_(parent), location_(frame) {}
+        : id_(id),
+          parent_(parent),
+          location_(std::move(frame)),
+          frame_id_(location_.id()) {}
+
+    Node(const Node&) = delete;
+    Node& operator=(const Node&) = delete;
 
-    ~Node() { PERFETTO_DCHECK(!ref_count_); }
+    ~Node() {
+      PERFETTO_DCHECK(!ref_count_);
+      if (children_table_capacity_)
+        delete[] children_.table;
+    }
 
     uint64_t id() const { return id_; }
 
    private:
-    Node* GetOrCreateChild(const Interned<Frame>& loc);
-    // Deletes all descendant nodes, regardless of |ref_count_|.
-    void DeleteChildren() { children_.clear(); }
+    // Number of children that are stored inline in the node, before being
+    // promoted to a table.
+    static constexpr uint32_t kInlineChildren = 2;
+    static constexpr uint32_t kMinTableCapacity = 8;
+
+    Node* GetChild(InternID frame_id) const;
+    void AddChild(Node* child);
+    void RemoveChild(Node* child);
+
+    template <typename F>
+    void ForEachChild(F fn) const {
+      if (!children_table_capacity_) {
+        for (uint32_t i = 0; i < num_children_; ++i)
+          fn(children_.inline_children[i]);
+        return;
+      }
+      for (uint32_t i = 0; i < children_table_capacity_; ++i) {
+        if (children_.table[i])
+          fn(children_.table[i]);
+      }
+    }
+
+    static uint32_t TableSlot(InternID frame_id, uint32_t capacity) {
+      // Frame ids are sequential, multiplying by an odd constant spreads
+      // them while keeping the mapping onto the low bits a bijection.
+      return (frame_id * 2654435761u) & (capacity - 1);
+    }
+    void InsertIntoTable(Node* child);
+    void RebuildTable(uint32_t new_capacity);
 
-    uint64_t ref_count_ = 0;
     uint64_t id_;
     Node* const parent_;
     const Interned<Frame> location_;
-
-    class NodeComparator {
-     public:
-      bool operator()(const Node& one, const Node& other) const {
-        return one.location_ < other.location_;
-      }
-    };
-    Node* AddChild(const Interned<Frame>& loc,
-                   uint64_t next_callstack_id_,
-                   Node* parent);
-    void RemoveChild(Node* node);
-    Node* GetChild(const Interned<Frame>& loc);
-
-    std::set<Node, NodeComparator> children_;
+    // Copy of location_.id(), to compare children without dereferencing
+    // location_.
+    const InternID frame_id_;
+    uint32_t ref_count_ = 0;
+    uint32_t num_children_ = 0;
+    // 0 if the children are stored in |children_.inline_children|.
+    uint32_t children_table_capacity_ = 0;
+    union Children {
+      Node* inline_children[kInlineChildren];
+      // Open addressing with linear probing, indexed by TableSlot(). Empty
+      // slots are nullptr.
+      Node** table;
+    } children_ = {};
   };
 
   GlobalCallstackTrie() = default;
-  ~GlobalCallstackTrie() = default;
+  ~GlobalCallstackTrie() { DeleteChildren(&root_); }
   GlobalCallstackTrie(const GlobalCallstackTrie&) = delete;
   GlobalCallstackTrie& operator=(const GlobalCallstackTrie&) = delete;
 
@@ -160,8 +194,8 @@ class GlobalCallstackTrie {
                        const std::vector<std::string>& build_ids);
   Node* CreateCallsite(const std::vector<Interned<Frame>>& callstack);
 
-  static void IncrementNode(Node* node);
-  static void DecrementNode(Node* node);
+  void IncrementNode(Node* node);
+  void DecrementNode(Node* node);
 
   std::vector<Interned<Frame>> BuildInverseCallstack(const Node* node) const;
 
@@ -170,12 +204,21 @@ class GlobalCallstackTrie {
   // of nodes (Node.ref_count_).
   void ClearTrie() {
     PERFETTO_DLOG("Clearing trie");
-    root_.DeleteChildren();
+    DeleteChildren(&root_);
   }
 
+  // Number of nodes, excluding the root.
+  size_t node_count() const { return node_allocator_.live_objects(); }
+
+  // Memory used by the nodes and their children tables. Walks the whole trie.
+  size_t EstimateNodeMemoryUsage() const;
+
  private:
   Node* GetOrCreateChild(Node* self, const Interned<Frame>& loc);
 
+  // Deletes all descendant nodes of |node|, regardless of |ref_count_|.
+  void DeleteChildren(Node* node);
+
   Interned<Frame> MakeRootFrame();
 
   Interner<std::string> string_interner_;
@@ -184,6 +227,8 @@ class GlobalCallstackTrie {
 
   uint64_t next_callstack_id_ = 0;
 
+  SlabAllocator<Node> node_allocator_;
+
   // Note: profile_module in trace processor relies on the value of this root
   // callsite being exactly "1". See the perf_sample parsing code.
   Node root_{MakeRootFrame(), ++next_callstack_id_};
@@ -0,0 +1,159 @@
+// Copyright (C) 2022 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/ext/base/hash.h"
+#include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/string_splitter.h"
+#include "src/profiling/common/callstack_trie.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+using Callstack = std::vector<unwindstack::FrameData>;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+unwindstack::FrameData MakeFrame(const std::string& function_name) {
+  unwindstack::FrameData frame{};
+  frame.pc = base::Hash::Combine(function_name.c_str());
+  frame.rel_pc = frame.pc;
+  frame.function_name = function_name;
+  return frame;
+}
+
+// Loads a corpus of callstacks in the "folded" format used by flamegraph
+// tools: one callstack per line, frames bottom-first separated by ';',
+// optionally followed by a space and a sample count (which is ignored).
+std::vector<Callstack> LoadCorpus(benchmark::State& state) {
+  std::vector<Callstack> callstacks;
+  base::ScopedFstream f(fopen("/tmp/callstack_corpus", "re"));
+  if (!f) {
+    state.SkipWithError(
+        "Corpus missing. Save folded callstacks into /tmp/callstack_corpus.");
+    return callstacks;
+  }
+  char line[16384];
+  while (fgets(line, sizeof(line), *f)) {
+    std::string stack_str(line);
+    size_t count_sep = stack_str.rfind(' ');
+    if (count_sep != std::string::npos)
+      stack_str.resize(count_sep);
+    Callstack callstack;
+    for (base::StringSplitter sp(stack_str, ';'); sp.Next();)
+      callstack.emplace_back(MakeFrame(sp.cur_token()));
+    // The trie expects frames top-first, like libunwindstack returns them.
+    std::reverse(callstack.begin(), callstack.end());
+    callstacks.emplace_back(std::move(callstack));
+  }
+  return callstacks;
+}
+
+// Generates callstacks shaped like the ones of a Java/C++ app: a few thread
+// entry points, a deep framework part shared by most callstacks, and a tail of
+// app frames picked from a skewed distribution.
+std::vector<Callstack> GenerateCorpus(size_t num_callstacks) {
+  std::minstd_rand0 rng(0);
+  std::vector<Callstack> callstacks;
+  callstacks.reserve(num_callstacks);
+  for (size_t i = 0; i < num_callstacks; ++i) {
+    Callstack callstack;
+    callstack.emplace_back(
+        MakeFrame("thread_start_" + std::to_string(rng() % 8)));
+    const size_t framework_depth = 20 + rng() % 20;
+    const uint32_t framework_variant = rng() % 16;
+    for (size_t d = 0; d < framework_depth; ++d) {
+      // Framework frames diverge only towards the end of the framework part.
+      uint32_t variant = d < framework_depth / 2 ? 0 : framework_variant;
+      callstack.emplace_back(MakeFrame("framework_" + std::to_string(d) + "_" +
+                                       std::to_string(variant)));
+    }
+    const size_t app_depth = 5 + rng() % 30;
+    for (size_t d = 0; d < app_depth; ++d) {
+      // Skewed: small function ids are much more likely.
+      uint32_t fn = static_cast<uint32_t>(rng() % (1 + rng() % 2000));
+      callstack.emplace_back(MakeFrame("app_" + std::to_string(fn)));
+    }
+    std::reverse(callstack.begin(), callstack.end());
+    callstacks.emplace_back(std::move(callstack));
+  }
+  return callstacks;
+}
+
+void InsertCallstacks(benchmark::State& state,
+                      const std::vector<Callstack>& callstacks) {
+  size_t max_depth = 0;
+  for (const Callstack& callstack : callstacks)
+    max_depth = std::max(max_depth, callstack.size());
+  const std::vector<std::string> build_ids(max_depth, "buildid");
+
+  size_t total_frames = 0;
+  for (const Callstack& callstack : callstacks)
+    total_frames += callstack.size();
+
+  for (auto _ : state) {
+    GlobalCallstackTrie trie;
+    std::vector<GlobalCallstackTrie::Node*> nodes;
+    nodes.reserve(callstacks.size());
+    for (const Callstack& callstack : callstacks) {
+      std::vector<std::string> ids(
+          build_ids.begin(),
+          build_ids.begin() + static_cast<ptrdiff_t>(callstack.size()));
+      GlobalCallstackTrie::Node* node = trie.CreateCallsite(callstack, ids);
+      trie.IncrementNode(node);
+      nodes.push_back(node);
+    }
+    state.counters["nodes"] =
+        benchmark::Counter(static_cast<double>(trie.node_count()));
+    state.counters["node_bytes"] = benchmark::Counter(
+        static_cast<double>(trie.EstimateNodeMemoryUsage()));
+    for (GlobalCallstackTrie::Node* node : nodes)
+      trie.DecrementNode(node);
+  }
+  state.counters["frames"] =
+      benchmark::Counter(static_cast<double>(total_frames),
+                         benchmark::Counter::kIsIterationInvariantRate);
+}
+
+}  // namespace
+
+static void BM_CallstackTrieInsertCorpus(benchmark::State& state) {
+  std::vector<Callstack> callstacks = LoadCorpus(state);
+  if (callstacks.empty())
+    return;
+  InsertCallstacks(state, callstacks);
+}
+BENCHMARK(BM_CallstackTrieInsertCorpus);
+
+static void BM_CallstackTrieInsertSynthetic(benchmark::State& state) {
+  const size_t num_callstacks =
+      IsBenchmarkFunctionalOnly() ? 100 : static_cast<size_t>(state.range(0));
+  InsertCallstacks(state, GenerateCorpus(num_callstacks));
+}
+BENCHMARK(BM_CallstackTrieInsertSynthetic)->Arg(10000)->Arg(100000);
+
+}  // namespace profiling
+}  // namespace perfetto
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/profiling/common/callstack_trie.h"
+
+#include <algorithm>
+#include <random>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+unwindstack::FrameData MakeFrame(uint64_t pc) {
+  unwindstack::FrameData frame{};
+  frame.pc = pc;
+  frame.rel_pc = pc;
+  frame.function_name = "fun" + std::to_string(pc);
+  return frame;
+}
+
+// Callstack (top frame first) of |leaf| called from a frame shared by all
+// callstacks.
+std::vector<unwindstack::FrameData> LeafCallstack(uint64_t leaf) {
+  return {MakeFrame(1000 + leaf), MakeFrame(1)};
+}
+
+std::vector<std::string> BuildIds(size_t n) {
+  return std::vector<std::string>(n, "buildid");
+}
+
+TEST(GlobalCallstackTrieTest, SameCallstackSameNode) {
+  GlobalCallstackTrie trie;
+  auto stack = LeafCallstack(1);
+  GlobalCallstackTrie::Node* node =
+      trie.CreateCallsite(stack, BuildIds(stack.size()));
+  EXPECT_EQ(trie.CreateCallsite(stack, BuildIds(stack.size())), node);
+  EXPECT_EQ(trie.node_count(), 2u);
+  EXPECT_EQ(trie.BuildInverseCallstack(node).size(), 2u);
+}
+
+// Exercises the promotion of the children of a node from inline storage to a
+// table and back, removing children in random order.
+TEST(GlobalCallstackTrieTest, ManyChildren) {
+  const uint64_t kNumLeaves = 500;
+  GlobalCallstackTrie trie;
+  std::vector<GlobalCallstackTrie::Node*> leaves;
+  for (uint64_t i = 0; i < kNumLeaves; ++i) {
+    auto stack = LeafCallstack(i);
+    GlobalCallstackTrie::Node* node =
+        trie.CreateCallsite(stack, BuildIds(stack.size()));
+    trie.IncrementNode(node);
+    leaves.push_back(node);
+  }
+  EXPECT_EQ(trie.node_count(), kNumLeaves + 1);
+
+  for (uint64_t i = 0; i < kNumLeaves; ++i) {
+    auto stack = LeafCallstack(i);
+    EXPECT_EQ(trie.CreateCallsite(stack, BuildIds(stack.size())), leaves[i]);
+  }
+
+  std::vector<uint64_t> order(kNumLeaves);
+  for (uint64_t i = 0; i < kNumLeaves; ++i)
+    order[i] = i;
+  std::minstd_rand0 rng(0);
+  std::shuffle(order.begin(), order.end(), rng);
+
+  for (size_t n = 0; n < order.size(); ++n) {
+    trie.DecrementNode(leaves[order[n]]);
+    leaves[order[n]] = nullptr;
+    // All remaining leaves must still be found.
+    if (n % 50 != 0 && n + 3 < order.size())
+      continue;
+    for (uint64_t i = 0; i < kNumLeaves; ++i) {
+      if (!leaves[i])
+        continue;
+      auto stack = LeafCallstack(i);
+      EXPECT_EQ(trie.CreateCallsite(stack, BuildIds(stack.size())), leaves[i]);
+    }
+  }
+  EXPECT_EQ(trie.node_count(), 0u);
+}
+
+TEST(GlobalCallstackTrieTest, ClearTrie) {
+  GlobalCallstackTrie trie;
+  for (uint64_t i = 0; i < 100; ++i) {
+    auto stack = LeafCallstack(i);
+    trie.CreateCallsite(stack, BuildIds(stack.size()));
+  }
+  EXPECT_EQ(trie.node_count(), 101u);
+  trie.ClearTrie();
+  EXPECT_EQ(trie.node_count(), 0u);
+
+  // Ids are not reset after clearing.
+  auto stack = LeafCallstack(0);
+  GlobalCallstackTrie::Node* node =
+      trie.CreateCallsite(stack, BuildIds(stack.size()));
+  EXPECT_GT(node->id(), 101u);
+}
+
+}  // namespace
+}  // namespace profiling
+}  // namespace perfetto
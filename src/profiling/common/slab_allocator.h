@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_PROFILING_COMMON_SLAB_ALLOCATOR_H_
+#define SRC_PROFILING_COMMON_SLAB_ALLOCATOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "perfetto/base/logging.h"
+
+namespace perfetto {
+namespace profiling {
+
+// Allocates objects of type T out of fixed-size slabs of kSlabSize objects.
+// Freed objects are put on an intrusive free list and their storage is reused
+// by the next allocation. Slabs are only returned to the system when the
+// allocator is destroyed.
+//
+// Compared to individual new/delete, this removes the per-object malloc
+// overhead and keeps objects that are allocated together close in memory.
+// Pointers to allocated objects are stable until they are passed to Delete().
+//
+// All objects must be Delete()-d before the allocator is destroyed.
+template <typename T, size_t kSlabSize = 256>
+class SlabAllocator {
+ public:
+  SlabAllocator() = default;
+  ~SlabAllocator() { PERFETTO_DCHECK(live_objects_ == 0); }
+
+  SlabAllocator(const SlabAllocator&) = delete;
+  SlabAllocator& operator=(const SlabAllocator&) = delete;
+
+  // Handing out stable pointers makes moving meaningless.
+  SlabAllocator(SlabAllocator&&) = delete;
+  SlabAllocator& operator=(SlabAllocator&&) = delete;
+
+  template <typename... Args>
+  T* New(Args&&... args) {
+    Slot* slot = free_list_;
+    if (slot) {
+      free_list_ = slot->next_free;
+    } else {
+      if (slabs_.empty() || next_slot_in_slab_ == kSlabSize) {
+        slabs_.emplace_back(new Slot[kSlabSize]);
+        next_slot_in_slab_ = 0;
+      }
+      slot = &slabs_.back()[next_slot_in_slab_++];
+    }
+    live_objects_++;
+    return new (&slot->storage) T(std::forward<Args>(args)...);
+  }
+
+  void Delete(T* obj) {
+    PERFETTO_DCHECK(live_objects_ > 0);
+    obj->~T();
+    Slot* slot = reinterpret_cast<Slot*>(obj);
+    slot->next_free = free_list_;
+    free_list_ = slot;
+    live_objects_--;
+  }
+
+  size_t live_objects() const { return live_objects_; }
+
+  // Memory held by the allocator, including free slots.
+  size_t allocated_bytes() const {
+    return slabs_.size() * kSlabSize * sizeof(Slot);
+  }
+
+ private:
+  union Slot {
+    Slot() {}
+    ~Slot() {}
+
+    Slot* next_free;
+    alignas(T) unsigned char storage[sizeof(T)];
+  };
+
+  std::vector<std::unique_ptr<Slot[]>> slabs_;
+  Slot* free_list_ = nullptr;
+  size_t next_slot_in_slab_ = 0;
+  size_t live_objects_ = 0;
+};
+
+}  // namespace profiling
+}  // namespace perfetto
+
+#endif  // SRC_PROFILING_COMMON_SLAB_ALLOCATOR_H_
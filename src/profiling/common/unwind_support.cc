@@ -16,16 +16,44 @@
 
 #include "src/profiling/common/unwind_support.h"
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include <cinttypes>
 
 #include <procinfo/process_map.h>
+#include <unwindstack/Elf.h>
+#include <unwindstack/MapInfo.h>
 #include <unwindstack/Maps.h>
 #include <unwindstack/Memory.h>
 
 #include "perfetto/ext/base/file_utils.h"
+#include "src/profiling/common/proc_utils.h"
 
 namespace perfetto {
 namespace profiling {
+namespace {
+
+// Past this much anonymous memory, the profiler stops retaining Elfs that are
+// no longer used by any of the processes it is unwinding.
+constexpr uint64_t kElfCacheMaxMemoryBytes = 256 * 1024 * 1024;
+
+int64_t GetMtimeNs(const struct stat& st) {
+  return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+         static_cast<int64_t>(st.st_mtim.tv_nsec);
+}
+
+base::Optional<uint64_t> GetSelfRssAnonAndSwapBytes() {
+  std::string status;
+  if (!base::ReadFile("/proc/self/status", &status))
+    return base::nullopt;
+  base::Optional<uint32_t> rss_and_swap_kb = GetRssAnonAndSwap(status);
+  if (!rss_and_swap_kb)
+    return base::nullopt;
+  return static_cast<uint64_t>(*rss_and_swap_kb) * 1024;
+}
+
+}  // namespace
 
 StackOverlayMemory::StackOverlayMemory(std::shared_ptr<unwindstack::Memory> mem,
                                        uint64_t sp,
@@ -91,18 +119,120 @@ void FDMaps::Reset() {
   maps_.clear();
 }
 
+// static
+ElfCache* ElfCache::GetInstance() {
+  static ElfCache* instance = new ElfCache(kElfCacheMaxMemoryBytes);
+  return instance;
+}
+
+ElfCache::ElfCache(uint64_t max_memory_bytes)
+    : ElfCache(max_memory_bytes, GetSelfRssAnonAndSwapBytes) {}
+
+bool ElfCache::Attach(unwindstack::MapInfo* map_info) {
+  const std::string& path = map_info->name();
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0)
+    return false;
+
+  std::lock_guard<std::mutex> l(mutex_);
+  auto file_it = files_.find({path, map_info->offset()});
+  if (file_it == files_.end())
+    return false;
+  const FileInfo& file = file_it->second;
+  auto entry_it = entries_.find(file.key);
+  if (file.dev != static_cast<uint64_t>(st.st_dev) ||
+      file.inode != static_cast<uint64_t>(st.st_ino) ||
+      file.mtime_ns != GetMtimeNs(st) || entry_it == entries_.end()) {
+    // The file was replaced, or its Elf was evicted.
+    files_.erase(file_it);
+    return false;
+  }
+  lru_.splice(lru_.begin(), lru_, entry_it->second);
+  map_info->set_elf_offset(file.elf_offset);
+  map_info->set_elf_start_offset(file.elf_start_offset);
+  map_info->elf() = entry_it->second->second;
+  return true;
+}
+
+void ElfCache::Add(unwindstack::MapInfo* map_info) {
+  std::shared_ptr<unwindstack::Elf> elf = map_info->elf();
+  if (!elf || !elf->valid() || map_info->memory_backed_elf())
+    return;
+  std::string build_id = elf->GetBuildID();
+  if (build_id.empty())
+    return;
+  const std::string& path = map_info->name();
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0)
+    return;
+
+  Key key{std::move(build_id), static_cast<uint64_t>(elf->GetLoadBias())};
+
+  std::lock_guard<std::mutex> l(mutex_);
+  files_[{path, map_info->offset()}] = FileInfo{
+      static_cast<uint64_t>(st.st_dev),
+      static_cast<uint64_t>(st.st_ino),
+      GetMtimeNs(st),
+      map_info->elf_offset(),
+      map_info->elf_start_offset(),
+      key,
+  };
+  auto entry_it = entries_.find(key);
+  if (entry_it != entries_.end()) {
+    // The same library at a different path, or added by another thread.
+    lru_.splice(lru_.begin(), lru_, entry_it->second);
+    return;
+  }
+  lru_.emplace_front(key, std::move(elf));
+  entries_.emplace(std::move(key), lru_.begin());
+
+  // The Elf that was just added is still referenced by |map_info|, so
+  // evicting it would not free any memory.
+  while (lru_.size() > 1) {
+    base::Optional<uint64_t> memory_bytes = get_memory_();
+    if (!memory_bytes || *memory_bytes <= max_memory_bytes_)
+      break;
+    EvictLeastRecentlyUsed();
+  }
+}
+
+void ElfCache::EvictLeastRecentlyUsed() {
+  auto last_it = std::prev(lru_.end());
+  for (auto file_it = files_.begin(); file_it != files_.end();) {
+    if (file_it->second.key.build_id == last_it->first.build_id &&
+        file_it->second.key.load_bias == last_it->first.load_bias) {
+      file_it = files_.erase(file_it);
+    } else {
+      ++file_it;
+    }
+  }
+  entries_.erase(last_it->first);
+  lru_.erase(last_it);
+}
+
+void ElfCache::Clear() {
+  std::lock_guard<std::mutex> l(mutex_);
+  files_.clear();
+  entries_.clear();
+  lru_.clear();
+}
+
 UnwindingMetadata::UnwindingMetadata(base::ScopedFile maps_fd,
-                                     base::ScopedFile mem_fd)
+                                     base::ScopedFile mem_fd,
+                                     ElfCache* cache)
     : fd_maps(std::move(maps_fd)),
-      fd_mem(std::make_shared<FDMemory>(std::move(mem_fd))) {
+      fd_mem(std::make_shared<FDMemory>(std::move(mem_fd))),
+      elf_cache(cache) {
   if (!fd_maps.Parse())
     PERFETTO_DLOG("Failed initial maps parse");
+  AttachCachedElfs();
 }
 
 void UnwindingMetadata::ReparseMaps() {
   reparses++;
   fd_maps.Reset();
   fd_maps.Parse();
+  AttachCachedElfs();
 #if PERFETTO_BUILDFLAG(PERFETTO_ANDROID_BUILD)
   jit_debug.reset();
   dex_files.reset();
@@ -138,6 +268,41 @@ const std::string& UnwindingMetadata::GetBuildId(
   return empty_string_;
 }
 
+void UnwindingMetadata::AttachCachedElfs() {
+  uncached_maps.clear();
+  if (!elf_cache)
+    return;
+  for (const std::shared_ptr<unwindstack::MapInfo>& map_info : fd_maps) {
+    const std::string& name = map_info->name();
+    if ((map_info->flags() & PROT_EXEC) == 0 ||
+        (map_info->flags() & unwindstack::MAPS_FLAGS_DEVICE_MAP) ||
+        name.empty() || name[0] != '/') {
+      continue;
+    }
+    if (elf_cache->Attach(map_info.get()))
+      elf_cache_hits++;
+    else
+      uncached_maps.emplace(map_info.get(), map_info);
+  }
+}
+
+void UnwindingMetadata::CacheElfs(
+    const std::vector<unwindstack::FrameData>& frames) {
+  if (!elf_cache || uncached_maps.empty())
+    return;
+  for (const unwindstack::FrameData& frame : frames) {
+    if (!frame.map_info)
+      continue;
+    auto it = uncached_maps.find(frame.map_info.get());
+    if (it == uncached_maps.end() || !frame.map_info->elf())
+      continue;
+    // The Elf of this mapping was parsed by libunwindstack for this unwind.
+    elf_cache->Add(frame.map_info.get());
+    elf_cache_misses++;
+    uncached_maps.erase(it);
+  }
+}
+
 std::string StringifyLibUnwindstackError(unwindstack::ErrorCode e) {
   switch (e) {
     case unwindstack::ERROR_NONE:
@@ -20,8 +20,14 @@
 // defines PERFETTO_BUILDFLAG
 #include "perfetto/base/build_config.h"
 
+#include <functional>
+#include <list>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <tuple>
+#include <vector>
 
 #include <unwindstack/Maps.h>
 #include <unwindstack/Unwinder.h>
@@ -32,6 +38,7 @@
 
 #include "perfetto/base/logging.h"
 #include "perfetto/base/time.h"
+#include "perfetto/ext/base/optional.h"
 #include "perfetto/ext/base/scoped_file.h"
 
 namespace perfetto {
@@ -90,8 +97,85 @@ class StackOverlayMemory : public unwindstack::Memory {
   const uint8_t* const stack_;
 };
 
+// Cache of the unwindstack::Elf objects, which hold the parsed unwind tables
+// and symbols of a library, shared by all processes and data sources of the
+// profiler. This way, a library mapped by many processes, or profiled over
+// several sessions, is only parsed once.
+//
+// Elfs are keyed by build id and load bias. As finding the build id of a
+// mapping requires reading the file, mappings are looked up by path and
+// offset, which are validated against the inode and modification time of the
+// file. Elfs read from the memory of a process, rather than from a file, are
+// not cached, as they are only valid for that process.
+//
+// The cache is bounded by the real memory of the profiler, rather than by an
+// estimate of the size of each Elf: after an Elf is added, the least recently
+// used Elfs are evicted for as long as the anonymous RSS and swap of the
+// profiler exceed the limit. As freed memory is not necessarily returned to
+// the system right away, this can evict more Elfs than strictly needed.
+class ElfCache {
+ public:
+  struct Key {
+    std::string build_id;
+    uint64_t load_bias;
+
+    bool operator<(const Key& other) const {
+      return std::tie(build_id, load_bias) <
+             std::tie(other.build_id, other.load_bias);
+    }
+  };
+
+  // Returns the anonymous RSS and swap of the profiler, in bytes.
+  using MemoryGetter = std::function<base::Optional<uint64_t>()>;
+
+  static ElfCache* GetInstance();
+
+  explicit ElfCache(uint64_t max_memory_bytes);
+  ElfCache(uint64_t max_memory_bytes, MemoryGetter get_memory)
+      : max_memory_bytes_(max_memory_bytes),
+        get_memory_(std::move(get_memory)) {}
+
+  // Sets the Elf of |map_info|, if its file is cached. Returns false on a
+  // miss.
+  bool Attach(unwindstack::MapInfo* map_info);
+  // Adds the Elf that libunwindstack created for |map_info|.
+  void Add(unwindstack::MapInfo* map_info);
+  void Clear();
+
+  size_t num_elfs() {
+    std::lock_guard<std::mutex> l(mutex_);
+    return entries_.size();
+  }
+
+ private:
+  // A mapping of a file, and the Elf it was resolved to.
+  struct FileInfo {
+    uint64_t dev;
+    uint64_t inode;
+    int64_t mtime_ns;
+    uint64_t elf_offset;
+    uint64_t elf_start_offset;
+    Key key;
+  };
+  using ListType =
+      std::list<std::pair<const Key, std::shared_ptr<unwindstack::Elf>>>;
+
+  void EvictLeastRecentlyUsed();
+
+  const uint64_t max_memory_bytes_;
+  const MemoryGetter get_memory_;
+  std::mutex mutex_;
+  // Most recently used first.
+  ListType lru_;
+  std::map<Key, ListType::iterator> entries_;
+  // Keyed by path and offset of the mapping.
+  std::map<std::pair<std::string, uint64_t>, FileInfo> files_;
+};
+
 struct UnwindingMetadata {
-  UnwindingMetadata(base::ScopedFile maps_fd, base::ScopedFile mem_fd);
+  UnwindingMetadata(base::ScopedFile maps_fd,
+                    base::ScopedFile mem_fd,
+                    ElfCache* elf_cache = ElfCache::GetInstance());
 
   // move-only
   UnwindingMetadata(const UnwindingMetadata&) = delete;
@@ -109,12 +193,29 @@ struct UnwindingMetadata {
 
   const std::string& GetBuildId(const unwindstack::FrameData& frame);
 
+  // Sets the Elfs of the executable mappings found in the ElfCache. Called
+  // whenever the maps are parsed. Does nothing if |elf_cache| is null.
+  void AttachCachedElfs();
+  // Adds the Elfs that were created while unwinding |frames| to the ElfCache.
+  // Does nothing if |elf_cache| is null.
+  void CacheElfs(const std::vector<unwindstack::FrameData>& frames);
+
   std::string empty_string_;
   FDMaps fd_maps;
   // The API of libunwindstack expects shared_ptr for Memory.
   std::shared_ptr<unwindstack::Memory> fd_mem;
   uint64_t reparses = 0;
   base::TimeMillis last_maps_reparse_time{0};
+  // Null if the Elfs are not cached across processes, e.g. because
+  // libunwindstack's own Elf caching is used instead.
+  ElfCache* elf_cache;
+  // Executable mappings that missed the ElfCache when the maps were parsed.
+  std::map<const unwindstack::MapInfo*, std::shared_ptr<unwindstack::MapInfo>>
+      uncached_maps;
+  // Mappings whose Elf was taken from the cache, and Elfs that had to be
+  // parsed and were added to it.
+  uint64_t elf_cache_hits = 0;
+  uint64_t elf_cache_misses = 0;
 #if PERFETTO_BUILDFLAG(PERFETTO_ANDROID_BUILD)
   std::unique_ptr<unwindstack::JitDebug> jit_debug;
   std::unique_ptr<unwindstack::DexFiles> dex_files;
@@ -30,6 +30,17 @@
 namespace perfetto {
 namespace profiling {
 
+HeapTracker::~HeapTracker() {
+  // Allocations reference the CallstackAllocations, so they need to go first.
+  allocations_.Clear();
+  dead_callstack_allocations_.clear();
+  for (auto it = callstack_allocations_.GetIterator(); it; ++it) {
+    callsites_->DecrementNode(it.key());
+    callstack_allocations_pool_.Delete(it.value());
+  }
+  callstack_allocations_.Clear();
+}
+
 void HeapTracker::RecordMalloc(
     const std::vector<unwindstack::FrameData>& callstack,
     const std::vector<std::string>& build_ids,
@@ -53,9 +64,9 @@ void HeapTracker::RecordMalloc(
     }
   }
 
-  auto it = allocations_.find(address);
-  if (it != allocations_.end()) {
-    Allocation& alloc = it->second;
+  Allocation* existing = allocations_.Find(address);
+  if (existing) {
+    Allocation& alloc = *existing;
     PERFETTO_DCHECK(alloc.sequence_number != sequence_number);
     if (alloc.sequence_number < sequence_number) {
       // As we are overwriting the previous allocation, the previous allocation
@@ -81,9 +92,9 @@ void HeapTracker::RecordMalloc(
     }
   } else {
     GlobalCallstackTrie::Node* node = callsites_->CreateCallsite(frames);
-    allocations_.emplace(address,
-                         Allocation(sample_size, alloc_size, sequence_number,
-                                    MaybeCreateCallstackAllocations(node)));
+    allocations_.Insert(address,
+                        Allocation(sample_size, alloc_size, sequence_number,
+                                   MaybeCreateCallstackAllocations(node)));
   }
 
   RecordOperation(sequence_number, {address, timestamp});
@@ -92,7 +103,7 @@ void HeapTracker::RecordMalloc(
 void HeapTracker::RecordOperation(uint64_t sequence_number,
                                   const PendingOperation& operation) {
   if (sequence_number != committed_sequence_number_ + 1) {
-    pending_operations_.emplace(sequence_number, operation);
+    pending_operations_.Insert(sequence_number, operation);
     return;
   }
 
@@ -100,11 +111,14 @@ void HeapTracker::RecordOperation(uint64_t sequence_number,
 
   // At this point some other pending operations might be eligible to be
   // committed.
-  auto it = pending_operations_.begin();
-  while (it != pending_operations_.end() &&
-         it->first == committed_sequence_number_ + 1) {
-    CommitOperation(it->first, it->second);
-    it = pending_operations_.erase(it);
+  while (pending_operations_.size() > 0) {
+    uint64_t next_sequence_number = committed_sequence_number_ + 1;
+    PendingOperation* pending = pending_operations_.Find(next_sequence_number);
+    if (!pending)
+      break;
+    PendingOperation next_operation = *pending;
+    pending_operations_.Erase(next_sequence_number);
+    CommitOperation(next_sequence_number, next_operation);
   }
 }
 
@@ -117,16 +131,16 @@ void HeapTracker::CommitOperation(uint64_t sequence_number,
   uint64_t address = operation.allocation_address;
 
   // We will see many frees for addresses we do not know about.
-  auto leaf_it = allocations_.find(address);
-  if (leaf_it == allocations_.end())
+  Allocation* leaf = allocations_.Find(address);
+  if (!leaf)
     return;
 
-  Allocation& value = leaf_it->second;
+  Allocation& value = *leaf;
   if (value.sequence_number == sequence_number) {
     AddToCallstackAllocations(operation.timestamp, value);
   } else if (value.sequence_number < sequence_number) {
     SubtractFromCallstackAllocations(value);
-    allocations_.erase(leaf_it);
+    allocations_.Erase(address);
   }
   // else (value.sequence_number > sequence_number:
   //  This allocation has been replaced by a newer one in RecordMalloc.
@@ -144,14 +158,13 @@ uint64_t HeapTracker::GetSizeForTesting(
       callsites_->CreateCallsite(stack, build_ids);
   // Hack to make it go away again if it wasn't used before.
   // This is only good because this is used for testing only.
-  GlobalCallstackTrie::IncrementNode(node);
-  GlobalCallstackTrie::DecrementNode(node);
-  auto it = callstack_allocations_.find(node);
-  if (it == callstack_allocations_.end()) {
+  callsites_->IncrementNode(node);
+  callsites_->DecrementNode(node);
+  const CallstackAllocations* alloc = FindCallstackAllocations(node);
+  if (!alloc) {
     return 0;
   }
-  const CallstackAllocations& alloc = it->second;
-  return alloc.value.totals.allocated - alloc.value.totals.freed;
+  return alloc->value.totals.allocated - alloc->value.totals.freed;
 }
 
 uint64_t HeapTracker::GetMaxForTesting(
@@ -162,14 +175,13 @@ uint64_t HeapTracker::GetMaxForTesting(
       callsites_->CreateCallsite(stack, build_ids);
   // Hack to make it go away again if it wasn't used before.
   // This is only good because this is used for testing only.
-  GlobalCallstackTrie::IncrementNode(node);
-  GlobalCallstackTrie::DecrementNode(node);
-  auto it = callstack_allocations_.find(node);
-  if (it == callstack_allocations_.end()) {
+  callsites_->IncrementNode(node);
+  callsites_->DecrementNode(node);
+  const CallstackAllocations* alloc = FindCallstackAllocations(node);
+  if (!alloc) {
     return 0;
   }
-  const CallstackAllocations& alloc = it->second;
-  return alloc.value.retain_max.max;
+  return alloc->value.retain_max.max;
 }
 
 uint64_t HeapTracker::GetMaxCountForTesting(
@@ -180,14 +192,13 @@ uint64_t HeapTracker::GetMaxCountForTesting(
       callsites_->CreateCallsite(stack, build_ids);
   // Hack to make it go away again if it wasn't used before.
   // This is only good because this is used for testing only.
-  GlobalCallstackTrie::IncrementNode(node);
-  GlobalCallstackTrie::DecrementNode(node);
-  auto it = callstack_allocations_.find(node);
-  if (it == callstack_allocations_.end()) {
+  callsites_->IncrementNode(node);
+  callsites_->DecrementNode(node);
+  const CallstackAllocations* alloc = FindCallstackAllocations(node);
+  if (!alloc) {
     return 0;
   }
-  const CallstackAllocations& alloc = it->second;
-  return alloc.value.retain_max.max_count;
+  return alloc->value.retain_max.max_count;
 }
 
 }  // namespace profiling
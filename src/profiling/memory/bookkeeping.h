@@ -17,12 +17,13 @@
 #ifndef SRC_PROFILING_MEMORY_BOOKKEEPING_H_
 #define SRC_PROFILING_MEMORY_BOOKKEEPING_H_
 
-#include <map>
 #include <vector>
 
 #include "perfetto/base/time.h"
+#include "perfetto/ext/base/flat_hash_map.h"
 #include "src/profiling/common/callstack_trie.h"
 #include "src/profiling/common/interner.h"
+#include "src/profiling/common/slab_allocator.h"
 #include "src/profiling/memory/unwound_messages.h"
 
 // Below is an illustration of the bookkeeping system state where
@@ -117,10 +118,10 @@ class HeapTracker {
       CallstackTotalAllocations totals;
     } value = {};
 
+    // Holds a reference on the node, released by HeapTracker when this is
+    // destroyed.
     GlobalCallstackTrie::Node* const node;
 
-    ~CallstackAllocations() { GlobalCallstackTrie::DecrementNode(node); }
-
     bool operator<(const CallstackAllocations& other) const {
       return node < other.node;
     }
@@ -130,6 +131,11 @@ class HeapTracker {
   explicit HeapTracker(GlobalCallstackTrie* callsites, bool dump_at_max_mode)
       : callsites_(callsites), dump_at_max_mode_(dump_at_max_mode) {}
 
+  ~HeapTracker();
+
+  HeapTracker(const HeapTracker&) = delete;
+  HeapTracker& operator=(const HeapTracker&) = delete;
+
   void RecordMalloc(const std::vector<unwindstack::FrameData>& callstack,
                     const std::vector<std::string>& build_ids,
                     uint64_t address,
@@ -145,42 +151,41 @@ class HeapTracker {
     // * We need to remove them after the callstacks were dumped, which
     //   currently happens after the allocations are dumped.
     // * This way, we do not destroy and recreate callstacks as frequently.
-    for (auto it_and_alloc : dead_callstack_allocations_) {
-      auto& it = it_and_alloc.first;
-      uint64_t allocated = it_and_alloc.second;
-      const CallstackAllocations& alloc = it->second;
+    for (const auto& alloc_and_allocated : dead_callstack_allocations_) {
+      CallstackAllocations* alloc = alloc_and_allocated.first;
+      uint64_t allocated = alloc_and_allocated.second;
       // For non-dump-at-max, we need to check, even if there are still no
       // allocations referencing this callstack, whether there were any
       // allocations that happened but were freed again. If that was the case,
       // we need to keep the callsite, because the next dump will indicate a
       // different self_alloc and self_freed.
-      if (alloc.allocs == 0 &&
+      if (alloc->allocs == 0 &&
           (dump_at_max_mode_ ||
-           alloc.value.totals.allocation_count == allocated)) {
+           alloc->value.totals.allocation_count == allocated)) {
         // TODO(fmayer): We could probably be smarter than throw away
         // our whole frames cache.
         ClearFrameCache();
-        callstack_allocations_.erase(it);
+        DeleteCallstackAllocations(alloc);
       }
     }
     dead_callstack_allocations_.clear();
 
-    for (auto it = callstack_allocations_.begin();
-         it != callstack_allocations_.end(); ++it) {
-      const CallstackAllocations& alloc = it->second;
-      fn(alloc);
+    for (auto it = callstack_allocations_.GetIterator(); it; ++it) {
+      CallstackAllocations* alloc = it.value();
+      fn(static_cast<const CallstackAllocations&>(*alloc));
 
-      if (alloc.allocs == 0)
+      if (alloc->allocs == 0)
         dead_callstack_allocations_.emplace_back(
-            it, !dump_at_max_mode_ ? alloc.value.totals.allocation_count : 0);
+            alloc,
+            !dump_at_max_mode_ ? alloc->value.totals.allocation_count : 0);
     }
   }
 
   template <typename F>
   void GetAllocations(F fn) {
-    for (const auto& addr_and_allocation : allocations_) {
-      const Allocation& alloc = addr_and_allocation.second;
-      fn(addr_and_allocation.first, alloc.sample_size, alloc.alloc_size,
+    for (auto it = allocations_.GetIterator(); it; ++it) {
+      const Allocation& alloc = it.value();
+      fn(it.key(), alloc.sample_size, alloc.alloc_size,
          alloc.callstack_allocations()->node->id());
     }
   }
@@ -254,17 +259,49 @@ class HeapTracker {
     uint64_t timestamp;
   };
 
+  // std::hash for integers is the identity function in most standard
+  // libraries. Allocation addresses have their low bits set to zero by the
+  // allocator alignment, and node pointers are spaced by sizeof(Node), so they
+  // need to be mixed before being used as keys of a power-of-two sized
+  // base::FlatHashMap. This is the finalizer of MurmurHash3.
+  struct AddressHash {
+    size_t operator()(uint64_t x) const {
+      x ^= x >> 33;
+      x *= 0xff51afd7ed558ccdULL;
+      x ^= x >> 33;
+      x *= 0xc4ceb9fe1a85ec53ULL;
+      x ^= x >> 33;
+      return static_cast<size_t>(x);
+    }
+    size_t operator()(const GlobalCallstackTrie::Node* node) const {
+      return (*this)(static_cast<uint64_t>(reinterpret_cast<uintptr_t>(node)));
+    }
+  };
+
   CallstackAllocations* MaybeCreateCallstackAllocations(
       GlobalCallstackTrie::Node* node) {
-    auto callstack_allocations_it = callstack_allocations_.find(node);
-    if (callstack_allocations_it == callstack_allocations_.end()) {
-      GlobalCallstackTrie::IncrementNode(node);
-      bool inserted;
-      std::tie(callstack_allocations_it, inserted) =
-          callstack_allocations_.emplace(node, node);
-      PERFETTO_DCHECK(inserted);
-    }
-    return &callstack_allocations_it->second;
+    CallstackAllocations** existing = callstack_allocations_.Find(node);
+    if (existing)
+      return *existing;
+    callsites_->IncrementNode(node);
+    CallstackAllocations* created = callstack_allocations_pool_.New(node);
+    bool inserted = callstack_allocations_.Insert(node, created).second;
+    PERFETTO_DCHECK(inserted);
+    base::ignore_result(inserted);
+    return created;
+  }
+
+  void DeleteCallstackAllocations(CallstackAllocations* alloc) {
+    GlobalCallstackTrie::Node* node = alloc->node;
+    callstack_allocations_.Erase(node);
+    callstack_allocations_pool_.Delete(alloc);
+    callsites_->DecrementNode(node);
+  }
+
+  CallstackAllocations* FindCallstackAllocations(
+      GlobalCallstackTrie::Node* node) const {
+    CallstackAllocations** alloc = callstack_allocations_.Find(node);
+    return alloc ? *alloc : nullptr;
   }
 
   void RecordOperation(uint64_t sequence_number,
@@ -298,11 +335,11 @@ class HeapTracker {
         alloc.callstack_allocations()->value.retain_max.max_count =
             alloc.callstack_allocations()->value.retain_max.cur_count;
       } else {
-        for (auto& p : callstack_allocations_) {
+        for (auto it = callstack_allocations_.GetIterator(); it; ++it) {
           // We need to reset max = cur for every CallstackAllocation, as we
           // do not know which ones have changed since the last max.
           // TODO(fmayer): Add an index to speed this up
-          CallstackAllocations& csa = p.second;
+          CallstackAllocations& csa = *it.value();
           csa.value.retain_max.max = csa.value.retain_max.cur;
           csa.value.retain_max.max_count = csa.value.retain_max.cur_count;
         }
@@ -331,13 +368,20 @@ class HeapTracker {
   // We cannot use an interner here, because after the last allocation goes
   // away, we still need to keep the CallstackAllocations around until the next
   // dump.
-  std::map<GlobalCallstackTrie::Node*, CallstackAllocations>
+  // The CallstackAllocations are owned by |callstack_allocations_pool_|, as
+  // Allocation holds pointers to them and base::FlatHashMap does not guarantee
+  // pointer stability.
+  SlabAllocator<CallstackAllocations> callstack_allocations_pool_;
+  base::FlatHashMap<GlobalCallstackTrie::Node*,
+                    CallstackAllocations*,
+                    AddressHash>
       callstack_allocations_;
 
-  std::vector<std::pair<decltype(callstack_allocations_)::iterator, uint64_t>>
+  std::vector<std::pair<CallstackAllocations*, uint64_t>>
       dead_callstack_allocations_;
 
-  std::map<uint64_t /* allocation address */, Allocation> allocations_;
+  base::FlatHashMap<uint64_t /* allocation address */, Allocation, AddressHash>
+      allocations_;
 
   // An operation is either a commit of an allocation or freeing of an
   // allocation. An operation is a free if its seq_id is larger than
@@ -346,7 +390,12 @@ class HeapTracker {
   //
   // If its seq_id is less than the sequence_number of the corresponding
   // allocation it could be either, but is ignored either way.
-  std::map<uint64_t /* seq_id */, PendingOperation /* allocation address */>
+  //
+  // Operations are only ever looked up by the next sequence number to be
+  // committed, so no ordering is needed.
+  base::FlatHashMap<uint64_t /* seq_id */,
+                    PendingOperation /* allocation address */,
+                    AddressHash>
       pending_operations_;
 
   uint64_t committed_timestamp_ = 0;
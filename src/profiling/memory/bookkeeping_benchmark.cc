@@ -0,0 +1,230 @@
+// Copyright (C) 2022 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <inttypes.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/scoped_file.h"
+#include "src/profiling/memory/bookkeeping.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+// A single malloc or free, as seen by HeapTracker.
+struct Operation {
+  bool is_malloc;
+  uint64_t sequence_number;
+  uint64_t address;
+  uint64_t size;
+  uint32_t callstack_idx;
+};
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+// Returns the number of bytes allocated from the heap, including the large
+// allocations served by mmap.
+size_t GetHeapBytes() {
+#if defined(__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  struct mallinfo2 info = mallinfo2();
+  return info.uordblks + info.hblkhd;
+#else
+  struct mallinfo info = mallinfo();
+  return static_cast<size_t>(info.uordblks) + static_cast<size_t>(info.hblkhd);
+#endif
+}
+
+// Builds |n| distinct callstacks that share common bottom frames, as real
+// callstacks do.
+std::vector<std::vector<unwindstack::FrameData>> MakeCallstacks(uint32_t n) {
+  std::vector<std::vector<unwindstack::FrameData>> callstacks(n);
+  for (uint32_t i = 0; i < n; ++i) {
+    const uint32_t depth = 8 + (i % 24);
+    for (uint32_t d = 0; d < depth; ++d) {
+      unwindstack::FrameData frame{};
+      // Top frames are unique to the callstack, bottom frames are shared.
+      const uint64_t key = d < depth / 2 ? i : d;
+      frame.pc = 0x1000 * (d + 1) + key;
+      frame.rel_pc = frame.pc;
+      frame.function_name = "fn_" + std::to_string(key);
+      callstacks[i].emplace_back(std::move(frame));
+    }
+  }
+  return callstacks;
+}
+
+// Parses a malloc/free stream recorded from a real heapprofd session. Each
+// line is one of:
+//   m <sequence number> <hex address> <sample size> <callstack index>
+//   f <sequence number> <hex address>
+std::vector<Operation> LoadRecordedOperations(benchmark::State& state,
+                                              uint32_t* num_callstacks) {
+  std::vector<Operation> ops;
+  base::ScopedFstream f(fopen("/tmp/heapprofd_ops", "re"));
+  if (!f) {
+    state.SkipWithError(
+        "Recorded operations missing. Save a malloc/free stream into "
+        "/tmp/heapprofd_ops (see bookkeeping_benchmark.cc for the format).");
+    return ops;
+  }
+  *num_callstacks = 0;
+  char line[256];
+  while (fgets(line, sizeof(line), *f)) {
+    Operation op{};
+    if (line[0] == 'm') {
+      op.is_malloc = true;
+      if (sscanf(line, "m %" SCNu64 " %" SCNx64 " %" SCNu64 " %" SCNu32,
+                 &op.sequence_number, &op.address, &op.size,
+                 &op.callstack_idx) != 4) {
+        continue;
+      }
+      *num_callstacks = std::max(*num_callstacks, op.callstack_idx + 1);
+    } else if (line[0] == 'f') {
+      if (sscanf(line, "f %" SCNu64 " %" SCNx64, &op.sequence_number,
+                 &op.address) != 2) {
+        continue;
+      }
+    } else {
+      continue;
+    }
+    ops.emplace_back(op);
+  }
+  return ops;
+}
+
+// Generates a stream resembling a server at a low sampling interval: a large
+// working set of live allocations, frees of random live allocations, address
+// reuse by the allocator and slight reordering of operations (as frees are
+// batched separately from mallocs by the client).
+std::vector<Operation> GenerateOperations(size_t num_ops,
+                                          uint32_t num_callstacks) {
+  std::minstd_rand0 rng(0);
+  std::vector<Operation> ops;
+  ops.reserve(num_ops);
+  std::vector<uint64_t> live;
+  std::vector<uint64_t> freed;
+  uint64_t next_address = 0x7f0000000000;
+  for (uint64_t seq = 1; seq <= num_ops; ++seq) {
+    Operation op{};
+    op.sequence_number = seq;
+    if (live.empty() || rng() % 100 < 55) {
+      op.is_malloc = true;
+      if (!freed.empty() && rng() % 2) {
+        op.address = freed.back();
+        freed.pop_back();
+      } else {
+        op.address = next_address;
+        next_address += 16 * (1 + rng() % 64);
+      }
+      op.size = 16 * (1 + rng() % 256);
+      op.callstack_idx = static_cast<uint32_t>(rng() % num_callstacks);
+      live.push_back(op.address);
+    } else {
+      size_t idx = rng() % live.size();
+      op.address = live[idx];
+      live[idx] = live.back();
+      live.pop_back();
+      freed.push_back(op.address);
+    }
+    ops.emplace_back(op);
+  }
+  for (size_t i = 0; i + 8 <= ops.size(); i += 8)
+    std::shuffle(ops.begin() + static_cast<ptrdiff_t>(i),
+                 ops.begin() + static_cast<ptrdiff_t>(i + 8), rng);
+  return ops;
+}
+
+void Replay(benchmark::State& state,
+            const std::vector<Operation>& ops,
+            uint32_t num_callstacks) {
+  const auto callstacks = MakeCallstacks(std::max(num_callstacks, 1u));
+  std::vector<std::vector<std::string>> build_ids;
+  for (const auto& callstack : callstacks)
+    build_ids.emplace_back(callstack.size(), "buildid");
+
+  for (auto _ : state) {
+    const size_t heap_bytes_start = GetHeapBytes();
+    GlobalCallstackTrie callsites;
+    HeapTracker tracker(&callsites, /*dump_at_max_mode=*/false);
+    for (const Operation& op : ops) {
+      if (op.is_malloc) {
+        tracker.RecordMalloc(callstacks[op.callstack_idx],
+                             build_ids[op.callstack_idx], op.address, op.size,
+                             op.size, op.sequence_number,
+                             /*timestamp=*/op.sequence_number);
+      } else {
+        tracker.RecordFree(op.address, op.sequence_number,
+                           /*timestamp=*/op.sequence_number);
+      }
+    }
+    uint64_t live_allocations = 0;
+    tracker.GetAllocations([&live_allocations](uint64_t, uint64_t, uint64_t,
+                                               uint64_t) {
+      live_allocations++;
+    });
+    benchmark::DoNotOptimize(live_allocations);
+    state.counters["live"] =
+        benchmark::Counter(static_cast<double>(live_allocations));
+
+    // All the memory used by the tracker (and the callstack trie), per live
+    // allocation at the end of the stream.
+    const size_t heap_bytes = GetHeapBytes() - heap_bytes_start;
+    state.counters["bytes_per_live"] = benchmark::Counter(
+        static_cast<double>(heap_bytes) /
+        static_cast<double>(std::max<uint64_t>(live_allocations, 1)));
+  }
+  state.counters["ops"] =
+      benchmark::Counter(static_cast<double>(ops.size()),
+                         benchmark::Counter::kIsIterationInvariant);
+  state.counters["rate"] =
+      benchmark::Counter(static_cast<double>(ops.size()),
+                         benchmark::Counter::kIsIterationInvariantRate);
+}
+
+}  // namespace
+
+static void BM_HeapTrackerReplayRecorded(benchmark::State& state) {
+  uint32_t num_callstacks = 0;
+  std::vector<Operation> ops = LoadRecordedOperations(state, &num_callstacks);
+  if (ops.empty())
+    return;
+  Replay(state, ops, num_callstacks);
+}
+BENCHMARK(BM_HeapTrackerReplayRecorded);
+
+static void BM_HeapTrackerReplaySynthetic(benchmark::State& state) {
+  const size_t num_ops =
+      IsBenchmarkFunctionalOnly() ? 1000 : static_cast<size_t>(state.range(0));
+  const uint32_t kNumCallstacks = 2000;
+  Replay(state, GenerateOperations(num_ops, kNumCallstacks), kNumCallstacks);
+}
+BENCHMARK(BM_HeapTrackerReplaySynthetic)
+    ->Arg(100000)
+    ->Arg(1000000)
+    ->Arg(4000000);
+
+}  // namespace profiling
+}  // namespace perfetto
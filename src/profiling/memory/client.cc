@@ -70,6 +70,58 @@ bool Contained(const StackRange& base, const char* ptr) {
   return (ptr >= base.begin && ptr < base.end);
 }
 
+uint64_t GetCoarseTimestamp() {
+  struct timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC_COARSE, &ts) == 0)
+    return static_cast<uint64_t>(base::FromPosixTimespec(ts).count());
+  return 0;
+}
+
+// Returns an identifier for the callstack of the caller, derived from the
+// return addresses found by following the frame pointer chain starting at
+// |frame_ptr|, or 0 if the chain cannot be followed.
+//
+// Frames that do not set up a frame pointer are not part of the chain, so
+// this can give the same identifier to different callstacks if the target is
+// not built with frame pointers.
+uint64_t GetFramePointerCallstackId(const char* frame_ptr,
+                                    const char* stackend) {
+#if defined(__aarch64__) || defined(__x86_64__) || defined(__i386__)
+  // The frame pointer points to a frame record consisting of the frame
+  // pointer of the caller, followed by the return address into the caller.
+  constexpr size_t kMaxFrames = 256;
+  constexpr size_t kFrameRecordSize = 2 * sizeof(uintptr_t);
+  uint64_t hash = 0xcbf29ce484222325;
+  size_t depth = 0;
+  const char* fp = frame_ptr;
+  for (; depth < kMaxFrames; ++depth) {
+    if (reinterpret_cast<uintptr_t>(fp) % sizeof(uintptr_t) != 0 ||
+        fp + kFrameRecordSize > stackend) {
+      return 0;
+    }
+    const uintptr_t* record = reinterpret_cast<const uintptr_t*>(fp);
+    hash = (hash ^ record[1]) * 0x100000001b3;
+    hash ^= hash >> 32;
+    const char* next_fp = reinterpret_cast<const char*>(record[0]);
+    // The stack grows towards numerically smaller addresses, so the frame of
+    // the caller needs to be above ours. Anything else ends the chain: the
+    // outermost frames (e.g. in libc) are often built without frame pointers
+    // and leave arbitrary values in the frame pointer register.
+    if (next_fp <= fp || next_fp >= stackend)
+      break;
+    fp = next_fp;
+  }
+  if (depth == kMaxFrames)
+    return 0;
+  hash = (hash ^ depth) * 0x100000001b3;
+  return hash ? hash : 1;
+#else
+  base::ignore_result(frame_ptr);
+  base::ignore_result(stackend);
+  return 0;
+#endif
+}
+
 }  // namespace
 
 uint64_t GetMaxTries(const ClientConfiguration& client_config) {
@@ -375,6 +427,16 @@ bool Client::RecordMalloc(uint32_t heap_id,
     shmem_.SetErrorState(SharedRingBuffer::kInvalidStackBounds);
     return false;
   }
+
+  uint64_t callstack_id = 0;
+  if (client_config_.deduplicate_callstacks) {
+    callstack_id = GetFramePointerCallstackId(stackptr, stackend);
+    if (callstack_id && IsCallstackSent(callstack_id)) {
+      return RecordMallocWithKnownCallstack(heap_id, sample_size, alloc_size,
+                                            alloc_address, callstack_id);
+    }
+  }
+
   uint64_t stack_size = static_cast<uint64_t>(stackend - stackptr);
   metadata.sample_size = sample_size;
   metadata.alloc_size = alloc_size;
@@ -384,21 +446,51 @@ bool Client::RecordMalloc(uint32_t heap_id,
   metadata.sequence_number =
       1 + sequence_number_[heap_id].fetch_add(1, std::memory_order_acq_rel);
   metadata.heap_id = heap_id;
-
-  struct timespec ts;
-  if (clock_gettime(CLOCK_MONOTONIC_COARSE, &ts) == 0) {
-    metadata.clock_monotonic_coarse_timestamp =
-        static_cast<uint64_t>(base::FromPosixTimespec(ts).count());
-  } else {
-    metadata.clock_monotonic_coarse_timestamp = 0;
-  }
+  metadata.clock_monotonic_coarse_timestamp = GetCoarseTimestamp();
 
   WireMessage msg{};
   msg.record_type = RecordType::Malloc;
   msg.alloc_header = &metadata;
+  if (callstack_id) {
+    // Only sent if heapprofd asked for deduplication, so older versions of
+    // heapprofd never see this record type.
+    msg.record_type = RecordType::MallocWithCallstackId;
+    msg.callstack_id = &callstack_id;
+  }
   msg.payload = const_cast<char*>(stackptr);
   msg.payload_size = static_cast<size_t>(stack_size);
 
+  if (SendWireMessageWithRetriesIfBlocking(msg) == -1)
+    return false;
+  // Only mark the callstack as sent after the record is in the buffer, so
+  // heapprofd reads it before any KnownCallstackMalloc record referring to it.
+  if (callstack_id)
+    MarkCallstackSent(callstack_id);
+
+  if (!shmem_.GetAndResetReaderPaused())
+    return true;
+  return SendControlSocketByte();
+}
+
+bool Client::RecordMallocWithKnownCallstack(uint32_t heap_id,
+                                            uint64_t sample_size,
+                                            uint64_t alloc_size,
+                                            uint64_t alloc_address,
+                                            uint64_t callstack_id) {
+  KnownCallstackAllocEntry entry;
+  entry.sequence_number =
+      1 + sequence_number_[heap_id].fetch_add(1, std::memory_order_acq_rel);
+  entry.alloc_size = alloc_size;
+  entry.sample_size = sample_size;
+  entry.alloc_address = alloc_address;
+  entry.clock_monotonic_coarse_timestamp = GetCoarseTimestamp();
+  entry.callstack_id = callstack_id;
+  entry.heap_id = heap_id;
+
+  WireMessage msg{};
+  msg.record_type = RecordType::KnownCallstackMalloc;
+  msg.known_callstack_header = &entry;
+
   if (SendWireMessageWithRetriesIfBlocking(msg) == -1)
     return false;
 
@@ -407,6 +499,18 @@ bool Client::RecordMalloc(uint32_t heap_id,
   return SendControlSocketByte();
 }
 
+// The acquire / release makes sure the write of a KnownCallstackMalloc record
+// gets ordered after the MallocWithCallstackId record that sent the callstack.
+bool Client::IsCallstackSent(uint64_t callstack_id) {
+  return sent_callstack_ids_[callstack_id % kCallstackCacheSize].load(
+             std::memory_order_acquire) == callstack_id;
+}
+
+void Client::MarkCallstackSent(uint64_t callstack_id) {
+  sent_callstack_ids_[callstack_id % kCallstackCacheSize].store(
+      callstack_id, std::memory_order_release);
+}
+
 int64_t Client::SendWireMessageWithRetriesIfBlocking(const WireMessage& msg) {
   for (uint64_t i = 0;
        max_shmem_tries_ == kInfiniteTries || i < max_shmem_tries_; ++i) {
@@ -116,6 +116,14 @@ class Client {
 
  private:
   const char* GetStackEnd(const char* stacktop);
+  bool RecordMallocWithKnownCallstack(uint32_t heap_id,
+                                      uint64_t sample_size,
+                                      uint64_t alloc_size,
+                                      uint64_t alloc_address,
+                                      uint64_t callstack_id)
+      PERFETTO_WARN_UNUSED_RESULT;
+  bool IsCallstackSent(uint64_t callstack_id);
+  void MarkCallstackSent(uint64_t callstack_id);
   bool SendControlSocketByte() PERFETTO_WARN_UNUSED_RESULT;
   int64_t SendWireMessageWithRetriesIfBlocking(const WireMessage&)
       PERFETTO_WARN_UNUSED_RESULT;
@@ -131,6 +139,13 @@ class Client {
       sequence_number_[base::ArraySize(ClientConfiguration{}.heaps)] = {};
   SharedRingBuffer shmem_;
 
+  // Callstack ids that were sent to heapprofd in a MallocWithCallstackId
+  // record, so further allocations with the same callstack can be sent as
+  // KnownCallstackMalloc.
+  // Indexed by callstack id % kCallstackCacheSize, mirroring what heapprofd
+  // keeps.
+  std::atomic<uint64_t> sent_callstack_ids_[kCallstackCacheSize] = {};
+
   // Used to detect (during the slow path) the situation where the process has
   // forked during profiling, and is performing malloc operations in the child.
   // In this scenario, we want to stop profiling in the child, as otherwise
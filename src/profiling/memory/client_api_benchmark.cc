@@ -12,6 +12,11 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
 #include <benchmark/benchmark.h>
 
 #include "perfetto/heap_profile.h"
@@ -31,6 +36,7 @@ uint32_t GetHeapId() {
 }
 
 ClientConfiguration g_client_config;
+bool g_lock_free_writes = true;
 int g_shmem_fd;
 
 base::UnixSocketRaw& GlobalServerSocket() {
@@ -58,8 +64,10 @@ std::shared_ptr<Client> ConstructClient(
   std::tie(cli_sock, srv_sock) = base::UnixSocketRaw::CreatePairPosix(
       base::SockFamily::kUnix, base::SockType::kStream);
   auto ringbuf = SharedRingBuffer::Create(8 * 1048576);
-  ringbuf->InfiniteBufferForTesting();
   PERFETTO_CHECK(ringbuf);
+  ringbuf->InfiniteBufferForTesting();
+  if (!g_lock_free_writes)
+    ringbuf->DisableLockFreeWritesForTesting();
   PERFETTO_CHECK(cli_sock);
   PERFETTO_CHECK(srv_sock);
   g_shmem_fd = ringbuf->fd();
@@ -215,6 +223,82 @@ static void BM_ClientApiEnabledHeapFree(benchmark::State& state) {
 
 BENCHMARK(BM_ClientApiEnabledHeapFree);
 
+// Reports samples from state.range(1) threads at the same time, all writing
+// into the same shared memory buffer. state.range(0) selects whether the
+// client writes into the buffer with (0) or without (1) taking the spinlock.
+//
+// The interesting metric is the tail latency of a single report, as this is
+// what the threads waiting on each other show up in.
+static void BM_ClientApiConcurrentSampleLatency(benchmark::State& state) {
+  const uint32_t heap_id = GetHeapId();
+  const size_t num_threads = static_cast<size_t>(state.range(1));
+  constexpr size_t kSamplesPerThread = 1000;
+
+  ClientConfiguration client_config{};
+  client_config.default_interval = 32000;
+  client_config.all_heaps = true;
+  g_client_config = client_config;
+  g_lock_free_writes = state.range(0) != 0;
+  PERFETTO_CHECK(AHeapProfile_initSession(malloc, free));
+  g_lock_free_writes = true;
+
+  PERFETTO_CHECK(g_shmem_fd);
+  auto ringbuf = SharedRingBuffer::Attach(base::ScopedFile(dup(g_shmem_fd)));
+
+  std::vector<std::vector<uint64_t>> latencies_ns(num_threads);
+  for (auto& thread_latencies : latencies_ns)
+    thread_latencies.reserve(kSamplesPerThread * 16);
+
+  for (auto _ : state) {
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < num_threads; ++i) {
+      threads.emplace_back([heap_id, &latencies_ns, i] {
+        for (size_t j = 0; j < kSamplesPerThread; ++j) {
+          auto start = std::chrono::steady_clock::now();
+          AHeapProfile_reportSample(heap_id, 0x123, 20);
+          auto end = std::chrono::steady_clock::now();
+          latencies_ns[i].push_back(static_cast<uint64_t>(
+              std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+                  .count()));
+        }
+      });
+    }
+    for (std::thread& thread : threads)
+      thread.join();
+  }
+  DisconnectGlobalServerSocket();
+  ringbuf->SetShuttingDown();
+
+  std::vector<uint64_t> all_latencies_ns;
+  for (const auto& thread_latencies : latencies_ns) {
+    all_latencies_ns.insert(all_latencies_ns.end(), thread_latencies.begin(),
+                            thread_latencies.end());
+  }
+  if (all_latencies_ns.empty())
+    return;
+  std::sort(all_latencies_ns.begin(), all_latencies_ns.end());
+  auto percentile = [&all_latencies_ns](size_t p) {
+    return static_cast<double>(
+        all_latencies_ns[(all_latencies_ns.size() - 1) * p / 100]);
+  };
+  state.counters["p50_ns"] = benchmark::Counter(percentile(50));
+  state.counters["p99_ns"] = benchmark::Counter(percentile(99));
+  state.counters["samples"] = benchmark::Counter(
+      static_cast<double>(all_latencies_ns.size()),
+      benchmark::Counter::kIsRate);
+}
+
+static void ConcurrentSampleLatencyArgs(benchmark::internal::Benchmark* b) {
+  for (int lock_free = 0; lock_free <= 1; ++lock_free) {
+    for (int threads = 1; threads <= 64; threads *= 2)
+      b->Args({lock_free, threads});
+  }
+}
+
+BENCHMARK(BM_ClientApiConcurrentSampleLatency)
+    ->Apply(ConcurrentSampleLatencyArgs)
+    ->UseRealTime();
+
 static void BM_ClientApiMallocFree(benchmark::State& state) {
   for (auto _ : state) {
     volatile char* x = static_cast<char*>(malloc(100));
@@ -70,16 +70,6 @@ constexpr uint64_t kMaxShmemSize = 500 * 1048576;    // ~500 MB
 constexpr int kProfilingSignal = __SIGRTMIN + 4;
 constexpr int kHeapprofdSignalValue = 0;
 
-std::vector<UnwindingWorker> MakeUnwindingWorkers(HeapprofdProducer* delegate,
-                                                  size_t n) {
-  std::vector<UnwindingWorker> ret;
-  for (size_t i = 0; i < n; ++i) {
-    ret.emplace_back(delegate,
-                     base::ThreadTaskRunner::CreateAndStart("heapprofdunwind"));
-  }
-  return ret;
-}
-
 bool ConfigTargetsProcess(const HeapprofdConfig& cfg,
                           const Process& proc,
                           const std::vector<std::string>& normalized_cmdlines) {
@@ -145,6 +135,8 @@ bool HeapprofdConfigToClientConfiguration(
       heapprofd_config.adaptive_sampling_shmem_threshold();
   cli_config->adaptive_sampling_max_sampling_interval_bytes =
       heapprofd_config.adaptive_sampling_max_sampling_interval_bytes();
+  cli_config->deduplicate_callstacks =
+      heapprofd_config.deduplicate_callstacks();
   size_t n = 0;
   const std::vector<std::string>& exclude_heaps =
       heapprofd_config.exclude_heaps();
@@ -209,7 +201,7 @@ HeapprofdProducer::HeapprofdProducer(HeapprofdMode mode,
     : task_runner_(task_runner),
       mode_(mode),
       exit_when_done_(exit_when_done),
-      unwinding_workers_(MakeUnwindingWorkers(this, kUnwinderThreads)),
+      unwinding_workers_(this, kUnwinderThreads),
       socket_delegate_(this),
       weak_factory_(this) {
   CheckDataSourceCpuTask();
@@ -558,10 +550,6 @@ void HeapprofdProducer::StartDataSource(DataSourceInstanceID id,
   PERFETTO_DLOG("Started DataSource");
 }
 
-UnwindingWorker& HeapprofdProducer::UnwinderForPID(pid_t pid) {
-  return unwinding_workers_[static_cast<uint64_t>(pid) % kUnwinderThreads];
-}
-
 void HeapprofdProducer::StopDataSource(DataSourceInstanceID id) {
   auto it = data_sources_.find(id);
   if (it == data_sources_.end()) {
@@ -604,7 +592,7 @@ void HeapprofdProducer::ShutdownDataSource(DataSource* data_source) {
 
   for (const auto& pid_and_process_state : data_source->process_states) {
     pid_t pid = pid_and_process_state.first;
-    UnwinderForPID(pid).PostDisconnectSocket(pid);
+    unwinding_workers_.PostDisconnectSocket(pid);
   }
 
   auto id = data_source->id;
@@ -620,7 +608,7 @@ void HeapprofdProducer::ShutdownDataSource(DataSource* data_source) {
 
           for (const auto& pid_and_process_state : ds.process_states) {
             pid_t pid = pid_and_process_state.first;
-            weak_producer->UnwinderForPID(pid).PostPurgeProcess(pid);
+            weak_producer->unwinding_workers_.PostPurgeProcess(pid);
           }
           // Do not dump any stragglers, just trigger the Flush and tear down
           // the data source.
@@ -657,6 +645,8 @@ void HeapprofdProducer::SetStats(
   stats->set_heap_samples(process_state.heap_samples);
   stats->set_map_reparses(process_state.map_reparses);
   stats->set_total_unwinding_time_us(process_state.total_unwinding_time_us);
+  stats->set_elf_cache_hits(process_state.elf_cache_hits);
+  stats->set_elf_cache_misses(process_state.elf_cache_misses);
   stats->set_client_spinlock_blocked_us(
       process_state.client_spinlock_blocked_us);
   auto* unwinding_hist = stats->set_unwinding_time_us();
@@ -869,8 +859,8 @@ void HeapprofdProducer::SocketDelegate::OnDataAvailable(
     handoff_data.client_config = data_source.client_configuration;
     handoff_data.stream_allocations = data_source.config.stream_allocations();
 
-    producer_->UnwinderForPID(self->peer_pid_linux())
-        .PostHandoffSocket(std::move(handoff_data));
+    producer_->unwinding_workers_.PostHandoffSocket(self->peer_pid_linux(),
+                                                    std::move(handoff_data));
     producer_->pending_processes_.erase(it);
   } else if (fds[kHandshakeMaps] || fds[kHandshakeMem]) {
     PERFETTO_DFATAL_OR_ELOG("%d: Received partial FDs.",
@@ -1056,6 +1046,8 @@ void HeapprofdProducer::HandleAllocRecord(AllocRecord* alloc_rec) {
   process_state.heap_samples++;
   process_state.unwinding_time_us.Add(alloc_rec->unwinding_time_us);
   process_state.total_unwinding_time_us += alloc_rec->unwinding_time_us;
+  process_state.elf_cache_hits = alloc_rec->elf_cache_hits;
+  process_state.elf_cache_misses = alloc_rec->elf_cache_misses;
 
   // abspc may no longer refer to the same functions, as we had to reparse
   // maps. Reset the cache.
@@ -192,6 +192,8 @@ class HeapprofdProducer : public Producer, public UnwindingWorker::Delegate {
     uint64_t unwinding_errors = 0;
 
     uint64_t total_unwinding_time_us = 0;
+    uint64_t elf_cache_hits = 0;
+    uint64_t elf_cache_misses = 0;
     uint64_t client_spinlock_blocked_us = 0;
     GlobalCallstackTrie* callsites;
     bool dump_at_max_mode;
@@ -264,7 +266,6 @@ class HeapprofdProducer : public Producer, public UnwindingWorker::Delegate {
 
   void DoContinuousDump(DataSourceInstanceID id, uint32_t dump_interval);
 
-  UnwindingWorker& UnwinderForPID(pid_t);
   bool IsPidProfiled(pid_t);
   DataSource* GetDataSourceForProcess(const Process& proc);
   void RecordOtherSourcesAsRejected(DataSource* active_ds, const Process& proc);
@@ -313,7 +314,7 @@ class HeapprofdProducer : public Producer, public UnwindingWorker::Delegate {
 
   std::map<FlushRequestID, size_t> flushes_in_progress_;
   std::map<DataSourceInstanceID, DataSource> data_sources_;
-  std::vector<UnwindingWorker> unwinding_workers_;
+  UnwindingWorkerPool unwinding_workers_;
 
   // Specific to mode_ == kChild
   Process target_process_{base::kInvalidPid, ""};
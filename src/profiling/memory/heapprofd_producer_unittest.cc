@@ -181,6 +181,19 @@ TEST(HeapprofdConfigToClientConfigurationTest, AdaptiveSamplingWithMax) {
             4 * 4096u);
 }
 
+TEST(HeapprofdConfigToClientConfigurationTest, DeduplicateCallstacks) {
+  HeapprofdConfig cfg;
+  cfg.add_heaps("foo");
+  cfg.set_sampling_interval_bytes(4096);
+  ClientConfiguration cli_config;
+  ASSERT_TRUE(HeapprofdConfigToClientConfiguration(cfg, &cli_config));
+  EXPECT_FALSE(cli_config.deduplicate_callstacks);
+
+  cfg.set_deduplicate_callstacks(true);
+  ASSERT_TRUE(HeapprofdConfigToClientConfiguration(cfg, &cli_config));
+  EXPECT_TRUE(cli_config.deduplicate_callstacks);
+}
+
 TEST(HeapprofdConfigToClientConfigurationTest, AllHeaps) {
   HeapprofdConfig cfg;
   cfg.set_all_heaps(true);
@@ -18,6 +18,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -49,6 +50,12 @@ constexpr auto kGuardSize = base::kPageSize * 1024 * 16;  // 64 MB.
 constexpr auto kFDSeals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
 #endif
 
+// Used for the stats that BeginWriteLockFree updates without holding the
+// spinlock.
+void AtomicIncrement(uint64_t* counter, uint64_t n) {
+  __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
 }  // namespace
 
 SharedRingBuffer::SharedRingBuffer(CreateFlag, size_t size) {
@@ -92,6 +99,8 @@ SharedRingBuffer::SharedRingBuffer(CreateFlag, size_t size) {
     return;
 
   new (meta_) MetadataPage();
+  meta_->protocol_version.store(kProtocolVersionLockFree,
+                                std::memory_order_relaxed);
 }
 
 SharedRingBuffer::~SharedRingBuffer() {
@@ -229,6 +238,55 @@ SharedRingBuffer::Buffer SharedRingBuffer::BeginWrite(
   return result;
 }
 
+SharedRingBuffer::Buffer SharedRingBuffer::BeginWriteLockFree(size_t size) {
+  PERFETTO_DCHECK(lock_free_writes());
+  Buffer result;
+
+  const uint64_t size_with_header =
+      base::AlignUp<kAlignment>(size + kHeaderSize);
+
+  // size_with_header < size is for catching overflow of size_with_header.
+  if (PERFETTO_UNLIKELY(size_with_header < size)) {
+    errno = EINVAL;
+    return result;
+  }
+
+  PointerPositions pos;
+  do {
+    // The read_pos needs to be loaded before the write_pos. Otherwise, other
+    // writers and the reader could advance both between the two loads, making
+    // us observe read_pos > write_pos.
+    //
+    // This acquire load is matched by the release in EndRead, which makes sure
+    // the reader has zeroed the space we are about to reserve.
+    pos.read_pos = meta_->read_pos.load(std::memory_order_acquire);
+    pos.write_pos = meta_->write_pos.load(std::memory_order_relaxed);
+    if (IsCorrupt(pos)) {
+      AtomicIncrement(&meta_->stats.num_writes_corrupt, 1);
+      errno = EBADF;
+      return result;
+    }
+    if (size_with_header > write_avail(pos)) {
+      AtomicIncrement(&meta_->stats.num_writes_overflow, 1);
+      errno = EAGAIN;
+      return result;
+    }
+    // Unlike BeginWrite, we cannot store a zero size into the header before
+    // publishing the new write_pos, as the space only belongs to us once the
+    // compare-and-swap succeeds. The header is already zero though, as the
+    // reader zeroes all records it consumes.
+  } while (!meta_->write_pos.compare_exchange_weak(
+      pos.write_pos, pos.write_pos + size_with_header,
+      std::memory_order_relaxed, std::memory_order_relaxed));
+
+  result.size = size;
+  result.data = at(pos.write_pos) + kHeaderSize;
+  result.bytes_free = write_avail(pos);
+  AtomicIncrement(&meta_->stats.bytes_written, size);
+  AtomicIncrement(&meta_->stats.num_writes_succeeded, 1);
+  return result;
+}
+
 void SharedRingBuffer::EndWrite(Buffer buf) {
   if (!buf)
     return;
@@ -291,7 +349,14 @@ size_t SharedRingBuffer::EndRead(Buffer buf) {
   if (!buf)
     return 0;
   size_t size_with_header = base::AlignUp<kAlignment>(buf.size + kHeaderSize);
-  meta_->read_pos.fetch_add(size_with_header, std::memory_order_relaxed);
+  if (lock_free_writes()) {
+    // BeginWriteLockFree relies on unused space being zeroed, so that the
+    // header of a record that was reserved but not committed yet reads as
+    // zero. The record was just read, so this is mostly in cache.
+    memset(buf.data - kHeaderSize, 0, size_with_header);
+  }
+  // This is matched by the acquire load in BeginWriteLockFree.
+  meta_->read_pos.fetch_add(size_with_header, std::memory_order_release);
   meta_->stats.num_reads_succeeded++;
   return size_with_header;
 }
@@ -52,8 +52,19 @@ namespace profiling {
 // meantime.
 // !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
 //
-// TODO:
-// - Write a benchmark.
+// Writers reserve space in one of two ways, depending on the protocol version
+// the reader advertised in the MetadataPage when creating the buffer:
+//
+// - kProtocolVersionSpinlock: space is reserved under the spinlock in the
+//   MetadataPage (BeginWrite). This is what buffers created by older readers
+//   support, and what older writers use regardless of the version.
+// - kProtocolVersionLockFree: space is reserved by advancing write_pos with a
+//   compare-and-swap (BeginWriteLockFree). The reader zeroes every record it
+//   consumes, so the header of a freshly reserved record reads as "not
+//   committed" until the writer's EndWrite.
+//
+// In both cases EndWrite commits the record by storing its size in the header,
+// so records can be committed in a different order than they were reserved.
 class SharedRingBuffer {
  public:
   class Buffer {
@@ -75,6 +86,11 @@ class SharedRingBuffer {
     uint64_t bytes_free = 0;
   };
 
+  enum ProtocolVersion : uint64_t {
+    kProtocolVersionSpinlock = 0,
+    kProtocolVersionLockFree = 1,
+  };
+
   enum ErrorState : uint64_t {
     kNoError = 0,
     kHitTimeout = 1,
@@ -122,7 +138,16 @@ class SharedRingBuffer {
     return read_avail(*pos);
   }
 
+  // Whether the reader supports BeginWriteLockFree on this buffer.
+  bool lock_free_writes() {
+    return meta_->protocol_version.load(std::memory_order_relaxed) >=
+           kProtocolVersionLockFree;
+  }
+
   Buffer BeginWrite(const ScopedSpinlock& spinlock, size_t size);
+  // Same as BeginWrite, but does not need the spinlock. Must only be used if
+  // lock_free_writes() is true.
+  Buffer BeginWriteLockFree(size_t size);
   void EndWrite(Buffer buf);
 
   Buffer BeginRead();
@@ -178,6 +203,13 @@ class SharedRingBuffer {
     return meta_->reader_paused.exchange(false, std::memory_order_relaxed);
   }
 
+  // Makes writers fall back to the spinlock, like a buffer created by a reader
+  // that predates kProtocolVersionLockFree.
+  void DisableLockFreeWritesForTesting() {
+    meta_->protocol_version.store(kProtocolVersionSpinlock,
+                                  std::memory_order_relaxed);
+  }
+
   void InfiniteBufferForTesting() {
     // Pretend this buffer is really large, while keeping size_mask_ as
     // original so it keeps wrapping in circles.
@@ -205,9 +237,14 @@ class SharedRingBuffer {
     // When the user requests stats, the atomics above get copied into this
     // struct, which is then returned.
     alignas(sizeof(uint64_t)) Stats stats;
+    // Set by the reader when creating the buffer. Fields above must not change
+    // their layout, as writers built against older versions of this struct
+    // still access them. Buffers created by older readers have this set to
+    // zero (kProtocolVersionSpinlock), as the memory is zero-initialized.
+    PERFETTO_CROSS_ABI_ALIGNED(std::atomic<ProtocolVersion>) protocol_version;
   };
 
-  static_assert(sizeof(MetadataPage) == 144,
+  static_assert(sizeof(MetadataPage) == 152,
                 "metadata page size needs to be ABI independent");
 
  private:
@@ -36,7 +36,9 @@ std::string ToString(const SharedRingBuffer::Buffer& buf_and_size) {
 
 bool TryWrite(SharedRingBuffer* wr, const char* src, size_t size) {
   SharedRingBuffer::Buffer buf;
-  {
+  if (wr->lock_free_writes()) {
+    buf = wr->BeginWriteLockFree(size);
+  } else {
     auto lock = wr->AcquireLock(ScopedSpinlock::Mode::Try);
     if (!lock.locked())
       return false;
@@ -186,11 +188,24 @@ TEST(SharedRingBufferTest, SingleThreadAttach) {
   StructuredTest(&*buf1, &*buf2);
 }
 
-TEST(SharedRingBufferTest, MultiThreadingTest) {
+TEST(SharedRingBufferTest, SingleThreadAttachSpinlock) {
+  constexpr auto kBufSize = base::kPageSize * 4;
+  base::Optional<SharedRingBuffer> buf1 = SharedRingBuffer::Create(kBufSize);
+  buf1->DisableLockFreeWritesForTesting();
+  base::Optional<SharedRingBuffer> buf2 =
+      SharedRingBuffer::Attach(base::ScopedFile(dup(buf1->fd())));
+  ASSERT_FALSE(buf2->lock_free_writes());
+  StructuredTest(&*buf2, &*buf1);
+}
+
+void RunMultiThreadingTest(bool lock_free) {
   constexpr auto kBufSize = base::kPageSize * 1024;  // 4 MB
   SharedRingBuffer rd = *SharedRingBuffer::Create(kBufSize);
+  if (!lock_free)
+    rd.DisableLockFreeWritesForTesting();
   SharedRingBuffer wr =
       *SharedRingBuffer::Attach(base::ScopedFile(dup(rd.fd())));
+  ASSERT_EQ(wr.lock_free_writes(), lock_free);
 
   std::mutex mutex;
   std::unordered_map<std::string, int64_t> expected_contents;
@@ -254,6 +269,57 @@ TEST(SharedRingBufferTest, MultiThreadingTest) {
   reader_thread.join();
 }
 
+TEST(SharedRingBufferTest, MultiThreadingTest) {
+  RunMultiThreadingTest(/*lock_free=*/true);
+}
+
+TEST(SharedRingBufferTest, MultiThreadingTestSpinlock) {
+  RunMultiThreadingTest(/*lock_free=*/false);
+}
+
+// Records reserved with BeginWriteLockFree can be committed out of order, but
+// the reader only sees them in reservation order.
+TEST(SharedRingBufferTest, LockFreeOutOfOrderCommit) {
+  constexpr auto kBufSize = base::kPageSize * 4;
+  base::Optional<SharedRingBuffer> rd = SharedRingBuffer::Create(kBufSize);
+  ASSERT_TRUE(rd);
+  SharedRingBuffer wr =
+      *SharedRingBuffer::Attach(base::ScopedFile(dup(rd->fd())));
+  ASSERT_TRUE(wr.lock_free_writes());
+
+  // Go around the buffer a few times, so that reservations land on space that
+  // previously held (longer) records.
+  std::string filler(base::kPageSize + 3, 'x');
+  for (int i = 0; i < 8; ++i) {
+    ASSERT_TRUE(TryWrite(&wr, filler.data(), filler.size()));
+    auto buf = rd->BeginRead();
+    ASSERT_EQ(ToString(buf), filler);
+    rd->EndRead(std::move(buf));
+  }
+
+  SharedRingBuffer::Buffer first = wr.BeginWriteLockFree(4);
+  SharedRingBuffer::Buffer second = wr.BeginWriteLockFree(4);
+  ASSERT_TRUE(first);
+  ASSERT_TRUE(second);
+  memcpy(second.data, "bar", 4);
+  wr.EndWrite(std::move(second));
+  EXPECT_FALSE(rd->BeginRead());
+
+  memcpy(first.data, "foo", 4);
+  wr.EndWrite(std::move(first));
+  {
+    auto buf = rd->BeginRead();
+    EXPECT_EQ(ToString(buf), std::string("foo", 4));
+    rd->EndRead(std::move(buf));
+  }
+  {
+    auto buf = rd->BeginRead();
+    EXPECT_EQ(ToString(buf), std::string("bar", 4));
+    rd->EndRead(std::move(buf));
+  }
+  EXPECT_FALSE(rd->BeginRead());
+}
+
 TEST(SharedRingBufferTest, InvalidSize) {
   constexpr auto kBufSize = base::kPageSize * 4 + 1;
   base::Optional<SharedRingBuffer> wr = SharedRingBuffer::Create(kBufSize);
@@ -19,6 +19,8 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+
 #include <unwindstack/MachineArm.h>
 #include <unwindstack/MachineArm64.h>
 #include <unwindstack/MachineMips.h>
@@ -50,6 +52,7 @@
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/thread_task_runner.h"
+#include "perfetto/ext/base/utils.h"
 
 #include "src/profiling/memory/unwound_messages.h"
 #include "src/profiling/memory/wire_protocol.h"
@@ -88,6 +91,36 @@ void ReadFromRawData(unwindstack::Regs* regs, void* raw_data) {
   memcpy(regs->RawData(), raw_data, GetRegsSize(regs));
 }
 
+void CacheCallstack(UnwindingWorker::ClientData* client_data,
+                    uint64_t callstack_id,
+                    const AllocRecord& rec) {
+  if (client_data->callstack_cache.empty())
+    client_data->callstack_cache.resize(kCallstackCacheSize);
+  UnwindingWorker::CachedCallstack& cached =
+      client_data->callstack_cache[callstack_id % kCallstackCacheSize];
+  cached.callstack_id = callstack_id;
+  cached.error = rec.error;
+  cached.frames = rec.frames;
+  cached.build_ids = rec.build_ids;
+}
+
+// Returns false if the callstack is not in the cache. This can happen if a
+// racing Malloc record evicted it before this record was read.
+bool GetCachedCallstack(UnwindingWorker::ClientData* client_data,
+                        uint64_t callstack_id,
+                        AllocRecord* out) {
+  if (client_data->callstack_cache.empty())
+    return false;
+  const UnwindingWorker::CachedCallstack& cached =
+      client_data->callstack_cache[callstack_id % kCallstackCacheSize];
+  if (cached.callstack_id != callstack_id)
+    return false;
+  out->error = cached.error;
+  out->frames = cached.frames;
+  out->build_ids = cached.build_ids;
+  return true;
+}
+
 }  // namespace
 
 std::unique_ptr<unwindstack::Regs> CreateRegsFromRawData(
@@ -180,6 +213,7 @@ bool DoUnwind(WireMessage* msg, UnwindingMetadata* metadata, AllocRecord* out) {
       break;
     }
   }
+  metadata->CacheElfs(out->frames);
   out->build_ids.resize(out->frames.size());
   for (size_t i = 0; i < out->frames.size(); ++i) {
     out->build_ids[i] = metadata->GetBuildId(out->frames[i]);
@@ -217,9 +251,20 @@ void UnwindingWorker::OnDisconnect(base::UnixSocket* self) {
   }
 }
 
+void UnwindingWorker::AddClientData(pid_t pid, ClientData client_data) {
+  client_data_.emplace(pid, std::move(client_data));
+  num_clients_.store(client_data_.size(), std::memory_order_relaxed);
+  alloc_record_arena_.Enable();
+}
+
 void UnwindingWorker::RemoveClientData(
     std::map<pid_t, ClientData>::iterator client_data_iterator) {
+  pid_t pid = client_data_iterator->first;
+  SetClientBusy(&client_data_iterator->second, false);
   client_data_.erase(client_data_iterator);
+  num_clients_.store(client_data_.size(), std::memory_order_relaxed);
+  if (pool_)
+    pool_->RemoveClient(pid, this);
   if (client_data_.empty()) {
     // We got rid of the last client. Flush and destruct AllocRecords in
     // arena. Disable the arena (will not accept returning borrowed records)
@@ -312,16 +357,22 @@ void UnwindingWorker::BatchUnwindJob(pid_t peer_pid) {
   bool reader_paused = false;
   switch (ReadAndUnwindBatch(&client_data).status) {
     case ReadAndUnwindBatchResult::Status::kHasMore:
+      SetClientBusy(&client_data, true);
+      // The worker the process is moved to reposts the job.
+      if (MaybeMoveClient(it))
+        return;
       thread_task_runner_.get()->PostTask(
           [this, peer_pid] { BatchUnwindJob(peer_pid); });
       job_reposted = true;
       break;
     case ReadAndUnwindBatchResult::Status::kReadSome:
+      SetClientBusy(&client_data, false);
       thread_task_runner_.get()->PostDelayedTask(
           [this, peer_pid] { BatchUnwindJob(peer_pid); }, kRetryDelayMs);
       job_reposted = true;
       break;
     case ReadAndUnwindBatchResult::Status::kReadNone:
+      SetClientBusy(&client_data, false);
       client_data.shmem.SetReaderPaused();
       reader_paused = true;
       break;
@@ -335,6 +386,46 @@ void UnwindingWorker::BatchUnwindJob(pid_t peer_pid) {
   PERFETTO_CHECK(job_reposted || reader_paused);
 }
 
+void UnwindingWorker::SetClientBusy(ClientData* client_data, bool busy) {
+  if (client_data->busy == busy)
+    return;
+  client_data->busy = busy;
+  if (busy)
+    num_busy_clients_.fetch_add(1, std::memory_order_relaxed);
+  else
+    num_busy_clients_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+bool UnwindingWorker::MaybeMoveClient(
+    std::map<pid_t, ClientData>::iterator client_data_it) {
+  // With a single busy process, this worker is not the bottleneck.
+  if (!pool_ || num_busy_clients_.load(std::memory_order_relaxed) < 2)
+    return false;
+  UnwindingWorker* to = pool_->FindIdleWorker(this);
+  if (!to)
+    return false;
+
+  pid_t peer_pid = client_data_it->first;
+  ClientData client_data = std::move(client_data_it->second);
+  SetClientBusy(&client_data, false);
+  client_data_.erase(client_data_it);
+  num_clients_.store(client_data_.size(), std::memory_order_relaxed);
+
+  // The records of this process that were read by this worker have to be
+  // posted to the main thread before the ones read by the new worker.
+  if (!client_data.free_records.empty()) {
+    delegate_->PostFreeRecord(this, std::move(client_data.free_records));
+    client_data.free_records.clear();
+    client_data.free_records.reserve(kRecordBatchSize);
+  }
+  base::UnixSocketRaw sock = client_data.sock->ReleaseSocket();
+  client_data.sock.reset();
+  PERFETTO_DLOG("%d: Moving process to a different unwinding worker.",
+                peer_pid);
+  pool_->MoveClient(peer_pid, to, std::move(sock), std::move(client_data));
+  return true;
+}
+
 void UnwindingWorker::DrainJob(pid_t peer_pid) {
   auto it = client_data_.find(peer_pid);
   if (it == client_data_.end()) {
@@ -384,16 +475,51 @@ void UnwindingWorker::HandleBuffer(UnwindingWorker* self,
     return;
   }
 
-  if (msg.record_type == RecordType::Malloc) {
+  if (msg.record_type == RecordType::Malloc ||
+      msg.record_type == RecordType::MallocWithCallstackId) {
     std::unique_ptr<AllocRecord> rec = alloc_record_arena->BorrowAllocRecord();
     rec->alloc_metadata = *msg.alloc_header;
     rec->pid = peer_pid;
     rec->data_source_instance_id = data_source_instance_id;
     auto start_time_us = base::GetWallTimeNs() / 1000;
-    if (!client_data->stream_allocations)
+    if (!client_data->stream_allocations) {
       DoUnwind(&msg, unwinding_metadata, rec.get());
+      if (msg.callstack_id)
+        CacheCallstack(client_data, *msg.callstack_id, *rec);
+    }
     rec->unwinding_time_us = static_cast<uint64_t>(
         ((base::GetWallTimeNs() / 1000) - start_time_us).count());
+    rec->elf_cache_hits = unwinding_metadata->elf_cache_hits;
+    rec->elf_cache_misses = unwinding_metadata->elf_cache_misses;
+    delegate->PostAllocRecord(self, std::move(rec));
+  } else if (msg.record_type == RecordType::KnownCallstackMalloc) {
+    const KnownCallstackAllocEntry& entry = *msg.known_callstack_header;
+    std::unique_ptr<AllocRecord> rec = alloc_record_arena->BorrowAllocRecord();
+    rec->alloc_metadata = AllocMetadata{};
+    rec->alloc_metadata.sequence_number = entry.sequence_number;
+    rec->alloc_metadata.alloc_size = entry.alloc_size;
+    rec->alloc_metadata.sample_size = entry.sample_size;
+    rec->alloc_metadata.alloc_address = entry.alloc_address;
+    rec->alloc_metadata.clock_monotonic_coarse_timestamp =
+        entry.clock_monotonic_coarse_timestamp;
+    rec->alloc_metadata.heap_id = entry.heap_id;
+    rec->pid = peer_pid;
+    rec->data_source_instance_id = data_source_instance_id;
+    rec->reparsed_map = false;
+    rec->unwinding_time_us = 0;
+    rec->elf_cache_hits = unwinding_metadata->elf_cache_hits;
+    rec->elf_cache_misses = unwinding_metadata->elf_cache_misses;
+    if (!client_data->stream_allocations &&
+        !GetCachedCallstack(client_data, entry.callstack_id, rec.get())) {
+      PERFETTO_DLOG("Unknown callstack id %" PRIu64, entry.callstack_id);
+      unwindstack::FrameData frame_data{};
+      frame_data.function_name = "ERROR UNKNOWN CALLSTACK";
+      rec->frames.clear();
+      rec->build_ids.clear();
+      rec->frames.emplace_back(std::move(frame_data));
+      rec->build_ids.emplace_back("");
+      rec->error = true;
+    }
     delegate->PostAllocRecord(self, std::move(rec));
   } else if (msg.record_type == RecordType::Free) {
     FreeRecord rec;
@@ -449,11 +575,36 @@ void UnwindingWorker::HandleHandoffSocket(HandoffData handoff_data) {
       handoff_data.stream_allocations,
       /*drain_bytes=*/0,
       /*free_records=*/{},
+      /*callstack_cache=*/{},
   };
   client_data.free_records.reserve(kRecordBatchSize);
   client_data.shmem.SetReaderPaused();
-  client_data_.emplace(peer_pid, std::move(client_data));
-  alloc_record_arena_.Enable();
+  AddClientData(peer_pid, std::move(client_data));
+}
+
+void UnwindingWorker::PostAdoptClient(base::UnixSocketRaw sock,
+                                      ClientData client_data) {
+  // Like for PostHandoffSocket, the arguments are not copyable.
+  auto* raw_data =
+      new std::pair<base::UnixSocketRaw, ClientData>(std::move(sock),
+                                                     std::move(client_data));
+  thread_task_runner_.get()->PostTask([this, raw_data] {
+    std::pair<base::UnixSocketRaw, ClientData> data = std::move(*raw_data);
+    delete raw_data;
+    HandleAdoptClient(std::move(data.first), std::move(data.second));
+  });
+}
+
+void UnwindingWorker::HandleAdoptClient(base::UnixSocketRaw sock,
+                                        ClientData client_data) {
+  client_data.sock = base::UnixSocket::AdoptConnected(
+      sock.ReleaseFd(), this, this->thread_task_runner_.get(),
+      base::SockFamily::kUnix, base::SockType::kStream);
+  pid_t peer_pid = client_data.sock->peer_pid_linux();
+  AddClientData(peer_pid, std::move(client_data));
+  // The previous worker had not finished reading the buffer, and the reader
+  // is not paused, so the client will not notify us of new data.
+  BatchUnwindJob(peer_pid);
 }
 
 void UnwindingWorker::PostDisconnectSocket(pid_t pid) {
@@ -469,6 +620,10 @@ void UnwindingWorker::PostPurgeProcess(pid_t pid) {
   thread_task_runner_.get()->PostTask([this, pid] {
     auto it = client_data_.find(pid);
     if (it == client_data_.end()) {
+      // The process might have been moved to a different worker.
+      UnwindingWorker* owner = pool_ ? pool_->OwnerForPID(pid) : nullptr;
+      if (owner && owner != this)
+        owner->PostPurgeProcess(pid);
       return;
     }
     RemoveClientData(it);
@@ -481,6 +636,10 @@ void UnwindingWorker::HandleDisconnectSocket(pid_t pid) {
     // This is expected if the client voluntarily disconnects before the
     // profiling session ended. In that case, there is a race between the main
     // thread learning about the disconnect and it calling back here.
+    // The process might also have been moved to a different worker.
+    UnwindingWorker* owner = pool_ ? pool_->OwnerForPID(pid) : nullptr;
+    if (owner && owner != this)
+      owner->PostDisconnectSocket(pid);
     return;
   }
   ClientData& client_data = it->second;
@@ -518,5 +677,106 @@ void AllocRecordArena::Enable() {
 
 UnwindingWorker::Delegate::~Delegate() = default;
 
+UnwindingWorkerPool::UnwindingWorkerPool(UnwindingWorker::Delegate* delegate,
+                                         size_t num_workers) {
+  for (size_t i = 0; i < num_workers; ++i) {
+    workers_.emplace_back(new UnwindingWorker(
+        delegate, base::ThreadTaskRunner::CreateAndStart("heapprofdunwind"),
+        this));
+  }
+}
+
+void UnwindingWorkerPool::PostHandoffSocket(
+    pid_t pid,
+    UnwindingWorker::HandoffData handoff_data) {
+  std::lock_guard<std::mutex> l(mutex_);
+  auto it = owners_.find(pid);
+  if (it == owners_.end()) {
+    // Assign the process to the worker with the fewest processes.
+    std::vector<size_t> num_processes(workers_.size());
+    for (const auto& pid_and_owner : owners_) {
+      for (size_t i = 0; i < workers_.size(); ++i) {
+        if (workers_[i].get() == pid_and_owner.second)
+          num_processes[i]++;
+      }
+    }
+    size_t least_loaded = static_cast<size_t>(
+        std::min_element(num_processes.begin(), num_processes.end()) -
+        num_processes.begin());
+    it = owners_.emplace(pid, workers_[least_loaded].get()).first;
+  }
+  it->second->PostHandoffSocket(std::move(handoff_data));
+}
+
+void UnwindingWorkerPool::PostDisconnectSocket(pid_t pid) {
+  std::lock_guard<std::mutex> l(mutex_);
+  auto it = owners_.find(pid);
+  if (it != owners_.end()) {
+    it->second->PostDisconnectSocket(pid);
+    return;
+  }
+  // The mapping can be gone if the process reconnected while the previous
+  // connection was being torn down. Workers ignore pids they do not handle.
+  for (auto& worker : workers_)
+    worker->PostDisconnectSocket(pid);
+}
+
+void UnwindingWorkerPool::PostPurgeProcess(pid_t pid) {
+  std::lock_guard<std::mutex> l(mutex_);
+  auto it = owners_.find(pid);
+  if (it != owners_.end()) {
+    it->second->PostPurgeProcess(pid);
+    return;
+  }
+  for (auto& worker : workers_)
+    worker->PostPurgeProcess(pid);
+}
+
+UnwindingWorker* UnwindingWorkerPool::FindIdleWorker(
+    const UnwindingWorker* from) {
+  UnwindingWorker* idle = nullptr;
+  for (auto& worker : workers_) {
+    if (worker.get() == from || worker->num_busy_clients() != 0)
+      continue;
+    if (!idle || worker->num_clients() < idle->num_clients())
+      idle = worker.get();
+  }
+  return idle;
+}
+
+void UnwindingWorkerPool::MoveClient(pid_t pid,
+                                     UnwindingWorker* to,
+                                     base::UnixSocketRaw sock,
+                                     UnwindingWorker::ClientData client_data) {
+  // Post under the lock, so that tasks for |pid| routed to |to| are run after
+  // it has adopted the process.
+  std::lock_guard<std::mutex> l(mutex_);
+  owners_[pid] = to;
+  to->PostAdoptClient(std::move(sock), std::move(client_data));
+}
+
+void UnwindingWorkerPool::RemoveClient(pid_t pid,
+                                       const UnwindingWorker* from) {
+  {
+    std::lock_guard<std::mutex> l(mutex_);
+    auto it = owners_.find(pid);
+    if (it == owners_.end() || it->second != from)
+      return;
+    owners_.erase(it);
+    if (!owners_.empty())
+      return;
+  }
+  // The last process has disconnected, so none of the cached Elfs are in use
+  // anymore. Free them rather than holding on to them while idle.
+  ElfCache::GetInstance()->Clear();
+  base::MaybeReleaseAllocatorMemToOS();
+}
+
+UnwindingWorker* UnwindingWorkerPool::OwnerForPID(pid_t pid) {
+  std::lock_guard<std::mutex> l(mutex_);
+  auto it = owners_.find(pid);
+  return it == owners_.end() ? nullptr : it->second;
+}
+
 }  // namespace profiling
 }  // namespace perfetto
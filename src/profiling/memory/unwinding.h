@@ -19,6 +19,12 @@
 
 #include <unwindstack/Regs.h>
 
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 #include "perfetto/base/time.h"
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/thread_task_runner.h"
@@ -56,6 +62,8 @@ class AllocRecordArena {
   bool enabled_ = true;
 };
 
+class UnwindingWorkerPool;
+
 class UnwindingWorker : public base::UnixSocket::EventListener {
  public:
   class Delegate {
@@ -81,8 +89,13 @@ class UnwindingWorker : public base::UnixSocket::EventListener {
     bool stream_allocations;
   };
 
-  UnwindingWorker(Delegate* delegate, base::ThreadTaskRunner thread_task_runner)
+  // |pool| can be null, in which case processes are never moved to a
+  // different worker.
+  UnwindingWorker(Delegate* delegate,
+                  base::ThreadTaskRunner thread_task_runner,
+                  UnwindingWorkerPool* pool = nullptr)
       : delegate_(delegate),
+        pool_(pool),
         thread_task_runner_(std::move(thread_task_runner)) {}
 
   // Public API safe to call from other threads.
@@ -93,6 +106,16 @@ class UnwindingWorker : public base::UnixSocket::EventListener {
     alloc_record_arena_.ReturnAllocRecord(std::move(record));
   }
 
+  // Number of processes handled by this worker, and number of those that had
+  // more data in their buffer than one batch could read. Updated on the
+  // worker thread, read by the UnwindingWorkerPool to balance load.
+  size_t num_clients() const {
+    return num_clients_.load(std::memory_order_relaxed);
+  }
+  size_t num_busy_clients() const {
+    return num_busy_clients_.load(std::memory_order_relaxed);
+  }
+
   // Implementation of UnixSocket::EventListener.
   // Do not call explicitly.
   void OnDisconnect(base::UnixSocket* self) override;
@@ -103,6 +126,15 @@ class UnwindingWorker : public base::UnixSocket::EventListener {
   void OnDataAvailable(base::UnixSocket* self) override;
 
  public:
+  // Unwound callstack of a MallocWithCallstackId record, used for
+  // subsequent KnownCallstackMalloc records with the same id.
+  struct CachedCallstack {
+    uint64_t callstack_id = 0;
+    bool error = false;
+    std::vector<unwindstack::FrameData> frames;
+    std::vector<std::string> build_ids;
+  };
+
   // public for testing/fuzzer
   struct ClientData {
     DataSourceInstanceID data_source_instance_id;
@@ -113,6 +145,11 @@ class UnwindingWorker : public base::UnixSocket::EventListener {
     bool stream_allocations = false;
     size_t drain_bytes = 0;
     std::vector<FreeRecord> free_records;
+    // Indexed by callstack_id % kCallstackCacheSize, like in the client.
+    // Empty unless the client sent a MallocWithCallstackId record.
+    std::vector<CachedCallstack> callstack_cache;
+    // Whether the last batch read for this client left data in the buffer.
+    bool busy = false;
   };
 
   // public for testing/fuzzing
@@ -124,8 +161,18 @@ class UnwindingWorker : public base::UnixSocket::EventListener {
                            Delegate* delegate);
 
  private:
+  friend class UnwindingWorkerPool;
+
   void HandleHandoffSocket(HandoffData data);
   void HandleDisconnectSocket(pid_t pid);
+  // Takes over a process, with its already parsed maps, from another worker.
+  void PostAdoptClient(base::UnixSocketRaw sock, ClientData client_data);
+  void HandleAdoptClient(base::UnixSocketRaw sock, ClientData client_data);
+  // If this worker has more than one busy process and another worker is idle,
+  // moves the process to the idle worker. Returns whether it did so.
+  bool MaybeMoveClient(std::map<pid_t, ClientData>::iterator client_data_it);
+  void SetClientBusy(ClientData* client_data, bool busy);
+  void AddClientData(pid_t pid, ClientData client_data);
   void RemoveClientData(
       std::map<pid_t, ClientData>::iterator client_data_iterator);
   void FinishDisconnect(
@@ -148,6 +195,9 @@ class UnwindingWorker : public base::UnixSocket::EventListener {
   AllocRecordArena alloc_record_arena_;
   std::map<pid_t, ClientData> client_data_;
   Delegate* delegate_;
+  UnwindingWorkerPool* const pool_;
+  std::atomic<size_t> num_clients_{0};
+  std::atomic<size_t> num_busy_clients_{0};
 
   // Task runner with a dedicated thread. Keep last as instances this class are
   // currently (incorrectly) being destroyed on the main thread, instead of the
@@ -165,6 +215,51 @@ class UnwindingWorker : public base::UnixSocket::EventListener {
   base::ThreadTaskRunner thread_task_runner_;
 };
 
+// Set of UnwindingWorkers that share the unwinding of all profiled processes.
+//
+// All records of a process are read and unwound by a single worker at a time,
+// as the UnwindingMetadata and the shared memory buffer of a process cannot be
+// used concurrently. New processes are assigned to the worker with the fewest
+// processes, and a worker that has a backlog for more than one process hands
+// one of them, together with its UnwindingMetadata, to an idle worker.
+//
+// Keeps track of which worker currently owns which process, so that requests
+// for a process are routed to the right worker.
+class UnwindingWorkerPool {
+ public:
+  UnwindingWorkerPool(UnwindingWorker::Delegate* delegate, size_t num_workers);
+  UnwindingWorkerPool(const UnwindingWorkerPool&) = delete;
+  UnwindingWorkerPool& operator=(const UnwindingWorkerPool&) = delete;
+
+  // Public API safe to call from other threads.
+  void PostDisconnectSocket(pid_t pid);
+  void PostPurgeProcess(pid_t pid);
+  void PostHandoffSocket(pid_t pid, UnwindingWorker::HandoffData);
+
+  size_t size() const { return workers_.size(); }
+  UnwindingWorker& worker(size_t i) { return *workers_[i]; }
+
+ private:
+  friend class UnwindingWorker;
+
+  // Called by |from| on its own thread.
+  UnwindingWorker* FindIdleWorker(const UnwindingWorker* from);
+  void MoveClient(pid_t pid,
+                  UnwindingWorker* to,
+                  base::UnixSocketRaw sock,
+                  UnwindingWorker::ClientData client_data);
+  // Clears the ElfCache once no process is left.
+  void RemoveClient(pid_t pid, const UnwindingWorker* from);
+  UnwindingWorker* OwnerForPID(pid_t pid);
+
+  // Held while posting tasks to workers, so that a task for a process cannot
+  // overtake the task moving the process to a different worker.
+  std::mutex mutex_;
+  std::map<pid_t, UnwindingWorker*> owners_;
+  // Workers hold a pointer to the pool, so the pool cannot be moved.
+  std::vector<std::unique_ptr<UnwindingWorker>> workers_;
+};
+
 }  // namespace profiling
 }  // namespace perfetto
 
@@ -24,6 +24,8 @@
 
 #include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/unix_socket.h"
+#include "perfetto/ext/base/waitable_event.h"
 #include "src/profiling/common/unwind_support.h"
 #include "src/profiling/memory/client.h"
 #include "src/profiling/memory/wire_protocol.h"
@@ -182,6 +184,220 @@ TEST(UnwindingTest, DoUnwindReparse) {
                "namespace)::GetRecord(perfetto::profiling::WireMessage*)");
 }
 
+TEST(UnwindingTest, ElfCacheAcrossMetadata) {
+  ElfCache cache(1024 * 1024 * 1024);
+  WireMessage msg;
+  auto record = GetRecord(&msg);
+  AllocRecord first;
+  {
+    UnwindingMetadata metadata(base::OpenFile("/proc/self/maps", O_RDONLY),
+                               base::OpenFile("/proc/self/mem", O_RDONLY),
+                               &cache);
+    EXPECT_EQ(metadata.elf_cache_hits, 0u);
+    ASSERT_TRUE(DoUnwind(&msg, &metadata, &first));
+    EXPECT_GT(metadata.elf_cache_misses, 0u);
+  }
+  ASSERT_GT(cache.num_elfs(), 0u);
+
+  // A new process mapping the same libraries reuses their Elfs.
+  UnwindingMetadata metadata(base::OpenFile("/proc/self/maps", O_RDONLY),
+                             base::OpenFile("/proc/self/mem", O_RDONLY),
+                             &cache);
+  EXPECT_GT(metadata.elf_cache_hits, 0u);
+  AllocRecord second;
+  ASSERT_TRUE(DoUnwind(&msg, &metadata, &second));
+  ASSERT_EQ(second.frames.size(), first.frames.size());
+  for (size_t i = 0; i < first.frames.size(); ++i) {
+    EXPECT_EQ(second.frames[i].function_name, first.frames[i].function_name);
+    EXPECT_EQ(second.frames[i].rel_pc, first.frames[i].rel_pc);
+  }
+}
+
+TEST(UnwindingTest, ElfCacheEvictsOverMemoryBudget) {
+  uint64_t memory_bytes = 0;
+  ElfCache cache(1024, [&memory_bytes] {
+    return base::Optional<uint64_t>(memory_bytes);
+  });
+  WireMessage msg;
+  auto record = GetRecord(&msg);
+  uint64_t misses = 0;
+  {
+    UnwindingMetadata metadata(base::OpenFile("/proc/self/maps", O_RDONLY),
+                               base::OpenFile("/proc/self/mem", O_RDONLY),
+                               &cache);
+    AllocRecord out;
+    ASSERT_TRUE(DoUnwind(&msg, &metadata, &out));
+    misses = metadata.elf_cache_misses;
+  }
+  ASSERT_GT(cache.num_elfs(), 1u);
+
+  // Over the budget, all but the Elf that was just added are evicted.
+  memory_bytes = 2048;
+  cache.Clear();
+  UnwindingMetadata metadata(base::OpenFile("/proc/self/maps", O_RDONLY),
+                             base::OpenFile("/proc/self/mem", O_RDONLY),
+                             &cache);
+  AllocRecord out;
+  ASSERT_TRUE(DoUnwind(&msg, &metadata, &out));
+  EXPECT_EQ(cache.num_elfs(), 1u);
+  EXPECT_EQ(metadata.elf_cache_misses, misses);
+}
+
+TEST(UnwindingTest, NoElfCache) {
+  WireMessage msg;
+  auto record = GetRecord(&msg);
+  UnwindingMetadata metadata(base::OpenFile("/proc/self/maps", O_RDONLY),
+                             base::OpenFile("/proc/self/mem", O_RDONLY),
+                             /*elf_cache=*/nullptr);
+  AllocRecord out;
+  ASSERT_TRUE(DoUnwind(&msg, &metadata, &out));
+  EXPECT_EQ(metadata.elf_cache_hits, 0u);
+  EXPECT_EQ(metadata.elf_cache_misses, 0u);
+}
+
+class RecordingDelegate : public UnwindingWorker::Delegate {
+ public:
+  void PostAllocRecord(UnwindingWorker*,
+                       std::unique_ptr<AllocRecord> rec) override {
+    alloc_records.emplace_back(std::move(rec));
+  }
+  void PostFreeRecord(UnwindingWorker*, std::vector<FreeRecord>) override {}
+  void PostHeapNameRecord(UnwindingWorker*, HeapNameRecord) override {}
+  void PostSocketDisconnected(UnwindingWorker*,
+                              DataSourceInstanceID,
+                              pid_t,
+                              SharedRingBuffer::Stats) override {}
+
+  std::vector<std::unique_ptr<AllocRecord>> alloc_records;
+};
+
+// Serializes |msg| the way SendWireMessage does, so it can be passed to
+// HandleBuffer.
+std::vector<uint64_t> Serialize(const WireMessage& msg) {
+  std::vector<uint64_t> buf;
+  auto append = [&buf](const void* data, size_t size) {
+    size_t offset = buf.size() * sizeof(uint64_t);
+    buf.resize((offset + size + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+    memcpy(reinterpret_cast<char*>(buf.data()) + offset, data, size);
+  };
+  append(&msg.record_type, sizeof(msg.record_type));
+  if (msg.record_type == RecordType::Malloc ||
+      msg.record_type == RecordType::MallocWithCallstackId) {
+    append(msg.alloc_header, sizeof(*msg.alloc_header));
+    if (msg.record_type == RecordType::MallocWithCallstackId)
+      append(msg.callstack_id, sizeof(*msg.callstack_id));
+    append(msg.payload, msg.payload_size);
+  } else if (msg.record_type == RecordType::KnownCallstackMalloc) {
+    append(msg.known_callstack_header, sizeof(*msg.known_callstack_header));
+  }
+  return buf;
+}
+
+void HandleMessage(const WireMessage& msg,
+                   UnwindingWorker::ClientData* client_data,
+                   RecordingDelegate* delegate) {
+  AllocRecordArena arena;
+  std::vector<uint64_t> data = Serialize(msg);
+  SharedRingBuffer::Buffer buf(reinterpret_cast<uint8_t*>(data.data()),
+                               data.size() * sizeof(uint64_t), 0);
+  UnwindingWorker::HandleBuffer(nullptr, &arena, buf, client_data, getpid(),
+                                delegate);
+}
+
+TEST(UnwindingTest, KnownCallstackMalloc) {
+  base::ScopedFile proc_maps(base::OpenFile("/proc/self/maps", O_RDONLY));
+  base::ScopedFile proc_mem(base::OpenFile("/proc/self/mem", O_RDONLY));
+  UnwindingMetadata metadata(std::move(proc_maps), std::move(proc_mem));
+  UnwindingWorker::ClientData client_data{
+      1, {}, std::move(metadata), {}, {}, {}, {}, {}, {},
+  };
+  RecordingDelegate delegate;
+
+  uint64_t callstack_id = 0x1234;
+  WireMessage msg;
+  auto record = GetRecord(&msg);
+  msg.record_type = RecordType::MallocWithCallstackId;
+  msg.callstack_id = &callstack_id;
+  HandleMessage(msg, &client_data, &delegate);
+
+  KnownCallstackAllocEntry entry{};
+  entry.sequence_number = 2;
+  entry.alloc_size = 20;
+  entry.sample_size = 20;
+  entry.alloc_address = 0x20;
+  entry.callstack_id = callstack_id;
+  WireMessage known_msg{};
+  known_msg.record_type = RecordType::KnownCallstackMalloc;
+  known_msg.known_callstack_header = &entry;
+  HandleMessage(known_msg, &client_data, &delegate);
+
+  // Evicted or never sent.
+  entry.callstack_id = callstack_id + kCallstackCacheSize;
+  HandleMessage(known_msg, &client_data, &delegate);
+
+  ASSERT_EQ(delegate.alloc_records.size(), 3u);
+  const AllocRecord& unwound = *delegate.alloc_records[0];
+  const AllocRecord& known = *delegate.alloc_records[1];
+  ASSERT_GT(unwound.frames.size(), 0u);
+  ASSERT_EQ(known.frames.size(), unwound.frames.size());
+  for (size_t i = 0; i < known.frames.size(); ++i) {
+    EXPECT_EQ(known.frames[i].pc, unwound.frames[i].pc);
+    EXPECT_EQ(known.frames[i].function_name, unwound.frames[i].function_name);
+  }
+  EXPECT_EQ(known.build_ids, unwound.build_ids);
+  EXPECT_EQ(known.alloc_metadata.sequence_number, 2u);
+  EXPECT_EQ(known.alloc_metadata.alloc_address, 0x20u);
+
+  const AllocRecord& unknown = *delegate.alloc_records[2];
+  EXPECT_TRUE(unknown.error);
+  ASSERT_EQ(unknown.frames.size(), 1u);
+  EXPECT_EQ(unknown.frames[0].function_name, "ERROR UNKNOWN CALLSTACK");
+}
+
+class DisconnectDelegate : public UnwindingWorker::Delegate {
+ public:
+  void PostAllocRecord(UnwindingWorker*,
+                       std::unique_ptr<AllocRecord>) override {}
+  void PostFreeRecord(UnwindingWorker*, std::vector<FreeRecord>) override {}
+  void PostHeapNameRecord(UnwindingWorker*, HeapNameRecord) override {}
+  void PostSocketDisconnected(UnwindingWorker*,
+                              DataSourceInstanceID ds_id,
+                              pid_t pid,
+                              SharedRingBuffer::Stats) override {
+    disconnected_ds_id = ds_id;
+    disconnected_pid = pid;
+    disconnected.Notify();
+  }
+
+  base::WaitableEvent disconnected;
+  DataSourceInstanceID disconnected_ds_id = 0;
+  pid_t disconnected_pid = 0;
+};
+
+TEST(UnwindingWorkerPoolTest, DisconnectReachesOwner) {
+  DisconnectDelegate delegate;
+  UnwindingWorkerPool pool(&delegate, 3);
+  auto sock_pair = base::UnixSocketRaw::CreatePairPosix(
+      base::SockFamily::kUnix, base::SockType::kStream);
+  base::Optional<SharedRingBuffer> shmem = SharedRingBuffer::Create(8 * 4096);
+  ASSERT_TRUE(shmem);
+
+  UnwindingWorker::HandoffData handoff_data;
+  handoff_data.data_source_instance_id = 42;
+  handoff_data.sock = std::move(sock_pair.first);
+  handoff_data.maps_fd = base::OpenFile("/proc/self/maps", O_RDONLY);
+  handoff_data.mem_fd = base::OpenFile("/proc/self/mem", O_RDONLY);
+  handoff_data.shmem = std::move(*shmem);
+  handoff_data.client_config = {};
+  handoff_data.stream_allocations = false;
+  pool.PostHandoffSocket(getpid(), std::move(handoff_data));
+  pool.PostDisconnectSocket(getpid());
+
+  delegate.disconnected.Wait();
+  EXPECT_EQ(delegate.disconnected_ds_id, 42u);
+  EXPECT_EQ(delegate.disconnected_pid, getpid());
+}
+
 TEST(AllocRecordArenaTest, Smoke) {
   AllocRecordArena a;
   auto borrowed = a.BorrowAllocRecord();
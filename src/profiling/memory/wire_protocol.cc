@@ -63,7 +63,9 @@ int64_t WithBuffer(SharedRingBuffer* shmem, size_t total_size, F fn) {
     return -1;
   }
   SharedRingBuffer::Buffer buf;
-  {
+  if (shmem->lock_free_writes()) {
+    buf = shmem->BeginWriteLockFree(total_size);
+  } else {
     ScopedSpinlock lock = shmem->AcquireLock(ScopedSpinlock::Mode::Try);
     if (!lock.locked()) {
       PERFETTO_DLOG("Failed to acquire spinlock.");
@@ -104,6 +106,24 @@ int64_t SendWireMessage(SharedRingBuffer* shmem, const WireMessage& msg) {
                          msg.payload, msg.payload_size);
           });
     }
+    case RecordType::MallocWithCallstackId: {
+      size_t total_size = sizeof(msg.record_type) + sizeof(*msg.alloc_header) +
+                          sizeof(*msg.callstack_id) + msg.payload_size;
+      return WithBuffer(
+          shmem, total_size, [msg](SharedRingBuffer::Buffer* buf) {
+            size_t offset = 0;
+            memcpy(buf->data, &msg.record_type, sizeof(msg.record_type));
+            offset += sizeof(msg.record_type);
+            memcpy(buf->data + offset, msg.alloc_header,
+                   sizeof(*msg.alloc_header));
+            offset += sizeof(*msg.alloc_header);
+            memcpy(buf->data + offset, msg.callstack_id,
+                   sizeof(*msg.callstack_id));
+            offset += sizeof(*msg.callstack_id);
+            UnsafeMemcpy(reinterpret_cast<char*>(buf->data) + offset,
+                         msg.payload, msg.payload_size);
+          });
+    }
     case RecordType::Free: {
       constexpr size_t total_size =
           sizeof(msg.record_type) + sizeof(*msg.free_header);
@@ -124,6 +144,17 @@ int64_t SendWireMessage(SharedRingBuffer* shmem, const WireMessage& msg) {
                    sizeof(*msg.heap_name_header));
           });
     }
+    case RecordType::KnownCallstackMalloc: {
+      constexpr size_t total_size =
+          sizeof(msg.record_type) + sizeof(*msg.known_callstack_header);
+      return WithBuffer(
+          shmem, total_size, [msg](SharedRingBuffer::Buffer* buf) {
+            memcpy(buf->data, &msg.record_type, sizeof(msg.record_type));
+            memcpy(buf->data + sizeof(msg.record_type),
+                   msg.known_callstack_header,
+                   sizeof(*msg.known_callstack_header));
+          });
+    }
   }
 }
 
@@ -137,13 +168,20 @@ bool ReceiveWireMessage(char* buf, size_t size, WireMessage* out) {
 
   out->payload = nullptr;
   out->payload_size = 0;
+  out->callstack_id = nullptr;
   out->record_type = *record_type;
 
-  if (*record_type == RecordType::Malloc) {
+  if (*record_type == RecordType::Malloc ||
+      *record_type == RecordType::MallocWithCallstackId) {
     if (!ViewAndAdvance<AllocMetadata>(&buf, &out->alloc_header, end)) {
       PERFETTO_DFATAL_OR_ELOG("Cannot read alloc header.");
       return false;
     }
+    if (*record_type == RecordType::MallocWithCallstackId &&
+        !ViewAndAdvance<uint64_t>(&buf, &out->callstack_id, end)) {
+      PERFETTO_DFATAL_OR_ELOG("Cannot read callstack id.");
+      return false;
+    }
     out->payload = buf;
     if (buf > end) {
       PERFETTO_DFATAL_OR_ELOG("Receive buffer overflowed");
@@ -160,6 +198,12 @@ bool ReceiveWireMessage(char* buf, size_t size, WireMessage* out) {
       PERFETTO_DFATAL_OR_ELOG("Cannot read free header.");
       return false;
     }
+  } else if (*record_type == RecordType::KnownCallstackMalloc) {
+    if (!ViewAndAdvance<KnownCallstackAllocEntry>(
+            &buf, &out->known_callstack_header, end)) {
+      PERFETTO_DFATAL_OR_ELOG("Cannot read known callstack header.");
+      return false;
+    }
   } else {
     PERFETTO_DFATAL_OR_ELOG("Invalid record type.");
     return false;
@@ -68,6 +68,10 @@ constexpr size_t kMaxRegisterDataSize =
 // and heapprofd. The basic format of a record sent by the client is
 // record size (uint64_t) | record type (RecordType = uint64_t) | record
 // If record type is Malloc, the record format is AllocMetdata | raw stack.
+// If record type is MallocWithCallstackId, the record format is
+// AllocMetadata | callstack id (uint64_t) | raw stack.
+// If record type is KnownCallstackMalloc, the record is a
+// KnownCallstackAllocEntry.
 // If the record type is Free, the record is a FreeEntry.
 // If record type is HeapName, the record is a HeapName.
 // On connect, heapprofd sends one ClientConfiguration struct over the control
@@ -96,6 +100,9 @@ struct ClientConfiguration {
   PERFETTO_CROSS_ABI_ALIGNED(bool) disable_fork_teardown;
   PERFETTO_CROSS_ABI_ALIGNED(bool) disable_vfork_detection;
   PERFETTO_CROSS_ABI_ALIGNED(bool) all_heaps;
+  // Send KnownCallstackMalloc records for callstacks that were sent before,
+  // identified by their frame pointer chain.
+  PERFETTO_CROSS_ABI_ALIGNED(bool) deduplicate_callstacks;
   // Just double check that the array sizes are in correct order.
 };
 
@@ -103,8 +110,16 @@ enum class RecordType : uint64_t {
   Free = 0,
   Malloc = 1,
   HeapName = 2,
+  KnownCallstackMalloc = 3,
+  MallocWithCallstackId = 4,
 };
 
+// Number of callstack ids the client remembers having sent to heapprofd,
+// which heapprofd needs to remember the unwound frames of. Callstack ids are
+// stored at the index given by their lower bits, so a newer id evicts an older
+// one with the same lower bits.
+constexpr uint64_t kCallstackCacheSize = 4096;
+
 // Make the whole struct 8-aligned. This is to make sizeof(AllocMetdata)
 // the same on 32 and 64-bit.
 struct alignas(8) AllocMetadata {
@@ -125,6 +140,19 @@ struct alignas(8) AllocMetadata {
   PERFETTO_CROSS_ABI_ALIGNED(unwindstack::ArchEnum) arch;
 };
 
+// Sent instead of AllocMetadata and the raw stack if the callstack was
+// previously sent in a MallocWithCallstackId record with the same
+// callstack_id.
+struct KnownCallstackAllocEntry {
+  PERFETTO_CROSS_ABI_ALIGNED(uint64_t) sequence_number;
+  PERFETTO_CROSS_ABI_ALIGNED(uint64_t) alloc_size;
+  PERFETTO_CROSS_ABI_ALIGNED(uint64_t) sample_size;
+  PERFETTO_CROSS_ABI_ALIGNED(uint64_t) alloc_address;
+  PERFETTO_CROSS_ABI_ALIGNED(uint64_t) clock_monotonic_coarse_timestamp;
+  PERFETTO_CROSS_ABI_ALIGNED(uint64_t) callstack_id;
+  PERFETTO_CROSS_ABI_ALIGNED(uint32_t) heap_id;
+};
+
 struct FreeEntry {
   PERFETTO_CROSS_ABI_ALIGNED(uint64_t) sequence_number;
   PERFETTO_CROSS_ABI_ALIGNED(uint64_t) addr;
@@ -144,6 +172,9 @@ static_assert(sizeof(FreeEntry) == 24,
               "FreeEntry needs to be the same size across ABIs.");
 static_assert(sizeof(HeapName) == 80,
               "HeapName needs to be the same size across ABIs.");
+static_assert(
+    sizeof(KnownCallstackAllocEntry) == 56,
+    "KnownCallstackAllocEntry needs to be the same size across ABIs.");
 static_assert(sizeof(ClientConfiguration) == 4656,
               "ClientConfiguration needs to be the same size across ABIs.");
 
@@ -159,6 +190,10 @@ struct WireMessage {
   AllocMetadata* alloc_header;
   FreeEntry* free_header;
   HeapName* heap_name_header;
+  KnownCallstackAllocEntry* known_callstack_header;
+  // Only set for MallocWithCallstackId: heapprofd should remember the unwound
+  // callstack for subsequent KnownCallstackMalloc records with this id.
+  uint64_t* callstack_id;
 
   char* payload;
   size_t payload_size;
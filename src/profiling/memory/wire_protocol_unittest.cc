@@ -47,6 +47,18 @@ bool operator==(const FreeEntry& one, const FreeEntry& other) {
           std::tie(other.sequence_number, other.addr, other.heap_id));
 }
 
+bool operator==(const KnownCallstackAllocEntry& one,
+                const KnownCallstackAllocEntry& other);
+bool operator==(const KnownCallstackAllocEntry& one,
+                const KnownCallstackAllocEntry& other) {
+  return std::tie(one.sequence_number, one.alloc_size, one.sample_size,
+                  one.alloc_address, one.clock_monotonic_coarse_timestamp,
+                  one.callstack_id, one.heap_id) ==
+         std::tie(other.sequence_number, other.alloc_size, other.sample_size,
+                  other.alloc_address, other.clock_monotonic_coarse_timestamp,
+                  other.callstack_id, other.heap_id);
+}
+
 namespace {
 
 base::ScopedFile CopyFD(int fd) {
@@ -104,6 +116,47 @@ TEST(WireProtocolTest, AllocMessage) {
   shmem_server->EndRead(std::move(buf));
 }
 
+TEST(WireProtocolTest, AllocWithCallstackIdMessage) {
+  char payload[] = {0x77, 0x77, 0x77, 0x00};
+  uint64_t callstack_id = 0xE1E2E3E4E5E6E7E8;
+  WireMessage msg = {};
+  msg.record_type = RecordType::MallocWithCallstackId;
+  AllocMetadata metadata = {};
+  metadata.sequence_number = 0xA1A2A3A4A5A6A7A8;
+  metadata.alloc_size = 0xB1B2B3B4B5B6B7B8;
+  metadata.alloc_address = 0xC1C2C3C4C5C6C7C8;
+  metadata.stack_pointer = 0xD1D2D3D4D5D6D7D8;
+  metadata.arch = unwindstack::ARCH_X86;
+  for (size_t i = 0; i < kMaxRegisterDataSize; ++i)
+    metadata.register_data[i] = 0x66;
+  msg.alloc_header = &metadata;
+  msg.callstack_id = &callstack_id;
+  msg.payload = payload;
+  msg.payload_size = sizeof(payload);
+
+  auto shmem_client = SharedRingBuffer::Create(kShmemSize);
+  ASSERT_TRUE(shmem_client);
+  ASSERT_TRUE(shmem_client->is_valid());
+  auto shmem_server = SharedRingBuffer::Attach(CopyFD(shmem_client->fd()));
+
+  ASSERT_GE(SendWireMessage(&shmem_client.value(), msg), 0);
+
+  auto buf = shmem_server->BeginRead();
+  ASSERT_TRUE(buf);
+  WireMessage recv_msg;
+  ASSERT_TRUE(ReceiveWireMessage(reinterpret_cast<char*>(buf.data), buf.size,
+                                 &recv_msg));
+
+  ASSERT_EQ(recv_msg.record_type, msg.record_type);
+  ASSERT_EQ(*recv_msg.alloc_header, *msg.alloc_header);
+  ASSERT_NE(recv_msg.callstack_id, nullptr);
+  ASSERT_EQ(*recv_msg.callstack_id, callstack_id);
+  ASSERT_EQ(recv_msg.payload_size, msg.payload_size);
+  ASSERT_STREQ(recv_msg.payload, msg.payload);
+
+  shmem_server->EndRead(std::move(buf));
+}
+
 TEST(WireProtocolTest, FreeMessage) {
   WireMessage msg = {};
   msg.record_type = RecordType::Free;
@@ -132,6 +185,38 @@ TEST(WireProtocolTest, FreeMessage) {
   shmem_server->EndRead(std::move(buf));
 }
 
+TEST(WireProtocolTest, KnownCallstackMallocMessage) {
+  WireMessage msg = {};
+  msg.record_type = RecordType::KnownCallstackMalloc;
+  KnownCallstackAllocEntry entry = {};
+  entry.sequence_number = 0xA1A2A3A4A5A6A7A8;
+  entry.alloc_size = 0xB1B2B3B4B5B6B7B8;
+  entry.sample_size = 0xB1B2B3B4B5B6B7B8;
+  entry.alloc_address = 0xC1C2C3C4C5C6C7C8;
+  entry.callstack_id = 0xE1E2E3E4E5E6E7E8;
+  entry.heap_id = 3;
+  msg.known_callstack_header = &entry;
+
+  auto shmem_client = SharedRingBuffer::Create(kShmemSize);
+  ASSERT_TRUE(shmem_client);
+  ASSERT_TRUE(shmem_client->is_valid());
+  auto shmem_server = SharedRingBuffer::Attach(CopyFD(shmem_client->fd()));
+
+  ASSERT_GE(SendWireMessage(&shmem_client.value(), msg), 0);
+
+  auto buf = shmem_server->BeginRead();
+  ASSERT_TRUE(buf);
+  WireMessage recv_msg;
+  ASSERT_TRUE(ReceiveWireMessage(reinterpret_cast<char*>(buf.data), buf.size,
+                                 &recv_msg));
+
+  ASSERT_EQ(recv_msg.record_type, msg.record_type);
+  ASSERT_EQ(*recv_msg.known_callstack_header, *msg.known_callstack_header);
+  ASSERT_EQ(recv_msg.payload_size, 0u);
+
+  shmem_server->EndRead(std::move(buf));
+}
+
 TEST(GetHeapSamplingInterval, Default) {
   ClientConfiguration cli_config{};
   cli_config.all_heaps = true;
@@ -56,6 +56,8 @@ struct ParsedSample {
   std::vector<char> stack;
   bool stack_maxed = false;
   std::vector<uint64_t> kernel_ips;
+  // Userspace callchain unwound by the kernel (frame pointer unwinding mode).
+  std::vector<uint64_t> user_ips;
 };
 
 // Entry in an unwinding queue. Either a sample that requires unwinding, or a
@@ -346,6 +346,7 @@ base::Optional<EventConfig> EventConfig::Create(
 
   // Callstack sampling.
   bool user_frames = false;
+  bool frame_pointer_unwinding = false;
   bool kernel_frames = false;
   TargetFilter target_filter;
   bool legacy_config = pb_config.all_cpus();  // all_cpus was mandatory before
@@ -366,6 +367,10 @@ base::Optional<EventConfig> EventConfig::Create(
       case PerfEventConfig::UNWIND_DWARF:
         user_frames = true;
         break;
+      case PerfEventConfig::UNWIND_FRAME_POINTER:
+        user_frames = true;
+        frame_pointer_unwinding = true;
+        break;
       default:
         // enum value from the future that we don't yet know, refuse the config
         // TODO(rsavitski): double-check that both pbzero and ::gen propagate
@@ -396,6 +401,7 @@ base::Optional<EventConfig> EventConfig::Create(
   uint32_t read_tick_period_ms = pb_config.ring_buffer_read_period_ms()
                                      ? pb_config.ring_buffer_read_period_ms()
                                      : kDefaultReadTickPeriodMs;
+  bool reader_threads = pb_config.ring_buffer_reader_threads();
 
   // Calculate a rough upper limit for the amount of samples the producer
   // should read per read tick, as a safeguard against getting stuck chasing the
@@ -438,6 +444,14 @@ base::Optional<EventConfig> EventConfig::Create(
   pe.size = sizeof(perf_event_attr);
   pe.disabled = 1;  // will be activated via ioctl
 
+  // Reader threads block on the event's fd, so ask the kernel to wake them up
+  // once a quarter of the ring buffer is occupied.
+  if (reader_threads) {
+    pe.watermark = 1;
+    pe.wakeup_watermark =
+        static_cast<uint32_t>(*ring_buffer_pages * base::kPageSize / 4);
+  }
+
   // Sampling timebase.
   pe.type = timebase_event.attr_type;
   pe.config = timebase_event.attr_config;
@@ -456,7 +470,7 @@ base::Optional<EventConfig> EventConfig::Create(
   pe.clockid = ToClockId(pb_config.timebase().timestamp_clock());
   pe.use_clockid = true;
 
-  if (user_frames) {
+  if (user_frames && !frame_pointer_unwinding) {
     pe.sample_type |= PERF_SAMPLE_STACK_USER | PERF_SAMPLE_REGS_USER;
     // PERF_SAMPLE_STACK_USER:
     // Needs to be < ((u16)(~0u)), and have bottom 8 bits clear.
@@ -468,27 +482,32 @@ base::Optional<EventConfig> EventConfig::Create(
     pe.sample_regs_user =
         PerfUserRegsMaskForArch(unwindstack::Regs::CurrentArch());
   }
-  if (kernel_frames) {
+  if (kernel_frames || frame_pointer_unwinding) {
     pe.sample_type |= PERF_SAMPLE_CALLCHAIN;
-    pe.exclude_callchain_user = true;
+    // With frame pointer unwinding, the kernel unwinds the userspace part of
+    // the callchain as well.
+    pe.exclude_callchain_user = !frame_pointer_unwinding;
+    pe.exclude_callchain_kernel = !kernel_frames;
   }
 
   return EventConfig(
-      raw_ds_config, pe, timebase_event, user_frames, kernel_frames,
-      std::move(target_filter), ring_buffer_pages.value(), read_tick_period_ms,
-      samples_per_tick_limit, remote_descriptor_timeout_ms,
-      pb_config.unwind_state_clear_period_ms(), max_enqueued_footprint_bytes,
-      pb_config.target_installed_by());
+      raw_ds_config, pe, timebase_event, user_frames, frame_pointer_unwinding,
+      kernel_frames, std::move(target_filter), ring_buffer_pages.value(),
+      read_tick_period_ms, reader_threads, samples_per_tick_limit,
+      remote_descriptor_timeout_ms, pb_config.unwind_state_clear_period_ms(),
+      max_enqueued_footprint_bytes, pb_config.target_installed_by());
 }
 
 EventConfig::EventConfig(const DataSourceConfig& raw_ds_config,
                          const perf_event_attr& pe,
                          const PerfCounter& timebase_event,
                          bool user_frames,
+                         bool frame_pointer_unwinding,
                          bool kernel_frames,
                          TargetFilter target_filter,
                          uint32_t ring_buffer_pages,
                          uint32_t read_tick_period_ms,
+                         bool reader_threads,
                          uint64_t samples_per_tick_limit,
                          uint32_t remote_descriptor_timeout_ms,
                          uint32_t unwind_state_clear_period_ms,
@@ -497,10 +516,12 @@ EventConfig::EventConfig(const DataSourceConfig& raw_ds_config,
     : perf_event_attr_(pe),
       timebase_event_(timebase_event),
       user_frames_(user_frames),
+      frame_pointer_unwinding_(frame_pointer_unwinding),
       kernel_frames_(kernel_frames),
       target_filter_(std::move(target_filter)),
       ring_buffer_pages_(ring_buffer_pages),
       read_tick_period_ms_(read_tick_period_ms),
+      reader_threads_(reader_threads),
       samples_per_tick_limit_(samples_per_tick_limit),
       remote_descriptor_timeout_ms_(remote_descriptor_timeout_ms),
       unwind_state_clear_period_ms_(unwind_state_clear_period_ms),
@@ -126,6 +126,7 @@ class EventConfig {
 
   uint32_t ring_buffer_pages() const { return ring_buffer_pages_; }
   uint32_t read_tick_period_ms() const { return read_tick_period_ms_; }
+  bool reader_threads() const { return reader_threads_; }
   uint64_t samples_per_tick_limit() const { return samples_per_tick_limit_; }
   uint32_t remote_descriptor_timeout_ms() const {
     return remote_descriptor_timeout_ms_;
@@ -138,6 +139,7 @@ class EventConfig {
   }
   bool sample_callstacks() const { return user_frames_ || kernel_frames_; }
   bool user_frames() const { return user_frames_; }
+  bool frame_pointer_unwinding() const { return frame_pointer_unwinding_; }
   bool kernel_frames() const { return kernel_frames_; }
   const TargetFilter& filter() const { return target_filter_; }
   perf_event_attr* perf_attr() const {
@@ -154,10 +156,12 @@ class EventConfig {
               const perf_event_attr& pe,
               const PerfCounter& timebase_event,
               bool user_frames,
+              bool frame_pointer_unwinding,
               bool kernel_frames,
               TargetFilter target_filter,
               uint32_t ring_buffer_pages,
               uint32_t read_tick_period_ms,
+              bool reader_threads,
               uint64_t samples_per_tick_limit,
               uint32_t remote_descriptor_timeout_ms,
               uint32_t unwind_state_clear_period_ms,
@@ -175,6 +179,11 @@ class EventConfig {
   // If true, include userspace frames in sampled callstacks.
   const bool user_frames_;
 
+  // If true, userspace frames are unwound by the kernel (following frame
+  // pointers), instead of sampling the stack and registers for unwinding by
+  // libunwindstack.
+  const bool frame_pointer_unwinding_;
+
   // If true, include kernel frames in sampled callstacks.
   const bool kernel_frames_;
 
@@ -188,6 +197,10 @@ class EventConfig {
   // How often the ring buffers should be read.
   const uint32_t read_tick_period_ms_;
 
+  // If true, each ring buffer is read by a dedicated thread, which is woken up
+  // by the kernel when the buffer reaches a watermark.
+  const bool reader_threads_;
+
   // Guardrail for the amount of samples a given read attempt will extract from
   // *each* per-cpu buffer.
   const uint64_t samples_per_tick_limit_;
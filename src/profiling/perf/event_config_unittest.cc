@@ -22,6 +22,7 @@
 
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/optional.h"
+#include "perfetto/ext/base/utils.h"
 #include "test/gtest_and_gmock.h"
 
 #include "protos/perfetto/common/perf_events.gen.h"
@@ -103,6 +104,29 @@ TEST(EventConfigTest, ReadTickPeriodDefaultedIfUnset) {
   }
 }
 
+TEST(EventConfigTest, ReaderThreadsSetWakeupWatermark) {
+  {  // by default, buffers are polled and the kernel doesn't wake us up
+    protos::gen::PerfEventConfig cfg;
+    base::Optional<EventConfig> event_config = CreateEventConfig(cfg);
+
+    ASSERT_TRUE(event_config.has_value());
+    EXPECT_FALSE(event_config->reader_threads());
+    EXPECT_FALSE(event_config->perf_attr()->watermark);
+  }
+  {  // reader threads are woken up at a quarter of the buffer's capacity
+    protos::gen::PerfEventConfig cfg;
+    cfg.set_ring_buffer_pages(64);
+    cfg.set_ring_buffer_reader_threads(true);
+    base::Optional<EventConfig> event_config = CreateEventConfig(cfg);
+
+    ASSERT_TRUE(event_config.has_value());
+    EXPECT_TRUE(event_config->reader_threads());
+    EXPECT_TRUE(event_config->perf_attr()->watermark);
+    EXPECT_EQ(event_config->perf_attr()->wakeup_watermark,
+              16 * base::kPageSize);
+  }
+}
+
 TEST(EventConfigTest, RemotePeriodTimeoutDefaultedIfUnset) {
   {  // if unset, a default is used
     protos::gen::PerfEventConfig cfg;
@@ -309,6 +333,27 @@ TEST(EventConfigTest, CallstackSamplingModeDetection) {
 
     EXPECT_NE(event_config->perf_attr()->exclude_callchain_user, 0u);
   }
+  {  // frame pointer unwinding: kernel unwinds the userspace callchain
+    protos::gen::PerfEventConfig cfg;
+    cfg.mutable_callstack_sampling()->set_user_frames(
+        protos::gen::PerfEventConfig::UNWIND_FRAME_POINTER);
+
+    base::Optional<EventConfig> event_config = CreateEventConfig(cfg);
+
+    ASSERT_TRUE(event_config.has_value());
+    EXPECT_TRUE(event_config->sample_callstacks());
+    EXPECT_TRUE(event_config->user_frames());
+    EXPECT_TRUE(event_config->frame_pointer_unwinding());
+    EXPECT_FALSE(event_config->kernel_frames());
+    EXPECT_EQ(event_config->perf_attr()->sample_type &
+                  (PERF_SAMPLE_STACK_USER | PERF_SAMPLE_REGS_USER),
+              0u);
+    EXPECT_EQ(event_config->perf_attr()->sample_type & (PERF_SAMPLE_CALLCHAIN),
+              static_cast<uint64_t>(PERF_SAMPLE_CALLCHAIN));
+
+    EXPECT_EQ(event_config->perf_attr()->exclude_callchain_user, 0u);
+    EXPECT_NE(event_config->perf_attr()->exclude_callchain_kernel, 0u);
+  }
 }
 
 TEST(EventConfigTest, EnableKernelFrames) {
@@ -23,6 +23,8 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+
 #include "perfetto/ext/base/utils.h"
 #include "src/profiling/perf/regs_parsing.h"
 
@@ -83,6 +85,22 @@ bool MaybeApplyTracepointFilter(int fd, const PerfCounter& event) {
 
 }  // namespace
 
+void SplitUserCallchain(std::vector<uint64_t>* ips,
+                        std::vector<uint64_t>* user_ips) {
+  auto user_it = std::find(ips->begin(), ips->end(),
+                           static_cast<uint64_t>(PERF_CONTEXT_USER));
+  if (user_it == ips->end())
+    return;
+
+  user_ips->reserve(static_cast<size_t>(ips->end() - user_it));
+  for (auto it = user_it + 1; it != ips->end(); ++it) {
+    if (*it >= static_cast<uint64_t>(PERF_CONTEXT_MAX))
+      break;  // start of another context
+    user_ips->push_back(*it);
+  }
+  ips->erase(user_it, ips->end());
+}
+
 PerfRingBuffer::PerfRingBuffer(PerfRingBuffer&& other) noexcept
     : metadata_page_(other.metadata_page_),
       mmap_sz_(other.mmap_sz_),
@@ -148,7 +166,7 @@ base::Optional<PerfRingBuffer> PerfRingBuffer::Allocate(
 // TODO(rsavitski): is there false sharing between |data_tail| and |data_head|?
 // Is there an argument for maintaining our own copy of |data_tail| instead of
 // reloading it?
-char* PerfRingBuffer::ReadRecordNonconsuming() {
+PerfRingBuffer::ReadableRange PerfRingBuffer::GetReadableRange() {
   static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t), "");
 
   PERFETTO_DCHECK(valid());
@@ -164,10 +182,13 @@ char* PerfRingBuffer::ReadRecordNonconsuming() {
           ->load(std::memory_order_acquire);
 
   PERFETTO_DCHECK(read_offset <= write_offset);
-  if (write_offset == read_offset)
-    return nullptr;  // no new data
+  return ReadableRange{read_offset, write_offset};
+}
+
+char* PerfRingBuffer::RecordAt(uint64_t offset) {
+  PERFETTO_DCHECK(valid());
 
-  size_t read_pos = static_cast<size_t>(read_offset & (data_buf_sz_ - 1));
+  size_t read_pos = static_cast<size_t>(offset & (data_buf_sz_ - 1));
 
   // event header (64 bits) guaranteed to be contiguous
   PERFETTO_DCHECK(read_pos <= data_buf_sz_ - sizeof(perf_event_header));
@@ -193,17 +214,17 @@ char* PerfRingBuffer::ReadRecordNonconsuming() {
   }
 }
 
-void PerfRingBuffer::Consume(size_t bytes) {
+void PerfRingBuffer::ConsumeUpTo(uint64_t offset) {
   PERFETTO_DCHECK(valid());
+  PERFETTO_DCHECK(offset >= metadata_page_->data_tail);
 
   // Advance |data_tail|, which is written only by this thread. The store of the
   // updated value needs to have release semantics such that the preceding
   // payload reads are ordered before it. The reader in this case is the kernel,
   // which reads |data_tail| to calculate the available ring buffer capacity
   // before trying to store a new record.
-  uint64_t updated_tail = metadata_page_->data_tail + bytes;
   reinterpret_cast<std::atomic<uint64_t>*>(&metadata_page_->data_tail)
-      ->store(updated_tail, std::memory_order_release);
+      ->store(offset, std::memory_order_release);
 }
 
 EventReader::EventReader(uint32_t cpu,
@@ -246,19 +267,23 @@ base::Optional<EventReader> EventReader::ConfigureEvents(
                                           std::move(ring_buffer.value()));
 }
 
-base::Optional<ParsedSample> EventReader::ReadUntilSample(
-    std::function<void(uint64_t)> records_lost_callback) {
-  for (;;) {
-    char* event = ring_buffer_.ReadRecordNonconsuming();
-    if (!event)
-      return base::nullopt;  // caught up with the writer
-
+bool EventReader::ReadBatch(
+    uint64_t max_samples,
+    const std::function<void(ParsedSample)>& sample_callback,
+    const std::function<void(uint64_t)>& records_lost_callback) {
+  PerfRingBuffer::ReadableRange range = ring_buffer_.GetReadableRange();
+  uint64_t read_offset = range.read_offset;
+  uint64_t samples = 0;
+  while (read_offset < range.write_offset && samples < max_samples) {
+    char* event = ring_buffer_.RecordAt(read_offset);
     auto* event_hdr = reinterpret_cast<const perf_event_header*>(event);
 
+    read_offset += event_hdr->size;
+
     if (event_hdr->type == PERF_RECORD_SAMPLE) {
-      ParsedSample sample = ParseSampleRecord(cpu_, event);
-      ring_buffer_.Consume(event_hdr->size);
-      return base::make_optional(std::move(sample));
+      sample_callback(ParseSampleRecord(cpu_, event));
+      samples++;
+      continue;
     }
 
     if (event_hdr->type == PERF_RECORD_LOST) {
@@ -274,21 +299,21 @@ base::Optional<ParsedSample> EventReader::ReadUntilSample(
           event + sizeof(perf_event_header) + sizeof(uint64_t));
 
       records_lost_callback(records_lost);
-      ring_buffer_.Consume(event_hdr->size);
-      continue;  // keep looking for a sample
+      continue;  // keep looking for samples
     }
 
     // Kernel had to throttle irqs.
     if (event_hdr->type == PERF_RECORD_THROTTLE ||
         event_hdr->type == PERF_RECORD_UNTHROTTLE) {
-      ring_buffer_.Consume(event_hdr->size);
-      continue;  // keep looking for a sample
+      continue;  // keep looking for samples
     }
 
     PERFETTO_DFATAL_OR_ELOG("Unsupported event type [%zu]",
                             static_cast<size_t>(event_hdr->type));
-    ring_buffer_.Consume(event_hdr->size);
   }
+  if (read_offset != range.read_offset)
+    ring_buffer_.ConsumeUpTo(read_offset);
+  return read_offset == range.write_offset;
 }
 
 // Generally, samples can belong to any cpu (which can be recorded with
@@ -337,6 +362,11 @@ ParsedSample EventReader::ParseSampleRecord(uint32_t cpu,
     sample.kernel_ips.resize(static_cast<size_t>(chain_len));
     parse_pos = ReadValues<uint64_t>(sample.kernel_ips.data(), parse_pos,
                                      static_cast<size_t>(chain_len));
+
+    // If the kernel was also asked to unwind the userspace stack (via frame
+    // pointers), split off the userspace part of the callchain.
+    if (!event_attr_.exclude_callchain_user)
+      SplitUserCallchain(&sample.kernel_ips, &sample.user_ips);
   }
 
   if (event_attr_.sample_type & PERF_SAMPLE_REGS_USER) {
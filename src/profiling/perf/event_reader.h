@@ -22,6 +22,8 @@
 #include <sys/mman.h>
 #include <sys/types.h>
 
+#include <vector>
+
 #include "perfetto/ext/base/optional.h"
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/tracing/core/basic_types.h"
@@ -44,8 +46,18 @@ class PerfRingBuffer {
   PerfRingBuffer(PerfRingBuffer&& other) noexcept;
   PerfRingBuffer& operator=(PerfRingBuffer&& other) noexcept;
 
-  char* ReadRecordNonconsuming();
-  void Consume(size_t bytes);
+  // Batched reading: |GetReadableRange| loads the kernel's write position once,
+  // and returns the offsets of all unconsumed records. Records within the
+  // range are accessed with |RecordAt|, which returns a contiguous pointer
+  // that is valid until the next call. The whole batch is then released with
+  // a single |ConsumeUpTo|.
+  struct ReadableRange {
+    uint64_t read_offset;
+    uint64_t write_offset;
+  };
+  ReadableRange GetReadableRange();
+  char* RecordAt(uint64_t offset);
+  void ConsumeUpTo(uint64_t offset);
 
  private:
   PerfRingBuffer() = default;
@@ -79,17 +91,22 @@ class EventReader {
       uint32_t cpu,
       const EventConfig& event_cfg);
 
-  // Consumes records from the ring buffer until either encountering a sample,
-  // or catching up to the writer. The other record of interest
-  // (PERF_RECORD_LOST) is handled via the given callback.
-  base::Optional<ParsedSample> ReadUntilSample(
-      std::function<void(uint64_t)> lost_events_callback);
+  // Consumes the records that are in the ring buffer at the time of the call,
+  // stopping early after |max_samples| samples. Samples are parsed in place
+  // and passed to |sample_callback|, and the consumed position is published to
+  // the kernel once for the whole batch. The other record of interest
+  // (PERF_RECORD_LOST) is handled via |lost_events_callback|. Returns true if
+  // the reader caught up with the writer.
+  bool ReadBatch(uint64_t max_samples,
+                 const std::function<void(ParsedSample)>& sample_callback,
+                 const std::function<void(uint64_t)>& lost_events_callback);
 
   void EnableEvents();
   // Pauses the event counting, without invalidating existing samples.
   void DisableEvents();
 
   uint32_t cpu() const { return cpu_; }
+  int perf_fd() const { return perf_fd_.get(); }
 
   ~EventReader() = default;
 
@@ -114,6 +131,13 @@ class EventReader {
   PerfRingBuffer ring_buffer_;
 };
 
+// The callchain consists of sections of addresses, each preceded by a context
+// marker (PERF_CONTEXT_KERNEL, PERF_CONTEXT_USER, ...). Moves the addresses
+// of the userspace section (without the marker) into |user_ips|, leaving the
+// kernel section in |ips|. Exposed for testing.
+void SplitUserCallchain(std::vector<uint64_t>* ips,
+                        std::vector<uint64_t>* user_ips);
+
 }  // namespace profiling
 }  // namespace perfetto
 
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/profiling/perf/event_reader.h"
+
+#include <linux/perf_event.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+constexpr uint64_t kContextKernel = static_cast<uint64_t>(PERF_CONTEXT_KERNEL);
+constexpr uint64_t kContextUser = static_cast<uint64_t>(PERF_CONTEXT_USER);
+constexpr uint64_t kContextGuest = static_cast<uint64_t>(PERF_CONTEXT_GUEST);
+
+TEST(SplitUserCallchainTest, KernelAndUser) {
+  std::vector<uint64_t> ips{kContextKernel, 0x10, 0x20, kContextUser, 0x30,
+                            0x40};
+  std::vector<uint64_t> user_ips;
+  SplitUserCallchain(&ips, &user_ips);
+  EXPECT_THAT(ips, ElementsAre(kContextKernel, 0x10, 0x20));
+  EXPECT_THAT(user_ips, ElementsAre(0x30, 0x40));
+}
+
+TEST(SplitUserCallchainTest, UserOnly) {
+  std::vector<uint64_t> ips{kContextUser, 0x30};
+  std::vector<uint64_t> user_ips;
+  SplitUserCallchain(&ips, &user_ips);
+  EXPECT_THAT(ips, IsEmpty());
+  EXPECT_THAT(user_ips, ElementsAre(0x30));
+}
+
+TEST(SplitUserCallchainTest, KernelOnly) {
+  std::vector<uint64_t> ips{kContextKernel, 0x10};
+  std::vector<uint64_t> user_ips;
+  SplitUserCallchain(&ips, &user_ips);
+  EXPECT_THAT(ips, ElementsAre(kContextKernel, 0x10));
+  EXPECT_THAT(user_ips, IsEmpty());
+}
+
+TEST(SplitUserCallchainTest, EmptyUserSection) {
+  std::vector<uint64_t> ips{kContextKernel, 0x10, kContextUser};
+  std::vector<uint64_t> user_ips;
+  SplitUserCallchain(&ips, &user_ips);
+  EXPECT_THAT(ips, ElementsAre(kContextKernel, 0x10));
+  EXPECT_THAT(user_ips, IsEmpty());
+}
+
+TEST(SplitUserCallchainTest, StopsAtNextContext) {
+  std::vector<uint64_t> ips{kContextUser, 0x30, kContextGuest, 0x50};
+  std::vector<uint64_t> user_ips;
+  SplitUserCallchain(&ips, &user_ips);
+  EXPECT_THAT(ips, IsEmpty());
+  EXPECT_THAT(user_ips, ElementsAre(0x30));
+}
+
+}  // namespace
+}  // namespace profiling
+}  // namespace perfetto
@@ -42,6 +42,7 @@
 #include "src/profiling/common/unwind_support.h"
 #include "src/profiling/perf/common_types.h"
 #include "src/profiling/perf/event_reader.h"
+#include "src/profiling/perf/reader_thread.h"
 
 #include "protos/perfetto/common/builtin_clock.pbzero.h"
 #include "protos/perfetto/common/perf_events.gen.h"
@@ -421,6 +422,25 @@ void PerfProducer::StartDataSource(DataSourceInstanceID ds_id,
   PERFETTO_CHECK(inserted);
   DataSourceState& ds = ds_it->second;
 
+  // Optionally, hand the kernel buffers over to dedicated reader threads.
+  // They wake up the main thread once they've parsed some samples.
+  auto weak_this = weak_factory_.GetWeakPtr();
+  if (ds.event_config.reader_threads()) {
+    base::TaskRunner* task_runner = task_runner_;
+    auto samples_available = [weak_this, task_runner, ds_id] {
+      task_runner->PostTask([weak_this, ds_id] {
+        if (weak_this)
+          weak_this->DrainReaderThreads(ds_id);
+      });
+    };
+    for (auto& per_cpu_reader : ds.per_cpu_readers) {
+      ds.reader_threads.emplace_back(std::unique_ptr<PerCpuReaderThread>(
+          new PerCpuReaderThread(&per_cpu_reader,
+                                 ds.event_config.read_tick_period_ms(),
+                                 samples_available)));
+    }
+  }
+
   // Start the configured events.
   for (auto& per_cpu_reader : ds.per_cpu_readers) {
     per_cpu_reader.EnableEvents();
@@ -443,7 +463,6 @@ void PerfProducer::StartDataSource(DataSourceInstanceID ds_id,
 
   // Kick off periodic read task.
   auto tick_period_ms = ds.event_config.read_tick_period_ms();
-  auto weak_this = weak_factory_.GetWeakPtr();
   task_runner_->PostDelayedTask(
       [weak_this, ds_id] {
         if (weak_this)
@@ -587,10 +606,20 @@ void PerfProducer::TickDataSourceRead(DataSourceInstanceID ds_id) {
 
   PERFETTO_METATRACE_SCOPED(TAG_PRODUCER, PROFILER_READ_TICK);
 
-  // Make a pass over all per-cpu readers.
+  // Make a pass over all per-cpu readers. If the buffers are being drained by
+  // reader threads, take the samples they've already parsed instead. Their
+  // wakeups normally do this sooner, the periodic task is only a backstop.
   uint64_t max_samples = ds.event_config.samples_per_tick_limit();
   bool more_records_available = false;
-  for (EventReader& reader : ds.per_cpu_readers) {
+  for (size_t i = 0; i < ds.per_cpu_readers.size(); i++) {
+    PerCpuReaderThread* thread =
+        ds.reader_threads.empty() ? nullptr : ds.reader_threads[i].get();
+    if (thread)
+      DrainReaderThread(thread, ds_id, &ds);
+    if (thread && !thread->stopped())
+      continue;
+
+    EventReader& reader = ds.per_cpu_readers[i];
     if (ReadAndParsePerCpuBuffer(&reader, max_samples, ds_id, &ds)) {
       more_records_available = true;
     }
@@ -631,138 +660,168 @@ bool PerfProducer::ReadAndParsePerCpuBuffer(EventReader* reader,
     });
   };
 
-  for (uint64_t i = 0; i < max_samples; i++) {
-    base::Optional<ParsedSample> sample =
-        reader->ReadUntilSample(records_lost_callback);
-    if (!sample) {
-      return false;  // caught up to the writer
-    }
+  bool caught_up = reader->ReadBatch(
+      max_samples,
+      [this, ds_id, ds](ParsedSample sample) {
+        HandleParsedSample(ds_id, ds, std::move(sample));
+      },
+      records_lost_callback);
 
-    // Counter-only mode: skip the unwinding stage, serialise the sample
-    // immediately.
-    const EventConfig& event_config = ds->event_config;
-    if (!event_config.sample_callstacks()) {
-      CompletedSample output;
-      output.common = sample->common;
-      EmitSample(ds_id, std::move(output));
-      continue;
-    }
+  // If we stopped due to |max_samples|, there are most likely more events in
+  // the kernel buffer. Though we might be exactly on the boundary.
+  return !caught_up;
+}
 
-    // Sampling either or both of userspace and kernel callstacks.
-    pid_t pid = sample->common.pid;
-    auto& process_state = ds->process_states[pid];  // insert if new
+void PerfProducer::DrainReaderThreads(DataSourceInstanceID ds_id) {
+  auto it = data_sources_.find(ds_id);
+  if (it == data_sources_.end())
+    return;
+  DataSourceState& ds = it->second;
 
-    // Asynchronous proc-fd lookup timed out.
-    if (process_state == ProcessTrackingStatus::kFdsTimedOut) {
-      PERFETTO_DLOG("Skipping sample for pid [%d]: kFdsTimedOut",
-                    static_cast<int>(pid));
-      EmitSkippedSample(ds_id, std::move(sample.value()),
-                        SampleSkipReason::kReadStage);
-      continue;
-    }
+  for (auto& thread : ds.reader_threads)
+    DrainReaderThread(thread.get(), ds_id, &ds);
+  unwinding_worker_->PostProcessQueue();
+}
 
-    // Previously excluded, e.g. due to failing the target filter check.
-    if (process_state == ProcessTrackingStatus::kRejected) {
-      PERFETTO_DLOG("Skipping sample for pid [%d]: kRejected",
-                    static_cast<int>(pid));
-      continue;
-    }
+void PerfProducer::DrainReaderThread(PerCpuReaderThread* thread,
+                                     DataSourceInstanceID ds_id,
+                                     DataSourceState* ds) {
+  PERFETTO_METATRACE_SCOPED(TAG_PRODUCER, PROFILER_READ_CPU);
 
-    // Seeing pid for the first time. We need to consider whether the process
-    // is a kernel thread, and which callstacks we're recording.
-    //
-    // {user} stacks -> user processes: signal for proc-fd lookup
-    //               -> kthreads: reject
-    //
-    // {kernel} stacks -> user processes: accept without proc-fds
-    //                 -> kthreads: accept without proc-fds
-    //
-    // {kernel+user} stacks -> user processes: signal for proc-fd lookup
-    //                      -> kthreads: accept without proc-fds
-    //
-    if (process_state == ProcessTrackingStatus::kInitial) {
-      PERFETTO_DLOG("New pid: [%d]", static_cast<int>(pid));
-
-      // Kernel threads (which have no userspace state) are never relevant if
-      // we're not recording kernel callchains.
-      bool is_kthread = !sample->regs;  // no userspace regs
-      if (is_kthread && !event_config.kernel_frames()) {
-        process_state = ProcessTrackingStatus::kRejected;
-        continue;
-      }
+  uint64_t records_lost = thread->TakeRecordsLost();
+  if (records_lost)
+    EmitRingBufferLoss(ds_id, thread->cpu(), records_lost);
 
-      // Check whether samples for this new process should be dropped due to
-      // the target filtering. Kernel threads don't have a cmdline, but we
-      // still check against pid inclusion/exclusion.
-      if (ShouldRejectDueToFilter(
-              pid, event_config.filter(), is_kthread, &ds->additional_cmdlines,
-              [pid](std::string* cmdline) {
-                return glob_aware::ReadProcCmdlineForPID(pid, cmdline);
-              })) {
-        process_state = ProcessTrackingStatus::kRejected;
-        continue;
-      }
+  thread->DrainSamples([this, ds_id, ds](ParsedSample sample) {
+    HandleParsedSample(ds_id, ds, std::move(sample));
+  });
+}
 
-      // At this point, sampled process is known to be of interest.
-      if (!is_kthread && event_config.user_frames()) {
-        // Start resolving the proc-fds. Response is async.
-        process_state = ProcessTrackingStatus::kFdsResolving;
-        InitiateDescriptorLookup(ds_id, pid,
-                                 event_config.remote_descriptor_timeout_ms());
-        // note: fallthrough
-      } else {
-        // Either a kernel thread (no need to obtain proc-fds), or a userspace
-        // process but we're not recording userspace callstacks.
-        process_state = ProcessTrackingStatus::kAccepted;
-        unwinding_worker_->PostRecordNoUserspaceProcess(ds_id, pid);
-        // note: fallthrough
-      }
-    }
+void PerfProducer::HandleParsedSample(DataSourceInstanceID ds_id,
+                                      DataSourceState* ds,
+                                      ParsedSample sample) {
+  // Counter-only mode: skip the unwinding stage, serialise the sample
+  // immediately.
+  const EventConfig& event_config = ds->event_config;
+  if (!event_config.sample_callstacks()) {
+    CompletedSample output;
+    output.common = sample.common;
+    EmitSample(ds_id, std::move(output));
+    return;
+  }
 
-    PERFETTO_CHECK(process_state == ProcessTrackingStatus::kAccepted ||
-                   process_state == ProcessTrackingStatus::kFdsResolving);
+  // Sampling either or both of userspace and kernel callstacks.
+  pid_t pid = sample.common.pid;
+  auto& process_state = ds->process_states[pid];  // insert if new
 
-    // If we're only interested in the kernel callchains, then userspace
-    // process samples are relevant only if they were sampled during kernel
-    // context.
-    if (!event_config.user_frames() &&
-        sample->common.cpu_mode == PERF_RECORD_MISC_USER) {
-      PERFETTO_DLOG("Skipping usermode sample for kernel-only config");
-      continue;
+  // Asynchronous proc-fd lookup timed out.
+  if (process_state == ProcessTrackingStatus::kFdsTimedOut) {
+    PERFETTO_DLOG("Skipping sample for pid [%d]: kFdsTimedOut",
+                  static_cast<int>(pid));
+    EmitSkippedSample(ds_id, std::move(sample), SampleSkipReason::kReadStage);
+    return;
+  }
+
+  // Previously excluded, e.g. due to failing the target filter check.
+  if (process_state == ProcessTrackingStatus::kRejected) {
+    PERFETTO_DLOG("Skipping sample for pid [%d]: kRejected",
+                  static_cast<int>(pid));
+    return;
+  }
+
+  // Seeing pid for the first time. We need to consider whether the process
+  // is a kernel thread, and which callstacks we're recording.
+  //
+  // {user} stacks -> user processes: signal for proc-fd lookup
+  //               -> kthreads: reject
+  //
+  // {kernel} stacks -> user processes: accept without proc-fds
+  //                 -> kthreads: accept without proc-fds
+  //
+  // {kernel+user} stacks -> user processes: signal for proc-fd lookup
+  //                      -> kthreads: accept without proc-fds
+  //
+  if (process_state == ProcessTrackingStatus::kInitial) {
+    PERFETTO_DLOG("New pid: [%d]", static_cast<int>(pid));
+
+    // Kernel threads (which have no userspace state) are never relevant if
+    // we're not recording kernel callchains. With frame pointer unwinding,
+    // the userspace registers aren't sampled, but the kernel only returns a
+    // userspace callchain for processes that have one.
+    bool is_kthread = event_config.frame_pointer_unwinding()
+                          ? sample.user_ips.empty()
+                          : !sample.regs;  // no userspace regs
+    if (is_kthread && !event_config.kernel_frames()) {
+      process_state = ProcessTrackingStatus::kRejected;
+      return;
     }
 
-    // Optionally: drop sample if above a given threshold of sampled stacks
-    // that are waiting in the unwinding queue.
-    uint64_t max_footprint_bytes = event_config.max_enqueued_footprint_bytes();
-    uint64_t sample_stack_size = sample->stack.size();
-    if (max_footprint_bytes) {
-      uint64_t footprint_bytes = unwinding_worker_->GetEnqueuedFootprint();
-      if (footprint_bytes + sample_stack_size >= max_footprint_bytes) {
-        PERFETTO_DLOG("Skipping sample enqueueing due to footprint limit.");
-        EmitSkippedSample(ds_id, std::move(sample.value()),
-                          SampleSkipReason::kUnwindEnqueue);
-        continue;
-      }
+    // Check whether samples for this new process should be dropped due to
+    // the target filtering. Kernel threads don't have a cmdline, but we
+    // still check against pid inclusion/exclusion.
+    if (ShouldRejectDueToFilter(
+            pid, event_config.filter(), is_kthread, &ds->additional_cmdlines,
+            [pid](std::string* cmdline) {
+              return glob_aware::ReadProcCmdlineForPID(pid, cmdline);
+            })) {
+      process_state = ProcessTrackingStatus::kRejected;
+      return;
     }
 
-    // Push the sample into the unwinding queue if there is room.
-    auto& queue = unwinding_worker_->unwind_queue();
-    WriteView write_view = queue.BeginWrite();
-    if (write_view.valid) {
-      queue.at(write_view.write_pos) =
-          UnwindEntry{ds_id, std::move(sample.value())};
-      queue.CommitWrite();
-      unwinding_worker_->IncrementEnqueuedFootprint(sample_stack_size);
+    // At this point, sampled process is known to be of interest.
+    if (!is_kthread && event_config.user_frames()) {
+      // Start resolving the proc-fds. Response is async.
+      process_state = ProcessTrackingStatus::kFdsResolving;
+      InitiateDescriptorLookup(ds_id, pid,
+                               event_config.remote_descriptor_timeout_ms());
+      // note: fallthrough
     } else {
-      PERFETTO_DLOG("Unwinder queue full, skipping sample");
-      EmitSkippedSample(ds_id, std::move(sample.value()),
+      // Either a kernel thread (no need to obtain proc-fds), or a userspace
+      // process but we're not recording userspace callstacks.
+      process_state = ProcessTrackingStatus::kAccepted;
+      unwinding_worker_->PostRecordNoUserspaceProcess(ds_id, pid);
+      // note: fallthrough
+    }
+  }
+
+  PERFETTO_CHECK(process_state == ProcessTrackingStatus::kAccepted ||
+                 process_state == ProcessTrackingStatus::kFdsResolving);
+
+  // If we're only interested in the kernel callchains, then userspace
+  // process samples are relevant only if they were sampled during kernel
+  // context.
+  if (!event_config.user_frames() &&
+      sample.common.cpu_mode == PERF_RECORD_MISC_USER) {
+    PERFETTO_DLOG("Skipping usermode sample for kernel-only config");
+    return;
+  }
+
+  // Optionally: drop sample if above a given threshold of sampled stacks
+  // that are waiting in the unwinding queue.
+  uint64_t max_footprint_bytes = event_config.max_enqueued_footprint_bytes();
+  uint64_t sample_stack_size = sample.stack.size();
+  if (max_footprint_bytes) {
+    uint64_t footprint_bytes = unwinding_worker_->GetEnqueuedFootprint();
+    if (footprint_bytes + sample_stack_size >= max_footprint_bytes) {
+      PERFETTO_DLOG("Skipping sample enqueueing due to footprint limit.");
+      EmitSkippedSample(ds_id, std::move(sample),
                         SampleSkipReason::kUnwindEnqueue);
+      return;
     }
-  }  // for (i < max_samples)
+  }
 
-  // Most likely more events in the kernel buffer. Though we might be exactly on
-  // the boundary due to |max_samples|.
-  return true;
+  // Push the sample into the unwinding queue if there is room.
+  auto& queue = unwinding_worker_->unwind_queue();
+  WriteView write_view = queue.BeginWrite();
+  if (write_view.valid) {
+    queue.at(write_view.write_pos) = UnwindEntry{ds_id, std::move(sample)};
+    queue.CommitWrite();
+    unwinding_worker_->IncrementEnqueuedFootprint(sample_stack_size);
+  } else {
+    PERFETTO_DLOG("Unwinder queue full, skipping sample");
+    EmitSkippedSample(ds_id, std::move(sample),
+                      SampleSkipReason::kUnwindEnqueue);
+  }
 }
 
 // Note: first-fit makes descriptor request fulfillment not true FIFO. But the
@@ -1002,6 +1061,11 @@ void PerfProducer::InitiateReaderStop(DataSourceState* ds) {
   for (auto& event_reader : ds->per_cpu_readers) {
     event_reader.DisableEvents();
   }
+  // The remaining records are read by the periodic read task, directly from
+  // the kernel buffers.
+  for (auto& reader_thread : ds->reader_threads) {
+    reader_thread->Stop();
+  }
 }
 
 void PerfProducer::PostFinishDataSourceStop(DataSourceInstanceID ds_id) {
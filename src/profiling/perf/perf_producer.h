@@ -41,6 +41,7 @@
 #include "src/profiling/perf/event_config.h"
 #include "src/profiling/perf/event_reader.h"
 #include "src/profiling/perf/proc_descriptors.h"
+#include "src/profiling/perf/reader_thread.h"
 #include "src/profiling/perf/unwinding.h"
 #include "src/tracing/core/metatrace_writer.h"
 // TODO(rsavitski): move to e.g. src/tracefs/.
@@ -53,7 +54,9 @@ namespace profiling {
 // summary in the mean time: three stages: (1) kernel buffer reader that parses
 // the samples -> (2) callstack unwinder -> (3) interning and serialization of
 // samples. This class handles stages (1) and (3) on the main thread. Unwinding
-// is done by |Unwinder| on a dedicated thread.
+// is done by |Unwinder| on a dedicated thread. Optionally, the kernel buffers
+// are instead drained by per-cpu |PerCpuReaderThread|s, with the main thread
+// only filtering their parsed samples before handing them to the unwinder.
 class PerfProducer : public Producer,
                      public ProcDescriptorDelegate,
                      public Unwinder::Delegate {
@@ -158,6 +161,9 @@ class PerfProducer : public Producer,
     std::unique_ptr<TraceWriter> trace_writer;
     // Indexed by cpu, vector never resized.
     std::vector<EventReader> per_cpu_readers;
+    // If using reader threads, indexed by cpu. Must be destroyed (joined)
+    // before |per_cpu_readers|.
+    std::vector<std::unique_ptr<PerCpuReaderThread>> reader_threads;
     // Tracks the incremental state for interned entries.
     InterningOutputTracker interning_output;
     // Producer thread's view of sampled processes. This is the primary tracking
@@ -194,6 +200,16 @@ class PerfProducer : public Producer,
                                 uint64_t max_samples,
                                 DataSourceInstanceID ds_id,
                                 DataSourceState* ds);
+  // Takes the samples already parsed by the data source's reader threads.
+  void DrainReaderThreads(DataSourceInstanceID ds_id);
+  void DrainReaderThread(PerCpuReaderThread* thread,
+                         DataSourceInstanceID ds_id,
+                         DataSourceState* ds);
+  // Filters a parsed sample, and pushes it into the unwinding queue (or emits
+  // it directly if it doesn't need unwinding).
+  void HandleParsedSample(DataSourceInstanceID ds_id,
+                          DataSourceState* ds,
+                          ParsedSample sample);
 
   void InitiateDescriptorLookup(DataSourceInstanceID ds_id,
                                 pid_t pid,
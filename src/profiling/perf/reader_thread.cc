@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/profiling/perf/reader_thread.h"
+
+#include <inttypes.h>
+#include <poll.h>
+
+#include <string>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/thread_utils.h"
+#include "perfetto/ext/base/utils.h"
+
+namespace perfetto {
+namespace profiling {
+
+PerCpuReaderThread::PerCpuReaderThread(
+    EventReader* reader,
+    uint32_t poll_timeout_ms,
+    std::function<void()> samples_available_callback)
+    : reader_(reader),
+      poll_timeout_ms_(poll_timeout_ms),
+      samples_available_callback_(std::move(samples_available_callback)),
+      thread_(&PerCpuReaderThread::Run, this) {}
+
+PerCpuReaderThread::~PerCpuReaderThread() {
+  Stop();
+}
+
+void PerCpuReaderThread::Stop() {
+  if (!thread_.joinable())
+    return;
+  stop_event_.Notify();
+  thread_.join();
+}
+
+void PerCpuReaderThread::Run() {
+  base::MaybeSetThreadName("perf-reader-" + std::to_string(cpu()));
+
+  struct pollfd fds[2] = {};
+  fds[0].fd = reader_->perf_fd();
+  fds[0].events = POLLIN;
+  fds[1].fd = stop_event_.fd();
+  fds[1].events = POLLIN;
+
+  for (;;) {
+    int ret =
+        PERFETTO_EINTR(poll(fds, 2, static_cast<int>(poll_timeout_ms_)));
+    if (ret < 0) {
+      PERFETTO_PLOG("poll() failed on perf reader thread for cpu%" PRIu32,
+                    cpu());
+      return;
+    }
+    if (fds[1].revents)
+      return;  // stop requested
+
+    // Either the watermark was reached, or the timeout expired. In the latter
+    // case there might still be records below the watermark.
+    ReadAvailableRecords();
+  }
+}
+
+void PerCpuReaderThread::ReadAvailableRecords() {
+  uint64_t samples_pushed = 0;
+  auto push_sample = [this, &samples_pushed](ParsedSample sample) {
+    WriteView write_view = queue_.BeginWrite();
+    PERFETTO_CHECK(write_view.valid);  // bounded by WriteCapacity()
+    queue_.at(write_view.write_pos) = std::move(sample);
+    queue_.CommitWrite();
+    samples_pushed++;
+  };
+  auto records_lost = [this](uint64_t count) {
+    records_lost_.fetch_add(count, std::memory_order_relaxed);
+  };
+
+  for (;;) {
+    // If the main thread is falling behind, leave the remaining records in the
+    // kernel buffer. Sampling will be throttled by the kernel as the buffer
+    // fills up, which is reported as lost records.
+    uint64_t capacity = queue_.WriteCapacity();
+    if (capacity == 0)
+      break;
+    if (reader_->ReadBatch(capacity, push_sample, records_lost))
+      break;  // caught up with the writer
+  }
+
+  if (samples_pushed && !wakeup_pending_.exchange(true))
+    samples_available_callback_();
+}
+
+void PerCpuReaderThread::DrainSamples(
+    const std::function<void(ParsedSample)>& sample_callback) {
+  // Reset before reading the queue, so that any samples pushed after the read
+  // below cause a new wakeup.
+  wakeup_pending_.store(false);
+
+  ReadView read_view = queue_.BeginRead();
+  for (uint64_t pos = read_view.read_pos; pos < read_view.write_pos; pos++)
+    sample_callback(std::move(queue_.at(pos)));
+  queue_.CommitNewReadPosition(read_view.write_pos);
+}
+
+}  // namespace profiling
+}  // namespace perfetto
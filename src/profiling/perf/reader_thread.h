@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_PROFILING_PERF_READER_THREAD_H_
+#define SRC_PROFILING_PERF_READER_THREAD_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <thread>
+
+#include "perfetto/ext/base/event_fd.h"
+#include "src/profiling/perf/common_types.h"
+#include "src/profiling/perf/event_reader.h"
+#include "src/profiling/perf/unwind_queue.h"
+
+namespace perfetto {
+namespace profiling {
+
+// Drains a single per-cpu kernel ring buffer on a dedicated thread. The thread
+// blocks on the perf_event fd until the kernel signals that the buffer has
+// reached its wakeup watermark (or |poll_timeout_ms| elapses), parses all
+// available records in batches, and hands the samples over to the producer's
+// main thread via a single-writer single-reader queue.
+//
+// The |EventReader| is owned by the caller, but must only be read by this
+// thread until |Stop| returns. Afterwards, the caller can read any remaining
+// records directly.
+class PerCpuReaderThread {
+ public:
+  static constexpr uint32_t kQueueSize = 512;
+
+  // |samples_available_callback| is called on the reader thread once new
+  // samples become available, and isn't called again until the main thread
+  // has drained the queue via |DrainSamples|.
+  PerCpuReaderThread(EventReader* reader,
+                     uint32_t poll_timeout_ms,
+                     std::function<void()> samples_available_callback);
+  ~PerCpuReaderThread();
+
+  PerCpuReaderThread(const PerCpuReaderThread&) = delete;
+  PerCpuReaderThread& operator=(const PerCpuReaderThread&) = delete;
+
+  // Main thread: passes all queued samples to |sample_callback|, in the order
+  // that they were read.
+  void DrainSamples(const std::function<void(ParsedSample)>& sample_callback);
+
+  // Main thread: returns the number of records that the kernel reported as
+  // lost since the previous call.
+  uint64_t TakeRecordsLost() {
+    return records_lost_.exchange(0, std::memory_order_relaxed);
+  }
+
+  // Wakes up and joins the reader thread. Samples that are already queued
+  // can still be drained afterwards.
+  void Stop();
+  bool stopped() const { return !thread_.joinable(); }
+
+  uint32_t cpu() const { return reader_->cpu(); }
+
+ private:
+  void Run();
+  // Reads until either catching up with the kernel, or filling the queue.
+  void ReadAvailableRecords();
+
+  EventReader* const reader_;
+  const uint32_t poll_timeout_ms_;
+  const std::function<void()> samples_available_callback_;
+
+  UnwindQueue<ParsedSample, kQueueSize> queue_;
+  std::atomic<bool> wakeup_pending_{false};
+  std::atomic<uint64_t> records_lost_{0};
+  base::EventFd stop_event_;
+
+  std::thread thread_;  // keep last, started by the constructor
+};
+
+}  // namespace profiling
+}  // namespace perfetto
+
+#endif  // SRC_PROFILING_PERF_READER_THREAD_H_
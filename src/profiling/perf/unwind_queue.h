@@ -70,6 +70,16 @@ class UnwindQueue {
 
   void CommitWrite() { wr_pos_.fetch_add(1u, std::memory_order_release); }
 
+  // Writer side: number of entries that can be written before the buffer is
+  // fully occupied. Can only grow concurrently, as the reader consumes entries.
+  uint64_t WriteCapacity() {
+    uint64_t rd = rd_pos_.load(std::memory_order_acquire);
+    uint64_t wr = wr_pos_.load(std::memory_order_relaxed);
+
+    PERFETTO_DCHECK(wr >= rd && wr - rd <= QueueSize);
+    return QueueSize - (wr - rd);
+  }
+
   ReadView BeginRead() {
     uint64_t wr = wr_pos_.load(std::memory_order_acquire);
     uint64_t rd = rd_pos_.load(std::memory_order_relaxed);
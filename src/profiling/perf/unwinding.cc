@@ -112,8 +112,10 @@ void Unwinder::AdoptProcDescriptors(DataSourceInstanceID ds_id,
   PERFETTO_METATRACE_SCOPED(TAG_PRODUCER, PROFILER_MAPS_PARSE);
 
   proc_state.status = ProcessState::Status::kFdsResolved;
-  proc_state.unwind_state =
-      UnwindingMetadata{std::move(maps_fd), std::move(mem_fd)};
+  // libunwindstack's own Elf cache, which is reset periodically, is used
+  // instead of heapprofd's ElfCache.
+  proc_state.unwind_state = UnwindingMetadata{
+      std::move(maps_fd), std::move(mem_fd), /*elf_cache=*/nullptr};
 }
 
 void Unwinder::PostRecordTimedOutProcDescriptors(DataSourceInstanceID ds_id,
@@ -330,6 +332,14 @@ CompletedSample Unwinder::UnwindSample(const ParsedSample& sample,
   if (!opt_user_state)
     return ret;
 
+  // Userspace stack already unwound by the kernel, using frame pointers. The
+  // registers are not sampled in this mode, so there is nothing else to do if
+  // the callchain is empty.
+  if (!sample.user_ips.empty() || !sample.regs) {
+    SymbolizeUserCallchain(sample, opt_user_state, &ret);
+    return ret;
+  }
+
   // Overlay the stack bytes over /proc/<pid>/mem.
   UnwindingMetadata* unwind_state = opt_user_state;
   std::shared_ptr<unwindstack::Memory> overlay_memory =
@@ -578,5 +588,57 @@ void Unwinder::ResetAndEnableUnwindstackCache() {
   unwindstack::Elf::SetCachingEnabled(true);   // reallocate a fresh cache
 }
 
+void SymbolizeUserCallchain(const ParsedSample& sample,
+                            UnwindingMetadata* unwind_state,
+                            CompletedSample* ret) {
+  unwindstack::JitDebug* jit_debug = nullptr;
+#if PERFETTO_BUILDFLAG(PERFETTO_ANDROID_BUILD)
+  jit_debug = unwind_state->GetJitDebug(unwindstack::Regs::CurrentArch());
+#endif
+
+  // Returns true if all addresses were found in the parsed maps.
+  auto build_frames = [&sample, unwind_state, jit_debug](
+                          std::vector<unwindstack::FrameData>* frames) {
+    bool all_mapped = true;
+    frames->clear();
+    frames->reserve(sample.user_ips.size());
+    for (size_t i = 0; i < sample.user_ips.size(); i++) {
+      // All but the leaf frame are return addresses, which can point past the
+      // end of the calling function. Look up the call instruction instead.
+      uint64_t pc = sample.user_ips[i];
+      if (i > 0 && pc > 0)
+        pc--;
+      unwindstack::FrameData frame =
+          unwindstack::Unwinder::BuildFrameFromPcOnly(
+              pc, unwindstack::Regs::CurrentArch(), &unwind_state->fd_maps,
+              jit_debug, unwind_state->fd_mem, /*resolve_names=*/true);
+      frame.num = i;
+      all_mapped &= frame.map_info != nullptr;
+      frames->emplace_back(std::move(frame));
+    }
+    return all_mapped;
+  };
+
+  // As with libunwindstack unwinding, an address outside of the parsed
+  // mappings likely means that /proc/pid/maps has changed since. Reparse and
+  // try again.
+  std::vector<unwindstack::FrameData> frames;
+  if (!build_frames(&frames)) {
+    PERFETTO_METATRACE_SCOPED(TAG_PRODUCER, PROFILER_MAPS_REPARSE);
+    PERFETTO_DLOG("Reparsing maps for pid [%d]",
+                  static_cast<int>(sample.common.pid));
+    unwind_state->ReparseMaps();
+    build_frames(&frames);
+  }
+
+  ret->build_ids.reserve(ret->build_ids.size() + frames.size());
+  ret->frames.reserve(ret->frames.size() + frames.size());
+  for (unwindstack::FrameData& frame : frames) {
+    ret->build_ids.emplace_back(unwind_state->GetBuildId(frame));
+    ret->frames.emplace_back(std::move(frame));
+  }
+  PERFETTO_CHECK(ret->build_ids.size() == ret->frames.size());
+}
+
 }  // namespace profiling
 }  // namespace perfetto
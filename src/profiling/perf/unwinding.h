@@ -63,6 +63,10 @@ constexpr static uint32_t kUnwindQueueCapacity = 1024;
 // starving the rest of the producer's work (including IPC and consumption of
 // records from the kernel ring buffers).
 //
+// Unlike heapprofd's UnwindingWorkerPool, there is only one such thread: the
+// unwind queue has a single consumer, and all the per-process state of the
+// data sources is owned by this thread.
+//
 // This class should not be instantiated directly, use the |UnwinderHandle|
 // below instead.
 //
@@ -311,6 +315,13 @@ class UnwinderHandle {
   Unwinder* unwinder_ = nullptr;
 };
 
+// Maps and symbolizes the userspace callchain that was unwound by the kernel
+// (frame pointer unwinding mode), appending the frames to |ret|. Exposed for
+// testing.
+void SymbolizeUserCallchain(const ParsedSample& sample,
+                            UnwindingMetadata* unwind_state,
+                            CompletedSample* ret);
+
 }  // namespace profiling
 }  // namespace perfetto
 
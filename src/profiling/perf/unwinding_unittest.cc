@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/profiling/perf/unwinding.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+
+#include <unwindstack/Unwinder.h>
+
+#include "perfetto/ext/base/file_utils.h"
+#include "src/profiling/common/unwind_support.h"
+#include "src/profiling/perf/common_types.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+using ::testing::HasSubstr;
+
+__attribute__((noinline)) void UserCallchainLeaf() {
+  asm volatile("" ::: "memory");
+}
+
+__attribute__((noinline)) void UserCallchainCaller() {
+  UserCallchainLeaf();
+}
+
+UnwindingMetadata SelfUnwindingMetadata() {
+  return UnwindingMetadata(base::OpenFile("/proc/self/maps", O_RDONLY),
+                           base::OpenFile("/proc/self/mem", O_RDONLY),
+                           /*elf_cache=*/nullptr);
+}
+
+TEST(SymbolizeUserCallchainTest, SymbolizesOwnFunctions) {
+  UnwindingMetadata metadata = SelfUnwindingMetadata();
+  ParsedSample sample;
+  // The leaf frame is the sampled pc, the others are return addresses, which
+  // point after the call instruction.
+  sample.user_ips = {
+      reinterpret_cast<uint64_t>(&UserCallchainLeaf),
+      reinterpret_cast<uint64_t>(&UserCallchainCaller) + 1,
+  };
+
+  CompletedSample ret;
+  // Kernel frames come first, and are kept.
+  ret.frames.emplace_back();
+  ret.build_ids.emplace_back();
+  SymbolizeUserCallchain(sample, &metadata, &ret);
+
+  ASSERT_EQ(ret.frames.size(), 3u);
+  ASSERT_EQ(ret.build_ids.size(), 3u);
+  EXPECT_THAT(ret.frames[1].function_name, HasSubstr("UserCallchainLeaf"));
+  EXPECT_EQ(ret.frames[1].num, 0u);
+  EXPECT_THAT(ret.frames[2].function_name, HasSubstr("UserCallchainCaller"));
+  EXPECT_EQ(ret.frames[2].num, 1u);
+  EXPECT_EQ(metadata.reparses, 0u);
+}
+
+TEST(SymbolizeUserCallchainTest, UnmappedAddressReparsesMaps) {
+  UnwindingMetadata metadata = SelfUnwindingMetadata();
+  ParsedSample sample;
+  sample.user_ips = {
+      reinterpret_cast<uint64_t>(&UserCallchainLeaf),
+      // Never mapped.
+      0x10,
+  };
+
+  CompletedSample ret;
+  SymbolizeUserCallchain(sample, &metadata, &ret);
+
+  ASSERT_EQ(ret.frames.size(), 2u);
+  ASSERT_EQ(ret.build_ids.size(), 2u);
+  EXPECT_THAT(ret.frames[0].function_name, HasSubstr("UserCallchainLeaf"));
+  EXPECT_EQ(ret.frames[1].map_info, nullptr);
+  EXPECT_EQ(metadata.reparses, 1u);
+}
+
+TEST(SymbolizeUserCallchainTest, EmptyCallchain) {
+  UnwindingMetadata metadata = SelfUnwindingMetadata();
+  ParsedSample sample;
+
+  CompletedSample ret;
+  SymbolizeUserCallchain(sample, &metadata, &ret);
+
+  EXPECT_TRUE(ret.frames.empty());
+  EXPECT_TRUE(ret.build_ids.empty());
+  EXPECT_EQ(metadata.reparses, 0u);
+}
+
+}  // namespace
+}  // namespace profiling
+}  // namespace perfetto
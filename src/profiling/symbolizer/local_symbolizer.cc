@@ -41,7 +41,8 @@ namespace profiling {
 // dies, which isn't the case.
 std::unique_ptr<Symbolizer> LocalSymbolizerOrDie(
     std::vector<std::string> binary_path,
-    const char* mode) {
+    const char* mode,
+    const char* index_file) {
   std::unique_ptr<Symbolizer> symbolizer;
 
   if (!binary_path.empty()) {
@@ -50,12 +51,14 @@ std::unique_ptr<Symbolizer> LocalSymbolizerOrDie(
     if (!mode || strncmp(mode, "find", 4) == 0)
       finder.reset(new LocalBinaryFinder(std::move(binary_path)));
     else if (strncmp(mode, "index", 5) == 0)
-      finder.reset(new LocalBinaryIndexer(std::move(binary_path)));
+      finder.reset(new LocalBinaryIndexer(std::move(binary_path),
+                                          index_file ? index_file : ""));
     else
       PERFETTO_FATAL("Invalid symbolizer mode [find | index]: %s", mode);
     symbolizer.reset(new LocalSymbolizer(std::move(finder)));
 #else
     base::ignore_result(mode);
+    base::ignore_result(index_file);
     PERFETTO_FATAL("This build does not support local symbolization.");
 #endif
   }
@@ -71,9 +74,13 @@ std::unique_ptr<Symbolizer> LocalSymbolizerOrDie(
 #include "perfetto/ext/base/utils.h"
 
 #include <signal.h>
+#include <stdio.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <algorithm>
+#include <thread>
+
 #if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
 constexpr const char* kDefaultSymbolizer = "llvm-symbolizer.exe";
 #else
@@ -116,6 +123,14 @@ std::vector<std::string> GetLines(
 }
 
 namespace {
+
+// Addresses below which a batch is not worth splitting across processes.
+constexpr size_t kMinAddressesPerProcess = 64;
+constexpr size_t kMaxSymbolizerProcesses = 8;
+
+// v2 stores the modification times in nanoseconds rather than seconds.
+constexpr char kIndexFileHeader[] = "perfetto-binary-index-v2";
+
 bool InRange(const void* base,
              size_t total_size,
              const void* ptr,
@@ -275,8 +290,126 @@ bool StartsWithElfMagic(const std::string& fname) {
   return true;
 }
 
-std::map<std::string, FoundBinary> BuildIdIndex(std::vector<std::string> dirs) {
+// A file seen by LocalBinaryIndexer. Files that are not ELF files, or have no
+// build id, have an empty |build_id|, so they are not read again either.
+struct IndexedFile {
+  int64_t mtime_ns;
+  uint64_t size;
+  std::string build_id;
+  uint64_t load_bias;
+};
+
+// With a resolution of a second, a file rewritten right after it was indexed
+// would look unchanged.
+int64_t GetMtimeNs(const struct stat& st) {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+  return static_cast<int64_t>(st.st_mtime) * 1000000000;
+#elif PERFETTO_BUILDFLAG(PERFETTO_OS_APPLE)
+  return static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 +
+         static_cast<int64_t>(st.st_mtimespec.tv_nsec);
+#else
+  return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+         static_cast<int64_t>(st.st_mtim.tv_nsec);
+#endif
+}
+
+base::Optional<std::string> FromHex(const std::string& hex) {
+  if (hex.size() % 2)
+    return base::nullopt;
+  std::string result(hex.size() / 2, '\0');
+  for (size_t i = 0; i < result.size(); ++i) {
+    base::Optional<uint64_t> byte =
+        base::StringToUInt64(hex.substr(2 * i, 2), 16);
+    if (!byte)
+      return base::nullopt;
+    result[i] = static_cast<char>(*byte);
+  }
+  return result;
+}
+
+// The index file has a header line, followed by a line per file:
+// <mtime in ns> <size> <load bias> <hex build id, or - if none> <path>
+std::map<std::string, IndexedFile> ReadIndexFile(const std::string& path) {
+  std::map<std::string, IndexedFile> result;
+  std::string content;
+  if (!base::ReadFile(path, &content))
+    return result;
+  base::StringSplitter lines(std::move(content), '\n');
+  if (!lines.Next() || strcmp(lines.cur_token(), kIndexFileHeader) != 0) {
+    PERFETTO_ELOG("Ignoring index %s with unknown format.", path.c_str());
+    return result;
+  }
+  while (lines.Next()) {
+    std::string line = lines.cur_token();
+    std::vector<std::string> fields;
+    size_t pos = 0;
+    while (fields.size() < 4) {
+      size_t space = line.find(' ', pos);
+      if (space == std::string::npos)
+        break;
+      fields.emplace_back(line.substr(pos, space - pos));
+      pos = space + 1;
+    }
+    base::Optional<int64_t> mtime_ns;
+    base::Optional<uint64_t> size;
+    base::Optional<uint64_t> load_bias;
+    base::Optional<std::string> build_id;
+    if (fields.size() == 4) {
+      mtime_ns = base::StringToInt64(fields[0]);
+      size = base::StringToUInt64(fields[1]);
+      load_bias = base::StringToUInt64(fields[2]);
+      build_id = fields[3] == "-" ? std::string() : FromHex(fields[3]);
+    }
+    if (!mtime_ns || !size || !load_bias || !build_id) {
+      PERFETTO_ELOG("Ignoring corrupted index %s.", path.c_str());
+      return {};
+    }
+    result[line.substr(pos)] = IndexedFile{*mtime_ns, *size, *build_id,
+                                           *load_bias};
+  }
+  return result;
+}
+
+void WriteIndexFile(const std::string& path,
+                    const std::map<std::string, IndexedFile>& index) {
+  std::string content = std::string(kIndexFileHeader) + "\n";
+  for (const auto& fname_and_file : index) {
+    const IndexedFile& file = fname_and_file.second;
+    content += std::to_string(file.mtime_ns) + " " +
+               std::to_string(file.size) + " " +
+               std::to_string(file.load_bias) + " " +
+               (file.build_id.empty() ? "-" : base::ToHex(file.build_id)) +
+               " " + fname_and_file.first + "\n";
+  }
+  // Write to a temporary file first, so that an interrupted run does not
+  // leave a truncated index behind.
+  std::string tmp_path = path + ".tmp";
+  {
+    base::ScopedFile fd(
+        base::OpenFile(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644));
+    if (!fd || base::WriteAll(*fd, content.data(), content.size()) !=
+                   static_cast<ssize_t>(content.size())) {
+      PERFETTO_PLOG("Failed to write index %s", tmp_path.c_str());
+      return;
+    }
+  }
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+  remove(path.c_str());
+#endif
+  if (rename(tmp_path.c_str(), path.c_str()) != 0)
+    PERFETTO_PLOG("Failed to write index %s", path.c_str());
+}
+
+std::map<std::string, FoundBinary> BuildIdIndex(std::vector<std::string> dirs,
+                                                const std::string& index_file,
+                                                size_t* files_read) {
   std::map<std::string, FoundBinary> result;
+  std::map<std::string, IndexedFile> old_index;
+  std::map<std::string, IndexedFile> new_index;
+  if (!index_file.empty())
+    old_index = ReadIndexFile(index_file);
+
+  size_t reused = 0;
   for (const std::string& dir : dirs) {
     std::vector<std::string> files;
     base::Status status = base::ListFilesRecursive(dir, files);
@@ -286,18 +419,44 @@ std::map<std::string, FoundBinary> BuildIdIndex(std::vector<std::string> dirs) {
     }
     for (const std::string& basename : files) {
       std::string fname = dir + "/" + basename;
-      if (!StartsWithElfMagic(fname)) {
-        continue;
+      IndexedFile file{0, 0, "", 0};
+      bool up_to_date = false;
+      if (!index_file.empty()) {
+        struct stat st;
+        if (stat(fname.c_str(), &st) != 0)
+          continue;
+        file.mtime_ns = GetMtimeNs(st);
+        file.size = static_cast<uint64_t>(st.st_size);
+        auto it = old_index.find(fname);
+        if (it != old_index.end() && it->second.mtime_ns == file.mtime_ns &&
+            it->second.size == file.size) {
+          file = it->second;
+          up_to_date = true;
+          reused++;
+        }
       }
-      base::Optional<BuildIdAndLoadBias> build_id_and_load_bias =
-          GetBuildIdAndLoadBias(fname);
-      if (build_id_and_load_bias) {
-        result.emplace(build_id_and_load_bias->build_id,
-                       FoundBinary{fname, build_id_and_load_bias->load_bias});
+      if (!up_to_date)
+        (*files_read)++;
+      if (!up_to_date && StartsWithElfMagic(fname)) {
+        base::Optional<BuildIdAndLoadBias> build_id_and_load_bias =
+            GetBuildIdAndLoadBias(fname);
+        if (build_id_and_load_bias) {
+          file.build_id = build_id_and_load_bias->build_id;
+          file.load_bias = build_id_and_load_bias->load_bias;
+        }
       }
+      if (!file.build_id.empty())
+        result.emplace(file.build_id, FoundBinary{fname, file.load_bias});
+      if (!index_file.empty())
+        new_index.emplace(std::move(fname), std::move(file));
     }
   }
 
+  if (!index_file.empty()) {
+    PERFETTO_DLOG("Reused %zu of %zu files from index %s.", reused,
+                  new_index.size(), index_file.c_str());
+    WriteIndexFile(index_file, new_index);
+  }
   return result;
 }
 
@@ -324,8 +483,10 @@ bool ParseLlvmSymbolizerLine(const std::string& line,
 
 BinaryFinder::~BinaryFinder() = default;
 
-LocalBinaryIndexer::LocalBinaryIndexer(std::vector<std::string> roots)
-    : buildid_to_file_(BuildIdIndex(std::move(roots))) {}
+LocalBinaryIndexer::LocalBinaryIndexer(std::vector<std::string> roots,
+                                       const std::string& index_file)
+    : buildid_to_file_(
+          BuildIdIndex(std::move(roots), index_file, &files_read_)) {}
 
 base::Optional<FoundBinary> LocalBinaryIndexer::FindBinary(
     const std::string& abspath,
@@ -531,20 +692,53 @@ std::vector<std::vector<SymbolizedFrame>> LocalSymbolizer::Symbolize(
     PERFETTO_LOG("Correcting load bias by %" PRIu64 " for %s",
                  load_bias_correction, mapping_name.c_str());
   }
-  std::vector<std::vector<SymbolizedFrame>> result;
-  result.reserve(addresses.size());
-  for (uint64_t address : addresses)
-    result.emplace_back(llvm_symbolizer_.Symbolize(
-        binary->file_name, address + load_bias_correction));
+  std::vector<std::vector<SymbolizedFrame>> result(addresses.size());
+  size_t num_processes =
+      std::min(max_processes_,
+               std::max<size_t>(addresses.size() / kMinAddressesPerProcess, 1));
+  while (llvm_symbolizers_.size() < num_processes) {
+    llvm_symbolizers_.emplace_back(
+        new LLVMSymbolizerProcess(symbolizer_path_));
+  }
+
+  // Each process symbolizes a contiguous range of |addresses|.
+  auto symbolize_range = [&](size_t process, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      result[i] = llvm_symbolizers_[process]->Symbolize(
+          binary->file_name, addresses[i] + load_bias_correction);
+    }
+  };
+  if (num_processes == 1) {
+    symbolize_range(0, 0, addresses.size());
+    return result;
+  }
+  size_t per_process = (addresses.size() + num_processes - 1) / num_processes;
+  std::vector<std::thread> threads;
+  for (size_t process = 0; process < num_processes; ++process) {
+    size_t begin = std::min(process * per_process, addresses.size());
+    size_t end = std::min(begin + per_process, addresses.size());
+    threads.emplace_back(symbolize_range, process, begin, end);
+  }
+  for (std::thread& thread : threads)
+    thread.join();
   return result;
 }
 
 LocalSymbolizer::LocalSymbolizer(const std::string& symbolizer_path,
-                                 std::unique_ptr<BinaryFinder> finder)
-    : llvm_symbolizer_(symbolizer_path), finder_(std::move(finder)) {}
+                                 std::unique_ptr<BinaryFinder> finder,
+                                 size_t max_processes)
+    : symbolizer_path_(symbolizer_path),
+      max_processes_(std::max<size_t>(max_processes, 1)),
+      finder_(std::move(finder)) {
+  llvm_symbolizers_.emplace_back(new LLVMSymbolizerProcess(symbolizer_path_));
+}
 
 LocalSymbolizer::LocalSymbolizer(std::unique_ptr<BinaryFinder> finder)
-    : LocalSymbolizer(kDefaultSymbolizer, std::move(finder)) {}
+    : LocalSymbolizer(
+          kDefaultSymbolizer,
+          std::move(finder),
+          std::min<size_t>(std::thread::hardware_concurrency(),
+                           kMaxSymbolizerProcesses)) {}
 
 LocalSymbolizer::~LocalSymbolizer() = default;
 
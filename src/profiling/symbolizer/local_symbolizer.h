@@ -49,15 +49,27 @@ class BinaryFinder {
       const std::string& build_id) = 0;
 };
 
+// Indexes all ELF files under |roots| by build id.
+//
+// If |index_file| is given, the build ids and load biases found are stored
+// there, together with the size and modification time of each file. Files
+// that did not change since the index was written are not read again on the
+// next run.
 class LocalBinaryIndexer : public BinaryFinder {
  public:
-  explicit LocalBinaryIndexer(std::vector<std::string> roots);
+  explicit LocalBinaryIndexer(std::vector<std::string> roots,
+                              const std::string& index_file = "");
 
   base::Optional<FoundBinary> FindBinary(const std::string& abspath,
                                          const std::string& build_id) override;
   ~LocalBinaryIndexer() override;
 
+  // Number of files that had to be read to build the index, i.e. that were
+  // not found up to date in |index_file|.
+  size_t files_read() const { return files_read_; }
+
  private:
+  size_t files_read_ = 0;
   std::map<std::string, FoundBinary> buildid_to_file_;
 };
 
@@ -94,11 +106,16 @@ class LLVMSymbolizerProcess {
   Subprocess subprocess_;
 };
 
+// Symbolizes addresses using llvm-symbolizer. Large batches of addresses are
+// split across up to |max_processes| llvm-symbolizer processes, each driven by
+// its own thread. Processes beyond the first one are started on demand.
 class LocalSymbolizer : public Symbolizer {
  public:
   LocalSymbolizer(const std::string& symbolizer_path,
-                  std::unique_ptr<BinaryFinder> finder);
+                  std::unique_ptr<BinaryFinder> finder,
+                  size_t max_processes = 1);
 
+  // Uses up to one llvm-symbolizer process per CPU.
   explicit LocalSymbolizer(std::unique_ptr<BinaryFinder> finder);
 
   std::vector<std::vector<SymbolizedFrame>> Symbolize(
@@ -112,13 +129,18 @@ class LocalSymbolizer : public Symbolizer {
   ~LocalSymbolizer() override;
 
  private:
-  LLVMSymbolizerProcess llvm_symbolizer_;
+  const std::string symbolizer_path_;
+  const size_t max_processes_;
+  std::vector<std::unique_ptr<LLVMSymbolizerProcess>> llvm_symbolizers_;
   std::unique_ptr<BinaryFinder> finder_;
 };
 
+// |index_file| is only used in "index" mode, see LocalBinaryIndexer. Can be
+// null.
 std::unique_ptr<Symbolizer> LocalSymbolizerOrDie(
     std::vector<std::string> binary_path,
-    const char* mode);
+    const char* mode,
+    const char* index_file = nullptr);
 
 }  // namespace profiling
 }  // namespace perfetto
@@ -20,8 +20,13 @@
 // This translation unit is built only on Linux and MacOS. See //gn/BUILD.gn.
 #if PERFETTO_BUILDFLAG(PERFETTO_LOCAL_SYMBOLIZER)
 
+#include <fcntl.h>
+#include <sys/stat.h>
+
 #include <cstddef>
 
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/string_utils.h"
 #include "src/base/test/tmp_dir_tree.h"
 #include "src/base/test/utils.h"
 #include "src/profiling/symbolizer/elf.h"
@@ -162,6 +167,71 @@ TEST(LocalBinaryIndexerTest, SimpleTree) {
   EXPECT_EQ(bin2.value().file_name, tmp.path() + "/dir2/elf1");
 }
 
+TEST(LocalBinaryIndexerTest, IndexFile) {
+  base::TmpDirTree tmp;
+  tmp.AddDir("dir1");
+  tmp.AddFile("dir1/elf1", CreateElfWithBuildId("AAAAAAAAAAAAAAAAAAAA"));
+  tmp.AddFile("dir1/nonelf1", "OTHERDATA");
+  // Overwritten by the indexer. Added here so that it gets cleaned up.
+  tmp.AddFile("index", "");
+  std::string index_file = tmp.AbsolutePath("index");
+
+  {
+    LocalBinaryIndexer indexer({tmp.path() + "/dir1"}, index_file);
+    EXPECT_TRUE(indexer.FindBinary("", "AAAAAAAAAAAAAAAAAAAA").has_value());
+    EXPECT_EQ(indexer.files_read(), 2u);
+  }
+  std::string index;
+  ASSERT_TRUE(base::ReadFile(index_file, &index));
+  EXPECT_THAT(index, testing::HasSubstr(base::ToHex("AAAAAAAAAAAAAAAAAAAA")));
+  EXPECT_THAT(index, testing::HasSubstr(tmp.path() + "/dir1/nonelf1"));
+
+  // Files added after the index was written are indexed as well, unchanged
+  // files are not read again.
+  tmp.AddFile("dir1/elf2", CreateElfWithBuildId("BBBBBBBBBBBBBBBBBBBB"));
+  LocalBinaryIndexer indexer({tmp.path() + "/dir1"}, index_file);
+  EXPECT_EQ(indexer.files_read(), 1u);
+  base::Optional<FoundBinary> bin1 =
+      indexer.FindBinary("", "AAAAAAAAAAAAAAAAAAAA");
+  ASSERT_TRUE(bin1.has_value());
+  EXPECT_EQ(bin1.value().file_name, tmp.path() + "/dir1/elf1");
+  base::Optional<FoundBinary> bin2 =
+      indexer.FindBinary("", "BBBBBBBBBBBBBBBBBBBB");
+  ASSERT_TRUE(bin2.has_value());
+  EXPECT_EQ(bin2.value().file_name, tmp.path() + "/dir1/elf2");
+}
+
+TEST(LocalBinaryIndexerTest, IndexFileSubsecondChange) {
+  base::TmpDirTree tmp;
+  tmp.AddDir("dir1");
+  tmp.AddFile("dir1/elf1", CreateElfWithBuildId("AAAAAAAAAAAAAAAAAAAA"));
+  tmp.AddFile("index", "");
+  std::string index_file = tmp.AbsolutePath("index");
+  std::string elf_file = tmp.AbsolutePath("dir1/elf1");
+
+  struct timespec times[2] = {{1000, 100}, {1000, 100}};
+  ASSERT_EQ(utimensat(AT_FDCWD, elf_file.c_str(), times, 0), 0);
+  {
+    LocalBinaryIndexer indexer({tmp.path() + "/dir1"}, index_file);
+    EXPECT_TRUE(indexer.FindBinary("", "AAAAAAAAAAAAAAAAAAAA").has_value());
+  }
+
+  // Rewritten with the same size, within the same second.
+  std::string elf = CreateElfWithBuildId("BBBBBBBBBBBBBBBBBBBB");
+  base::ScopedFile fd(base::OpenFile(elf_file, O_WRONLY | O_TRUNC));
+  ASSERT_TRUE(fd);
+  ASSERT_EQ(base::WriteAll(*fd, elf.data(), elf.size()),
+            static_cast<ssize_t>(elf.size()));
+  fd.reset();
+  times[0].tv_nsec = times[1].tv_nsec = 200;
+  ASSERT_EQ(utimensat(AT_FDCWD, elf_file.c_str(), times, 0), 0);
+
+  LocalBinaryIndexer indexer({tmp.path() + "/dir1"}, index_file);
+  EXPECT_EQ(indexer.files_read(), 1u);
+  EXPECT_FALSE(indexer.FindBinary("", "AAAAAAAAAAAAAAAAAAAA").has_value());
+  EXPECT_TRUE(indexer.FindBinary("", "BBBBBBBBBBBBBBBBBBBB").has_value());
+}
+
 TEST(LocalBinaryFinderTest, AbsolutePath) {
   base::TmpDirTree tmp;
   tmp.AddDir("root");
@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/containers/encoded_int_vector.h"
+
+#include <limits>
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+size_t WordBytes(uint64_t bits) {
+  return static_cast<size_t>((bits + 63) / 64 * sizeof(uint64_t));
+}
+
+}  // namespace
+
+// static
+constexpr uint32_t EncodedIntVector::kBlockSize;
+// static
+constexpr uint32_t EncodedIntVector::kMaxDictionarySize;
+
+EncodedIntVector::~EncodedIntVector() = default;
+
+// static
+uint32_t EncodedIntVector::BitWidth(uint64_t value) {
+  uint32_t width = 0;
+  for (; value != 0; value >>= 1)
+    width++;
+  return width;
+}
+
+void EncodedIntVector::Summary::Add(int64_t value) {
+  if (size == 0) {
+    min = max = previous = value;
+    runs = 1;
+  } else {
+    min = std::min(min, value);
+    max = std::max(max, value);
+    runs += value != previous;
+  }
+
+  uint32_t idx_in_block = size % kBlockSize;
+  if (idx_in_block == 0) {
+    block_min = block_max = value;
+  } else {
+    block_min = std::min(block_min, value);
+    block_max = std::max(block_max, value);
+  }
+  if (idx_in_block == kBlockSize - 1)
+    block_bits += kBlockSize * BitWidth(Offset(block_min, block_max));
+
+  // Runs of the same value don't change the set of distinct values.
+  if (track_distinct && (size == 0 || value != previous)) {
+    distinct.insert(value);
+    if (distinct.size() > kMaxDictionarySize) {
+      track_distinct = false;
+      distinct.clear();
+    }
+  }
+  previous = value;
+  size++;
+}
+
+void EncodedIntVector::Summary::Finish() {
+  uint32_t last_block_size = size % kBlockSize;
+  if (last_block_size != 0)
+    block_bits += last_block_size * BitWidth(Offset(block_min, block_max));
+}
+
+size_t EncodedIntVector::Summary::EncodedSize(Encoding encoding) const {
+  switch (encoding) {
+    case Encoding::kBitPacked:
+      return WordBytes(static_cast<uint64_t>(size) *
+                       BitWidth(Offset(min, max)));
+    case Encoding::kBlockDelta: {
+      size_t blocks = (size + kBlockSize - 1) / kBlockSize;
+      return blocks * sizeof(Block) + WordBytes(block_bits);
+    }
+    case Encoding::kDictionary:
+      if (!track_distinct)
+        return std::numeric_limits<size_t>::max();
+      return distinct.size() * sizeof(int64_t) +
+             WordBytes(static_cast<uint64_t>(size) *
+                       BitWidth(distinct.size() - 1));
+    case Encoding::kRunLength:
+      return runs * (sizeof(int64_t) + sizeof(uint32_t));
+  }
+  PERFETTO_FATAL("For GCC");
+}
+
+void EncodedIntVector::WriteBits(uint64_t bit, uint32_t width, uint64_t value) {
+  if (width == 0)
+    return;
+  size_t word = static_cast<size_t>(bit / 64);
+  uint32_t shift = static_cast<uint32_t>(bit % 64);
+  words_[word] |= value << shift;
+  if (shift + width > 64)
+    words_[word + 1] |= value >> (64 - shift);
+}
+
+void EncodedIntVector::FilterCodes(uint32_t start,
+                                   uint32_t end,
+                                   uint64_t bit,
+                                   uint32_t width,
+                                   uint64_t min_code,
+                                   uint64_t max_code,
+                                   BitVector* out) const {
+  // A single unsigned comparison checks both bounds.
+  uint64_t range = max_code - min_code;
+  for (uint32_t i = start; i < end; ++i, bit += width) {
+    if (ReadBits(bit, width) - min_code <= range)
+      out->Set(i);
+  }
+}
+
+BitVector EncodedIntVector::FilterRange(int64_t min, int64_t max) const {
+  BitVector out(size_, false);
+  if (min > max)
+    return out;
+
+  switch (encoding_) {
+    case Encoding::kBitPacked: {
+      if (max < base_ || min > max_)
+        break;
+      uint64_t min_code = Offset(base_, std::max(min, base_));
+      uint64_t max_code = Offset(base_, std::min(max, max_));
+      FilterCodes(0, size_, 0, width_, min_code, max_code, &out);
+      break;
+    }
+    case Encoding::kBlockDelta: {
+      // Blocks entirely inside or outside of the range are handled without
+      // looking at their values.
+      for (uint32_t b = 0; b < blocks_.size(); ++b) {
+        const Block& block = blocks_[b];
+        uint32_t start = b * kBlockSize;
+        uint32_t end = std::min(start + kBlockSize, size_);
+        uint64_t block_max_code = block.width == 64
+                                      ? std::numeric_limits<uint64_t>::max()
+                                      : (uint64_t(1) << block.width) - 1;
+        if (max < block.base)
+          continue;
+        uint64_t min_code = min <= block.base ? 0 : Offset(block.base, min);
+        if (min_code > block_max_code)
+          continue;
+        uint64_t max_code = std::min(Offset(block.base, max), block_max_code);
+        if (min_code == 0 && max_code == block_max_code) {
+          for (uint32_t i = start; i < end; ++i)
+            out.Set(i);
+          continue;
+        }
+        FilterCodes(start, end, block.bit_offset, block.width, min_code,
+                    max_code, &out);
+      }
+      break;
+    }
+    case Encoding::kDictionary: {
+      auto lo = std::lower_bound(values_.begin(), values_.end(), min);
+      auto hi = std::upper_bound(values_.begin(), values_.end(), max);
+      if (lo == hi)
+        break;
+      FilterCodes(0, size_, 0, width_,
+                  static_cast<uint64_t>(lo - values_.begin()),
+                  static_cast<uint64_t>(hi - values_.begin() - 1), &out);
+      break;
+    }
+    case Encoding::kRunLength: {
+      uint32_t start = 0;
+      for (uint32_t r = 0; r < values_.size(); ++r) {
+        if (values_[r] >= min && values_[r] <= max) {
+          for (uint32_t i = start; i < run_ends_[r]; ++i)
+            out.Set(i);
+        }
+        start = run_ends_[r];
+      }
+      break;
+    }
+  }
+  return out;
+}
+
+size_t EncodedIntVector::SizeBytes() const {
+  return sizeof(*this) + words_.size() * sizeof(uint64_t) +
+         blocks_.size() * sizeof(Block) + values_.size() * sizeof(int64_t) +
+         run_ends_.size() * sizeof(uint32_t);
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,295 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_CONTAINERS_ENCODED_INT_VECTOR_H_
+#define SRC_TRACE_PROCESSOR_CONTAINERS_ENCODED_INT_VECTOR_H_
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include "perfetto/base/logging.h"
+#include "src/trace_processor/containers/bit_vector.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// An immutable vector of integers stored in a compressed encoding. The
+// encoding is picked when the vector is created to use as little memory as
+// possible for the values:
+//  * kBitPacked: frame of reference encoding, each value is stored as its
+//    offset from the minimum using as many bits as the largest offset needs.
+//    Good for columns with a small range of values (e.g. cpu, depth).
+//  * kBlockDelta: like kBitPacked but for each block of |kBlockSize| values
+//    independently. For sorted columns (e.g. timestamps), values are stored as
+//    deltas from the first value of their block.
+//  * kDictionary: each value is stored as its index in the sorted list of
+//    distinct values. Good for columns with few distinct values spread over a
+//    large range.
+//  * kRunLength: consecutive equal values are stored once. Good for columns
+//    with long runs of the same value. Unlike the other encodings, looking up
+//    a value is O(log(number of runs)) instead of O(1).
+//
+// Values can be filtered by range directly on the encoded data (see
+// |FilterRange|) without decoding them one by one.
+class EncodedIntVector {
+ public:
+  enum class Encoding {
+    kBitPacked,
+    kBlockDelta,
+    kDictionary,
+    kRunLength,
+  };
+
+  static constexpr uint32_t kBlockSize = 128;
+  static constexpr uint32_t kMaxDictionarySize = 64 * 1024;
+
+  // Encodes |values| with the encoding which uses the least memory. Returns
+  // nullptr if no encoding saves at least a quarter of the memory used by
+  // |values|.
+  template <typename T>
+  static std::unique_ptr<EncodedIntVector> Encode(const std::vector<T>& values);
+
+  ~EncodedIntVector();
+
+  int64_t Get(uint32_t idx) const {
+    PERFETTO_DCHECK(idx < size_);
+    switch (encoding_) {
+      case Encoding::kBitPacked:
+        return AddOffset(base_, ReadBits(static_cast<uint64_t>(idx) * width_,
+                                         width_));
+      case Encoding::kBlockDelta: {
+        const Block& block = blocks_[idx / kBlockSize];
+        uint64_t bit = block.bit_offset + (idx % kBlockSize) * block.width;
+        return AddOffset(block.base, ReadBits(bit, block.width));
+      }
+      case Encoding::kDictionary:
+        return values_[ReadBits(static_cast<uint64_t>(idx) * width_, width_)];
+      case Encoding::kRunLength: {
+        auto it = std::upper_bound(run_ends_.begin(), run_ends_.end(), idx);
+        return values_[static_cast<size_t>(it - run_ends_.begin())];
+      }
+    }
+    PERFETTO_FATAL("For GCC");
+  }
+
+  // Returns a BitVector of |size()| bits where the bits of the indices whose
+  // value is in [min, max] are set.
+  BitVector FilterRange(int64_t min, int64_t max) const;
+
+  uint32_t size() const { return size_; }
+  Encoding encoding() const { return encoding_; }
+
+  // Returns the approximate number of bytes used to store the values.
+  size_t SizeBytes() const;
+
+ private:
+  struct Block {
+    int64_t base;
+    uint64_t bit_offset;
+    uint32_t width;
+  };
+
+  // Collects the information needed to compute the size of the vector with
+  // each encoding.
+  struct Summary {
+    void Add(int64_t value);
+    void Finish();
+    size_t EncodedSize(Encoding) const;
+
+    uint32_t size = 0;
+    int64_t min = 0;
+    int64_t max = 0;
+    int64_t previous = 0;
+    uint32_t runs = 0;
+
+    int64_t block_min = 0;
+    int64_t block_max = 0;
+    uint64_t block_bits = 0;
+
+    // Cleared once the number of distinct values exceeds kMaxDictionarySize.
+    bool track_distinct = true;
+    std::unordered_set<int64_t> distinct;
+  };
+
+  explicit EncodedIntVector(Encoding encoding) : encoding_(encoding) {}
+
+  static uint32_t BitWidth(uint64_t value);
+  static int64_t AddOffset(int64_t base, uint64_t offset) {
+    return static_cast<int64_t>(static_cast<uint64_t>(base) + offset);
+  }
+  static uint64_t Offset(int64_t base, int64_t value) {
+    return static_cast<uint64_t>(value) - static_cast<uint64_t>(base);
+  }
+
+  uint64_t ReadBits(uint64_t bit, uint32_t width) const {
+    if (width == 0)
+      return 0;
+    size_t word = static_cast<size_t>(bit / 64);
+    uint32_t shift = static_cast<uint32_t>(bit % 64);
+    uint64_t value = words_[word] >> shift;
+    if (shift + width > 64)
+      value |= words_[word + 1] << (64 - shift);
+    return width == 64 ? value : value & ((uint64_t(1) << width) - 1);
+  }
+  void WriteBits(uint64_t bit, uint32_t width, uint64_t value);
+
+  // Sets the bits of |out| for the indices in [start, end) whose code (as
+  // written by WriteBits starting at |bit| with |width| bits per value) is in
+  // [min_code, max_code].
+  void FilterCodes(uint32_t start,
+                   uint32_t end,
+                   uint64_t bit,
+                   uint32_t width,
+                   uint64_t min_code,
+                   uint64_t max_code,
+                   BitVector* out) const;
+
+  template <typename T>
+  void Build(const std::vector<T>& values, const Summary& summary);
+
+  Encoding encoding_;
+  uint32_t size_ = 0;
+
+  // kBitPacked: the minimum and maximum value and the number of bits per
+  // value. kDictionary: the number of bits per index.
+  int64_t base_ = 0;
+  int64_t max_ = 0;
+  uint32_t width_ = 0;
+
+  // kBlockDelta only.
+  std::vector<Block> blocks_;
+
+  // The packed bits of all the encodings but kRunLength.
+  std::vector<uint64_t> words_;
+
+  // kDictionary: the sorted distinct values. kRunLength: the value of each
+  // run.
+  std::vector<int64_t> values_;
+
+  // kRunLength only: the index one past the end of each run.
+  std::vector<uint32_t> run_ends_;
+};
+
+// static
+template <typename T>
+std::unique_ptr<EncodedIntVector> EncodedIntVector::Encode(
+    const std::vector<T>& values) {
+  static_assert(sizeof(T) <= sizeof(int64_t), "Values must fit in int64_t");
+  if (values.empty())
+    return nullptr;
+
+  Summary summary;
+  for (const T& value : values)
+    summary.Add(static_cast<int64_t>(value));
+  summary.Finish();
+
+  size_t best_size = values.size() * sizeof(T) * 3 / 4;
+  Encoding best = Encoding::kBitPacked;
+  bool found = false;
+  for (Encoding encoding : {Encoding::kBitPacked, Encoding::kBlockDelta,
+                            Encoding::kDictionary, Encoding::kRunLength}) {
+    size_t size = summary.EncodedSize(encoding);
+    if (size < best_size) {
+      best_size = size;
+      best = encoding;
+      found = true;
+    }
+  }
+  if (!found)
+    return nullptr;
+
+  std::unique_ptr<EncodedIntVector> encoded(new EncodedIntVector(best));
+  encoded->Build(values, summary);
+  return encoded;
+}
+
+template <typename T>
+void EncodedIntVector::Build(const std::vector<T>& values,
+                             const Summary& summary) {
+  size_ = static_cast<uint32_t>(values.size());
+  switch (encoding_) {
+    case Encoding::kBitPacked: {
+      base_ = summary.min;
+      max_ = summary.max;
+      width_ = BitWidth(Offset(base_, max_));
+      words_.resize((static_cast<uint64_t>(size_) * width_ + 63) / 64);
+      for (uint32_t i = 0; i < size_; ++i) {
+        WriteBits(static_cast<uint64_t>(i) * width_, width_,
+                  Offset(base_, static_cast<int64_t>(values[i])));
+      }
+      break;
+    }
+    case Encoding::kBlockDelta: {
+      words_.resize(static_cast<size_t>((summary.block_bits + 63) / 64));
+      uint64_t bit = 0;
+      for (uint32_t start = 0; start < size_; start += kBlockSize) {
+        uint32_t end = std::min(start + kBlockSize, size_);
+        auto minmax = std::minmax_element(values.begin() + start,
+                                          values.begin() + end);
+        Block block;
+        block.base = static_cast<int64_t>(*minmax.first);
+        block.bit_offset = bit;
+        block.width = BitWidth(
+            Offset(block.base, static_cast<int64_t>(*minmax.second)));
+        for (uint32_t i = start; i < end; ++i) {
+          WriteBits(bit, block.width,
+                    Offset(block.base, static_cast<int64_t>(values[i])));
+          bit += block.width;
+        }
+        blocks_.push_back(block);
+      }
+      break;
+    }
+    case Encoding::kDictionary: {
+      values_.assign(summary.distinct.begin(), summary.distinct.end());
+      std::sort(values_.begin(), values_.end());
+      width_ = BitWidth(values_.size() - 1);
+      words_.resize((static_cast<uint64_t>(size_) * width_ + 63) / 64);
+      for (uint32_t i = 0; i < size_; ++i) {
+        auto it = std::lower_bound(values_.begin(), values_.end(),
+                                   static_cast<int64_t>(values[i]));
+        WriteBits(static_cast<uint64_t>(i) * width_, width_,
+                  static_cast<uint64_t>(it - values_.begin()));
+      }
+      break;
+    }
+    case Encoding::kRunLength: {
+      for (uint32_t i = 0; i < size_; ++i) {
+        int64_t value = static_cast<int64_t>(values[i]);
+        if (i == 0 || value != values_.back()) {
+          values_.push_back(value);
+          run_ends_.push_back(i + 1);
+        } else {
+          run_ends_.back() = i + 1;
+        }
+      }
+      break;
+    }
+  }
+  words_.shrink_to_fit();
+  blocks_.shrink_to_fit();
+  values_.shrink_to_fit();
+  run_ends_.shrink_to_fit();
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_CONTAINERS_ENCODED_INT_VECTOR_H_
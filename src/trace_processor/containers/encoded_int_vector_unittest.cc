@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/containers/encoded_int_vector.h"
+
+#include <limits>
+#include <random>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using Encoding = EncodedIntVector::Encoding;
+
+// Checks that |encoded| holds |values| and that filtering it by a few ranges
+// matches filtering |values|.
+template <typename T>
+void CheckEncoded(const std::vector<T>& values,
+                  const EncodedIntVector& encoded) {
+  ASSERT_EQ(encoded.size(), values.size());
+  for (uint32_t i = 0; i < values.size(); ++i)
+    ASSERT_EQ(encoded.Get(i), static_cast<int64_t>(values[i])) << i;
+
+  std::minstd_rand rnd;
+  for (uint32_t i = 0; i < 20; ++i) {
+    int64_t a = static_cast<int64_t>(values[rnd() % values.size()]);
+    int64_t b = static_cast<int64_t>(values[rnd() % values.size()]);
+    int64_t min = std::min(a, b) + (i % 2);
+    int64_t max = std::max(a, b);
+    BitVector bv = encoded.FilterRange(min, max);
+    ASSERT_EQ(bv.size(), values.size());
+    for (uint32_t j = 0; j < values.size(); ++j) {
+      int64_t value = static_cast<int64_t>(values[j]);
+      ASSERT_EQ(bv.IsSet(j), value >= min && value <= max) << j;
+    }
+  }
+}
+
+TEST(EncodedIntVectorUnittest, BitPacked) {
+  std::vector<uint32_t> values;
+  for (uint32_t i = 0; i < 10000; ++i)
+    values.push_back(100 + (i * 7919) % 13);
+  auto encoded = EncodedIntVector::Encode(values);
+  ASSERT_TRUE(encoded);
+  ASSERT_EQ(encoded->encoding(), Encoding::kBitPacked);
+  ASSERT_LT(encoded->SizeBytes(), values.size());
+  CheckEncoded(values, *encoded);
+}
+
+TEST(EncodedIntVectorUnittest, BlockDeltaForSortedValues) {
+  std::vector<int64_t> values;
+  int64_t ts = 1000000000000;
+  std::minstd_rand rnd;
+  for (uint32_t i = 0; i < 10000; ++i) {
+    ts += rnd() % 100000;
+    values.push_back(ts);
+  }
+  auto encoded = EncodedIntVector::Encode(values);
+  ASSERT_TRUE(encoded);
+  ASSERT_EQ(encoded->encoding(), Encoding::kBlockDelta);
+  CheckEncoded(values, *encoded);
+}
+
+TEST(EncodedIntVectorUnittest, Dictionary) {
+  const int64_t kValues[] = {-5000000000, 0, 7, 1000000000000};
+  std::vector<int64_t> values;
+  for (uint32_t i = 0; i < 10000; ++i)
+    values.push_back(kValues[(i * 7919) % 4]);
+  auto encoded = EncodedIntVector::Encode(values);
+  ASSERT_TRUE(encoded);
+  ASSERT_EQ(encoded->encoding(), Encoding::kDictionary);
+  CheckEncoded(values, *encoded);
+}
+
+TEST(EncodedIntVectorUnittest, RunLength) {
+  std::vector<int64_t> values;
+  for (uint32_t i = 0; i < 10000; ++i)
+    values.push_back(i < 5000 ? -1 : (i / 1000) * 1000000000000);
+  auto encoded = EncodedIntVector::Encode(values);
+  ASSERT_TRUE(encoded);
+  ASSERT_EQ(encoded->encoding(), Encoding::kRunLength);
+  CheckEncoded(values, *encoded);
+}
+
+TEST(EncodedIntVectorUnittest, FullRange) {
+  std::vector<int64_t> values;
+  std::mt19937_64 rnd;
+  for (uint32_t i = 0; i < 1000; ++i)
+    values.push_back(static_cast<int64_t>(rnd()));
+  values.push_back(std::numeric_limits<int64_t>::min());
+  values.push_back(std::numeric_limits<int64_t>::max());
+
+  // Random 64 bit values don't compress.
+  ASSERT_FALSE(EncodedIntVector::Encode(values));
+
+  // Constant blocks of random values compress with any encoding but the
+  // values use the whole 64 bit range.
+  std::vector<int64_t> blocks;
+  for (int64_t value : values)
+    blocks.insert(blocks.end(), EncodedIntVector::kBlockSize, value);
+  auto encoded = EncodedIntVector::Encode(blocks);
+  ASSERT_TRUE(encoded);
+  CheckEncoded(blocks, *encoded);
+}
+
+TEST(EncodedIntVectorUnittest, Empty) {
+  ASSERT_FALSE(EncodedIntVector::Encode(std::vector<int64_t>()));
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
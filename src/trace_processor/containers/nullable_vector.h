@@ -19,22 +19,25 @@
 
 #include <stdint.h>
 
-#include <deque>
+#include <vector>
 
+#include "perfetto/base/compiler.h"
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/optional.h"
-#include "src/trace_processor/containers/row_map.h"
 
 namespace perfetto {
 namespace trace_processor {
 
 // A data structure which compactly stores a list of possibly nullable data.
 //
-// Internally, this class is implemented using a combination of a std::deque
-// with a BitVector used to store whether each index is null or not.
-// By default, for each null value, it only uses a single bit inside the
-// BitVector at a slight cost (searching the BitVector to find the index into
-// the std::deque) when looking up the data.
+// Internally, the indices are split into chunks of |kChunkSize| entries. Each
+// chunk stores its data contiguously in a std::vector alongside a bitmap of
+// which of its indices are non-null and, for each word of the bitmap, the
+// number of non-null entries before it in the chunk (i.e. a rank directory).
+// By default, for each null value, only a single bit of the bitmap is used at
+// a slight cost (a popcount of a single word to find the index into the data)
+// when looking up the data. Setting a null entry to non-null only moves the
+// data of its own chunk.
 template <typename T>
 class NullableVector {
  private:
@@ -42,7 +45,7 @@ class NullableVector {
     // Sparse mode is the default mode and ensures that nulls are stored using
     // only
     // a single bit (at the cost of making setting null entries to non-null
-    // O(n)).
+    // O(kChunkSize)).
     kSparse,
 
     // Dense mode forces the reservation of space for null entries which
@@ -52,6 +55,46 @@ class NullableVector {
   };
 
  public:
+  static constexpr uint32_t kChunkSize = 2048;
+
+  // Reads the values of a NullableVector. When the values are read at
+  // consecutive indices (e.g. when scanning a column), the index into the data
+  // is tracked as the indices advance instead of being looked up for each
+  // index. The NullableVector must not be modified while the cursor is used.
+  class Cursor {
+   public:
+    explicit Cursor(const NullableVector<T>* nv) : nv_(nv) {}
+
+    base::Optional<T> Get(uint32_t idx) {
+      PERFETTO_DCHECK(idx < nv_->size());
+      const Chunk& chunk = nv_->chunks_[idx / kChunkSize];
+      uint32_t offset = idx % kChunkSize;
+      if (nv_->mode_ == Mode::kSparse && idx != next_idx_)
+        next_data_ = chunk.Rank(offset);
+
+      next_idx_ = idx + 1;
+      if (!chunk.IsSet(offset)) {
+        if (next_idx_ % kChunkSize == 0)
+          next_data_ = 0;
+        return base::nullopt;
+      }
+      if (nv_->mode_ == Mode::kDense)
+        return chunk.data[offset];
+
+      const T& value = chunk.data[next_data_];
+      next_data_ = next_idx_ % kChunkSize == 0 ? 0 : next_data_ + 1;
+      return value;
+    }
+
+   private:
+    const NullableVector<T>* nv_ = nullptr;
+
+    // The index read by a call to |Get(next_idx_)| and, in sparse mode, the
+    // index into the data of its chunk if it is non-null.
+    uint32_t next_idx_ = 0;
+    uint32_t next_data_ = 0;
+  };
+
   // Creates an empty NullableVector.
   NullableVector() : NullableVector<T>(Mode::kSparse) {}
 
@@ -69,19 +112,24 @@ class NullableVector {
 
   // Returns the optional value at |idx| or base::nullopt if the value is null.
   base::Optional<T> Get(uint32_t idx) const {
-    bool contains = valid_.IsSet(idx);
-    if (mode_ == Mode::kDense) {
-      return contains ? base::make_optional(data_[idx]) : base::nullopt;
-    } else {
-      return contains ? base::make_optional(data_[valid_.CountSetBits(idx)])
-                      : base::nullopt;
-    }
+    PERFETTO_DCHECK(idx < size_);
+    const Chunk& chunk = chunks_[idx / kChunkSize];
+    uint32_t offset = idx % kChunkSize;
+    if (!chunk.IsSet(offset))
+      return base::nullopt;
+    return mode_ == Mode::kDense ? chunk.data[offset]
+                                 : chunk.data[chunk.Rank(offset)];
   }
 
   // Adds the given value to the NullableVector.
   void Append(T val) {
-    data_.emplace_back(val);
-    valid_.AppendTrue();
+    Chunk& chunk = AppendEntry();
+    chunk.data.emplace_back(val);
+
+    // The words after the last one are empty: their rank is computed when
+    // they start being used.
+    uint32_t offset = (size_ - 1) % kChunkSize;
+    chunk.valid[offset / 64] |= uint64_t(1) << (offset % 64);
   }
 
   // Adds the given optional value to the NullableVector.
@@ -95,18 +143,23 @@ class NullableVector {
 
   // Sets the value at |idx| to the given |val|.
   void Set(uint32_t idx, T val) {
+    PERFETTO_DCHECK(idx < size_);
+    Chunk& chunk = chunks_[idx / kChunkSize];
+    uint32_t offset = idx % kChunkSize;
     if (mode_ == Mode::kDense) {
-      valid_.Set(idx);
-      data_[idx] = val;
+      if (!chunk.IsSet(offset))
+        chunk.SetBit(offset);
+      chunk.data[offset] = val;
     } else {
       // Generally, we will be setting a null row to non-null so optimize for
       // that path.
-      uint32_t row = valid_.CountSetBits(idx);
-      bool was_set = valid_.Set(idx);
-      if (PERFETTO_UNLIKELY(was_set)) {
-        data_[row] = val;
+      uint32_t row = chunk.Rank(offset);
+      if (PERFETTO_UNLIKELY(chunk.IsSet(offset))) {
+        chunk.data[row] = val;
       } else {
-        data_.insert(data_.begin() + static_cast<ptrdiff_t>(row), val);
+        chunk.data.insert(chunk.data.begin() + static_cast<ptrdiff_t>(row),
+                          val);
+        chunk.SetBit(offset);
       }
     }
   }
@@ -114,32 +167,87 @@ class NullableVector {
   // Requests the removal of unused capacity.
   // Matches the semantics of std::vector::shrink_to_fit.
   void ShrinkToFit() {
-    data_.shrink_to_fit();
-    valid_.ShrinkToFit();
+    for (Chunk& chunk : chunks_)
+      chunk.data.shrink_to_fit();
+    chunks_.shrink_to_fit();
   }
 
   // Returns the size of the NullableVector; this includes any null values.
-  uint32_t size() const { return valid_.size(); }
+  uint32_t size() const { return size_; }
 
   // Returns whether data in this NullableVector is stored densely.
   bool IsDense() const { return mode_ == Mode::kDense; }
 
  private:
+  static constexpr uint32_t kWordsPerChunk = kChunkSize / 64;
+
+  struct Chunk {
+    bool IsSet(uint32_t offset) const {
+      return (valid[offset / 64] >> (offset % 64)) & 1u;
+    }
+
+    // Returns the number of non-null entries before |offset| in the chunk.
+    uint32_t Rank(uint32_t offset) const {
+      uint32_t word = offset / 64;
+      uint64_t mask = (uint64_t(1) << (offset % 64)) - 1;
+      return rank[word] +
+             static_cast<uint32_t>(PERFETTO_POPCOUNT(valid[word] & mask));
+    }
+
+    // Sets the bit for |offset| which must not be set.
+    void SetBit(uint32_t offset) {
+      PERFETTO_DCHECK(!IsSet(offset));
+      valid[offset / 64] |= uint64_t(1) << (offset % 64);
+      for (uint32_t i = offset / 64 + 1; i < kWordsPerChunk; ++i)
+        rank[i]++;
+    }
+
+    // The non-null values in sparse mode or all the values in dense mode.
+    std::vector<T> data;
+    uint64_t valid[kWordsPerChunk] = {};
+    uint16_t rank[kWordsPerChunk] = {};
+  };
+
   explicit NullableVector(Mode mode) : mode_(mode) {}
 
+  // Adds a null entry at the end of the bitmap and returns its chunk.
+  Chunk& AppendEntry() {
+    uint32_t offset = size_ % kChunkSize;
+    if (offset == 0)
+      chunks_.emplace_back();
+    size_++;
+
+    Chunk& chunk = chunks_.back();
+    uint32_t word = offset / 64;
+    if (offset % 64 == 0 && word > 0) {
+      chunk.rank[word] = static_cast<uint16_t>(
+          chunk.rank[word - 1] +
+          PERFETTO_POPCOUNT(chunk.valid[word - 1]));
+    }
+    return chunk;
+  }
+
   void AppendNull() {
+    Chunk& chunk = AppendEntry();
     if (mode_ == Mode::kDense) {
-      data_.emplace_back();
+      chunk.data.emplace_back();
     }
-    valid_.AppendFalse();
   }
 
   Mode mode_ = Mode::kSparse;
 
-  std::vector<T> data_;
-  BitVector valid_;
+  std::vector<Chunk> chunks_;
+  uint32_t size_ = 0;
 };
 
+// static
+template <typename T>
+constexpr uint32_t NullableVector<T>::kChunkSize;
+
+// static
+template <typename T>
+constexpr uint32_t NullableVector<T>::kWordsPerChunk;
+
 }  // namespace trace_processor
 }  // namespace perfetto
 
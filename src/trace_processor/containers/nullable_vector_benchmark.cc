@@ -12,6 +12,8 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <numeric>
 #include <random>
 
 #include <benchmark/benchmark.h>
@@ -23,6 +25,23 @@ namespace {
 static constexpr uint32_t kPoolSize = 100000;
 static constexpr uint32_t kSize = 123456;
 
+// Creates a NullableVector of |kSize| values where about half of the values
+// are null.
+perfetto::trace_processor::NullableVector<int64_t> CreateHalfNull() {
+  static constexpr uint32_t kRandomSeed = 42;
+  std::minstd_rand0 rnd_engine(kRandomSeed);
+
+  perfetto::trace_processor::NullableVector<int64_t> sv;
+  for (uint32_t i = 0; i < kSize; ++i) {
+    if (rnd_engine() % 2) {
+      sv.Append(static_cast<int64_t>(rnd_engine() % 1000));
+    } else {
+      sv.Append(perfetto::base::nullopt);
+    }
+  }
+  return sv;
+}
+
 }  // namespace
 
 static void BM_NullableVectorAppendNonNull(benchmark::State& state) {
@@ -64,3 +83,53 @@ static void BM_NullableVectorGetNonNull(benchmark::State& state) {
   }
 }
 BENCHMARK(BM_NullableVectorGetNonNull);
+
+static void BM_NullableVectorGetHalfNull(benchmark::State& state) {
+  std::vector<uint32_t> idx_pool(kPoolSize);
+
+  auto sv = CreateHalfNull();
+  static constexpr uint32_t kRandomSeed = 42;
+  std::minstd_rand0 rnd_engine(kRandomSeed);
+  for (uint32_t i = 0; i < kPoolSize; ++i) {
+    idx_pool[i] = rnd_engine() % kSize;
+  }
+
+  uint32_t pool_idx = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sv.Get(idx_pool[pool_idx]));
+    pool_idx = (pool_idx + 1) % kPoolSize;
+  }
+}
+BENCHMARK(BM_NullableVectorGetHalfNull);
+
+static void BM_NullableVectorFilterHalfNull(benchmark::State& state) {
+  using NullableVector = perfetto::trace_processor::NullableVector<int64_t>;
+  auto sv = CreateHalfNull();
+
+  for (auto _ : state) {
+    // Mirrors the way columns are filtered: a full scan of the values.
+    NullableVector::Cursor cursor(&sv);
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < sv.size(); ++i) {
+      auto value = cursor.Get(i);
+      count += value && *value < 500;
+    }
+    benchmark::DoNotOptimize(count);
+  }
+}
+BENCHMARK(BM_NullableVectorFilterHalfNull);
+
+static void BM_NullableVectorSortHalfNull(benchmark::State& state) {
+  auto sv = CreateHalfNull();
+
+  std::vector<uint32_t> idx(sv.size());
+  for (auto _ : state) {
+    // Mirrors the way columns are sorted: a stable sort of the indices.
+    std::iota(idx.begin(), idx.end(), 0);
+    std::stable_sort(idx.begin(), idx.end(), [&sv](uint32_t a, uint32_t b) {
+      return sv.Get(a) < sv.Get(b);
+    });
+    benchmark::ClobberMemory();
+  }
+}
+BENCHMARK(BM_NullableVectorSortHalfNull);
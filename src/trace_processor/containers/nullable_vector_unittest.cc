@@ -91,6 +91,54 @@ TEST(NullableVector, Dense) {
   ASSERT_EQ(sv.Get(2), 2);
 }
 
+TEST(NullableVector, SetAcrossChunks) {
+  static constexpr uint32_t kSize = NullableVector<int64_t>::kChunkSize * 3;
+  NullableVector<int64_t> sv;
+  for (uint32_t i = 0; i < kSize; ++i) {
+    if (i % 3 == 0) {
+      sv.Append(base::nullopt);
+    } else {
+      sv.Append(i);
+    }
+  }
+  for (uint32_t i = 0; i < kSize; i += 6)
+    sv.Set(i, i);
+
+  ASSERT_EQ(sv.size(), kSize);
+  for (uint32_t i = 0; i < kSize; ++i) {
+    if (i % 6 == 3) {
+      ASSERT_EQ(sv.Get(i), base::nullopt);
+    } else {
+      ASSERT_EQ(sv.Get(i), base::Optional<int64_t>(i));
+    }
+  }
+}
+
+TEST(NullableVector, Cursor) {
+  static constexpr uint32_t kSize = NullableVector<int64_t>::kChunkSize * 2 + 5;
+  for (bool dense : {false, true}) {
+    auto sv = dense ? NullableVector<int64_t>::Dense()
+                    : NullableVector<int64_t>::Sparse();
+    for (uint32_t i = 0; i < kSize; ++i) {
+      if (i % 5 == 0 || i % 7 == 0) {
+        sv.Append(base::nullopt);
+      } else {
+        sv.Append(i);
+      }
+    }
+
+    // Sequential reads.
+    NullableVector<int64_t>::Cursor cursor(&sv);
+    for (uint32_t i = 0; i < kSize; ++i)
+      ASSERT_EQ(cursor.Get(i), sv.Get(i));
+
+    // Skipping and going back.
+    NullableVector<int64_t>::Cursor other(&sv);
+    for (uint32_t i : {3u, 4u, 2047u, 2048u, 2049u, 10u, 11u, 12u, 4100u})
+      ASSERT_EQ(other.Get(i), sv.Get(i));
+  }
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
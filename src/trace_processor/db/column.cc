@@ -16,12 +16,65 @@
 
 #include "src/trace_processor/db/column.h"
 
+#include <string.h>
+
+#include <algorithm>
+#include <limits>
+
 #include "src/trace_processor/db/compare.h"
 #include "src/trace_processor/db/table.h"
 
 namespace perfetto {
 namespace trace_processor {
 
+namespace {
+
+// Maps numeric values to unsigned integers with the same order.
+uint64_t NumericSortKey(int32_t value) {
+  return static_cast<uint32_t>(value) ^ (uint32_t(1) << 31);
+}
+
+uint64_t NumericSortKey(uint32_t value) {
+  return value;
+}
+
+uint64_t NumericSortKey(int64_t value) {
+  return static_cast<uint64_t>(value) ^ (uint64_t(1) << 63);
+}
+
+uint64_t NumericSortKey(double value) {
+  // -0.0 and 0.0 compare equal.
+  if (value == 0)
+    value = 0;
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  // Negative values are ordered backwards by their bits and before positive
+  // values.
+  return bits >> 63 ? ~bits : bits | (uint64_t(1) << 63);
+}
+
+// Maps numeric values to the keys of the index of their column. All the
+// integer types use the keys of int64 values so they can be looked up with the
+// long value of a SqlValue.
+uint64_t IndexKey(int32_t value) {
+  return NumericSortKey(static_cast<int64_t>(value));
+}
+
+uint64_t IndexKey(uint32_t value) {
+  return NumericSortKey(static_cast<int64_t>(value));
+}
+
+uint64_t IndexKey(int64_t value) {
+  return NumericSortKey(value);
+}
+
+uint64_t IndexKey(double value) {
+  return NumericSortKey(value);
+}
+
+}  // namespace
+
 Column::Column(const Column& column,
                Table* table,
                uint32_t col_idx,
@@ -91,12 +144,267 @@ Column Column::IdColumn(Table* table, uint32_t col_idx, uint32_t overlay_idx) {
                 nullptr);
 }
 
-void Column::StableSort(bool desc, std::vector<uint32_t>* idx) const {
+void Column::GetBatch(uint32_t row, uint32_t count, SqlValue* out) const {
+  const ColumnStorageOverlay& ov = overlay();
+  switch (type_) {
+    case ColumnType::kInt32:
+      GetBatchTyped<int32_t>(row, count, out);
+      return;
+    case ColumnType::kUint32:
+      GetBatchTyped<uint32_t>(row, count, out);
+      return;
+    case ColumnType::kInt64:
+      GetBatchTyped<int64_t>(row, count, out);
+      return;
+    case ColumnType::kDouble:
+      GetBatchTyped<double>(row, count, out);
+      return;
+    case ColumnType::kString: {
+      for (uint32_t i = 0; i < count; ++i) {
+        const char* str = GetStringPoolStringAtIdx(ov.Get(row + i)).c_str();
+        out[i] = str == nullptr ? SqlValue() : SqlValue::String(str);
+      }
+      return;
+    }
+    case ColumnType::kId:
+      for (uint32_t i = 0; i < count; ++i)
+        out[i] = SqlValue::Long(ov.Get(row + i));
+      return;
+    case ColumnType::kDummy:
+      PERFETTO_FATAL("GetBatch not allowed on dummy column");
+  }
+  PERFETTO_FATAL("For GCC");
+}
+
+template <typename T>
+void Column::GetBatchTyped(uint32_t row, uint32_t count, SqlValue* out) const {
+  const ColumnStorageOverlay& ov = overlay();
+  if (IsNullable()) {
+    const auto& nv = storage<base::Optional<T>>();
+    for (uint32_t i = 0; i < count; ++i) {
+      base::Optional<T> value = nv.Get(ov.Get(row + i));
+      out[i] = value ? ToSqlValue(*value) : SqlValue();
+    }
+    return;
+  }
+  const auto& sv = storage<T>();
+  for (uint32_t i = 0; i < count; ++i)
+    out[i] = ToSqlValue(sv.Get(ov.Get(row + i)));
+}
+
+void Column::AppendSortKeys(bool desc,
+                            std::vector<std::vector<uint64_t>>* keys) const {
+  size_t first_key = keys->size();
+  switch (type_) {
+    case ColumnType::kInt32: {
+      if (IsNullable()) {
+        AppendNumericSortKeys<int32_t, true /* is_nullable */>(keys);
+      } else {
+        AppendNumericSortKeys<int32_t, false /* is_nullable */>(keys);
+      }
+      break;
+    }
+    case ColumnType::kUint32: {
+      if (IsNullable()) {
+        AppendNumericSortKeys<uint32_t, true /* is_nullable */>(keys);
+      } else {
+        AppendNumericSortKeys<uint32_t, false /* is_nullable */>(keys);
+      }
+      break;
+    }
+    case ColumnType::kInt64: {
+      if (IsNullable()) {
+        AppendNumericSortKeys<int64_t, true /* is_nullable */>(keys);
+      } else {
+        AppendNumericSortKeys<int64_t, false /* is_nullable */>(keys);
+      }
+      break;
+    }
+    case ColumnType::kDouble: {
+      if (IsNullable()) {
+        AppendNumericSortKeys<double, true /* is_nullable */>(keys);
+      } else {
+        AppendNumericSortKeys<double, false /* is_nullable */>(keys);
+      }
+      break;
+    }
+    case ColumnType::kString:
+      AppendStringSortKeys(keys);
+      break;
+    case ColumnType::kId: {
+      std::vector<uint64_t> ids;
+      ids.reserve(overlay().size());
+      for (auto it = overlay().IterateRows(); it; it.Next())
+        ids.push_back(it.index());
+      keys->emplace_back(std::move(ids));
+      break;
+    }
+    case ColumnType::kDummy:
+      PERFETTO_FATAL("AppendSortKeys not allowed on dummy column");
+  }
+
   if (desc) {
-    StableSort<true /* desc */>(idx);
+    for (size_t i = first_key; i < keys->size(); ++i) {
+      for (uint64_t& key : (*keys)[i])
+        key = ~key;
+    }
+  }
+}
+
+bool Column::CreateIndex() const {
+  if (IsId() || IsDummy() || IsSorted())
+    return false;
+  const ColumnStorageOverlay& ov = overlay();
+  if (!ov.IsRange() || (!ov.empty() && ov.Get(0) != 0))
+    return false;
+  if (UsableIndex())
+    return true;
+
+  std::vector<std::pair<uint64_t, uint32_t>> entries;
+  entries.reserve(ov.size());
+  switch (type_) {
+    case ColumnType::kInt32:
+      AppendNumericIndexEntries<int32_t>(ov.size(), &entries);
+      break;
+    case ColumnType::kUint32:
+      AppendNumericIndexEntries<uint32_t>(ov.size(), &entries);
+      break;
+    case ColumnType::kInt64:
+      AppendNumericIndexEntries<int64_t>(ov.size(), &entries);
+      break;
+    case ColumnType::kDouble:
+      AppendNumericIndexEntries<double>(ov.size(), &entries);
+      break;
+    case ColumnType::kString: {
+      // String ids are not ordered like the strings: these keys only support
+      // equality lookups (see FilterIntoIndex).
+      const auto& sv = storage<StringPool::Id>();
+      for (uint32_t i = 0; i < ov.size(); ++i) {
+        StringPool::Id id = sv.Get(i);
+        if (!id.is_null())
+          entries.emplace_back(id.raw_id(), i);
+      }
+      break;
+    }
+    case ColumnType::kId:
+    case ColumnType::kDummy:
+      PERFETTO_FATAL("Should be handled above");
+  }
+  storage_->set_index(std::unique_ptr<SecondaryIndex>(
+      new SecondaryIndex(ov.size(), std::move(entries))));
+  return true;
+}
+
+size_t Column::IndexSizeBytes() const {
+  const SecondaryIndex* index = storage_ ? storage_->index() : nullptr;
+  return index ? index->SizeBytes() : 0;
+}
+
+template <typename T>
+void Column::AppendNumericIndexEntries(
+    uint32_t size,
+    std::vector<std::pair<uint64_t, uint32_t>>* entries) const {
+  PERFETTO_DCHECK(ColumnTypeHelper<T>::ToColumnType() == type_);
+  if (IsNullable()) {
+    typename NullableVector<T>::Cursor cursor(
+        &storage<base::Optional<T>>().vector());
+    for (uint32_t i = 0; i < size; ++i) {
+      base::Optional<T> value = cursor.Get(i);
+      if (value)
+        entries->emplace_back(IndexKey(*value), i);
+    }
   } else {
-    StableSort<false /* desc */>(idx);
+    const auto& sv = storage<T>();
+    for (uint32_t i = 0; i < size; ++i)
+      entries->emplace_back(IndexKey(sv.Get(i)), i);
+  }
+}
+
+const SecondaryIndex* Column::UsableIndex() const {
+  const SecondaryIndex* index = storage_ ? storage_->index() : nullptr;
+  if (!index)
+    return nullptr;
+
+  // The index finds indices of the storage: it can only be used if the rows
+  // of this column are the indices of the storage in order.
+  const ColumnStorageOverlay& ov = overlay();
+  if (!ov.IsRange() || ov.size() != index->size() ||
+      (!ov.empty() && ov.Get(0) != 0)) {
+    return nullptr;
+  }
+  return index;
+}
+
+bool Column::FilterIntoIndex(FilterOp op, SqlValue value, RowMap* rm) const {
+  const SecondaryIndex* index = UsableIndex();
+  if (!index)
+    return false;
+
+  uint64_t key = 0;
+  switch (type_) {
+    case ColumnType::kInt32:
+    case ColumnType::kUint32:
+    case ColumnType::kInt64:
+      // Comparisons with doubles need the values to be converted.
+      if (value.type != SqlValue::Type::kLong)
+        return false;
+      key = IndexKey(value.long_value);
+      break;
+    case ColumnType::kDouble:
+      if (value.type != SqlValue::Type::kDouble)
+        return false;
+      key = IndexKey(value.double_value);
+      break;
+    case ColumnType::kString: {
+      if (op != FilterOp::kEq || value.type != SqlValue::Type::kString)
+        return false;
+      // Strings are interned: if the string is not in the pool, no row can be
+      // equal to it.
+      base::Optional<StringPool::Id> id =
+          string_pool_->GetId(value.string_value);
+      if (id) {
+        index->IntersectEq(id->raw_id(), rm);
+      } else {
+        rm->Clear();
+      }
+      return true;
+    }
+    case ColumnType::kId:
+    case ColumnType::kDummy:
+      return false;
+  }
+
+  constexpr uint64_t kMaxKey = std::numeric_limits<uint64_t>::max();
+  switch (op) {
+    case FilterOp::kEq:
+      index->IntersectEq(key, rm);
+      return true;
+    case FilterOp::kLt:
+      if (key == 0) {
+        rm->Clear();
+      } else {
+        index->IntersectRange(0, key - 1, rm);
+      }
+      return true;
+    case FilterOp::kLe:
+      index->IntersectRange(0, key, rm);
+      return true;
+    case FilterOp::kGt:
+      if (key == kMaxKey) {
+        rm->Clear();
+      } else {
+        index->IntersectRange(key + 1, kMaxKey, rm);
+      }
+      return true;
+    case FilterOp::kGe:
+      index->IntersectRange(key, kMaxKey, rm);
+      return true;
+    case FilterOp::kNe:
+    case FilterOp::kIsNull:
+    case FilterOp::kIsNotNull:
+      return false;
   }
+  PERFETTO_FATAL("For GCC");
 }
 
 void Column::FilterIntoSlow(FilterOp op, SqlValue value, RowMap* rm) const {
@@ -157,8 +465,10 @@ void Column::FilterIntoNumericSlow(FilterOp op,
   if (op == FilterOp::kIsNull) {
     PERFETTO_DCHECK(value.is_null());
     if (is_nullable) {
-      overlay().FilterInto(rm, [this](uint32_t row) {
-        return !storage<base::Optional<T>>().Get(row).has_value();
+      typename NullableVector<T>::Cursor cursor(
+          &storage<base::Optional<T>>().vector());
+      overlay().FilterInto(rm, [&cursor](uint32_t row) {
+        return !cursor.Get(row).has_value();
       });
     } else {
       rm->Clear();
@@ -167,13 +477,20 @@ void Column::FilterIntoNumericSlow(FilterOp op,
   } else if (op == FilterOp::kIsNotNull) {
     PERFETTO_DCHECK(value.is_null());
     if (is_nullable) {
-      overlay().FilterInto(rm, [this](uint32_t row) {
-        return storage<base::Optional<T>>().Get(row).has_value();
+      typename NullableVector<T>::Cursor cursor(
+          &storage<base::Optional<T>>().vector());
+      overlay().FilterInto(rm, [&cursor](uint32_t row) {
+        return cursor.Get(row).has_value();
       });
     }
     return;
   }
 
+  if (!is_nullable && value.type == SqlValue::Type::kLong &&
+      FilterIntoEncoded(storage<T>().encoded(), op, value.long_value, rm)) {
+    return;
+  }
+
   if (value.type == SqlValue::Type::kDouble) {
     double double_value = value.double_value;
     if (std::is_same<T, double>::value) {
@@ -218,60 +535,118 @@ void Column::FilterIntoNumericSlow(FilterOp op,
   }
 }
 
+bool Column::FilterIntoEncoded(const EncodedIntVector* encoded,
+                               FilterOp op,
+                               int64_t value,
+                               RowMap* rm) const {
+  // Filtering the encoded data always goes through the whole column: only do
+  // it if a large enough part of the column is left to filter.
+  if (!encoded || rm->size() < encoded->size() / 16)
+    return false;
+
+  int64_t min = std::numeric_limits<int64_t>::min();
+  int64_t max = std::numeric_limits<int64_t>::max();
+  bool negate = false;
+  switch (op) {
+    case FilterOp::kEq:
+      min = max = value;
+      break;
+    case FilterOp::kNe:
+      min = max = value;
+      negate = true;
+      break;
+    case FilterOp::kLt:
+      if (value == min) {
+        rm->Clear();
+        return true;
+      }
+      max = value - 1;
+      break;
+    case FilterOp::kLe:
+      max = value;
+      break;
+    case FilterOp::kGt:
+      if (value == max) {
+        rm->Clear();
+        return true;
+      }
+      min = value + 1;
+      break;
+    case FilterOp::kGe:
+      min = value;
+      break;
+    case FilterOp::kIsNull:
+    case FilterOp::kIsNotNull:
+      return false;
+  }
+
+  BitVector matches = encoded->FilterRange(min, max);
+  overlay().FilterInto(rm, [&matches, negate](uint32_t idx) {
+    return matches.IsSet(idx) != negate;
+  });
+  return true;
+}
+
 template <typename T, bool is_nullable, typename Comparator>
 void Column::FilterIntoNumericWithComparatorSlow(FilterOp op,
                                                  RowMap* rm,
                                                  Comparator cmp) const {
+  // Rows are mostly filtered in increasing order: read nullable values through
+  // a cursor to avoid looking up the position of each value.
+  base::Optional<typename NullableVector<T>::Cursor> cursor;
+  if (is_nullable)
+    cursor.emplace(&storage<base::Optional<T>>().vector());
+
   switch (op) {
     case FilterOp::kLt:
-      overlay().FilterInto(rm, [this, &cmp](uint32_t idx) {
+      overlay().FilterInto(rm, [this, &cmp, &cursor](uint32_t idx) {
         if (is_nullable) {
-          auto opt_value = storage<base::Optional<T>>().Get(idx);
+          auto opt_value = cursor->Get(idx);
           return opt_value && cmp(*opt_value) < 0;
         }
         return cmp(storage<T>().Get(idx)) < 0;
       });
       break;
     case FilterOp::kEq:
-      overlay().FilterInto(rm, [this, &cmp](uint32_t idx) {
+      overlay().FilterInto(rm, [this, &cmp, &cursor](uint32_t idx) {
         if (is_nullable) {
-          auto opt_value = storage<base::Optional<T>>().Get(idx);
+          auto opt_value = cursor->Get(idx);
           return opt_value && cmp(*opt_value) == 0;
         }
         return cmp(storage<T>().Get(idx)) == 0;
       });
       break;
     case FilterOp::kGt:
-      overlay().FilterInto(rm, [this, &cmp](uint32_t idx) {
+      overlay().FilterInto(rm, [this, &cmp, &cursor](uint32_t idx) {
         if (is_nullable) {
-          auto opt_value = storage<base::Optional<T>>().Get(idx);
+          auto opt_value = cursor->Get(idx);
           return opt_value && cmp(*opt_value) > 0;
         }
         return cmp(storage<T>().Get(idx)) > 0;
       });
       break;
     case FilterOp::kNe:
-      overlay().FilterInto(rm, [this, &cmp](uint32_t idx) {
+      overlay().FilterInto(rm, [this, &cmp, &cursor](uint32_t idx) {
         if (is_nullable) {
-          auto opt_value = storage<base::Optional<T>>().Get(idx);
+          auto opt_value = cursor->Get(idx);
           return opt_value && cmp(*opt_value) != 0;
         }
         return cmp(storage<T>().Get(idx)) != 0;
       });
       break;
     case FilterOp::kLe:
-      overlay().FilterInto(rm, [this, &cmp](uint32_t idx) {
+      overlay().FilterInto(rm, [this, &cmp, &cursor](uint32_t idx) {
         if (is_nullable) {
-          auto opt_value = storage<base::Optional<T>>().Get(idx);
+          auto opt_value = cursor->Get(idx);
           return opt_value && cmp(*opt_value) <= 0;
         }
         return cmp(storage<T>().Get(idx)) <= 0;
       });
       break;
     case FilterOp::kGe:
-      overlay().FilterInto(rm, [this, &cmp](uint32_t idx) {
+      overlay().FilterInto(rm, [this, &cmp, &cursor](uint32_t idx) {
         if (is_nullable) {
-          auto opt_value = storage<base::Optional<T>>().Get(idx);
+          auto opt_value = cursor->Get(idx);
           return opt_value && cmp(*opt_value) >= 0;
         }
         return cmp(storage<T>().Get(idx)) >= 0;
@@ -408,81 +783,80 @@ void Column::FilterIntoIdSlow(FilterOp op, SqlValue value, RowMap* rm) const {
   }
 }
 
-template <bool desc>
-void Column::StableSort(std::vector<uint32_t>* out) const {
-  switch (type_) {
-    case ColumnType::kInt32: {
-      if (IsNullable()) {
-        StableSortNumeric<desc, int32_t, true /* is_nullable */>(out);
-      } else {
-        StableSortNumeric<desc, int32_t, false /* is_nullable */>(out);
-      }
-      break;
-    }
-    case ColumnType::kUint32: {
-      if (IsNullable()) {
-        StableSortNumeric<desc, uint32_t, true /* is_nullable */>(out);
-      } else {
-        StableSortNumeric<desc, uint32_t, false /* is_nullable */>(out);
-      }
-      break;
-    }
-    case ColumnType::kInt64: {
-      if (IsNullable()) {
-        StableSortNumeric<desc, int64_t, true /* is_nullable */>(out);
-      } else {
-        StableSortNumeric<desc, int64_t, false /* is_nullable */>(out);
-      }
-      break;
-    }
-    case ColumnType::kDouble: {
-      if (IsNullable()) {
-        StableSortNumeric<desc, double, true /* is_nullable */>(out);
+template <typename T, bool is_nullable>
+void Column::AppendNumericSortKeys(
+    std::vector<std::vector<uint64_t>>* keys) const {
+  PERFETTO_DCHECK(IsNullable() == is_nullable);
+  PERFETTO_DCHECK(ColumnTypeHelper<T>::ToColumnType() == type_);
+
+  // The keys of 32 bit values leave room to encode nulls as a key before
+  // all the others. 64 bit values need a separate key for whether they are
+  // null.
+  bool separate_null_keys = is_nullable && sizeof(T) == sizeof(uint64_t);
+  std::vector<uint64_t> null_keys(separate_null_keys ? overlay().size() : 0);
+  std::vector<uint64_t> value_keys(overlay().size());
+
+  uint32_t row = 0;
+  if (is_nullable) {
+    typename NullableVector<T>::Cursor cursor(
+        &storage<base::Optional<T>>().vector());
+    for (auto it = overlay().IterateRows(); it; it.Next(), ++row) {
+      base::Optional<T> value = cursor.Get(it.index());
+      if (!value)
+        continue;
+      if (separate_null_keys) {
+        null_keys[row] = 1;
+        value_keys[row] = NumericSortKey(*value);
       } else {
-        StableSortNumeric<desc, double, false /* is_nullable */>(out);
+        value_keys[row] = NumericSortKey(*value) + 1;
       }
-      break;
-    }
-    case ColumnType::kString: {
-      overlay().StableSort(out, [this](uint32_t a_idx, uint32_t b_idx) {
-        auto a_str = GetStringPoolStringAtIdx(a_idx);
-        auto b_str = GetStringPoolStringAtIdx(b_idx);
-
-        int res = compare::NullableString(a_str, b_str);
-        return desc ? res > 0 : res < 0;
-      });
-      break;
     }
-    case ColumnType::kId:
-      overlay().StableSort(out, [](uint32_t a_idx, uint32_t b_idx) {
-        int res = compare::Numeric(a_idx, b_idx);
-        return desc ? res > 0 : res < 0;
-      });
-      break;
-    case ColumnType::kDummy:
-      PERFETTO_FATAL("StableSort not allowed on dummy column");
+  } else {
+    for (auto it = overlay().IterateRows(); it; it.Next(), ++row)
+      value_keys[row] = NumericSortKey(storage<T>().Get(it.index()));
   }
+
+  if (separate_null_keys)
+    keys->emplace_back(std::move(null_keys));
+  keys->emplace_back(std::move(value_keys));
 }
 
-template <bool desc, typename T, bool is_nullable>
-void Column::StableSortNumeric(std::vector<uint32_t>* out) const {
-  PERFETTO_DCHECK(IsNullable() == is_nullable);
-  PERFETTO_DCHECK(ColumnTypeHelper<T>::ToColumnType() == type_);
+void Column::AppendStringSortKeys(
+    std::vector<std::vector<uint64_t>>* keys) const {
+  PERFETTO_DCHECK(type_ == ColumnType::kString);
 
-  overlay().StableSort(out, [this](uint32_t a_idx, uint32_t b_idx) {
-    if (is_nullable) {
-      auto a_val = storage<base::Optional<T>>().Get(a_idx);
-      auto b_val = storage<base::Optional<T>>().Get(b_idx);
+  std::vector<uint64_t> ids;
+  ids.reserve(overlay().size());
+  for (auto it = overlay().IterateRows(); it; it.Next())
+    ids.push_back(storage<StringPool::Id>().Get(it.index()).raw_id());
 
-      int res = compare::NullableNumeric(a_val, b_val);
-      return desc ? res > 0 : res < 0;
-    }
-    auto a_val = storage<T>().Get(a_idx);
-    auto b_val = storage<T>().Get(b_idx);
+  // Strings are interned so each distinct string only needs to be compared
+  // once: the key of a row is then the rank of its string among all the
+  // distinct strings of the column.
+  std::vector<uint32_t> by_string(ids.begin(), ids.end());
+  std::sort(by_string.begin(), by_string.end());
+  by_string.erase(std::unique(by_string.begin(), by_string.end()),
+                  by_string.end());
+  std::sort(by_string.begin(), by_string.end(),
+            [this](uint32_t a, uint32_t b) {
+              return compare::NullableString(
+                         string_pool_->Get(StringPool::Id::Raw(a)),
+                         string_pool_->Get(StringPool::Id::Raw(b))) < 0;
+            });
 
-    int res = compare::Numeric(a_val, b_val);
-    return desc ? res > 0 : res < 0;
-  });
+  std::vector<std::pair<uint32_t, uint32_t>> rank_by_id(by_string.size());
+  for (uint32_t i = 0; i < by_string.size(); ++i)
+    rank_by_id[i] = std::make_pair(by_string[i], i);
+  std::sort(rank_by_id.begin(), rank_by_id.end());
+
+  for (uint64_t& id : ids) {
+    auto it = std::lower_bound(
+        rank_by_id.begin(), rank_by_id.end(),
+        std::make_pair(static_cast<uint32_t>(id), uint32_t(0)));
+    PERFETTO_DCHECK(it != rank_by_id.end() && it->first == id);
+    id = it->second;
+  }
+  keys->emplace_back(std::move(ids));
 }
 
 const ColumnStorageOverlay& Column::overlay() const {
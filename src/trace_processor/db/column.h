@@ -260,6 +260,11 @@ class Column {
   // Gets the value of the Column at the given |row|.
   SqlValue Get(uint32_t row) const { return GetAtIdx(overlay().Get(row)); }
 
+  // Gets the values of the Column for the |count| rows starting at |row| and
+  // writes them to |out|. Equivalent to calling |Get| for each row but only
+  // switches on the type of the Column once for the whole batch.
+  void GetBatch(uint32_t row, uint32_t count, SqlValue* out) const;
+
   // Returns the row containing the given value in the Column.
   base::Optional<uint32_t> IndexOf(SqlValue value) const {
     switch (type_) {
@@ -288,9 +293,35 @@ class Column {
     PERFETTO_FATAL("For GCC");
   }
 
-  // Sorts |idx| in ascending or descending order (determined by |desc|) based
-  // on the contents of this column.
-  void StableSort(bool desc, std::vector<uint32_t>* idx) const;
+  // Appends to |keys| one or two arrays of sort keys with an entry for each
+  // row of this column: comparing the keys of two rows lexicographically (in
+  // the order the arrays were appended) gives the same order as comparing the
+  // values of this column in ascending or descending order (determined by
+  // |desc|). Nulls sort before any other value in ascending order.
+  //
+  // Unlike the values themselves, the keys can be compared without going
+  // through the overlay or the string pool which makes them much faster to
+  // sort (see Table::Sort).
+  void AppendSortKeys(bool desc,
+                      std::vector<std::vector<uint64_t>>* keys) const;
+
+  // Builds an index over the values of this column which speeds up equality
+  // and range filters (only equality for strings). The index is shared with
+  // the columns backed by the same storage and is dropped when the values are
+  // modified.
+  //
+  // Returns false, without building the index, if the column cannot use an
+  // index: ids, dummy and sorted columns already have faster ways to filter
+  // and the index is only used while the rows of the table are the values of
+  // the storage in order (i.e. the table was not filtered or sorted).
+  bool CreateIndex() const;
+
+  // Returns whether this column has an index it can use for filtering.
+  bool HasIndex() const { return UsableIndex() != nullptr; }
+
+  // Returns the number of bytes used by the index of this column or 0 if the
+  // column has no index.
+  size_t IndexSizeBytes() const;
 
   // Updates the given RowMap by only keeping rows where this column meets the
   // given filter constraint.
@@ -324,6 +355,14 @@ class Column {
         return;
     }
 
+    if (PERFETTO_UNLIKELY(storage_ && storage_->index())) {
+      // If the column has an index, use it to find the matching rows instead
+      // of a full table scan.
+      bool handled = FilterIntoIndex(op, value, rm);
+      if (handled)
+        return;
+    }
+
     FilterIntoSlow(op, value, rm);
   }
 
@@ -389,6 +428,12 @@ class Column {
   // Public for testing.
   bool IsDummy() const { return type_ == ColumnType::kDummy; }
 
+  // Returns a number which changes every time the values of the column are
+  // modified (see ColumnStorageBase::mutation_count).
+  uint64_t mutation_count() const {
+    return storage_ ? storage_->mutation_count() : 0;
+  }
+
   // Returns the index of the RowMap in the containing table.
   uint32_t overlay_index() const { return overlay_index_; }
 
@@ -521,6 +566,9 @@ class Column {
     PERFETTO_FATAL("For GCC");
   }
 
+  template <typename T>
+  void GetBatchTyped(uint32_t row, uint32_t count, SqlValue* out) const;
+
   template <typename T>
   SqlValue GetAtIdxTyped(uint32_t idx) const {
     if (IsNullable()) {
@@ -613,6 +661,22 @@ class Column {
     rm->Intersect(set_id, ov.size());
   }
 
+  // Returns the index of the storage if it can be used to filter this column
+  // or nullptr otherwise.
+  const SecondaryIndex* UsableIndex() const;
+
+  // Appends to |entries| the index entries of the first |size| values of this
+  // numeric column. |T| should match the type of this column.
+  template <typename T>
+  void AppendNumericIndexEntries(
+      uint32_t size,
+      std::vector<std::pair<uint64_t, uint32_t>>* entries) const;
+
+  // Filters |rm| using the index of the storage. Returns false, without
+  // modifying |rm|, if there is no usable index or if it does not support the
+  // filter.
+  bool FilterIntoIndex(FilterOp op, SqlValue value, RowMap* rm) const;
+
   // Slow path filter method which will perform a full table scan.
   void FilterIntoSlow(FilterOp op, SqlValue value, RowMap* rm) const;
 
@@ -620,6 +684,14 @@ class Column {
   template <typename T, bool is_nullable>
   void FilterIntoNumericSlow(FilterOp op, SqlValue value, RowMap* rm) const;
 
+  // Filters |rm| by comparing the values of a compressed integer column to
+  // |value| directly on |encoded|. Returns false, without modifying |rm|, if
+  // |encoded| is null or if the filter is cheaper on the decoded values.
+  bool FilterIntoEncoded(const EncodedIntVector* encoded,
+                         FilterOp op,
+                         int64_t value,
+                         RowMap* rm) const;
+
   // Slow path filter method for numerics with a comparator which will perform a
   // full table scan.
   template <typename T, bool is_nullable, typename Comparator = int(T)>
@@ -633,14 +705,13 @@ class Column {
   // Slow path filter method for ids which will perform a full table scan.
   void FilterIntoIdSlow(FilterOp op, SqlValue value, RowMap* rm) const;
 
-  // Stable sorts this column storing the result in |out|.
-  template <bool desc>
-  void StableSort(std::vector<uint32_t>* out) const;
-
-  // Stable sorts this column storing the result in |out|.
+  // Appends the sort keys of this numeric column to |keys|.
   // |T| and |is_nullable| should match the type and nullability of this column.
-  template <bool desc, typename T, bool is_nullable>
-  void StableSortNumeric(std::vector<uint32_t>* out) const;
+  template <typename T, bool is_nullable>
+  void AppendNumericSortKeys(std::vector<std::vector<uint64_t>>* keys) const;
+
+  // Appends the sort keys of this string column to |keys|.
+  void AppendStringSortKeys(std::vector<std::vector<uint64_t>>* keys) const;
 
   static constexpr bool IsDense(uint32_t flags) {
     return (flags & Flag::kDense) != 0;
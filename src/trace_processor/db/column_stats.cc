@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/db/column_stats.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <unordered_map>
+
+#include "src/trace_processor/db/compare.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+// Returns a key which is equal for equal non-null values of the same type.
+// Strings are interned in the string pool so their pointers can be compared.
+int64_t ValueKey(const SqlValue& value) {
+  switch (value.type) {
+    case SqlValue::Type::kLong:
+      return value.long_value;
+    case SqlValue::Type::kDouble: {
+      int64_t bits;
+      memcpy(&bits, &value.double_value, sizeof(bits));
+      return bits;
+    }
+    case SqlValue::Type::kString:
+      return static_cast<int64_t>(
+          reinterpret_cast<uintptr_t>(value.string_value));
+    case SqlValue::Type::kBytes:
+      return static_cast<int64_t>(
+          reinterpret_cast<uintptr_t>(value.bytes_value));
+    case SqlValue::Type::kNull:
+      break;
+  }
+  PERFETTO_FATAL("Null values do not have a key");
+}
+
+bool IsNumeric(const SqlValue& value) {
+  return value.type == SqlValue::Type::kLong ||
+         value.type == SqlValue::Type::kDouble;
+}
+
+double NumericAsDouble(const SqlValue& value) {
+  return value.type == SqlValue::Type::kLong
+             ? static_cast<double>(value.long_value)
+             : value.double_value;
+}
+
+bool IsLess(const SqlValue& a, const SqlValue& b) {
+  return compare::SqlValue(a, b) < 0;
+}
+
+// Returns the bounds of an equi-depth histogram of |count| sorted values,
+// where |value_at(i)| returns the i-th value.
+template <typename ValueAt>
+std::vector<SqlValue> EquiDepthHistogram(uint32_t count, ValueAt value_at) {
+  std::vector<SqlValue> bounds;
+  if (count == 0)
+    return bounds;
+  uint32_t buckets = std::min(ColumnStats::kHistogramBuckets, count);
+  for (uint32_t i = 0; i <= buckets; ++i) {
+    uint64_t idx = static_cast<uint64_t>(count - 1) * i / buckets;
+    bounds.emplace_back(value_at(static_cast<uint32_t>(idx)));
+  }
+  return bounds;
+}
+
+}  // namespace
+
+// static
+constexpr uint32_t ColumnStats::kMaxSampleRows;
+
+// static
+constexpr uint32_t ColumnStats::kHistogramBuckets;
+
+// static
+ColumnStats ColumnStats::Compute(const Column& col, uint32_t row_count) {
+  ColumnStats stats;
+  stats.row_count = row_count;
+  if (row_count == 0 || col.IsDummy())
+    return stats;
+
+  auto get = [&col](uint32_t row) { return col.Get(row); };
+  if (col.IsId()) {
+    stats.distinct_count = row_count;
+    stats.min = col.Get(0);
+    stats.max = col.Get(row_count - 1);
+    stats.histogram = EquiDepthHistogram(row_count, get);
+    return stats;
+  }
+
+  // Count how many times each value is seen in the sample. One row is picked
+  // at random in each block of |stride| rows: always picking the first row
+  // would only ever see some of the values of columns which repeat with a
+  // period sharing a divisor with |stride| (e.g. per-cpu data).
+  uint32_t stride = (row_count + kMaxSampleRows - 1) / kMaxSampleRows;
+  std::minstd_rand rnd;
+  uint32_t sample_rows = 0;
+  uint32_t sample_nulls = 0;
+  std::unordered_map<int64_t, uint32_t> counts;
+  std::vector<SqlValue> sample_values;
+  for (uint32_t start = 0; start < row_count; start += stride) {
+    uint32_t row = start;
+    if (stride > 1) {
+      row = std::min(start + static_cast<uint32_t>(rnd() % stride),
+                     row_count - 1);
+    }
+    sample_rows++;
+    SqlValue value = col.Get(row);
+    if (value.is_null()) {
+      sample_nulls++;
+      continue;
+    }
+    counts[ValueKey(value)]++;
+    sample_values.emplace_back(value);
+    if (!stats.min || compare::SqlValue(value, *stats.min) < 0)
+      stats.min = value;
+    if (!stats.max || compare::SqlValue(value, *stats.max) > 0)
+      stats.max = value;
+  }
+
+  if (col.IsSorted() && !col.IsNullable()) {
+    // The values are already in order: the histogram can be exact.
+    stats.min = col.Get(0);
+    stats.max = col.Get(row_count - 1);
+    stats.histogram = EquiDepthHistogram(row_count, get);
+  } else {
+    if (col.IsSorted()) {
+      SqlValue first = col.Get(0);
+      SqlValue last = col.Get(row_count - 1);
+      if (!first.is_null())
+        stats.min = first;
+      if (!last.is_null())
+        stats.max = last;
+    }
+    std::sort(sample_values.begin(), sample_values.end(), IsLess);
+    stats.histogram = EquiDepthHistogram(
+        static_cast<uint32_t>(sample_values.size()),
+        [&sample_values](uint32_t i) { return sample_values[i]; });
+  }
+
+  stats.null_count = static_cast<uint32_t>(
+      static_cast<uint64_t>(sample_nulls) * row_count / sample_rows);
+  uint32_t non_null_count = row_count - stats.null_count;
+
+  uint32_t sample_distinct = static_cast<uint32_t>(counts.size());
+  if (sample_rows == row_count) {
+    stats.distinct_count = sample_distinct;
+    return stats;
+  }
+
+  // Guaranteed-error estimator (Charikar et al.): the values seen exactly
+  // once in the sample are scaled up by sqrt(rows / sample rows) as they are
+  // the ones likely to stand for values which were not sampled.
+  uint32_t singletons = 0;
+  for (const auto& value_and_count : counts)
+    singletons += value_and_count.second == 1;
+  double scale = sqrt(static_cast<double>(row_count) / sample_rows);
+  double estimate = scale * singletons + (sample_distinct - singletons);
+  stats.distinct_count = std::max(
+      sample_distinct,
+      static_cast<uint32_t>(
+          std::min(estimate, static_cast<double>(non_null_count))));
+  return stats;
+}
+
+base::Optional<double> ColumnStats::FractionBelow(const SqlValue& value,
+                                                  bool inclusive) const {
+  if (histogram.empty() || value.is_null())
+    return base::nullopt;
+  const SqlValue& first = histogram.front();
+  if (value.type != first.type && !(IsNumeric(value) && IsNumeric(first)))
+    return base::nullopt;
+
+  // |idx| is the first bound greater than |value| (or greater than or equal
+  // to it if not |inclusive|): the values below |value| fill the buckets
+  // before |idx - 1| and part of the bucket [idx - 1, idx].
+  auto it = inclusive ? std::upper_bound(histogram.begin(), histogram.end(),
+                                         value, IsLess)
+                      : std::lower_bound(histogram.begin(), histogram.end(),
+                                         value, IsLess);
+  auto idx = static_cast<size_t>(std::distance(histogram.begin(), it));
+  size_t buckets = histogram.size() - 1;
+  if (idx == 0)
+    return 0.0;
+  if (idx > buckets)
+    return 1.0;
+
+  // Assume that numeric values are uniformly distributed within a bucket.
+  double in_bucket = 0.5;
+  const SqlValue& lo = histogram[idx - 1];
+  const SqlValue& hi = histogram[idx];
+  if (IsNumeric(value) && IsNumeric(lo) && IsNumeric(hi)) {
+    double lo_value = NumericAsDouble(lo);
+    double hi_value = NumericAsDouble(hi);
+    if (hi_value > lo_value) {
+      in_bucket = (NumericAsDouble(value) - lo_value) / (hi_value - lo_value);
+      in_bucket = std::min(std::max(in_bucket, 0.0), 1.0);
+    }
+  }
+  return (static_cast<double>(idx - 1) + in_bucket) /
+         static_cast<double>(buckets);
+}
+
+TableStatsCache::TableStatsCache() = default;
+TableStatsCache::~TableStatsCache() = default;
+
+const std::vector<ColumnStats>& TableStatsCache::GetOrCompute(
+    const Table& table) {
+  Entry& entry = stats_[&table];
+  const std::vector<Column>& columns = table.columns();
+  bool rows_changed = entry.stats.size() != columns.size() ||
+                      (!entry.stats.empty() &&
+                       entry.stats.front().row_count != table.row_count());
+  if (rows_changed) {
+    entry.stats.assign(columns.size(), ColumnStats());
+    entry.mutation_counts.assign(columns.size(), 0);
+  }
+
+  // Values can also be modified in place (e.g. the duration of a slice is
+  // only known when it ends): recompute the statistics of those columns.
+  for (size_t i = 0; i < columns.size(); ++i) {
+    uint64_t mutation_count = columns[i].mutation_count();
+    if (!rows_changed && entry.mutation_counts[i] == mutation_count)
+      continue;
+    entry.stats[i] = ColumnStats::Compute(columns[i], table.row_count());
+    entry.mutation_counts[i] = mutation_count;
+  }
+  return entry.stats;
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
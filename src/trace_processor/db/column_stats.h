@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_DB_COLUMN_STATS_H_
+#define SRC_TRACE_PROCESSOR_DB_COLUMN_STATS_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <vector>
+
+#include "perfetto/ext/base/optional.h"
+#include "perfetto/trace_processor/basic_types.h"
+#include "src/trace_processor/db/table.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Statistics about the values of a Column, used to estimate the selectivity
+// of constraints when planning queries.
+//
+// To keep them cheap to compute on large tables, the statistics are computed
+// on a sample of at most |kMaxSampleRows| rows spread over the whole table:
+// they are exact for smaller tables and estimates otherwise. The min and max
+// of sorted columns are always exact.
+struct ColumnStats {
+  static constexpr uint32_t kMaxSampleRows = 64 * 1024;
+  static constexpr uint32_t kHistogramBuckets = 32;
+
+  // Computes the statistics of |col| which has |row_count| rows.
+  static ColumnStats Compute(const Column& col, uint32_t row_count);
+
+  // Returns the fraction of the rows which are null.
+  double null_fraction() const {
+    return row_count == 0 ? 0 : static_cast<double>(null_count) / row_count;
+  }
+
+  // Returns the estimated fraction of the non-null values which are less than
+  // |value| (or equal to it if |inclusive| is true), based on |histogram|.
+  // Returns nullopt if the histogram is empty or |value| cannot be compared
+  // with the values of the column.
+  base::Optional<double> FractionBelow(const SqlValue& value,
+                                       bool inclusive) const;
+
+  uint32_t row_count = 0;
+  uint32_t null_count = 0;
+  uint32_t distinct_count = 0;
+
+  // Null if the column does not have any non-null value.
+  base::Optional<SqlValue> min;
+  base::Optional<SqlValue> max;
+
+  // The bounds of an equi-depth histogram of the non-null values: each of the
+  // |histogram.size() - 1| buckets holds about the same number of values.
+  // Values repeated many times span several buckets. Empty if the column does
+  // not have any non-null value.
+  std::vector<SqlValue> histogram;
+};
+
+// Caches the statistics of the columns of tables. The statistics of a column
+// are computed the first time they are requested and recomputed only if rows
+// were added to the table or the values of the column were modified since.
+class TableStatsCache {
+ public:
+  TableStatsCache();
+  ~TableStatsCache();
+
+  // Returns the statistics of the columns of |table|, in the same order as
+  // the columns. Tables are identified by their address so |table| should
+  // outlive this class.
+  const std::vector<ColumnStats>& GetOrCompute(const Table& table);
+
+  // Drops the statistics of |table|, which is about to be destroyed.
+  void Erase(const Table* table) { stats_.erase(table); }
+
+ private:
+  struct Entry {
+    std::vector<ColumnStats> stats;
+
+    // The Column::mutation_count() of each column when its statistics were
+    // computed.
+    std::vector<uint64_t> mutation_counts;
+  };
+
+  std::map<const Table*, Entry> stats_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_DB_COLUMN_STATS_H_
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/db/column_stats.h"
+
+#include "src/trace_processor/tables/macros.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+#define PERFETTO_TP_TEST_STATS_TABLE_DEF(NAME, PARENT, C) \
+  NAME(TestStatsTable, "test_stats")                      \
+  PARENT(PERFETTO_TP_ROOT_TABLE_PARENT_DEF, C)            \
+  C(int64_t, ts, Column::Flag::kSorted)                   \
+  C(base::Optional<int64_t>, dur)                         \
+  C(StringPool::Id, name)
+PERFETTO_TP_TABLE(PERFETTO_TP_TEST_STATS_TABLE_DEF);
+
+TestStatsTable::~TestStatsTable() = default;
+
+class ColumnStatsTest : public ::testing::Test {
+ protected:
+  ColumnStatsTest() : table_(&pool_, nullptr) {}
+
+  // Adds |count| rows: dur is null for one row in 5 and has 80 distinct
+  // values otherwise while name has 3 distinct values.
+  void AddRows(uint32_t count) {
+    const char* kNames[] = {"a", "b", "c"};
+    for (uint32_t i = 0; i < count; ++i) {
+      uint32_t row = table_.row_count();
+      base::Optional<int64_t> dur;
+      if (row % 5 != 0)
+        dur = (row % 100) * 10;
+      table_.Insert(TestStatsTable::Row(
+          row, dur, pool_.InternString(kNames[row % 3])));
+    }
+  }
+
+  StringPool pool_;
+  TestStatsTable table_;
+};
+
+TEST_F(ColumnStatsTest, ExactOnSmallTables) {
+  AddRows(1000);
+  ColumnStats ts = ColumnStats::Compute(table_.ts(), table_.row_count());
+  ASSERT_EQ(ts.null_count, 0u);
+  ASSERT_EQ(ts.distinct_count, 1000u);
+  ASSERT_EQ(ts.min->AsLong(), 0);
+  ASSERT_EQ(ts.max->AsLong(), 999);
+
+  ColumnStats dur = ColumnStats::Compute(table_.dur(), table_.row_count());
+  ASSERT_EQ(dur.null_count, 200u);
+  ASSERT_DOUBLE_EQ(dur.null_fraction(), 0.2);
+  ASSERT_EQ(dur.distinct_count, 80u);
+  ASSERT_EQ(dur.min->AsLong(), 10);
+  ASSERT_EQ(dur.max->AsLong(), 990);
+
+  ColumnStats name = ColumnStats::Compute(table_.name(), table_.row_count());
+  ASSERT_EQ(name.distinct_count, 3u);
+  ASSERT_STREQ(name.min->AsString(), "a");
+  ASSERT_STREQ(name.max->AsString(), "c");
+}
+
+TEST_F(ColumnStatsTest, EstimatedOnLargeTables) {
+  AddRows(ColumnStats::kMaxSampleRows * 4);
+  uint32_t row_count = table_.row_count();
+
+  ColumnStats ts = ColumnStats::Compute(table_.ts(), row_count);
+  // Values which are all distinct are extrapolated from the sample and the
+  // min and max of sorted columns are exact.
+  ASSERT_GT(ts.distinct_count, row_count / 4);
+  ASSERT_LE(ts.distinct_count, row_count);
+  ASSERT_EQ(ts.max->AsLong(), row_count - 1);
+
+  ColumnStats name = ColumnStats::Compute(table_.name(), row_count);
+  ASSERT_EQ(name.distinct_count, 3u);
+
+  ColumnStats dur = ColumnStats::Compute(table_.dur(), row_count);
+  ASSERT_NEAR(dur.null_fraction(), 0.2, 0.01);
+  ASSERT_EQ(dur.distinct_count, 80u);
+}
+
+TEST_F(ColumnStatsTest, Histogram) {
+  AddRows(1000);
+  ColumnStats ts = ColumnStats::Compute(table_.ts(), table_.row_count());
+  ASSERT_EQ(ts.histogram.size(), ColumnStats::kHistogramBuckets + 1);
+  ASSERT_EQ(ts.histogram.front().AsLong(), 0);
+  ASSERT_EQ(ts.histogram.back().AsLong(), 999);
+  ASSERT_NEAR(*ts.FractionBelow(SqlValue::Long(250), false), 0.25, 0.01);
+  ASSERT_NEAR(*ts.FractionBelow(SqlValue::Double(749.5), true), 0.75, 0.01);
+  ASSERT_EQ(*ts.FractionBelow(SqlValue::Long(-1), true), 0.0);
+  ASSERT_EQ(*ts.FractionBelow(SqlValue::Long(999), true), 1.0);
+  ASSERT_FALSE(ts.FractionBelow(SqlValue::String("a"), true));
+
+  // dur takes values multiple of 10 in [10, 990] (0 is always null).
+  ColumnStats dur = ColumnStats::Compute(table_.dur(), table_.row_count());
+  ASSERT_NEAR(*dur.FractionBelow(SqlValue::Long(500), false), 0.5, 0.05);
+
+  // Strings are ordered but not interpolated: half of the names are below
+  // "b" and "b" itself spans a third of the histogram.
+  ColumnStats name = ColumnStats::Compute(table_.name(), table_.row_count());
+  double below_b = *name.FractionBelow(SqlValue::String("b"), false);
+  double upto_b = *name.FractionBelow(SqlValue::String("b"), true);
+  ASSERT_NEAR(below_b, 1.0 / 3, 0.05);
+  ASSERT_NEAR(upto_b, 2.0 / 3, 0.05);
+}
+
+TEST_F(ColumnStatsTest, CacheRecomputesWhenRowsAdded) {
+  TableStatsCache cache;
+  AddRows(10);
+  ASSERT_EQ(cache.GetOrCompute(table_)[2].distinct_count, 10u);
+  ASSERT_EQ(cache.GetOrCompute(table_).size(), table_.columns().size());
+
+  AddRows(10);
+  ASSERT_EQ(cache.GetOrCompute(table_)[2].distinct_count, 20u);
+  ASSERT_EQ(cache.GetOrCompute(table_)[2].row_count, 20u);
+}
+
+TEST_F(ColumnStatsTest, CacheRecomputesWhenValuesSet) {
+  TableStatsCache cache;
+  AddRows(10);
+  ASSERT_EQ(cache.GetOrCompute(table_)[3].distinct_count, 8u);
+  ASSERT_EQ(cache.GetOrCompute(table_)[3].null_count, 2u);
+
+  // Setting the null durations in place does not change the row count.
+  table_.mutable_dur()->Set(0, 1000);
+  table_.mutable_dur()->Set(5, 1000);
+  const std::vector<ColumnStats>& stats = cache.GetOrCompute(table_);
+  ASSERT_EQ(stats[3].null_count, 0u);
+  ASSERT_EQ(stats[3].distinct_count, 9u);
+  ASSERT_EQ(stats[3].max->AsLong(), 1000);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
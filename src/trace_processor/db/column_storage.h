@@ -17,7 +17,13 @@
 #ifndef SRC_TRACE_PROCESSOR_DB_COLUMN_STORAGE_H_
 #define SRC_TRACE_PROCESSOR_DB_COLUMN_STORAGE_H_
 
+#include <memory>
+#include <type_traits>
+
+#include "perfetto/base/compiler.h"
+#include "src/trace_processor/containers/encoded_int_vector.h"
 #include "src/trace_processor/containers/nullable_vector.h"
+#include "src/trace_processor/db/secondary_index.h"
 
 namespace perfetto {
 namespace trace_processor {
@@ -34,9 +40,64 @@ class ColumnStorageBase {
 
   ColumnStorageBase(ColumnStorageBase&&) = default;
   ColumnStorageBase& operator=(ColumnStorageBase&&) noexcept = default;
+
+  // Returns the index over the values of this storage or nullptr if no index
+  // was created (see Column::CreateIndex).
+  const SecondaryIndex* index() const { return index_.get(); }
+  void set_index(std::unique_ptr<SecondaryIndex> index) {
+    index_ = std::move(index);
+  }
+
+  // Returns the number of modifications of the values so far. Allows data
+  // derived from the values outside of this class (e.g. column statistics) to
+  // find out whether it is stale.
+  uint64_t mutation_count() const { return mutation_count_; }
+
+ protected:
+  // Drops the index as it would not match the values anymore and counts the
+  // modification. Should be called by every method modifying the values.
+  void OnValuesModified() {
+    mutation_count_++;
+    if (PERFETTO_UNLIKELY(index_))
+      index_.reset();
+  }
+
+ private:
+  std::unique_ptr<SecondaryIndex> index_;
+  uint64_t mutation_count_ = 0;
 };
 
+namespace column_storage_internal {
+
+template <typename T>
+T FromInt64(int64_t value, std::true_type /* is_integral */) {
+  return static_cast<T>(value);
+}
+
+template <typename T>
+T FromInt64(int64_t, std::false_type /* is_integral */) {
+  PERFETTO_FATAL("Only integer columns can be encoded");
+}
+
+template <typename T>
+std::unique_ptr<EncodedIntVector> Encode(const std::vector<T>& values,
+                                         std::true_type /* is_integral */) {
+  return EncodedIntVector::Encode(values);
+}
+
+template <typename T>
+std::unique_ptr<EncodedIntVector> Encode(const std::vector<T>&,
+                                         std::false_type /* is_integral */) {
+  return nullptr;
+}
+
+}  // namespace column_storage_internal
+
 // Class used for implementing storage for non-null columns.
+//
+// Integer columns are compressed when the table is finalized (see
+// |ShrinkToFit|) if one of the encodings of EncodedIntVector saves enough
+// memory. Modifying a compressed column decompresses it.
 template <typename T>
 class ColumnStorage : public ColumnStorageBase {
  public:
@@ -48,11 +109,42 @@ class ColumnStorage : public ColumnStorageBase {
   ColumnStorage(ColumnStorage&&) = default;
   ColumnStorage& operator=(ColumnStorage&&) noexcept = default;
 
-  T Get(uint32_t idx) const { return vector_[idx]; }
-  void Append(T val) { vector_.emplace_back(val); }
-  void Set(uint32_t idx, T val) { vector_[idx] = val; }
-  uint32_t size() const { return static_cast<uint32_t>(vector_.size()); }
-  void ShrinkToFit() { vector_.shrink_to_fit(); }
+  T Get(uint32_t idx) const {
+    if (PERFETTO_UNLIKELY(encoded_)) {
+      return column_storage_internal::FromInt64<T>(encoded_->Get(idx),
+                                                   std::is_integral<T>());
+    }
+    return vector_[idx];
+  }
+  void Append(T val) {
+    OnValuesModified();
+    Decode();
+    vector_.emplace_back(val);
+  }
+  void Set(uint32_t idx, T val) {
+    OnValuesModified();
+    Decode();
+    vector_[idx] = val;
+  }
+  uint32_t size() const {
+    return encoded_ ? encoded_->size() : static_cast<uint32_t>(vector_.size());
+  }
+
+  // Releases the unused memory and compresses integer columns.
+  void ShrinkToFit() {
+    if (encoded_)
+      return;
+    encoded_ =
+        column_storage_internal::Encode(vector_, std::is_integral<T>());
+    if (encoded_) {
+      std::vector<T>().swap(vector_);
+    } else {
+      vector_.shrink_to_fit();
+    }
+  }
+
+  // Returns the compressed values or nullptr if the column is not compressed.
+  const EncodedIntVector* encoded() const { return encoded_.get(); }
 
   template <bool IsDense>
   static ColumnStorage<T> Create() {
@@ -61,7 +153,19 @@ class ColumnStorage : public ColumnStorageBase {
   }
 
  private:
+  void Decode() {
+    if (PERFETTO_LIKELY(!encoded_))
+      return;
+    vector_.reserve(encoded_->size() + 1);
+    for (uint32_t i = 0; i < encoded_->size(); ++i) {
+      vector_.emplace_back(column_storage_internal::FromInt64<T>(
+          encoded_->Get(i), std::is_integral<T>()));
+    }
+    encoded_.reset();
+  }
+
   std::vector<T> vector_;
+  std::unique_ptr<EncodedIntVector> encoded_;
 };
 
 // Class used for implementing storage for nullable columns.
@@ -77,13 +181,24 @@ class ColumnStorage<base::Optional<T>> : public ColumnStorageBase {
   ColumnStorage& operator=(ColumnStorage&&) noexcept = default;
 
   base::Optional<T> Get(uint32_t idx) const { return nv_.Get(idx); }
-  void Append(T val) { nv_.Append(val); }
-  void Append(base::Optional<T> val) { nv_.Append(val); }
-  void Set(uint32_t idx, T val) { nv_.Set(idx, val); }
+  void Append(T val) {
+    OnValuesModified();
+    nv_.Append(val);
+  }
+  void Append(base::Optional<T> val) {
+    OnValuesModified();
+    nv_.Append(val);
+  }
+  void Set(uint32_t idx, T val) {
+    OnValuesModified();
+    nv_.Set(idx, val);
+  }
   uint32_t size() const { return nv_.size(); }
   bool IsDense() const { return nv_.IsDense(); }
   void ShrinkToFit() { nv_.ShrinkToFit(); }
 
+  const NullableVector<T>& vector() const { return nv_; }
+
   template <bool IsDense>
   static ColumnStorage<base::Optional<T>> Create() {
     return IsDense
@@ -109,6 +109,10 @@ class ColumnStorageOverlay {
   // Returns whether this ColumnStorageOverlay is empty.
   bool empty() const { return size() == 0; }
 
+  // Returns whether this ColumnStorageOverlay contains a contiguous range of
+  // indices.
+  bool IsRange() const { return row_map_.IsRange(); }
+
   // Returns the index at the given |row|.
   OutputIndex Get(uint32_t row) const { return row_map_.Get(row); }
 
@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/db/runtime_table.h"
+
+#include <algorithm>
+
+#include "perfetto/ext/base/string_utils.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+RuntimeTable::RuntimeTable(StringPool* pool, std::vector<std::string> col_names)
+    : Table(pool),
+      col_names_(std::move(col_names)),
+      values_(col_names_.size()) {}
+
+RuntimeTable::~RuntimeTable() = default;
+
+base::Status RuntimeTable::AddNull(uint32_t idx) {
+  ColumnValues& col = values_[idx];
+  switch (col.type) {
+    case ColumnValues::Type::kNull:
+    case ColumnValues::Type::kLong:
+      col.longs.emplace_back(base::nullopt);
+      break;
+    case ColumnValues::Type::kDouble:
+      col.doubles.emplace_back(base::nullopt);
+      break;
+    case ColumnValues::Type::kString:
+      col.strings.emplace_back(StringPool::Id::Null());
+      break;
+  }
+  return base::OkStatus();
+}
+
+base::Status RuntimeTable::AddInteger(uint32_t idx, int64_t res) {
+  ColumnValues& col = values_[idx];
+  if (col.type == ColumnValues::Type::kNull)
+    col.type = ColumnValues::Type::kLong;
+  if (col.type != ColumnValues::Type::kLong) {
+    return base::ErrStatus("Column %s has values of different types",
+                           col_names_[idx].c_str());
+  }
+  col.longs.emplace_back(res);
+  return base::OkStatus();
+}
+
+base::Status RuntimeTable::AddFloat(uint32_t idx, double res) {
+  ColumnValues& col = values_[idx];
+  if (col.type == ColumnValues::Type::kNull) {
+    col.type = ColumnValues::Type::kDouble;
+    col.doubles.resize(col.longs.size());
+    col.longs.clear();
+  }
+  if (col.type != ColumnValues::Type::kDouble) {
+    return base::ErrStatus("Column %s has values of different types",
+                           col_names_[idx].c_str());
+  }
+  col.doubles.emplace_back(res);
+  return base::OkStatus();
+}
+
+base::Status RuntimeTable::AddText(uint32_t idx, const char* ptr) {
+  ColumnValues& col = values_[idx];
+  if (col.type == ColumnValues::Type::kNull) {
+    col.type = ColumnValues::Type::kString;
+    col.strings.resize(col.longs.size(), StringPool::Id::Null());
+    col.longs.clear();
+  }
+  if (col.type != ColumnValues::Type::kString) {
+    return base::ErrStatus("Column %s has values of different types",
+                           col_names_[idx].c_str());
+  }
+  col.strings.emplace_back(string_pool_->InternString(ptr));
+  return base::OkStatus();
+}
+
+template <typename T>
+void RuntimeTable::AddNumericColumn(
+    uint32_t col_idx,
+    const std::vector<base::Optional<T>>& values) {
+  const char* name = col_names_[col_idx].c_str();
+  uint32_t table_idx = static_cast<uint32_t>(columns_.size());
+
+  bool non_null = std::all_of(
+      values.begin(), values.end(),
+      [](const base::Optional<T>& v) { return v.has_value(); });
+  if (!non_null) {
+    std::unique_ptr<ColumnStorage<base::Optional<T>>> storage(
+        new ColumnStorage<base::Optional<T>>(
+            ColumnStorage<base::Optional<T>>::template Create<false>()));
+    for (const base::Optional<T>& v : values)
+      storage->Append(v);
+    columns_.emplace_back(name, storage.get(), Column::Flag::kNoFlag, this,
+                          table_idx, 0);
+    storage_.emplace_back(std::move(storage));
+    return;
+  }
+
+  // Knowing that a column is sorted (e.g. ts in most views over slices)
+  // allows filters on it to binary search instead of scanning.
+  uint32_t flags = Column::Flag::kNonNull;
+  bool sorted = true;
+  for (uint32_t i = 1; i < values.size() && sorted; ++i)
+    sorted = *values[i - 1] <= *values[i];
+  if (sorted)
+    flags |= Column::Flag::kSorted;
+
+  std::unique_ptr<ColumnStorage<T>> storage(new ColumnStorage<T>());
+  for (const base::Optional<T>& v : values)
+    storage->Append(*v);
+  columns_.emplace_back(name, storage.get(), flags, this, table_idx, 0);
+  storage_.emplace_back(std::move(storage));
+}
+
+base::Status RuntimeTable::AddColumnsAndOverlays(uint32_t rows) {
+  PERFETTO_CHECK(columns_.empty());
+
+  base::Optional<uint32_t> id_col;
+  for (uint32_t i = 0; i < col_names_.size(); ++i) {
+    if (values_[i].size() != rows) {
+      return base::ErrStatus("Column %s has %u values, expected %u",
+                             col_names_[i].c_str(), values_[i].size(), rows);
+    }
+    // The id column is looked up by its exact name (see
+    // DbSqliteTable::ComputeSchema) but SQLite column names are case
+    // insensitive: "ID" would clash with the id column added below.
+    if (col_names_[i] == "id") {
+      if (id_col)
+        return base::ErrStatus("Duplicate id column");
+      id_col = i;
+    } else if (base::CaseInsensitiveEqual(col_names_[i], "id")) {
+      return base::ErrStatus("Column %s clashes with the id column",
+                             col_names_[i].c_str());
+    }
+  }
+
+  // An existing id column is kept as a normal column (its values are not
+  // guaranteed to be the row index) but it still has to be a valid key.
+  if (id_col) {
+    const ColumnValues& id = values_[*id_col];
+    bool valid = id.type == ColumnValues::Type::kLong &&
+                 std::all_of(id.longs.begin(), id.longs.end(),
+                             [](const base::Optional<int64_t>& v) {
+                               return v.has_value();
+                             });
+    if (!valid && rows > 0)
+      return base::ErrStatus("id column must only contain non-null integers");
+  }
+
+  row_count_ = rows;
+  overlays_.emplace_back(rows);
+  if (!id_col)
+    columns_.emplace_back(Column::IdColumn(this, 0, 0));
+
+  for (uint32_t i = 0; i < col_names_.size(); ++i) {
+    ColumnValues& col = values_[i];
+    switch (col.type) {
+      case ColumnValues::Type::kNull:
+      case ColumnValues::Type::kLong:
+        AddNumericColumn(i, col.longs);
+        break;
+      case ColumnValues::Type::kDouble:
+        AddNumericColumn(i, col.doubles);
+        break;
+      case ColumnValues::Type::kString: {
+        std::unique_ptr<ColumnStorage<StringPool::Id>> storage(
+            new ColumnStorage<StringPool::Id>());
+        for (StringPool::Id id : col.strings)
+          storage->Append(id);
+        // String columns handle nulls through the null string id.
+        columns_.emplace_back(col_names_[i].c_str(), storage.get(),
+                              Column::Flag::kNonNull, this,
+                              static_cast<uint32_t>(columns_.size()), 0);
+        storage_.emplace_back(std::move(storage));
+        break;
+      }
+    }
+  }
+  values_.clear();
+  return base::OkStatus();
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_DB_RUNTIME_TABLE_H_
+#define SRC_TRACE_PROCESSOR_DB_RUNTIME_TABLE_H_
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "perfetto/base/status.h"
+#include "perfetto/ext/base/optional.h"
+#include "src/trace_processor/containers/string_pool.h"
+#include "src/trace_processor/db/column_storage.h"
+#include "src/trace_processor/db/table.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Represents a table whose schema is only known at runtime (e.g. the result
+// of an SQL query). Values are added column by column and the type of each
+// column is inferred from them; once all the values have been added,
+// |AddColumnsAndOverlays| creates the columns of the table.
+//
+// Each column can hold either integers, doubles or strings (together with
+// nulls): adding values of different types to a column is an error.
+// If none of the columns is named "id", an id column is added so that the
+// table can be exposed to SQLite (see DbSqliteTable).
+class RuntimeTable : public Table {
+ public:
+  RuntimeTable(StringPool* pool, std::vector<std::string> col_names);
+  ~RuntimeTable() override;
+
+  RuntimeTable(const RuntimeTable&) = delete;
+  RuntimeTable& operator=(const RuntimeTable&) = delete;
+
+  base::Status AddNull(uint32_t idx);
+  base::Status AddInteger(uint32_t idx, int64_t res);
+  base::Status AddFloat(uint32_t idx, double res);
+  base::Status AddText(uint32_t idx, const char* ptr);
+
+  // Creates the columns of the table from the values added so far. Each
+  // column must have exactly |rows| values. Must be called exactly once.
+  base::Status AddColumnsAndOverlays(uint32_t rows);
+
+ private:
+  struct ColumnValues {
+    enum class Type { kNull, kLong, kDouble, kString };
+
+    uint32_t size() const {
+      switch (type) {
+        case Type::kNull:
+        case Type::kLong:
+          return static_cast<uint32_t>(longs.size());
+        case Type::kDouble:
+          return static_cast<uint32_t>(doubles.size());
+        case Type::kString:
+          return static_cast<uint32_t>(strings.size());
+      }
+      PERFETTO_FATAL("For GCC");
+    }
+
+    // Nulls are stored in |longs| until the first non-null value is added.
+    Type type = Type::kNull;
+    std::vector<base::Optional<int64_t>> longs;
+    std::vector<base::Optional<double>> doubles;
+    std::vector<StringPool::Id> strings;
+  };
+
+  template <typename T>
+  void AddNumericColumn(uint32_t col_idx,
+                        const std::vector<base::Optional<T>>& values);
+
+  std::vector<std::string> col_names_;
+  std::vector<ColumnValues> values_;
+  std::vector<std::unique_ptr<ColumnStorageBase>> storage_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_DB_RUNTIME_TABLE_H_
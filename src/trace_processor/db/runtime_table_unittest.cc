@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/db/runtime_table.h"
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+TEST(RuntimeTableTest, InfersColumnTypes) {
+  StringPool pool;
+  RuntimeTable table(&pool, {"ts", "dur", "value", "name"});
+
+  ASSERT_TRUE(table.AddInteger(0, 10).ok());
+  ASSERT_TRUE(table.AddNull(1).ok());
+  ASSERT_TRUE(table.AddNull(2).ok());
+  ASSERT_TRUE(table.AddText(3, "foo").ok());
+
+  ASSERT_TRUE(table.AddInteger(0, 20).ok());
+  ASSERT_TRUE(table.AddInteger(1, 5).ok());
+  ASSERT_TRUE(table.AddFloat(2, 1.5).ok());
+  ASSERT_TRUE(table.AddNull(3).ok());
+
+  ASSERT_TRUE(table.AddColumnsAndOverlays(2).ok());
+  ASSERT_EQ(table.row_count(), 2u);
+
+  // An id column is added in front of the columns of the table.
+  ASSERT_EQ(table.GetColumnCount(), 5u);
+  ASSERT_TRUE(table.GetColumn(0).IsId());
+
+  const Column* ts = table.GetColumnByName("ts");
+  ASSERT_EQ(ts->type(), SqlValue::Type::kLong);
+  ASSERT_TRUE(ts->IsSorted());
+  ASSERT_FALSE(ts->IsNullable());
+
+  const Column* dur = table.GetColumnByName("dur");
+  ASSERT_TRUE(dur->IsNullable());
+  ASSERT_TRUE(dur->Get(0).is_null());
+  ASSERT_EQ(dur->Get(1).AsLong(), 5);
+
+  const Column* value = table.GetColumnByName("value");
+  ASSERT_EQ(value->type(), SqlValue::Type::kDouble);
+  ASSERT_TRUE(value->Get(0).is_null());
+  ASSERT_EQ(value->Get(1).AsDouble(), 1.5);
+
+  const Column* name = table.GetColumnByName("name");
+  ASSERT_EQ(name->type(), SqlValue::Type::kString);
+  ASSERT_STREQ(name->Get(0).AsString(), "foo");
+  ASSERT_TRUE(name->Get(1).is_null());
+
+  Table filtered = table.Filter({ts->eq_value(SqlValue::Long(20))});
+  ASSERT_EQ(filtered.row_count(), 1u);
+}
+
+TEST(RuntimeTableTest, MixedTypes) {
+  StringPool pool;
+  RuntimeTable table(&pool, {"value"});
+
+  ASSERT_TRUE(table.AddInteger(0, 10).ok());
+  ASSERT_FALSE(table.AddText(0, "foo").ok());
+  ASSERT_FALSE(table.AddFloat(0, 1.0).ok());
+}
+
+TEST(RuntimeTableTest, ExistingIdColumn) {
+  StringPool pool;
+  {
+    RuntimeTable table(&pool, {"id", "ts"});
+    ASSERT_TRUE(table.AddInteger(0, 5).ok());
+    ASSERT_TRUE(table.AddInteger(1, 3).ok());
+    ASSERT_TRUE(table.AddInteger(0, 2).ok());
+    ASSERT_TRUE(table.AddInteger(1, 1).ok());
+    ASSERT_TRUE(table.AddColumnsAndOverlays(2).ok());
+
+    ASSERT_EQ(table.GetColumnCount(), 2u);
+    ASSERT_FALSE(table.GetColumn(0).IsId());
+    ASSERT_EQ(table.GetColumn(0).Get(1).AsLong(), 2);
+    ASSERT_FALSE(table.GetColumnByName("ts")->IsSorted());
+  }
+  {
+    RuntimeTable table(&pool, {"id"});
+    ASSERT_TRUE(table.AddNull(0).ok());
+    ASSERT_FALSE(table.AddColumnsAndOverlays(1).ok());
+  }
+  {
+    // Would clash with the id column added to the table.
+    RuntimeTable table(&pool, {"ID"});
+    ASSERT_TRUE(table.AddInteger(0, 1).ok());
+    ASSERT_FALSE(table.AddColumnsAndOverlays(1).ok());
+  }
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
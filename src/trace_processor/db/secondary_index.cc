@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/db/secondary_index.h"
+
+#include <algorithm>
+
+#include "src/trace_processor/containers/bit_vector.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+SecondaryIndex::SecondaryIndex(
+    uint32_t size,
+    std::vector<std::pair<uint64_t, uint32_t>> entries)
+    : size_(size) {
+  std::sort(entries.begin(), entries.end());
+  keys_.reserve(entries.size());
+  indices_.reserve(entries.size());
+  for (const auto& key_and_idx : entries) {
+    PERFETTO_DCHECK(key_and_idx.second < size_);
+    keys_.push_back(key_and_idx.first);
+    indices_.push_back(key_and_idx.second);
+  }
+
+  uint32_t count = static_cast<uint32_t>(keys_.size());
+  for (uint32_t begin = 0; begin < count;) {
+    uint32_t end = begin + 1;
+    while (end < count && keys_[end] == keys_[begin])
+      end++;
+    groups_.Insert(keys_[begin], Group{begin, end});
+    begin = end;
+  }
+}
+
+SecondaryIndex::~SecondaryIndex() = default;
+
+void SecondaryIndex::IntersectEq(uint64_t key, RowMap* rm) const {
+  Group* group = groups_.Find(key);
+  if (!group) {
+    rm->Clear();
+    return;
+  }
+  Intersect(group->begin, group->end, true /* sorted */, rm);
+}
+
+void SecondaryIndex::IntersectRange(uint64_t min,
+                                    uint64_t max,
+                                    RowMap* rm) const {
+  if (min > max) {
+    rm->Clear();
+    return;
+  }
+  auto begin = std::lower_bound(keys_.begin(), keys_.end(), min);
+  auto end = std::upper_bound(begin, keys_.end(), max);
+  Intersect(static_cast<uint32_t>(begin - keys_.begin()),
+            static_cast<uint32_t>(end - keys_.begin()),
+            begin == end || *begin == *(end - 1), rm);
+}
+
+void SecondaryIndex::Intersect(uint32_t begin,
+                               uint32_t end,
+                               bool sorted,
+                               RowMap* rm) const {
+  if (rm->empty())
+    return;
+  if (begin == end) {
+    rm->Clear();
+    return;
+  }
+
+  if (!rm->IsRange()) {
+    BitVector matches(size_, false);
+    for (uint32_t i = begin; i < end; ++i)
+      matches.Set(indices_[i]);
+    rm->Filter([&matches](uint32_t idx) { return matches.IsSet(idx); });
+    return;
+  }
+
+  // Only keep the indices in the range of |rm|. Like RowMap::FilterRange,
+  // only use a BitVector if it is smaller than the vector of indices.
+  uint32_t first = rm->Get(0);
+  uint32_t last = rm->Get(rm->size() - 1);
+  uint32_t count = end - begin;
+  if (count * sizeof(uint32_t) > BitVector::ApproxBytesCost(last + 1)) {
+    BitVector matches(last + 1, false);
+    for (uint32_t i = begin; i < end; ++i) {
+      uint32_t idx = indices_[i];
+      if (idx >= first && idx <= last)
+        matches.Set(idx);
+    }
+    *rm = RowMap(std::move(matches));
+    return;
+  }
+
+  std::vector<uint32_t> matches;
+  matches.reserve(count);
+  for (uint32_t i = begin; i < end; ++i) {
+    uint32_t idx = indices_[i];
+    if (idx >= first && idx <= last)
+      matches.push_back(idx);
+  }
+  if (!sorted)
+    std::sort(matches.begin(), matches.end());
+  *rm = RowMap(std::move(matches));
+}
+
+size_t SecondaryIndex::SizeBytes() const {
+  // Each slot of the hash map also has a one byte tag.
+  return sizeof(*this) + keys_.capacity() * sizeof(uint64_t) +
+         indices_.capacity() * sizeof(uint32_t) +
+         groups_.capacity() * (sizeof(uint64_t) + sizeof(Group) + 1);
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
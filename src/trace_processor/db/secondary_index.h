@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_DB_SECONDARY_INDEX_H_
+#define SRC_TRACE_PROCESSOR_DB_SECONDARY_INDEX_H_
+
+#include <stdint.h>
+
+#include <utility>
+#include <vector>
+
+#include "perfetto/ext/base/flat_hash_map.h"
+#include "src/trace_processor/containers/row_map.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// An index over the values of the storage of a column which allows finding
+// the indices of the values equal to, or in a range of, a given value without
+// scanning the whole storage.
+//
+// The index does not know about the type of the values: each non-null value
+// is represented by a 64-bit key which must preserve the order of the values
+// (see Column::CreateIndex). The index keeps:
+//  * the indices of the values sorted by key: the values in a range of keys
+//    are found with a binary search.
+//  * a hash map from each distinct key to its indices in the sorted indices:
+//    equality lookups don't need a binary search.
+//
+// The index is immutable: it has to be rebuilt when the storage changes.
+class SecondaryIndex {
+ public:
+  // |entries| contains a (key, index) pair for each non-null value of the
+  // storage and |size| is the number of values of the storage, null or not.
+  SecondaryIndex(uint32_t size,
+                 std::vector<std::pair<uint64_t, uint32_t>> entries);
+  ~SecondaryIndex();
+
+  SecondaryIndex(const SecondaryIndex&) = delete;
+  SecondaryIndex& operator=(const SecondaryIndex&) = delete;
+
+  // Removes from |rm| (which should contain indices of the storage) the
+  // indices whose key is not equal to |key|.
+  void IntersectEq(uint64_t key, RowMap* rm) const;
+
+  // Removes from |rm| (which should contain indices of the storage) the
+  // indices whose key is not in [min, max].
+  void IntersectRange(uint64_t min, uint64_t max, RowMap* rm) const;
+
+  // Returns the number of values of the storage at the time the index was
+  // built.
+  uint32_t size() const { return size_; }
+
+  // Returns the approximate number of bytes used by the index.
+  size_t SizeBytes() const;
+
+ private:
+  struct KeyHasher {
+    size_t operator()(uint64_t key) const {
+      // Keys of integral doubles only differ in their high bits: mix them
+      // into the low bits used to pick a slot (finalizer of MurmurHash3).
+      key ^= key >> 33;
+      key *= 0xff51afd7ed558ccdull;
+      key ^= key >> 33;
+      return static_cast<size_t>(key);
+    }
+  };
+
+  // The range of |indices_| having the same key.
+  struct Group {
+    uint32_t begin;
+    uint32_t end;
+  };
+
+  // Removes from |rm| the indices not in indices_[begin, end). |sorted|
+  // indicates whether this range of |indices_| is sorted.
+  void Intersect(uint32_t begin, uint32_t end, bool sorted, RowMap* rm) const;
+
+  uint32_t size_ = 0;
+
+  // The keys of the non-null values in increasing order and their indices in
+  // the storage. Indices having the same key are sorted.
+  std::vector<uint64_t> keys_;
+  std::vector<uint32_t> indices_;
+
+  base::FlatHashMap<uint64_t, Group, KeyHasher> groups_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_DB_SECONDARY_INDEX_H_
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "src/trace_processor/db/secondary_index.h"
+
+#include <memory>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using testing::ElementsAre;
+using testing::IsEmpty;
+
+std::vector<uint32_t> ToVector(const RowMap& rm) {
+  std::vector<uint32_t> out;
+  for (auto it = rm.IterateRows(); it; it.Next())
+    out.push_back(it.index());
+  return out;
+}
+
+// Index over the keys [5, 3, null, 5, 1, 3, 5, null, 7, 3].
+std::unique_ptr<SecondaryIndex> CreateIndex() {
+  return std::unique_ptr<SecondaryIndex>(new SecondaryIndex(
+      10, {{5, 0}, {3, 1}, {5, 3}, {1, 4}, {3, 5}, {5, 6}, {7, 8}, {3, 9}}));
+}
+
+TEST(SecondaryIndexUnittest, IntersectEq) {
+  std::unique_ptr<SecondaryIndex> index = CreateIndex();
+
+  RowMap rm(0, 10);
+  index->IntersectEq(5, &rm);
+  ASSERT_THAT(ToVector(rm), ElementsAre(0, 3, 6));
+
+  rm = RowMap(2, 9);
+  index->IntersectEq(3, &rm);
+  ASSERT_THAT(ToVector(rm), ElementsAre(5));
+
+  rm = RowMap(0, 10);
+  index->IntersectEq(4, &rm);
+  ASSERT_THAT(ToVector(rm), IsEmpty());
+}
+
+TEST(SecondaryIndexUnittest, IntersectRange) {
+  std::unique_ptr<SecondaryIndex> index = CreateIndex();
+
+  RowMap rm(0, 10);
+  index->IntersectRange(3, 5, &rm);
+  ASSERT_THAT(ToVector(rm), ElementsAre(0, 1, 3, 5, 6, 9));
+
+  rm = RowMap(1, 8);
+  index->IntersectRange(0, 4, &rm);
+  ASSERT_THAT(ToVector(rm), ElementsAre(1, 4, 5));
+
+  rm = RowMap(0, 10);
+  index->IntersectRange(8, 100, &rm);
+  ASSERT_THAT(ToVector(rm), IsEmpty());
+
+  rm = RowMap(0, 10);
+  index->IntersectRange(5, 3, &rm);
+  ASSERT_THAT(ToVector(rm), IsEmpty());
+}
+
+TEST(SecondaryIndexUnittest, IntersectNonRange) {
+  std::unique_ptr<SecondaryIndex> index = CreateIndex();
+
+  RowMap rm(BitVector{true, true, false, true, false, true, false, true});
+  index->IntersectRange(3, 7, &rm);
+  ASSERT_THAT(ToVector(rm), ElementsAre(0, 1, 3, 5));
+
+  rm = RowMap(std::vector<uint32_t>{9, 6, 8, 4});
+  index->IntersectEq(3, &rm);
+  ASSERT_THAT(ToVector(rm), ElementsAre(9));
+}
+
+TEST(SecondaryIndexUnittest, LargeRange) {
+  // Enough matches for the result to be stored in a BitVector.
+  std::vector<std::pair<uint64_t, uint32_t>> entries;
+  for (uint32_t i = 0; i < 10000; ++i)
+    entries.emplace_back(i % 7, i);
+  std::unique_ptr<SecondaryIndex> index(
+      new SecondaryIndex(10000, std::move(entries)));
+
+  RowMap rm(100, 9000);
+  index->IntersectRange(1, 6, &rm);
+  std::vector<uint32_t> expected;
+  for (uint32_t i = 100; i < 9000; ++i) {
+    if (i % 7 != 0)
+      expected.push_back(i);
+  }
+  ASSERT_EQ(ToVector(rm), expected);
+  ASSERT_GT(index->SizeBytes(), 10000 * (sizeof(uint64_t) + sizeof(uint32_t)));
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
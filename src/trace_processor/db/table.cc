@@ -16,9 +16,112 @@
 
 #include "src/trace_processor/db/table.h"
 
+#include <algorithm>
+
+#include "perfetto/base/build_config.h"
+
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+#include <thread>
+#endif
+
 namespace perfetto {
 namespace trace_processor {
 
+namespace {
+
+// The minimum number of rows each thread sorts when sorting a table in
+// parallel: below this, starting a thread costs more than it saves.
+constexpr uint32_t kMinRowsPerSortThread = 256 * 1024;
+
+// When non-zero, the number of threads used to sort any table (see
+// Table::SetSortThreadCountForTesting).
+uint32_t g_sort_thread_count_for_testing = 0;
+
+// Stable sorts |idx| with |less|, splitting the work between threads for
+// large tables.
+template <typename Comparator>
+void ParallelStableSort(std::vector<uint32_t>* idx, Comparator less) {
+  uint32_t thread_count = 1;
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  if (g_sort_thread_count_for_testing > 0) {
+    thread_count = g_sort_thread_count_for_testing;
+  } else {
+    thread_count = std::min(std::max(std::thread::hardware_concurrency(), 1u),
+                            static_cast<uint32_t>(idx->size()) /
+                                kMinRowsPerSortThread);
+  }
+#endif
+  if (thread_count <= 1) {
+    std::stable_sort(idx->begin(), idx->end(), less);
+    return;
+  }
+
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  // Sort one chunk on each thread then merge pairs of adjacent chunks, also
+  // in parallel, until a single chunk is left. Merging adjacent chunks keeps
+  // the sort stable.
+  auto begin = idx->begin();
+  std::vector<size_t> bounds;
+  for (uint32_t i = 0; i <= thread_count; ++i)
+    bounds.push_back(idx->size() * i / thread_count);
+
+  std::vector<std::thread> threads;
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    threads.emplace_back([&less, begin, &bounds, i] {
+      std::stable_sort(begin + static_cast<ptrdiff_t>(bounds[i]),
+                       begin + static_cast<ptrdiff_t>(bounds[i + 1]), less);
+    });
+  }
+  for (std::thread& thread : threads)
+    thread.join();
+
+  while (bounds.size() > 2) {
+    threads.clear();
+    std::vector<size_t> merged_bounds;
+    size_t i = 0;
+    for (; i + 2 < bounds.size(); i += 2) {
+      threads.emplace_back([&less, begin, &bounds, i] {
+        std::inplace_merge(begin + static_cast<ptrdiff_t>(bounds[i]),
+                           begin + static_cast<ptrdiff_t>(bounds[i + 1]),
+                           begin + static_cast<ptrdiff_t>(bounds[i + 2]),
+                           less);
+      });
+      merged_bounds.push_back(bounds[i]);
+    }
+    if (i + 1 < bounds.size())
+      merged_bounds.push_back(bounds[i]);
+    merged_bounds.push_back(bounds.back());
+
+    for (std::thread& thread : threads)
+      thread.join();
+    bounds = std::move(merged_bounds);
+  }
+#endif
+}
+
+// Stable sorts |idx| by comparing the keys of the rows lexicographically.
+void StableSortByKeys(const std::vector<std::vector<uint64_t>>& keys,
+                      std::vector<uint32_t>* idx) {
+  // Sorting on a single key is the common case: avoid looping over the keys
+  // for each comparison.
+  if (keys.size() == 1) {
+    const uint64_t* key = keys.front().data();
+    ParallelStableSort(idx, [key](uint32_t a, uint32_t b) {
+      return key[a] < key[b];
+    });
+    return;
+  }
+  ParallelStableSort(idx, [&keys](uint32_t a, uint32_t b) {
+    for (const std::vector<uint64_t>& key : keys) {
+      if (key[a] != key[b])
+        return key[a] < key[b];
+    }
+    return false;
+  });
+}
+
+}  // namespace
+
 Table::Table() = default;
 Table::~Table() = default;
 
@@ -54,6 +157,11 @@ Table Table::CopyExceptRowMaps() const {
   return table;
 }
 
+// static
+void Table::SetSortThreadCountForTesting(uint32_t thread_count) {
+  g_sort_thread_count_for_testing = thread_count;
+}
+
 Table Table::Sort(const std::vector<Order>& od) const {
   if (od.empty())
     return Copy();
@@ -75,40 +183,17 @@ Table Table::Sort(const std::vector<Order>& od) const {
     PERFETTO_DCHECK(od.front().desc);
     std::iota(idx.rbegin(), idx.rend(), 0);
   } else {
-    // As our data is columnar, it's always more efficient to sort one column
-    // at a time rather than try and sort lexiographically all at once.
-    // To preserve correctness, we need to stably sort the index vector once
-    // for each order by in *reverse* order. Reverse order is important as it
-    // preserves the lexiographical property.
-    //
-    // For example, suppose we have the following:
-    // Table {
-    //   Column x;
-    //   Column y
-    //   Column z;
-    // }
-    //
-    // Then, to sort "y asc, x desc", we could do one of two things:
-    //  1) sort the index vector all at once and on each index, we compare
-    //     y then z. This is slow as the data is columnar and we need to
-    //     repeatedly branch inside each column.
-    //  2) we can stably sort first on x desc and then sort on y asc. This will
-    //     first put all the x in the correct order such that when we sort on
-    //     y asc, we will have the correct order of x where y is the same (since
-    //     the sort is stable).
-    //
-    // TODO(lalitm): it is possible that we could sort the last constraint (i.e.
-    // the first constraint in the below loop) in a non-stable way. However,
-    // this is more subtle than it appears as we would then need special
-    // handling where there are order bys on a column which is already sorted
-    // (e.g. ts, id). Investigate whether the performance gains from this are
-    // worthwhile. This also needs changes to the constraint modification logic
-    // in DbSqliteTable which currently eliminates constraints on sorted
-    // columns.
-    std::iota(idx.begin(), idx.end(), 0);
-    for (auto it = od.rbegin(); it != od.rend(); ++it) {
-      columns_[it->col_idx].StableSort(it->desc, &idx);
+    // As our data is columnar, comparing the rows through the overlay and
+    // storage of each column is slow. Instead, each column is first converted
+    // to arrays of integer keys (see Column::AppendSortKeys) which are then
+    // compared lexicographically: in the order of the order bys and, for
+    // rows with equal keys, in the order of the rows in the table.
+    std::vector<std::vector<uint64_t>> keys;
+    for (const Order& order : od) {
+      columns_[order.col_idx].AppendSortKeys(order.desc, &keys);
     }
+    std::iota(idx.begin(), idx.end(), 0);
+    StableSortByKeys(keys, &idx);
   }
 
   // Return a copy of this table with the RowMaps using the computed ordered
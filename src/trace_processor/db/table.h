@@ -145,6 +145,11 @@ class Table {
   // Sorts the Table using the specified order by constraints.
   Table Sort(const std::vector<Order>& od) const;
 
+  // Makes Sort() split the sort of any table between |thread_count| threads,
+  // regardless of the number of rows and of the hardware. 0 restores the
+  // default. Has no effect on WASM, where sorts are single-threaded.
+  static void SetSortThreadCountForTesting(uint32_t thread_count);
+
   // Returns the column at index |idx| in the Table.
   const Column& GetColumn(uint32_t idx) const { return columns_[idx]; }
 
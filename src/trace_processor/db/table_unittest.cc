@@ -15,6 +15,10 @@
  */
 
 #include "src/trace_processor/db/table.h"
+
+#include <limits>
+#include <random>
+
 #include "perfetto/ext/base/optional.h"
 #include "src/trace_processor/db/typed_column.h"
 #include "src/trace_processor/tables/macros.h"
@@ -35,6 +39,38 @@ PERFETTO_TP_TABLE(PERFETTO_TP_TEST_EVENT_TABLE_DEF);
 
 TestEventTable::~TestEventTable() = default;
 
+#define PERFETTO_TP_TEST_SORT_TABLE_DEF(NAME, PARENT, C) \
+  NAME(TestSortTable, "sort")                            \
+  PARENT(PERFETTO_TP_ROOT_TABLE_PARENT_DEF, C)           \
+  C(int32_t, cpu)                                        \
+  C(base::Optional<int64_t>, value)                      \
+  C(base::Optional<double>, dbl)                         \
+  C(StringPool::Id, name)
+PERFETTO_TP_TABLE(PERFETTO_TP_TEST_SORT_TABLE_DEF);
+
+TestSortTable::~TestSortTable() = default;
+
+// Checks that the rows of |table| are sorted by |od| and, for equal values,
+// by id.
+void CheckSorted(const Table& table, const std::vector<Order>& od) {
+  const Column& id = *table.GetColumnByName("id");
+  for (uint32_t row = 1; row < table.row_count(); ++row) {
+    int res = 0;
+    for (const Order& order : od) {
+      const Column& col = table.GetColumn(order.col_idx);
+      res = compare::SqlValue(col.Get(row - 1), col.Get(row));
+      if (order.desc)
+        res = -res;
+      if (res != 0)
+        break;
+    }
+    ASSERT_LE(res, 0) << row;
+    if (res == 0) {
+      ASSERT_LT(id.Get(row - 1).long_value, id.Get(row).long_value) << row;
+    }
+  }
+}
+
 TEST(TableTest, SetIdColumns) {
   StringPool pool;
   TestEventTable table{&pool, nullptr};
@@ -126,6 +162,155 @@ TEST(TableTest, SetIdColumns) {
   }
 }
 
+TEST(TableTest, SortMultipleColumns) {
+  StringPool pool;
+  TestSortTable table{&pool, nullptr};
+
+  std::minstd_rand rnd;
+  const char* kNames[] = {"a", "b", "ab", ""};
+  for (uint32_t i = 0; i < 64 * 1024; ++i) {
+    TestSortTable::Row row;
+    row.cpu = static_cast<int32_t>(rnd() % 5) - 2;
+    if (rnd() % 4) {
+      row.value = static_cast<int64_t>(rnd() % 7) - 3;
+      if (rnd() % 16 == 0)
+        row.value = std::numeric_limits<int64_t>::min();
+    }
+    if (rnd() % 4)
+      row.dbl = static_cast<double>(static_cast<int32_t>(rnd() % 9) - 4) / 2;
+    if (rnd() % 4)
+      row.name = pool.InternString(kNames[rnd() % 4]);
+    table.Insert(row);
+  }
+
+  std::vector<Order> od = {table.cpu().ascending(), table.dbl().ascending(),
+                           table.value().descending(),
+                           table.name().descending()};
+  Table sorted = table.Sort(od);
+  ASSERT_EQ(sorted.row_count(), table.row_count());
+  CheckSorted(sorted, od);
+
+  // Sorting a filtered table must go through its overlays.
+  Table filtered = table.Filter({table.id().lt(4096)});
+  std::vector<std::vector<Order>> orders = {
+      {table.value().ascending()},
+      {table.dbl().descending()},
+      {table.name().ascending(), table.cpu().descending()},
+  };
+  for (const std::vector<Order>& filtered_od : orders)
+    CheckSorted(filtered.Sort(filtered_od), filtered_od);
+}
+
+TEST(TableTest, SortMultipleThreads) {
+  StringPool pool;
+  TestSortTable table{&pool, nullptr};
+
+  // Few distinct values so that most rows compare equal to rows in other
+  // chunks: the merges must keep them in the order of their ids.
+  std::minstd_rand rnd;
+  for (uint32_t i = 0; i < 10007; ++i) {
+    TestSortTable::Row row;
+    row.cpu = static_cast<int32_t>(rnd() % 3);
+    if (rnd() % 4)
+      row.value = static_cast<int64_t>(rnd() % 4);
+    table.Insert(row);
+  }
+
+  std::vector<std::vector<Order>> orders = {
+      {table.cpu().ascending()},
+      {table.value().descending(), table.cpu().ascending()},
+  };
+  // Odd thread counts leave a chunk unmerged in some of the merge rounds.
+  for (uint32_t thread_count : {2u, 3u, 5u, 8u}) {
+    Table::SetSortThreadCountForTesting(thread_count);
+    for (const std::vector<Order>& od : orders) {
+      Table sorted = table.Sort(od);
+      ASSERT_EQ(sorted.row_count(), table.row_count());
+      CheckSorted(sorted, od);
+    }
+  }
+  Table::SetSortThreadCountForTesting(0);
+}
+
+std::vector<int64_t> FilteredIds(const Table& table,
+                                 const std::vector<Constraint>& cs) {
+  Table filtered = table.Filter(cs);
+  const Column* id = filtered.GetColumnByName("id");
+  std::vector<int64_t> ids;
+  for (uint32_t i = 0; i < filtered.row_count(); ++i)
+    ids.push_back(id->Get(i).AsLong());
+  return ids;
+}
+
+TEST(TableTest, FilterWithIndex) {
+  StringPool pool;
+  TestSortTable table{&pool, nullptr};
+
+  std::minstd_rand rnd;
+  const char* kNames[] = {"a", "b", "ab", ""};
+  for (uint32_t i = 0; i < 4096; ++i) {
+    TestSortTable::Row row;
+    row.cpu = static_cast<int32_t>(rnd() % 5) - 2;
+    if (rnd() % 4)
+      row.value = static_cast<int64_t>(rnd() % 7) - 3;
+    if (rnd() % 4)
+      row.dbl = static_cast<double>(static_cast<int32_t>(rnd() % 9) - 4) / 2;
+    if (rnd() % 4)
+      row.name = pool.InternString(kNames[rnd() % 4]);
+    table.Insert(row);
+  }
+
+  std::vector<std::vector<Constraint>> queries;
+  std::vector<const Column*> numeric_cols = {&table.cpu(), &table.value(),
+                                             &table.dbl()};
+  for (const Column* col : numeric_cols) {
+    for (SqlValue value : {SqlValue::Long(-3), SqlValue::Long(0),
+                           SqlValue::Long(2), SqlValue::Double(0.5),
+                           SqlValue::Double(-1)}) {
+      queries.push_back({col->eq_value(value)});
+      queries.push_back({col->lt_value(value)});
+      queries.push_back({col->le_value(value)});
+      queries.push_back({col->gt_value(value)});
+      queries.push_back({col->ge_value(value)});
+      queries.push_back({col->ne_value(value)});
+    }
+    queries.push_back({col->is_null()});
+  }
+  for (const char* name : {"a", "ab", "", "unknown"}) {
+    queries.push_back({table.name().eq_value(SqlValue::String(name))});
+    queries.push_back({table.name().gt_value(SqlValue::String(name))});
+  }
+  queries.push_back({table.cpu().eq_value(SqlValue::Long(1)),
+                     table.name().eq_value(SqlValue::String("b"))});
+  queries.push_back({table.id().lt(2048), table.value().ge_value(
+                                              SqlValue::Long(1))});
+
+  std::vector<std::vector<int64_t>> expected;
+  for (const std::vector<Constraint>& cs : queries)
+    expected.push_back(FilteredIds(table, cs));
+
+  ASSERT_FALSE(table.id().CreateIndex());
+  std::vector<const Column*> cols = numeric_cols;
+  cols.push_back(&table.name());
+  for (const Column* col : cols) {
+    ASSERT_TRUE(col->CreateIndex());
+    ASSERT_TRUE(col->HasIndex());
+    ASSERT_GT(col->IndexSizeBytes(), 0u);
+  }
+  for (uint32_t i = 0; i < queries.size(); ++i)
+    ASSERT_EQ(FilteredIds(table, queries[i]), expected[i]) << "Query " << i;
+
+  // The columns of a filtered table cannot use the index.
+  Table filtered = table.Filter({table.id().ge(1)});
+  ASSERT_FALSE(filtered.GetColumnByName("cpu")->HasIndex());
+
+  // Modifying the column drops its index.
+  table.mutable_cpu()->Set(1, 10);
+  ASSERT_FALSE(table.cpu().HasIndex());
+  ASSERT_THAT(FilteredIds(table, {table.cpu().eq_value(SqlValue::Long(10))}),
+              testing::ElementsAre(1));
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
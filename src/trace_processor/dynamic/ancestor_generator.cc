@@ -95,6 +95,25 @@ base::Status GetAncestors(
   return base::OkStatus();
 }
 
+// Same as GetAncestors but uses the slice tree index instead of looking up
+// the parent of each ancestor in the slice table.
+base::Status GetSliceAncestors(
+    const TraceStorage& storage,
+    SliceId starting_id,
+    std::vector<tables::SliceTable::RowNumber>& row_numbers_accumulator) {
+  base::Optional<uint32_t> start_row =
+      storage.slice_table().id().IndexOf(starting_id);
+  if (!start_row) {
+    return base::ErrStatus("no row with id %" PRIu32 "",
+                           static_cast<uint32_t>(starting_id.value));
+  }
+  std::vector<uint32_t> rows;
+  storage.slice_tree_index().GetAncestors(*start_row, &rows);
+  for (uint32_t row : rows)
+    row_numbers_accumulator.emplace_back(row);
+  return base::OkStatus();
+}
+
 template <typename ChildTable, typename ConstraintType, typename ParentTable>
 std::unique_ptr<Table> ExtendWithStartId(
     ConstraintType constraint_value,
@@ -157,10 +176,15 @@ base::Status AncestorGenerator::ComputeTable(
   int64_t start_id = constraint_it->value.AsLong();
   uint32_t start_id_uint = static_cast<uint32_t>(start_id);
   switch (type_) {
-    case Ancestor::kSlice:
-      return BuildAncestorsTable<tables::AncestorSliceTable>(
-          SliceId(start_id_uint), context_->storage->slice_table(),
-          table_return);
+    case Ancestor::kSlice: {
+      std::vector<tables::SliceTable::RowNumber> ancestors;
+      RETURN_IF_ERROR(GetSliceAncestors(*context_->storage,
+                                        SliceId(start_id_uint), ancestors));
+      table_return = ExtendWithStartId<tables::AncestorSliceTable>(
+          start_id_uint, context_->storage->slice_table(),
+          std::move(ancestors));
+      return base::OkStatus();
+    }
 
     case Ancestor::kStackProfileCallsite:
       return BuildAncestorsTable<tables::AncestorStackProfileCallsiteTable>(
@@ -175,7 +199,8 @@ base::Status AncestorGenerator::ComputeTable(
           slice_table.FilterToIterator({slice_table.stack_id().eq(start_id)});
       std::vector<tables::SliceTable::RowNumber> ancestors;
       for (; it; ++it) {
-        RETURN_IF_ERROR(GetAncestors(slice_table, it.id(), ancestors));
+        RETURN_IF_ERROR(
+            GetSliceAncestors(*context_->storage, it.id(), ancestors));
       }
       // Sort to keep the slices in timestamp order.
       std::sort(ancestors.begin(), ancestors.end());
@@ -217,10 +242,10 @@ uint32_t AncestorGenerator::EstimateRowCount() {
 
 // static
 base::Optional<std::vector<tables::SliceTable::RowNumber>>
-AncestorGenerator::GetAncestorSlices(const tables::SliceTable& slices,
+AncestorGenerator::GetAncestorSlices(const TraceStorage& storage,
                                      SliceId slice_id) {
   std::vector<tables::SliceTable::RowNumber> ret;
-  auto status = GetAncestors(slices, slice_id, ret);
+  auto status = GetSliceAncestors(storage, slice_id, ret);
   if (!status.ok())
     return base::nullopt;
   return std::move(ret);  // -Wreturn-std-move-in-c++11
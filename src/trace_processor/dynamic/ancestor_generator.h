@@ -55,7 +55,7 @@ class AncestorGenerator : public DynamicTableGenerator {
   // Returns base::nullopt if an invalid |slice_id| is given. This is used by
   // ConnectedFlowGenerator to traverse flow indirectly connected flow events.
   static base::Optional<std::vector<tables::SliceTable::RowNumber>>
-  GetAncestorSlices(const tables::SliceTable& slices, SliceId slice_id);
+  GetAncestorSlices(const TraceStorage& storage, SliceId slice_id);
 
  private:
   Ancestor type_;
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/dynamic/column_stats_generator.h"
+
+#include <algorithm>
+
+#include "perfetto/ext/base/string_utils.h"
+#include "src/trace_processor/db/runtime_table.h"
+#include "src/trace_processor/util/status_macros.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+using ColumnIndex = ColumnStatsGenerator::ColumnIndex;
+
+base::Status AddValue(RuntimeTable* out,
+                      uint32_t col,
+                      const base::Optional<SqlValue>& value) {
+  if (!value)
+    return out->AddNull(col);
+  switch (value->type) {
+    case SqlValue::Type::kLong:
+      return out->AddText(col, std::to_string(value->long_value).c_str());
+    case SqlValue::Type::kDouble:
+      return out->AddText(
+          col, base::StackString<32>("%g", value->double_value).c_str());
+    case SqlValue::Type::kString:
+      return out->AddText(col, value->string_value);
+    case SqlValue::Type::kBytes:
+    case SqlValue::Type::kNull:
+      break;
+  }
+  return out->AddNull(col);
+}
+
+}  // namespace
+
+ColumnStatsGenerator::ColumnStatsGenerator(
+    StringPool* pool,
+    const std::map<std::string, const Table*>* tables,
+    TableStatsCache* stats_cache)
+    : pool_(pool), tables_(tables), stats_cache_(stats_cache) {}
+
+ColumnStatsGenerator::~ColumnStatsGenerator() = default;
+
+Table::Schema ColumnStatsGenerator::CreateSchema() {
+  Table::Schema schema;
+  schema.columns.push_back(Table::Schema::Column{
+      "id", SqlValue::Type::kLong, true /* is_id */, true /* is_sorted */,
+      false /* is_hidden */, false /* is_set_id */});
+  for (const char* name : {"table_name", "column_name"}) {
+    schema.columns.push_back(Table::Schema::Column{
+        name, SqlValue::Type::kString, false /* is_id */,
+        false /* is_sorted */, false /* is_hidden */, false /* is_set_id */});
+  }
+  for (const char* name : {"row_count", "null_count", "distinct_count"}) {
+    schema.columns.push_back(Table::Schema::Column{
+        name, SqlValue::Type::kLong, false /* is_id */, false /* is_sorted */,
+        false /* is_hidden */, false /* is_set_id */});
+  }
+  for (const char* name : {"min_value", "max_value"}) {
+    schema.columns.push_back(Table::Schema::Column{
+        name, SqlValue::Type::kString, false /* is_id */,
+        false /* is_sorted */, false /* is_hidden */, false /* is_set_id */});
+  }
+  schema.columns.push_back(Table::Schema::Column{
+      "index_size_bytes", SqlValue::Type::kLong, false /* is_id */,
+      false /* is_sorted */, false /* is_hidden */, false /* is_set_id */});
+  return schema;
+}
+
+std::string ColumnStatsGenerator::TableName() {
+  return "column_stats";
+}
+
+uint32_t ColumnStatsGenerator::EstimateRowCount() {
+  // Tables have around 10 columns on average.
+  return static_cast<uint32_t>(tables_->size() * 10);
+}
+
+base::Status ColumnStatsGenerator::ValidateConstraints(
+    const QueryConstraints&) {
+  return base::OkStatus();
+}
+
+base::Status ColumnStatsGenerator::ComputeTable(
+    const std::vector<Constraint>& cs,
+    const std::vector<Order>&,
+    const BitVector&,
+    std::unique_ptr<Table>& table_return) {
+  // Computing the statistics of a table is not free: only do it for the table
+  // we are asked about, if any.
+  auto it = std::find_if(cs.begin(), cs.end(), [](const Constraint& c) {
+    return c.col_idx == static_cast<uint32_t>(ColumnIndex::kTableName) &&
+           c.op == FilterOp::kEq && c.value.type == SqlValue::Type::kString;
+  });
+
+  std::unique_ptr<RuntimeTable> out(new RuntimeTable(
+      pool_, {"table_name", "column_name", "row_count", "null_count",
+              "distinct_count", "min_value", "max_value",
+              "index_size_bytes"}));
+  uint32_t rows = 0;
+  for (const auto& name_and_table : *tables_) {
+    if (it != cs.end() && name_and_table.first != it->value.AsString())
+      continue;
+
+    const Table& table = *name_and_table.second;
+    const std::vector<ColumnStats>& stats = stats_cache_->GetOrCompute(table);
+    for (uint32_t i = 0; i < stats.size(); ++i, ++rows) {
+      RETURN_IF_ERROR(out->AddText(0, name_and_table.first.c_str()));
+      RETURN_IF_ERROR(out->AddText(1, table.GetColumn(i).name()));
+      RETURN_IF_ERROR(out->AddInteger(2, stats[i].row_count));
+      RETURN_IF_ERROR(out->AddInteger(3, stats[i].null_count));
+      RETURN_IF_ERROR(out->AddInteger(4, stats[i].distinct_count));
+      RETURN_IF_ERROR(AddValue(out.get(), 5, stats[i].min));
+      RETURN_IF_ERROR(AddValue(out.get(), 6, stats[i].max));
+      RETURN_IF_ERROR(out->AddInteger(
+          7, static_cast<int64_t>(table.GetColumn(i).IndexSizeBytes())));
+    }
+  }
+  RETURN_IF_ERROR(out->AddColumnsAndOverlays(rows));
+  table_return = std::move(out);
+  return base::OkStatus();
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
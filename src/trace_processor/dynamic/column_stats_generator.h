@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_DYNAMIC_COLUMN_STATS_GENERATOR_H_
+#define SRC_TRACE_PROCESSOR_DYNAMIC_COLUMN_STATS_GENERATOR_H_
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "src/trace_processor/containers/string_pool.h"
+#include "src/trace_processor/db/column_stats.h"
+#include "src/trace_processor/dynamic/dynamic_table_generator.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Dynamic table generator for the "column_stats" table which exposes the
+// statistics used to estimate the cost of queries (see ColumnStats) for each
+// column of the db tables. For example:
+//   SELECT column_name, distinct_count
+//   FROM column_stats
+//   WHERE table_name = 'sched_slice'
+// The min and max values of the columns are converted to strings as their
+// type differs between columns. |index_size_bytes| is the memory used by the
+// index of the column (see Column::CreateIndex), 0 if it has none.
+class ColumnStatsGenerator : public DynamicTableGenerator {
+ public:
+  enum class ColumnIndex : uint32_t {
+    kId = 0,
+    kTableName,
+    kColumnName,
+    kRowCount,
+    kNullCount,
+    kDistinctCount,
+    kMinValue,
+    kMaxValue,
+    kIndexSizeBytes,
+  };
+
+  // |tables| maps the name of the tables to the tables themselves and
+  // |stats_cache| caches their statistics. All the arguments must outlive
+  // this class.
+  ColumnStatsGenerator(StringPool* pool,
+                       const std::map<std::string, const Table*>* tables,
+                       TableStatsCache* stats_cache);
+  ~ColumnStatsGenerator() override;
+
+  Table::Schema CreateSchema() override;
+  std::string TableName() override;
+  uint32_t EstimateRowCount() override;
+  base::Status ValidateConstraints(const QueryConstraints&) override;
+  base::Status ComputeTable(const std::vector<Constraint>& cs,
+                            const std::vector<Order>& ob,
+                            const BitVector& cols_used,
+                            std::unique_ptr<Table>& table_return) override;
+
+ private:
+  StringPool* pool_ = nullptr;
+  const std::map<std::string, const Table*>* tables_ = nullptr;
+  TableStatsCache* stats_cache_ = nullptr;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_DYNAMIC_COLUMN_STATS_GENERATOR_H_
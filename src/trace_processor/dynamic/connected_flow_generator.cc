@@ -133,16 +133,16 @@ class BFS {
 
   // Includes the relatives of |slice_id| to the list of slices to visit.
   BFS& GoToRelatives(SliceId slice_id, RelativesVisitMode visit_relatives) {
-    const auto& slice_table = context_->storage->slice_table();
+    const TraceStorage& storage = *context_->storage;
     if (visit_relatives & VISIT_ANCESTORS) {
       auto opt_ancestors =
-          AncestorGenerator::GetAncestorSlices(slice_table, slice_id);
+          AncestorGenerator::GetAncestorSlices(storage, slice_id);
       if (opt_ancestors)
         GoToRelativesImpl(*opt_ancestors);
     }
     if (visit_relatives & VISIT_DESCENDANTS) {
       auto opt_descendants =
-          DescendantGenerator::GetDescendantSlices(slice_table, slice_id);
+          DescendantGenerator::GetDescendantSlices(storage, slice_id);
       if (opt_descendants)
         GoToRelativesImpl(*opt_descendants);
     }
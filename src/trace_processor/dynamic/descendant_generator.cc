@@ -61,37 +61,27 @@ std::unique_ptr<Table> ExtendWithStartId(
 }
 
 base::Status GetDescendants(
-    const tables::SliceTable& slices,
+    const TraceStorage& storage,
     SliceId starting_id,
     std::vector<tables::SliceTable::RowNumber>& row_numbers_accumulator) {
-  auto start_ref = slices.FindById(starting_id);
+  base::Optional<uint32_t> start_row =
+      storage.slice_table().id().IndexOf(starting_id);
   // The query gave an invalid ID that doesn't exist in the slice table.
-  if (!start_ref) {
+  if (!start_row) {
     return base::ErrStatus("no row with id %" PRIu32 "",
                            static_cast<uint32_t>(starting_id.value));
   }
 
-  // All nested descendents must be on the same track, with a ts greater than
-  // |start_ref.ts| and whose depth is larger than |start_ref|'s.
-  std::vector<Constraint> cs({slices.ts().ge(start_ref->ts()),
-                              slices.track_id().eq(start_ref->track_id().value),
-                              slices.depth().gt(start_ref->depth())});
-
-  // As an optimization, for any finished slices, we only need to consider
-  // slices which started before the end of this slice (because slices on a
-  // track are always perfectly stacked).
-  // For unfinshed slices (i.e. -1 dur), we need to consider until the end of
-  // the trace so we cannot add any similar constraint.
-  if (start_ref->dur() >= 0) {
-    cs.emplace_back(slices.ts().le(start_ref->ts() + start_ref->dur()));
-  }
-
+  // The descendants are a contiguous range in the slice tree index so this
+  // does not depend on the number of other slices on the track.
+  //
   // It's important we insert directly into |row_numbers_accumulator| and not
   // overwrite it because we expect the existing elements in
   // |row_numbers_accumulator| to be preserved.
-  for (auto it = slices.FilterToIterator(cs); it; ++it) {
-    row_numbers_accumulator.emplace_back(it.row_number());
-  }
+  std::vector<uint32_t> rows;
+  storage.slice_tree_index().GetDescendants(*start_row, &rows);
+  for (uint32_t row : rows)
+    row_numbers_accumulator.emplace_back(row);
   return base::OkStatus();
 }
 
@@ -139,8 +129,9 @@ base::Status DescendantGenerator::ComputeTable(
     case Descendant::kSlice: {
       // Build up all the children row ids.
       uint32_t start_id_uint = static_cast<uint32_t>(start_id);
-      RETURN_IF_ERROR(GetDescendants(
-          slices, tables::SliceTable::Id(start_id_uint), descendants));
+      RETURN_IF_ERROR(GetDescendants(*context_->storage,
+                                     tables::SliceTable::Id(start_id_uint),
+                                     descendants));
       table_return = ExtendWithStartId<tables::DescendantSliceTable>(
           start_id_uint, slices, std::move(descendants));
       break;
@@ -148,7 +139,8 @@ base::Status DescendantGenerator::ComputeTable(
     case Descendant::kSliceByStack: {
       auto sbs_cs = {slices.stack_id().eq(start_id)};
       for (auto it = slices.FilterToIterator(sbs_cs); it; ++it) {
-        RETURN_IF_ERROR(GetDescendants(slices, it.id(), descendants));
+        RETURN_IF_ERROR(
+            GetDescendants(*context_->storage, it.id(), descendants));
       }
       table_return = ExtendWithStartId<tables::DescendantSliceByStackTable>(
           start_id, slices, std::move(descendants));
@@ -185,10 +177,10 @@ uint32_t DescendantGenerator::EstimateRowCount() {
 
 // static
 base::Optional<std::vector<tables::SliceTable::RowNumber>>
-DescendantGenerator::GetDescendantSlices(const tables::SliceTable& slices,
+DescendantGenerator::GetDescendantSlices(const TraceStorage& storage,
                                          SliceId slice_id) {
   std::vector<tables::SliceTable::RowNumber> ret;
-  auto status = GetDescendants(slices, slice_id, ret);
+  auto status = GetDescendants(storage, slice_id, ret);
   if (!status.ok())
     return base::nullopt;
   return std::move(ret);
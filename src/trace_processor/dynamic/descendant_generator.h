@@ -50,7 +50,7 @@ class DescendantGenerator : public DynamicTableGenerator {
   // base::nullopt if an invalid |slice_id| is given. This is used by
   // ConnectedFlowGenerator to traverse flow indirectly connected flow events.
   static base::Optional<std::vector<tables::SliceTable::RowNumber>>
-  GetDescendantSlices(const tables::SliceTable& slices, SliceId slice_id);
+  GetDescendantSlices(const TraceStorage& storage, SliceId slice_id);
 
  private:
   Descendant type_;
@@ -0,0 +1,447 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/dynamic/experimental_aggregate_generator.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "perfetto/ext/base/flat_hash_map.h"
+#include "perfetto/ext/base/optional.h"
+#include "perfetto/ext/base/string_utils.h"
+#include "src/trace_processor/db/runtime_table.h"
+#include "src/trace_processor/db/typed_column.h"
+#include "src/trace_processor/sqlite/sqlite_utils.h"
+#include "src/trace_processor/util/status_macros.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+using ColumnIndex = ExperimentalAggregateGenerator::ColumnIndex;
+
+// Number of rows whose values are read from the columns at once before being
+// aggregated.
+constexpr uint32_t kChunkSize = 1024;
+
+enum class Aggregation { kCount, kSum, kMin, kMax, kAvg };
+
+enum class ValueKind { kLong, kDouble, kString };
+
+base::Optional<Aggregation> ParseAggregation(const std::string& raw) {
+  std::string aggregation = base::ToLower(raw);
+  if (aggregation == "count")
+    return Aggregation::kCount;
+  if (aggregation == "sum")
+    return Aggregation::kSum;
+  if (aggregation == "min")
+    return Aggregation::kMin;
+  if (aggregation == "max")
+    return Aggregation::kMax;
+  if (aggregation == "avg")
+    return Aggregation::kAvg;
+  return base::nullopt;
+}
+
+base::Optional<ValueKind> GetValueKind(const Column& col) {
+  if (col.IsId() || col.IsColumnType<int32_t>() ||
+      col.IsColumnType<uint32_t>() || col.IsColumnType<int64_t>()) {
+    return ValueKind::kLong;
+  }
+  if (col.IsColumnType<double>())
+    return ValueKind::kDouble;
+  if (col.IsColumnType<StringPool::Id>())
+    return ValueKind::kString;
+  return base::nullopt;
+}
+
+// The values of a range of rows of a column. Integer, id and string columns
+// (represented by the ids of the strings in the string pool) are read into
+// |longs| while double columns are read into |doubles|.
+struct Chunk {
+  void Clear() {
+    longs.clear();
+    doubles.clear();
+    is_null.clear();
+  }
+
+  std::vector<int64_t> longs;
+  std::vector<double> doubles;
+  std::vector<uint8_t> is_null;
+};
+
+template <typename T, typename Out>
+void GatherNumeric(const Column& col,
+                   uint32_t start,
+                   uint32_t end,
+                   std::vector<Out>* out,
+                   std::vector<uint8_t>* is_null) {
+  if (col.IsNullable()) {
+    const auto& typed = *TypedColumn<base::Optional<T>>::FromColumn(&col);
+    for (uint32_t i = start; i < end; ++i) {
+      base::Optional<T> value = typed[i];
+      out->push_back(value ? static_cast<Out>(*value) : Out());
+      is_null->push_back(!value.has_value());
+    }
+    return;
+  }
+  const auto& typed = *TypedColumn<T>::FromColumn(&col);
+  for (uint32_t i = start; i < end; ++i) {
+    out->push_back(static_cast<Out>(typed[i]));
+    is_null->push_back(false);
+  }
+}
+
+// Reads the values of |col| for the rows [start, end) into |chunk|.
+void Gather(const Column& col, uint32_t start, uint32_t end, Chunk* chunk) {
+  chunk->Clear();
+  if (col.IsId()) {
+    for (uint32_t i = start; i < end; ++i) {
+      chunk->longs.push_back(col.overlay().Get(i));
+      chunk->is_null.push_back(false);
+    }
+  } else if (col.IsColumnType<int32_t>()) {
+    GatherNumeric<int32_t>(col, start, end, &chunk->longs, &chunk->is_null);
+  } else if (col.IsColumnType<uint32_t>()) {
+    GatherNumeric<uint32_t>(col, start, end, &chunk->longs, &chunk->is_null);
+  } else if (col.IsColumnType<int64_t>()) {
+    GatherNumeric<int64_t>(col, start, end, &chunk->longs, &chunk->is_null);
+  } else if (col.IsColumnType<double>()) {
+    GatherNumeric<double>(col, start, end, &chunk->doubles, &chunk->is_null);
+  } else if (col.IsColumnType<StringPool::Id>()) {
+    const auto& typed = *TypedColumn<StringPool::Id>::FromColumn(&col);
+    for (uint32_t i = start; i < end; ++i) {
+      StringPool::Id id = typed[i];
+      chunk->longs.push_back(id.raw_id());
+      chunk->is_null.push_back(id.is_null());
+    }
+  } else {
+    PERFETTO_FATAL("Unsupported column type");
+  }
+}
+
+// Keys are often timestamps or other values with many trailing zero bits:
+// mix them (MurmurHash3 finalizer) before using them in the power-of-two
+// sized hash map as std::hash is the identity on integers.
+struct KeyHash {
+  size_t operator()(int64_t key) const {
+    uint64_t x = static_cast<uint64_t>(key);
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return static_cast<size_t>(x);
+  }
+};
+
+struct Group {
+  int64_t key = 0;
+  bool key_is_null = false;
+
+  // Number of rows in the group and number of non-null aggregated values.
+  uint32_t count = 0;
+  uint32_t non_null = 0;
+
+  int64_t long_value = 0;
+  double double_value = 0;
+};
+
+bool AddOverflows(int64_t a, int64_t b, int64_t* res) {
+  if ((b > 0 && a > std::numeric_limits<int64_t>::max() - b) ||
+      (b < 0 && a < std::numeric_limits<int64_t>::min() - b)) {
+    return true;
+  }
+  *res = a + b;
+  return false;
+}
+
+base::Status AccumulateLong(Aggregation aggregation,
+                            int64_t value,
+                            Group* group) {
+  bool first = group->non_null++ == 0;
+  switch (aggregation) {
+    case Aggregation::kCount:
+      break;
+    case Aggregation::kSum:
+      if (AddOverflows(group->long_value, value, &group->long_value))
+        return base::ErrStatus("integer overflow");
+      break;
+    case Aggregation::kMin:
+      group->long_value = first ? value : std::min(group->long_value, value);
+      break;
+    case Aggregation::kMax:
+      group->long_value = first ? value : std::max(group->long_value, value);
+      break;
+    case Aggregation::kAvg:
+      group->double_value += static_cast<double>(value);
+      break;
+  }
+  return base::OkStatus();
+}
+
+void AccumulateDouble(Aggregation aggregation, double value, Group* group) {
+  bool first = group->non_null++ == 0;
+  switch (aggregation) {
+    case Aggregation::kCount:
+      break;
+    case Aggregation::kSum:
+    case Aggregation::kAvg:
+      group->double_value += value;
+      break;
+    case Aggregation::kMin:
+      group->double_value =
+          first ? value : std::min(group->double_value, value);
+      break;
+    case Aggregation::kMax:
+      group->double_value =
+          first ? value : std::max(group->double_value, value);
+      break;
+  }
+}
+
+base::Status FindConstraint(const std::vector<Constraint>& cs,
+                            ColumnIndex col,
+                            std::string* value) {
+  auto it = std::find_if(cs.begin(), cs.end(), [col](const Constraint& c) {
+    return c.col_idx == static_cast<uint32_t>(col) && c.op == FilterOp::kEq;
+  });
+  if (it == cs.end() || it->value.type != SqlValue::Type::kString)
+    return base::ErrStatus("All arguments must be non-null strings");
+  *value = it->value.AsString();
+  return base::OkStatus();
+}
+
+}  // namespace
+
+ExperimentalAggregateGenerator::ExperimentalAggregateGenerator(
+    const std::map<std::string, const Table*>* tables)
+    : tables_(tables) {}
+
+ExperimentalAggregateGenerator::~ExperimentalAggregateGenerator() = default;
+
+Table::Schema ExperimentalAggregateGenerator::CreateSchema() {
+  // The key and value columns take the type of the aggregated table's
+  // columns so their type is left unspecified.
+  Table::Schema schema;
+  schema.columns.push_back(Table::Schema::Column{
+      "id", SqlValue::Type::kLong, true /* is_id */, true /* is_sorted */,
+      false /* is_hidden */, false /* is_set_id */});
+  schema.columns.push_back(Table::Schema::Column{
+      "key", SqlValue::Type::kNull, false /* is_id */, false /* is_sorted */,
+      false /* is_hidden */, false /* is_set_id */});
+  schema.columns.push_back(Table::Schema::Column{
+      "count", SqlValue::Type::kLong, false /* is_id */,
+      false /* is_sorted */, false /* is_hidden */, false /* is_set_id */});
+  schema.columns.push_back(Table::Schema::Column{
+      "value", SqlValue::Type::kNull, false /* is_id */,
+      false /* is_sorted */, false /* is_hidden */, false /* is_set_id */});
+  for (const char* name :
+       {"table_name", "group_by", "aggregation", "aggregate_column"}) {
+    schema.columns.push_back(Table::Schema::Column{
+        name, SqlValue::Type::kString, false /* is_id */,
+        false /* is_sorted */, true /* is_hidden */, false /* is_set_id */});
+  }
+  return schema;
+}
+
+std::string ExperimentalAggregateGenerator::TableName() {
+  return "experimental_aggregate";
+}
+
+uint32_t ExperimentalAggregateGenerator::EstimateRowCount() {
+  // The number of groups is usually small compared to the tables.
+  return 1024;
+}
+
+base::Status ExperimentalAggregateGenerator::ValidateConstraints(
+    const QueryConstraints& qc) {
+  for (ColumnIndex col : {ColumnIndex::kTableName, ColumnIndex::kGroupBy,
+                          ColumnIndex::kAggregation,
+                          ColumnIndex::kAggregateColumn}) {
+    auto it = std::find_if(
+        qc.constraints().begin(), qc.constraints().end(),
+        [col](const QueryConstraints::Constraint& c) {
+          return c.column == static_cast<int>(col) &&
+                 sqlite_utils::IsOpEq(c.op);
+        });
+    if (it == qc.constraints().end())
+      return base::ErrStatus("Failed to find required constraints");
+  }
+  return base::OkStatus();
+}
+
+base::Status ExperimentalAggregateGenerator::ComputeTable(
+    const std::vector<Constraint>& cs,
+    const std::vector<Order>&,
+    const BitVector&,
+    std::unique_ptr<Table>& table_return) {
+  std::string table_name;
+  std::string group_by;
+  std::string aggregation;
+  std::string aggregate_column;
+  RETURN_IF_ERROR(FindConstraint(cs, ColumnIndex::kTableName, &table_name));
+  RETURN_IF_ERROR(FindConstraint(cs, ColumnIndex::kGroupBy, &group_by));
+  RETURN_IF_ERROR(FindConstraint(cs, ColumnIndex::kAggregation, &aggregation));
+  RETURN_IF_ERROR(
+      FindConstraint(cs, ColumnIndex::kAggregateColumn, &aggregate_column));
+
+  auto it = tables_->find(table_name);
+  if (it == tables_->end())
+    return base::ErrStatus("Unknown table %s", table_name.c_str());
+  return ComputeAggregateTable(*it->second, table_name, group_by, aggregation,
+                               aggregate_column, table_return);
+}
+
+// static
+base::Status ExperimentalAggregateGenerator::ComputeAggregateTable(
+    const Table& table,
+    const std::string& table_name,
+    const std::string& group_by,
+    const std::string& aggregation,
+    const std::string& aggregate_column,
+    std::unique_ptr<Table>& table_return) {
+  const Column* group_col = table.GetColumnByName(group_by.c_str());
+  if (!group_col)
+    return base::ErrStatus("Unknown column %s", group_by.c_str());
+  base::Optional<ValueKind> key_kind = GetValueKind(*group_col);
+  if (!key_kind || *key_kind == ValueKind::kDouble) {
+    return base::ErrStatus("Cannot group by column %s",
+                           group_by.c_str());
+  }
+
+  base::Optional<Aggregation> agg = ParseAggregation(aggregation);
+  if (!agg)
+    return base::ErrStatus("Unknown aggregation %s", aggregation.c_str());
+
+  // A null |agg_col| means that rows are counted (i.e. COUNT(*)).
+  const Column* agg_col = nullptr;
+  base::Optional<ValueKind> value_kind;
+  if (aggregate_column != "*" || *agg != Aggregation::kCount) {
+    agg_col = table.GetColumnByName(aggregate_column.c_str());
+    if (!agg_col)
+      return base::ErrStatus("Unknown column %s", aggregate_column.c_str());
+    value_kind = GetValueKind(*agg_col);
+    bool supported = value_kind && (*value_kind != ValueKind::kString ||
+                                    *agg == Aggregation::kCount);
+    if (!supported) {
+      return base::ErrStatus("Cannot compute %s of column %s",
+                             aggregation.c_str(), aggregate_column.c_str());
+    }
+  }
+
+  // Hash aggregation: the values of the columns are read in chunks and
+  // accumulated into the group of their key.
+  std::vector<Group> groups;
+  base::FlatHashMap<int64_t, uint32_t, KeyHash> group_by_key;
+  base::Optional<uint32_t> null_group;
+  Chunk keys;
+  Chunk values;
+  for (uint32_t start = 0; start < table.row_count(); start += kChunkSize) {
+    uint32_t end = std::min(start + kChunkSize, table.row_count());
+    Gather(*group_col, start, end, &keys);
+    if (agg_col)
+      Gather(*agg_col, start, end, &values);
+
+    for (uint32_t i = 0; i < end - start; ++i) {
+      uint32_t group_idx;
+      if (keys.is_null[i]) {
+        if (!null_group) {
+          null_group = static_cast<uint32_t>(groups.size());
+          groups.emplace_back();
+          groups.back().key_is_null = true;
+        }
+        group_idx = *null_group;
+      } else {
+        auto it_and_inserted = group_by_key.Insert(
+            keys.longs[i], static_cast<uint32_t>(groups.size()));
+        if (it_and_inserted.second) {
+          groups.emplace_back();
+          groups.back().key = keys.longs[i];
+        }
+        group_idx = *it_and_inserted.first;
+      }
+
+      Group& group = groups[group_idx];
+      group.count++;
+      if (!agg_col || values.is_null[i])
+        continue;
+      if (*value_kind == ValueKind::kDouble) {
+        AccumulateDouble(*agg, values.doubles[i], &group);
+      } else {
+        RETURN_IF_ERROR(AccumulateLong(*agg, values.longs[i], &group));
+      }
+    }
+  }
+
+  StringPool* pool = table.string_pool();
+  std::sort(groups.begin(), groups.end(),
+            [&key_kind, pool](const Group& a, const Group& b) {
+              if (a.key_is_null || b.key_is_null)
+                return a.key_is_null && !b.key_is_null;
+              if (*key_kind != ValueKind::kString)
+                return a.key < b.key;
+              auto a_str = pool->Get(
+                  StringPool::Id::Raw(static_cast<uint32_t>(a.key)));
+              auto b_str = pool->Get(
+                  StringPool::Id::Raw(static_cast<uint32_t>(b.key)));
+              return strcmp(a_str.c_str(), b_str.c_str()) < 0;
+            });
+
+  std::unique_ptr<RuntimeTable> out(new RuntimeTable(
+      pool, {"key", "count", "value", "table_name", "group_by", "aggregation",
+             "aggregate_column"}));
+  for (const Group& group : groups) {
+    if (group.key_is_null) {
+      RETURN_IF_ERROR(out->AddNull(0));
+    } else if (*key_kind == ValueKind::kString) {
+      StringPool::Id id = StringPool::Id::Raw(static_cast<uint32_t>(group.key));
+      RETURN_IF_ERROR(out->AddText(0, pool->Get(id).c_str()));
+    } else {
+      RETURN_IF_ERROR(out->AddInteger(0, group.key));
+    }
+    RETURN_IF_ERROR(out->AddInteger(1, group.count));
+
+    if (*agg == Aggregation::kCount) {
+      uint32_t count = agg_col ? group.non_null : group.count;
+      RETURN_IF_ERROR(out->AddInteger(2, count));
+    } else if (group.non_null == 0) {
+      RETURN_IF_ERROR(out->AddNull(2));
+    } else if (*agg == Aggregation::kAvg) {
+      RETURN_IF_ERROR(out->AddFloat(2, group.double_value / group.non_null));
+    } else if (*value_kind == ValueKind::kDouble) {
+      RETURN_IF_ERROR(out->AddFloat(2, group.double_value));
+    } else {
+      RETURN_IF_ERROR(out->AddInteger(2, group.long_value));
+    }
+
+    RETURN_IF_ERROR(out->AddText(3, table_name.c_str()));
+    RETURN_IF_ERROR(out->AddText(4, group_by.c_str()));
+    RETURN_IF_ERROR(out->AddText(5, aggregation.c_str()));
+    RETURN_IF_ERROR(out->AddText(6, aggregate_column.c_str()));
+  }
+  RETURN_IF_ERROR(
+      out->AddColumnsAndOverlays(static_cast<uint32_t>(groups.size())));
+  table_return = std::move(out);
+  return base::OkStatus();
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_DYNAMIC_EXPERIMENTAL_AGGREGATE_GENERATOR_H_
+#define SRC_TRACE_PROCESSOR_DYNAMIC_EXPERIMENTAL_AGGREGATE_GENERATOR_H_
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "src/trace_processor/dynamic/dynamic_table_generator.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Dynamic table generator for the "experimental_aggregate" table-valued
+// function which computes a grouped aggregation directly on the columns of a
+// db Table instead of having SQLite pull every row through the virtual table
+// interface. For example:
+//   SELECT key AS utid, value AS total_dur
+//   FROM experimental_aggregate('sched_slice', 'utid', 'sum', 'dur')
+// is equivalent to:
+//   SELECT utid, SUM(dur) AS total_dur FROM sched_slice GROUP BY utid
+//
+// The group by column must be an integer, id or string column. The
+// aggregation is one of count, sum, min, max or avg and follows the semantics
+// of the SQLite function with the same name; count additionally accepts '*'
+// as the aggregated column. Only count is supported on string columns.
+//
+// Each output row contains the key of the group, the number of rows in the
+// group and the aggregated value. Groups are sorted by key, with the null
+// group (if any) first.
+class ExperimentalAggregateGenerator : public DynamicTableGenerator {
+ public:
+  enum class ColumnIndex : uint32_t {
+    kId = 0,
+    kKey,
+    kCount,
+    kValue,
+    kTableName,
+    kGroupBy,
+    kAggregation,
+    kAggregateColumn,
+  };
+
+  // |tables| maps the name of the tables which can be aggregated to the
+  // tables themselves. It must outlive this class.
+  explicit ExperimentalAggregateGenerator(
+      const std::map<std::string, const Table*>* tables);
+  ~ExperimentalAggregateGenerator() override;
+
+  Table::Schema CreateSchema() override;
+  std::string TableName() override;
+  uint32_t EstimateRowCount() override;
+  base::Status ValidateConstraints(const QueryConstraints&) override;
+  base::Status ComputeTable(const std::vector<Constraint>& cs,
+                            const std::vector<Order>& ob,
+                            const BitVector& cols_used,
+                            std::unique_ptr<Table>& table_return) override;
+
+  // Visible for testing.
+  static base::Status ComputeAggregateTable(
+      const Table& table,
+      const std::string& table_name,
+      const std::string& group_by,
+      const std::string& aggregation,
+      const std::string& aggregate_column,
+      std::unique_ptr<Table>& table_return);
+
+ private:
+  const std::map<std::string, const Table*>* tables_ = nullptr;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_DYNAMIC_EXPERIMENTAL_AGGREGATE_GENERATOR_H_
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/dynamic/experimental_aggregate_generator.h"
+
+#include "src/trace_processor/tables/macros.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+#define PERFETTO_TP_TEST_AGGREGATE_TABLE_DEF(NAME, PARENT, C) \
+  NAME(TestAggregateTable, "test_aggregate")                  \
+  PARENT(PERFETTO_TP_ROOT_TABLE_PARENT_DEF, C)                \
+  C(uint32_t, utid)                                           \
+  C(base::Optional<int64_t>, dur)                             \
+  C(double, value)                                            \
+  C(StringPool::Id, name)
+PERFETTO_TP_TABLE(PERFETTO_TP_TEST_AGGREGATE_TABLE_DEF);
+
+TestAggregateTable::~TestAggregateTable() = default;
+
+class ExperimentalAggregateGeneratorTest : public ::testing::Test {
+ protected:
+  ExperimentalAggregateGeneratorTest() : table_(&pool_, nullptr) {
+    StringPool::Id a = pool_.InternString("a");
+    StringPool::Id b = pool_.InternString("b");
+    table_.Insert(TestAggregateTable::Row(1, 10, 1.5, a));
+    table_.Insert(TestAggregateTable::Row(2, 20, 2.5, b));
+    table_.Insert(TestAggregateTable::Row(1, base::nullopt, 3.0, a));
+    table_.Insert(TestAggregateTable::Row(1, 5, 0.5, b));
+  }
+
+  std::unique_ptr<Table> Aggregate(const std::string& group_by,
+                                   const std::string& aggregation,
+                                   const std::string& aggregate_column) {
+    std::unique_ptr<Table> out;
+    base::Status status = ExperimentalAggregateGenerator::ComputeAggregateTable(
+        table_, "test_aggregate", group_by, aggregation, aggregate_column,
+        out);
+    EXPECT_TRUE(status.ok()) << status.message();
+    return out;
+  }
+
+  base::Status AggregateStatus(const std::string& group_by,
+                               const std::string& aggregation,
+                               const std::string& aggregate_column) {
+    std::unique_ptr<Table> out;
+    return ExperimentalAggregateGenerator::ComputeAggregateTable(
+        table_, "test_aggregate", group_by, aggregation, aggregate_column,
+        out);
+  }
+
+  static SqlValue Get(const Table& table, const char* col, uint32_t row) {
+    return table.GetColumnByName(col)->Get(row);
+  }
+
+  StringPool pool_;
+  TestAggregateTable table_;
+};
+
+TEST_F(ExperimentalAggregateGeneratorTest, SumByInteger) {
+  auto out = Aggregate("utid", "sum", "dur");
+  ASSERT_EQ(out->row_count(), 2u);
+  ASSERT_TRUE(out->GetColumnByName("key")->IsSorted());
+
+  ASSERT_EQ(Get(*out, "key", 0).AsLong(), 1);
+  ASSERT_EQ(Get(*out, "count", 0).AsLong(), 3);
+  ASSERT_EQ(Get(*out, "value", 0).AsLong(), 15);
+
+  ASSERT_EQ(Get(*out, "key", 1).AsLong(), 2);
+  ASSERT_EQ(Get(*out, "count", 1).AsLong(), 1);
+  ASSERT_EQ(Get(*out, "value", 1).AsLong(), 20);
+
+  ASSERT_STREQ(Get(*out, "table_name", 0).AsString(), "test_aggregate");
+  ASSERT_STREQ(Get(*out, "aggregation", 1).AsString(), "sum");
+}
+
+TEST_F(ExperimentalAggregateGeneratorTest, AggregationsByString) {
+  auto avg = Aggregate("name", "AVG", "value");
+  ASSERT_EQ(avg->row_count(), 2u);
+  ASSERT_STREQ(Get(*avg, "key", 0).AsString(), "a");
+  ASSERT_DOUBLE_EQ(Get(*avg, "value", 0).AsDouble(), 2.25);
+  ASSERT_STREQ(Get(*avg, "key", 1).AsString(), "b");
+  ASSERT_DOUBLE_EQ(Get(*avg, "value", 1).AsDouble(), 1.5);
+
+  auto max = Aggregate("name", "max", "value");
+  ASSERT_DOUBLE_EQ(Get(*max, "value", 0).AsDouble(), 3.0);
+  ASSERT_DOUBLE_EQ(Get(*max, "value", 1).AsDouble(), 2.5);
+
+  auto min = Aggregate("name", "min", "dur");
+  ASSERT_EQ(Get(*min, "value", 0).AsLong(), 10);
+  ASSERT_EQ(Get(*min, "value", 1).AsLong(), 5);
+}
+
+TEST_F(ExperimentalAggregateGeneratorTest, Count) {
+  auto rows = Aggregate("utid", "count", "*");
+  ASSERT_EQ(Get(*rows, "value", 0).AsLong(), 3);
+  ASSERT_EQ(Get(*rows, "value", 1).AsLong(), 1);
+
+  // Counting a column ignores nulls.
+  auto non_null = Aggregate("utid", "count", "dur");
+  ASSERT_EQ(Get(*non_null, "value", 0).AsLong(), 2);
+  ASSERT_EQ(Get(*non_null, "value", 1).AsLong(), 1);
+
+  // Null keys are grouped together.
+  auto by_dur = Aggregate("dur", "count", "name");
+  ASSERT_EQ(by_dur->row_count(), 4u);
+  ASSERT_TRUE(Get(*by_dur, "key", 0).is_null());
+  ASSERT_EQ(Get(*by_dur, "key", 1).AsLong(), 5);
+}
+
+TEST_F(ExperimentalAggregateGeneratorTest, Errors) {
+  ASSERT_FALSE(AggregateStatus("value", "sum", "dur").ok());
+  ASSERT_FALSE(AggregateStatus("utid", "sum", "name").ok());
+  ASSERT_FALSE(AggregateStatus("utid", "median", "dur").ok());
+  ASSERT_FALSE(AggregateStatus("utid", "sum", "*").ok());
+  ASSERT_FALSE(AggregateStatus("missing", "sum", "dur").ok());
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
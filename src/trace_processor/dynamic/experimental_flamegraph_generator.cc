@@ -336,11 +336,11 @@ base::Status ExperimentalFlamegraphGenerator::ComputeTable(
     auto* tracker = HeapGraphTracker::GetOrCreate(context_);
     table = tracker->BuildFlamegraph(values.ts, *values.upid);
   } else if (values.profile_type == ProfileType::kHeapProfile) {
-    table = BuildHeapProfileFlamegraph(context_->storage.get(), *values.upid,
-                                       values.ts);
+    table = BuildHeapProfileFlamegraph(context_->storage.get(), &cache_,
+                                       *values.upid, values.ts);
   } else if (values.profile_type == ProfileType::kPerf) {
     table = BuildNativeCallStackSamplingFlamegraph(
-        context_->storage.get(), values.upid, values.upid_group,
+        context_->storage.get(), &cache_, values.upid, values.upid_group,
         values.time_constraints);
   }
   if (!values.focus_str.empty()) {
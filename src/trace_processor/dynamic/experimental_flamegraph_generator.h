@@ -53,6 +53,7 @@ class ExperimentalFlamegraphGenerator : public DynamicTableGenerator {
 
  private:
   TraceProcessorContext* context_ = nullptr;
+  FlamegraphCache cache_;
 };
 
 }  // namespace trace_processor
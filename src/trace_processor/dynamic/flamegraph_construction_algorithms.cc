@@ -16,9 +16,12 @@
 
 #include "src/trace_processor/dynamic/flamegraph_construction_algorithms.h"
 
+#include <algorithm>
+#include <limits>
 #include <set>
-#include <unordered_set>
 
+#include "perfetto/ext/base/flat_hash_map.h"
+#include "perfetto/ext/base/hash.h"
 #include "perfetto/ext/base/string_splitter.h"
 #include "perfetto/ext/base/string_utils.h"
 
@@ -26,32 +29,45 @@ namespace perfetto {
 namespace trace_processor {
 
 namespace {
+
+constexpr uint32_t kNoParent = std::numeric_limits<uint32_t>::max();
+
 struct MergedCallsite {
   StringId frame_name;
   StringId mapping_name;
   base::Optional<StringId> source_file;
   base::Optional<uint32_t> line_number;
-  base::Optional<uint32_t> parent_idx;
-  bool operator<(const MergedCallsite& o) const {
-    return std::tie(frame_name, mapping_name, parent_idx) <
-           std::tie(o.frame_name, o.mapping_name, o.parent_idx);
+};
+
+// Callsites are merged if they have the same frame name, mapping name and
+// merged parent.
+struct MergedCallsiteKey {
+  uint32_t frame_name;
+  uint32_t mapping_name;
+  uint32_t parent_idx;
+
+  bool operator==(const MergedCallsiteKey& o) const {
+    return frame_name == o.frame_name && mapping_name == o.mapping_name &&
+           parent_idx == o.parent_idx;
   }
 };
 
-struct FlamegraphTableAndMergedCallsites {
-  std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> tbl;
-  std::vector<uint32_t> callsite_to_merged_callsite;
+struct MergedCallsiteKeyHasher {
+  size_t operator()(const MergedCallsiteKey& key) const {
+    return static_cast<size_t>(
+        base::Hash::Combine(key.frame_name, key.mapping_name, key.parent_idx));
+  }
 };
 
-std::vector<MergedCallsite> GetMergedCallsites(TraceStorage* storage,
+std::vector<MergedCallsite> GetMergedCallsites(const TraceStorage& storage,
                                                uint32_t callstack_row) {
   const tables::StackProfileCallsiteTable& callsites_tbl =
-      storage->stack_profile_callsite_table();
+      storage.stack_profile_callsite_table();
   const tables::StackProfileFrameTable& frames_tbl =
-      storage->stack_profile_frame_table();
-  const tables::SymbolTable& symbols_tbl = storage->symbol_table();
+      storage.stack_profile_frame_table();
+  const tables::SymbolTable& symbols_tbl = storage.symbol_table();
   const tables::StackProfileMappingTable& mapping_tbl =
-      storage->stack_profile_mapping_table();
+      storage.stack_profile_mapping_table();
 
   uint32_t frame_idx =
       *frames_tbl.id().IndexOf(callsites_tbl.frame_id()[callstack_row]);
@@ -68,7 +84,7 @@ std::vector<MergedCallsite> GetMergedCallsites(TraceStorage* storage,
     base::Optional<StringId> deobfuscated_name =
         frames_tbl.deobfuscated_name()[frame_idx];
     return {{deobfuscated_name ? *deobfuscated_name : frame_name, mapping_name,
-             base::nullopt, base::nullopt, base::nullopt}};
+             base::nullopt, base::nullopt}};
   }
 
   std::vector<MergedCallsite> result;
@@ -80,31 +96,23 @@ std::vector<MergedCallsite> GetMergedCallsites(TraceStorage* storage,
        i < symbols_tbl.row_count() &&
        symbols_tbl.symbol_set_id()[i] == *symbol_set_id;
        ++i) {
-    result.emplace_back(MergedCallsite{
-        symbols_tbl.name()[i], mapping_name, symbols_tbl.source_file()[i],
-        symbols_tbl.line_number()[i], base::nullopt});
+    result.emplace_back(MergedCallsite{symbols_tbl.name()[i], mapping_name,
+                                       symbols_tbl.source_file()[i],
+                                       symbols_tbl.line_number()[i]});
   }
   std::reverse(result.begin(), result.end());
   return result;
 }
-}  // namespace
 
-static FlamegraphTableAndMergedCallsites BuildFlamegraphTableTreeStructure(
-    TraceStorage* storage,
-    base::Optional<UniquePid> upid,
-    base::Optional<std::string> upid_group,
-    int64_t default_timestamp,
-    StringId profile_type) {
+std::unique_ptr<MergedCallsiteTree> BuildMergedCallsiteTree(
+    const TraceStorage& storage) {
   const tables::StackProfileCallsiteTable& callsites_tbl =
-      storage->stack_profile_callsite_table();
+      storage.stack_profile_callsite_table();
 
-  std::vector<uint32_t> callsite_to_merged_callsite(callsites_tbl.row_count(),
-                                                    0);
-  std::map<MergedCallsite, uint32_t> merged_callsites_to_table_idx;
-
-  std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> tbl(
-      new tables::ExperimentalFlamegraphNodesTable(
-          storage->mutable_string_pool(), nullptr));
+  std::unique_ptr<MergedCallsiteTree> tree(new MergedCallsiteTree());
+  tree->callsite_to_merged_callsite.resize(callsites_tbl.row_count());
+  base::FlatHashMap<MergedCallsiteKey, uint32_t, MergedCallsiteKeyHasher>
+      merged_callsites_to_idx;
 
   // FORWARD PASS:
   // Aggregate callstacks by frame name / mapping name. Use symbolization
@@ -117,239 +125,305 @@ static FlamegraphTableAndMergedCallsites BuildFlamegraphTableTreeStructure(
       parent_idx = callsites_tbl.id().IndexOf(*opt_parent_id);
       // Make sure what we index into has been populated already.
       PERFETTO_CHECK(*parent_idx < i);
-      parent_idx = callsite_to_merged_callsite[*parent_idx];
+      parent_idx = tree->callsite_to_merged_callsite[*parent_idx];
     }
 
     auto callsites = GetMergedCallsites(storage, i);
     // Loop below needs to run at least once for parent_idx to get updated.
     PERFETTO_CHECK(!callsites.empty());
-    std::map<MergedCallsite, uint32_t> callsites_to_rowid;
-    for (MergedCallsite& merged_callsite : callsites) {
-      merged_callsite.parent_idx = parent_idx;
-      auto it = merged_callsites_to_table_idx.find(merged_callsite);
-      if (it == merged_callsites_to_table_idx.end()) {
-        std::tie(it, std::ignore) = merged_callsites_to_table_idx.emplace(
-            merged_callsite, merged_callsites_to_table_idx.size());
-        tables::ExperimentalFlamegraphNodesTable::Row row{};
-        if (parent_idx) {
-          row.depth = tbl->depth()[*parent_idx] + 1;
-        } else {
-          row.depth = 0;
-        }
-
-        // The 'ts' column is given a default value, taken from the query.
-        // So if the query is:
-        // `select * form experimental_flamegraph
-        //  where ts = 605908369259172
-        //  and upid = 1
-        //  and profile_type = 'native'`
-        // then row.ts == 605908369259172, for all rows
-        // This is not accurate. However, at present there is no other
-        // straightforward way of assigning timestamps to non-leaf nodes in the
-        // flamegraph tree. Non-leaf nodes would have to be assigned >= 1
-        // timestamps, which would increase data size without an advantage.
-        row.ts = default_timestamp;
-        if (upid) {
-          row.upid = *upid;
-        }
-        if (upid_group) {
-          row.upid_group = storage->InternString(base::StringView(*upid_group));
-        }
-        row.profile_type = profile_type;
-        row.name = merged_callsite.frame_name;
-        row.map_name = merged_callsite.mapping_name;
-        if (parent_idx)
-          row.parent_id = tbl->id()[*parent_idx];
-        tbl->Insert(row);
-        callsites_to_rowid[merged_callsite] =
-            static_cast<uint32_t>(merged_callsites_to_table_idx.size() - 1);
-
-        PERFETTO_CHECK(merged_callsites_to_table_idx.size() ==
-                       tbl->row_count());
-      } else {
-        MergedCallsite saved_callsite = it->first;
-        callsites_to_rowid.erase(saved_callsite);
-        if (saved_callsite.source_file != merged_callsite.source_file) {
-          saved_callsite.source_file = base::nullopt;
-        }
-        if (saved_callsite.line_number != merged_callsite.line_number) {
-          saved_callsite.line_number = base::nullopt;
-        }
-        callsites_to_rowid[saved_callsite] = it->second;
-      }
-      parent_idx = it->second;
-    }
-
-    for (const auto& it : callsites_to_rowid) {
-      if (it.first.source_file) {
-        tbl->mutable_source_file()->Set(it.second, *it.first.source_file);
-      }
-      if (it.first.line_number) {
-        tbl->mutable_line_number()->Set(it.second, *it.first.line_number);
+    for (const MergedCallsite& merged_callsite : callsites) {
+      MergedCallsiteKey key{merged_callsite.frame_name.raw_id(),
+                            merged_callsite.mapping_name.raw_id(),
+                            parent_idx ? *parent_idx : kNoParent};
+      auto idx = static_cast<uint32_t>(tree->nodes.size());
+      auto it_and_inserted = merged_callsites_to_idx.Insert(key, idx);
+      if (it_and_inserted.second) {
+        // The source file and line of a merged callsite are those of the
+        // first callsite merged into it.
+        MergedCallsiteTree::Node node;
+        node.name = merged_callsite.frame_name;
+        node.map_name = merged_callsite.mapping_name;
+        node.source_file = merged_callsite.source_file;
+        node.line_number = merged_callsite.line_number;
+        node.parent_idx = parent_idx;
+        node.depth = parent_idx ? tree->nodes[*parent_idx].depth + 1 : 0;
+        tree->nodes.push_back(node);
       }
+      parent_idx = *it_and_inserted.first;
     }
 
     PERFETTO_CHECK(parent_idx);
-    callsite_to_merged_callsite[i] = *parent_idx;
+    tree->callsite_to_merged_callsite[i] = *parent_idx;
   }
-
-  return {std::move(tbl), callsite_to_merged_callsite};
+  return tree;
 }
 
-static std::unique_ptr<tables::ExperimentalFlamegraphNodesTable>
-BuildFlamegraphTableHeapSizeAndCount(
-    std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> tbl,
-    const std::vector<uint32_t>& callsite_to_merged_callsite,
-    const Table& filtered) {
-  for (auto it = filtered.IterateRows(); it; it.Next()) {
-    int64_t size =
-        it.Get(static_cast<uint32_t>(
-                   tables::HeapProfileAllocationTable::ColumnIndex::size))
-            .long_value;
-    int64_t count =
-        it.Get(static_cast<uint32_t>(
-                   tables::HeapProfileAllocationTable::ColumnIndex::count))
-            .long_value;
-    int64_t callsite_id =
-        it
-            .Get(static_cast<uint32_t>(
-                tables::HeapProfileAllocationTable::ColumnIndex::callsite_id))
-            .long_value;
-
-    PERFETTO_CHECK((size <= 0 && count <= 0) || (size >= 0 && count >= 0));
-    uint32_t merged_idx =
-        callsite_to_merged_callsite[static_cast<unsigned long>(callsite_id)];
-    // On old heapprofd producers, the count field is incorrectly set and we
-    // zero it in proto_trace_parser.cc.
-    // As such, we cannot depend on count == 0 to imply size == 0, so we check
-    // for both of them separately.
-    if (size > 0) {
-      tbl->mutable_alloc_size()->Set(merged_idx,
-                                     tbl->alloc_size()[merged_idx] + size);
-    }
-    if (count > 0) {
-      tbl->mutable_alloc_count()->Set(merged_idx,
-                                      tbl->alloc_count()[merged_idx] + count);
-    }
+// Creates a table with one row per node of |tree|, with all the sizes and
+// counts set to zero.
+std::unique_ptr<tables::ExperimentalFlamegraphNodesTable>
+BuildFlamegraphTableTreeStructure(TraceStorage* storage,
+                                  const MergedCallsiteTree& tree,
+                                  base::Optional<UniquePid> upid,
+                                  base::Optional<std::string> upid_group,
+                                  int64_t default_timestamp,
+                                  StringId profile_type) {
+  std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> tbl(
+      new tables::ExperimentalFlamegraphNodesTable(
+          storage->mutable_string_pool(), nullptr));
 
-    tbl->mutable_size()->Set(merged_idx, tbl->size()[merged_idx] + size);
-    tbl->mutable_count()->Set(merged_idx, tbl->count()[merged_idx] + count);
+  base::Optional<StringId> upid_group_id;
+  if (upid_group)
+    upid_group_id = storage->InternString(base::StringView(*upid_group));
+
+  for (const MergedCallsiteTree::Node& node : tree.nodes) {
+    tables::ExperimentalFlamegraphNodesTable::Row row{};
+    row.depth = node.depth;
+
+    // The 'ts' column is given a default value, taken from the query.
+    // So if the query is:
+    // `select * form experimental_flamegraph
+    //  where ts = 605908369259172
+    //  and upid = 1
+    //  and profile_type = 'native'`
+    // then row.ts == 605908369259172, for all rows
+    // This is not accurate. However, at present there is no other
+    // straightforward way of assigning timestamps to non-leaf nodes in the
+    // flamegraph tree. Non-leaf nodes would have to be assigned >= 1
+    // timestamps, which would increase data size without an advantage.
+    row.ts = default_timestamp;
+    if (upid) {
+      row.upid = *upid;
+    }
+    row.upid_group = upid_group_id;
+    row.profile_type = profile_type;
+    row.name = node.name;
+    row.map_name = node.map_name;
+    if (node.parent_idx)
+      row.parent_id = tbl->id()[*node.parent_idx];
+    row.source_file = node.source_file;
+    row.line_number = node.line_number;
+    tbl->Insert(row);
   }
+  return tbl;
+}
 
-  // BACKWARD PASS:
-  // Propagate sizes to parents.
-  for (int64_t i = tbl->row_count() - 1; i >= 0; --i) {
-    auto idx = static_cast<uint32_t>(i);
-
-    tbl->mutable_cumulative_size()->Set(
-        idx, tbl->cumulative_size()[idx] + tbl->size()[idx]);
-    tbl->mutable_cumulative_count()->Set(
-        idx, tbl->cumulative_count()[idx] + tbl->count()[idx]);
-
-    tbl->mutable_cumulative_alloc_size()->Set(
-        idx, tbl->cumulative_alloc_size()[idx] + tbl->alloc_size()[idx]);
-    tbl->mutable_cumulative_alloc_count()->Set(
-        idx, tbl->cumulative_alloc_count()[idx] + tbl->alloc_count()[idx]);
-
-    auto parent = tbl->parent_id()[idx];
-    if (parent) {
-      uint32_t parent_idx = *tbl->id().IndexOf(
-          tables::ExperimentalFlamegraphNodesTable::Id(*parent));
-      tbl->mutable_cumulative_size()->Set(
-          parent_idx,
-          tbl->cumulative_size()[parent_idx] + tbl->cumulative_size()[idx]);
-      tbl->mutable_cumulative_count()->Set(
-          parent_idx,
-          tbl->cumulative_count()[parent_idx] + tbl->cumulative_count()[idx]);
-
-      tbl->mutable_cumulative_alloc_size()->Set(
-          parent_idx, tbl->cumulative_alloc_size()[parent_idx] +
-                          tbl->cumulative_alloc_size()[idx]);
-      tbl->mutable_cumulative_alloc_count()->Set(
-          parent_idx, tbl->cumulative_alloc_count()[parent_idx] +
-                          tbl->cumulative_alloc_count()[idx]);
+// Returns the range of |samples| (which are sorted by timestamp) satisfying
+// all the |time_constraints|.
+std::pair<size_t, size_t> FilterSamplesByTime(
+    const std::vector<FlamegraphSample>& samples,
+    const std::vector<TimeConstraints>& time_constraints) {
+  auto ts_less = [](const FlamegraphSample& s, int64_t ts) {
+    return s.ts < ts;
+  };
+  auto ts_greater = [](int64_t ts, const FlamegraphSample& s) {
+    return ts < s.ts;
+  };
+  auto begin = samples.begin();
+  auto end = samples.end();
+  for (const auto& tc : time_constraints) {
+    switch (tc.op) {
+      case FilterOp::kGt:
+        begin = std::max(
+            begin,
+            std::upper_bound(samples.begin(), samples.end(), tc.value,
+                             ts_greater));
+        break;
+      case FilterOp::kGe:
+        begin = std::max(begin, std::lower_bound(samples.begin(),
+                                                 samples.end(), tc.value,
+                                                 ts_less));
+        break;
+      case FilterOp::kLt:
+        end = std::min(end, std::lower_bound(samples.begin(), samples.end(),
+                                             tc.value, ts_less));
+        break;
+      case FilterOp::kLe:
+        end = std::min(end, std::upper_bound(samples.begin(), samples.end(),
+                                             tc.value, ts_greater));
+        break;
+      case FilterOp::kEq:
+      case FilterOp::kNe:
+      case FilterOp::kIsNull:
+      case FilterOp::kIsNotNull:
+        PERFETTO_FATAL("Filter operation %d not permitted for perf.",
+                       static_cast<int>(tc.op));
     }
   }
+  if (end < begin)
+    end = begin;
+  return std::make_pair(static_cast<size_t>(begin - samples.begin()),
+                        static_cast<size_t>(end - samples.begin()));
+}
 
-  return tbl;
+}  // namespace
+
+FlamegraphCache::FlamegraphCache() = default;
+FlamegraphCache::~FlamegraphCache() = default;
+
+void FlamegraphCache::MaybeInvalidate(const TraceStorage& storage) {
+  std::vector<uint32_t> row_counts{
+      storage.stack_profile_callsite_table().row_count(),
+      storage.stack_profile_frame_table().row_count(),
+      storage.stack_profile_mapping_table().row_count(),
+      storage.symbol_table().row_count(),
+      storage.heap_profile_allocation_table().row_count(),
+      storage.perf_sample_table().row_count(),
+      storage.thread_table().row_count(),
+  };
+  if (row_counts == table_row_counts_ &&
+      storage.profile_generation() == profile_generation_) {
+    return;
+  }
+  table_row_counts_ = std::move(row_counts);
+  profile_generation_ = storage.profile_generation();
+  merged_callsite_tree_.reset();
+  heap_profile_samples_.reset();
+  perf_samples_.reset();
+}
+
+const MergedCallsiteTree& FlamegraphCache::GetMergedCallsiteTree(
+    const TraceStorage& storage) {
+  MaybeInvalidate(storage);
+  if (!merged_callsite_tree_)
+    merged_callsite_tree_ = BuildMergedCallsiteTree(storage);
+  return *merged_callsite_tree_;
 }
 
-static std::unique_ptr<tables::ExperimentalFlamegraphNodesTable>
-BuildFlamegraphTableCallstackSizeAndCount(
-    std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> tbl,
-    const std::vector<uint32_t>& callsite_to_merged_callsite,
-    const Table& filtered) {
-  for (auto it = filtered.IterateRows(); it; it.Next()) {
-    int64_t callsite_id =
-        it.Get(static_cast<uint32_t>(
-                   tables::PerfSampleTable::ColumnIndex::callsite_id))
-            .long_value;
-    int64_t ts =
-        it.Get(static_cast<uint32_t>(tables::PerfSampleTable::ColumnIndex::ts))
-            .long_value;
-
-    uint32_t merged_idx =
-        callsite_to_merged_callsite[static_cast<unsigned long>(callsite_id)];
-    tbl->mutable_size()->Set(merged_idx, tbl->size()[merged_idx] + 1);
-    tbl->mutable_count()->Set(merged_idx, tbl->count()[merged_idx] + 1);
-    tbl->mutable_ts()->Set(merged_idx, ts);
+const std::vector<FlamegraphSample>& FlamegraphCache::GetHeapProfileSamples(
+    const TraceStorage& storage,
+    UniquePid upid) {
+  const MergedCallsiteTree& tree = GetMergedCallsiteTree(storage);
+  if (!heap_profile_samples_) {
+    heap_profile_samples_.reset(new SamplesByUpid());
+    const auto& allocs = storage.heap_profile_allocation_table();
+    for (uint32_t i = 0; i < allocs.row_count(); ++i) {
+      uint32_t merged_idx =
+          tree.callsite_to_merged_callsite[allocs.callsite_id()[i].value];
+      (*heap_profile_samples_)[allocs.upid()[i]].push_back(FlamegraphSample{
+          allocs.ts()[i], i, merged_idx, allocs.size()[i], allocs.count()[i]});
+    }
+    for (auto& upid_and_samples : *heap_profile_samples_) {
+      std::stable_sort(
+          upid_and_samples.second.begin(), upid_and_samples.second.end(),
+          [](const FlamegraphSample& a, const FlamegraphSample& b) {
+            return a.ts < b.ts;
+          });
+    }
   }
+  auto it = heap_profile_samples_->find(upid);
+  return it == heap_profile_samples_->end() ? empty_samples_ : it->second;
+}
 
-  // BACKWARD PASS:
-  // Propagate sizes to parents.
-  for (int64_t i = tbl->row_count() - 1; i >= 0; --i) {
-    auto idx = static_cast<uint32_t>(i);
-
-    tbl->mutable_cumulative_size()->Set(
-        idx, tbl->cumulative_size()[idx] + tbl->size()[idx]);
-    tbl->mutable_cumulative_count()->Set(
-        idx, tbl->cumulative_count()[idx] + tbl->count()[idx]);
-
-    auto parent = tbl->parent_id()[idx];
-    if (parent) {
-      uint32_t parent_idx = *tbl->id().IndexOf(
-          tables::ExperimentalFlamegraphNodesTable::Id(*parent));
-      tbl->mutable_cumulative_size()->Set(
-          parent_idx,
-          tbl->cumulative_size()[parent_idx] + tbl->cumulative_size()[idx]);
-      tbl->mutable_cumulative_count()->Set(
-          parent_idx,
-          tbl->cumulative_count()[parent_idx] + tbl->cumulative_count()[idx]);
+const std::vector<FlamegraphSample>& FlamegraphCache::GetPerfSamples(
+    const TraceStorage& storage,
+    UniquePid upid) {
+  const MergedCallsiteTree& tree = GetMergedCallsiteTree(storage);
+  if (!perf_samples_) {
+    perf_samples_.reset(new SamplesByUpid());
+    const auto& threads = storage.thread_table();
+    const auto& samples = storage.perf_sample_table();
+    // perf_sample is sorted by timestamp so the samples of each process will
+    // be too.
+    for (uint32_t i = 0; i < samples.row_count(); ++i) {
+      base::Optional<CallsiteId> callsite_id = samples.callsite_id()[i];
+      if (!callsite_id)
+        continue;
+      base::Optional<uint32_t> thread_row =
+          threads.id().IndexOf(tables::ThreadTable::Id(samples.utid()[i]));
+      if (!thread_row)
+        continue;
+      base::Optional<UniquePid> sample_upid = threads.upid()[*thread_row];
+      if (!sample_upid)
+        continue;
+      uint32_t merged_idx = tree.callsite_to_merged_callsite[callsite_id->value];
+      (*perf_samples_)[*sample_upid].push_back(
+          FlamegraphSample{samples.ts()[i], i, merged_idx, 1, 1});
     }
   }
-  return tbl;
+  auto it = perf_samples_->find(upid);
+  return it == perf_samples_->end() ? empty_samples_ : it->second;
 }
 
 std::unique_ptr<tables::ExperimentalFlamegraphNodesTable>
 BuildHeapProfileFlamegraph(TraceStorage* storage,
+                           FlamegraphCache* cache,
                            UniquePid upid,
                            int64_t timestamp) {
-  const tables::HeapProfileAllocationTable& allocation_tbl =
-      storage->heap_profile_allocation_table();
   // PASS OVER ALLOCATIONS:
-  // Aggregate allocations into the newly built tree.
-  auto filtered = allocation_tbl.Filter(
-      {allocation_tbl.ts().le(timestamp), allocation_tbl.upid().eq(upid)});
-  if (filtered.row_count() == 0) {
+  // Aggregate allocations into the tree. The allocations are sorted by
+  // timestamp so the ones before |timestamp| are a prefix.
+  const std::vector<FlamegraphSample>& samples =
+      cache->GetHeapProfileSamples(*storage, upid);
+  auto end = std::upper_bound(
+      samples.begin(), samples.end(), timestamp,
+      [](int64_t ts, const FlamegraphSample& s) { return ts < s.ts; });
+  if (end == samples.begin()) {
     return nullptr;
   }
+  const MergedCallsiteTree& tree = cache->GetMergedCallsiteTree(*storage);
   StringId profile_type = storage->InternString("native");
-  FlamegraphTableAndMergedCallsites table_and_callsites =
-      BuildFlamegraphTableTreeStructure(storage, upid, base::nullopt, timestamp,
-                                        profile_type);
-  return BuildFlamegraphTableHeapSizeAndCount(
-      std::move(table_and_callsites.tbl),
-      table_and_callsites.callsite_to_merged_callsite, filtered);
+
+  size_t node_count = tree.nodes.size();
+  std::vector<int64_t> size(node_count);
+  std::vector<int64_t> count(node_count);
+  std::vector<int64_t> alloc_size(node_count);
+  std::vector<int64_t> alloc_count(node_count);
+  for (auto it = samples.begin(); it != end; ++it) {
+    PERFETTO_CHECK((it->size <= 0 && it->count <= 0) ||
+                   (it->size >= 0 && it->count >= 0));
+    // On old heapprofd producers, the count field is incorrectly set and we
+    // zero it in proto_trace_parser.cc.
+    // As such, we cannot depend on count == 0 to imply size == 0, so we check
+    // for both of them separately.
+    if (it->size > 0)
+      alloc_size[it->merged_idx] += it->size;
+    if (it->count > 0)
+      alloc_count[it->merged_idx] += it->count;
+    size[it->merged_idx] += it->size;
+    count[it->merged_idx] += it->count;
+  }
+
+  // BACKWARD PASS:
+  // Propagate sizes to parents.
+  std::vector<int64_t> cumulative_size(size);
+  std::vector<int64_t> cumulative_count(count);
+  std::vector<int64_t> cumulative_alloc_size(alloc_size);
+  std::vector<int64_t> cumulative_alloc_count(alloc_count);
+  for (size_t i = node_count; i-- > 0;) {
+    const auto& parent = tree.nodes[i].parent_idx;
+    if (!parent)
+      continue;
+    cumulative_size[*parent] += cumulative_size[i];
+    cumulative_count[*parent] += cumulative_count[i];
+    cumulative_alloc_size[*parent] += cumulative_alloc_size[i];
+    cumulative_alloc_count[*parent] += cumulative_alloc_count[i];
+  }
+
+  std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> tbl =
+      BuildFlamegraphTableTreeStructure(storage, tree, upid, base::nullopt,
+                                        timestamp, profile_type);
+  for (uint32_t i = 0; i < node_count; ++i) {
+    tbl->mutable_size()->Set(i, size[i]);
+    tbl->mutable_count()->Set(i, count[i]);
+    tbl->mutable_alloc_size()->Set(i, alloc_size[i]);
+    tbl->mutable_alloc_count()->Set(i, alloc_count[i]);
+    tbl->mutable_cumulative_size()->Set(i, cumulative_size[i]);
+    tbl->mutable_cumulative_count()->Set(i, cumulative_count[i]);
+    tbl->mutable_cumulative_alloc_size()->Set(i, cumulative_alloc_size[i]);
+    tbl->mutable_cumulative_alloc_count()->Set(i, cumulative_alloc_count[i]);
+  }
+  return tbl;
 }
 
 std::unique_ptr<tables::ExperimentalFlamegraphNodesTable>
 BuildNativeCallStackSamplingFlamegraph(
     TraceStorage* storage,
+    FlamegraphCache* cache,
     base::Optional<UniquePid> upid,
     base::Optional<std::string> upid_group,
     const std::vector<TimeConstraints>& time_constraints) {
   // 1.Extract required upids from input.
-  std::unordered_set<UniquePid> upids;
+  std::set<UniquePid> upids;
   if (upid) {
     upids.insert(*upid);
   } else {
@@ -361,48 +435,25 @@ BuildNativeCallStackSamplingFlamegraph(
     }
   }
 
-  // 2.Create set of all utids mapped to the given vector of upids
-  std::set<tables::ThreadTable::Id> utids;
-  RowMap threads_in_pid_rm;
-  for (uint32_t i = 0; i < storage->thread_table().row_count(); ++i) {
-    base::Optional<uint32_t> row_upid = storage->thread_table().upid()[i];
-    if (row_upid && upids.count(*row_upid) > 0) {
-      threads_in_pid_rm.Insert(i);
-    }
-  }
-
-  for (auto it = threads_in_pid_rm.IterateRows(); it; it.Next()) {
-    utids.insert(storage->thread_table().id()[it.index()]);
-  }
-
-  // 3.Get all row indices in perf_sample that have callstacks (some samples
-  // can have only counter values) and correspond to the requested utids.
-  std::vector<uint32_t> cs_rows;
-  for (uint32_t i = 0; i < storage->perf_sample_table().row_count(); ++i) {
-    if (storage->perf_sample_table().callsite_id()[i].has_value() &&
-        utids.find(static_cast<tables::ThreadTable::Id>(
-            storage->perf_sample_table().utid()[i])) != utids.end()) {
-      cs_rows.push_back(i);
-    }
+  // 2.Find the samples of each process which satisfy the time constraints.
+  // The samples of each process are sorted by timestamp so these are a
+  // contiguous range.
+  struct SampleRange {
+    const std::vector<FlamegraphSample>* samples;
+    size_t begin;
+    size_t end;
+  };
+  std::vector<SampleRange> ranges;
+  size_t sample_count = 0;
+  for (UniquePid sample_upid : upids) {
+    const std::vector<FlamegraphSample>& samples =
+        cache->GetPerfSamples(*storage, sample_upid);
+    std::pair<size_t, size_t> range =
+        FilterSamplesByTime(samples, time_constraints);
+    sample_count += range.second - range.first;
+    ranges.push_back(SampleRange{&samples, range.first, range.second});
   }
-
-  // 4.Filter rows that correspond to the selected utids
-  RowMap filtered_rm = RowMap(std::move(cs_rows));
-  Table filtered = storage->perf_sample_table().Apply(std::move(filtered_rm));
-
-  // 5.Filter rows by time constraints
-  for (const auto& tc : time_constraints) {
-    if (!(tc.op == FilterOp::kGt || tc.op == FilterOp::kLt ||
-          tc.op == FilterOp::kGe || tc.op == FilterOp::kLe)) {
-      PERFETTO_FATAL("Filter operation %d not permitted for perf.",
-                     static_cast<int>(tc.op));
-    }
-    Constraint cs = Constraint{
-        static_cast<uint32_t>(tables::PerfSampleTable::ColumnIndex::ts), tc.op,
-        SqlValue::Long(tc.value)};
-    filtered = filtered.Filter({cs});
-  }
-  if (filtered.row_count() == 0) {
+  if (sample_count == 0) {
     std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> empty_tbl(
         new tables::ExperimentalFlamegraphNodesTable(
             storage->mutable_string_pool(), nullptr));
@@ -425,13 +476,46 @@ BuildNativeCallStackSamplingFlamegraph(
       default_timestamp = tc.value;
     }
   }
+  const MergedCallsiteTree& tree = cache->GetMergedCallsiteTree(*storage);
   StringId profile_type = storage->InternString("perf");
-  FlamegraphTableAndMergedCallsites table_and_callsites =
-      BuildFlamegraphTableTreeStructure(storage, upid, upid_group,
+
+  // 3.Count the samples of each node. The timestamp of a node with samples is
+  // the one of its last sample in the perf_sample table.
+  size_t node_count = tree.nodes.size();
+  std::vector<int64_t> count(node_count);
+  std::vector<uint32_t> last_sample_row(node_count, 0);
+  std::vector<int64_t> last_sample_ts(node_count, default_timestamp);
+  for (const SampleRange& range : ranges) {
+    for (size_t i = range.begin; i < range.end; ++i) {
+      const FlamegraphSample& sample = (*range.samples)[i];
+      uint32_t idx = sample.merged_idx;
+      if (count[idx]++ == 0 || sample.row > last_sample_row[idx]) {
+        last_sample_row[idx] = sample.row;
+        last_sample_ts[idx] = sample.ts;
+      }
+    }
+  }
+
+  // BACKWARD PASS:
+  // Propagate sizes to parents.
+  std::vector<int64_t> cumulative_count(count);
+  for (size_t i = node_count; i-- > 0;) {
+    const auto& parent = tree.nodes[i].parent_idx;
+    if (parent)
+      cumulative_count[*parent] += cumulative_count[i];
+  }
+
+  std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> tbl =
+      BuildFlamegraphTableTreeStructure(storage, tree, upid, upid_group,
                                         default_timestamp, profile_type);
-  return BuildFlamegraphTableCallstackSizeAndCount(
-      std::move(table_and_callsites.tbl),
-      table_and_callsites.callsite_to_merged_callsite, filtered);
+  for (uint32_t i = 0; i < node_count; ++i) {
+    tbl->mutable_ts()->Set(i, last_sample_ts[i]);
+    tbl->mutable_size()->Set(i, count[i]);
+    tbl->mutable_count()->Set(i, count[i]);
+    tbl->mutable_cumulative_size()->Set(i, cumulative_count[i]);
+    tbl->mutable_cumulative_count()->Set(i, cumulative_count[i]);
+  }
+  return tbl;
 }
 
 }  // namespace trace_processor
@@ -17,6 +17,10 @@
 #ifndef SRC_TRACE_PROCESSOR_DYNAMIC_FLAMEGRAPH_CONSTRUCTION_ALGORITHMS_H_
 #define SRC_TRACE_PROCESSOR_DYNAMIC_FLAMEGRAPH_CONSTRUCTION_ALGORITHMS_H_
 
+#include <map>
+#include <memory>
+#include <vector>
+
 #include "src/trace_processor/storage/trace_storage.h"
 
 namespace perfetto {
@@ -28,14 +32,86 @@ struct TimeConstraints {
   int64_t value;
 };
 
+// The callsites of all the stack profiles in the trace merged by frame name,
+// mapping name and parent i.e. the nodes of every flamegraph before any
+// samples are aggregated into them.
+struct MergedCallsiteTree {
+  struct Node {
+    StringId name;
+    StringId map_name;
+    base::Optional<StringId> source_file;
+    base::Optional<uint32_t> line_number;
+    base::Optional<uint32_t> parent_idx;
+    uint32_t depth;
+  };
+
+  // Parents always come before their children.
+  std::vector<Node> nodes;
+
+  // The index in |nodes| of each row in the stack_profile_callsite table.
+  std::vector<uint32_t> callsite_to_merged_callsite;
+};
+
+// A heap profile allocation or a perf sample attributed to a node of the
+// MergedCallsiteTree.
+struct FlamegraphSample {
+  int64_t ts;
+  // Row of the sample in its table.
+  uint32_t row;
+  uint32_t merged_idx;
+  int64_t size;
+  int64_t count;
+};
+
+// Caches the parts of the flamegraph computation which do not depend on the
+// query: the MergedCallsiteTree and, for each (upid, profile type), the
+// samples of the process sorted by timestamp. Queries only need to aggregate
+// the samples in the requested time range into a copy of the tree rather than
+// rebuilding the tree and rescanning all samples. This matters for the UI
+// which issues a query every time the selected time range changes.
+//
+// The cache is dropped when any of the tables it is computed from grows or
+// has rows updated in place (see TraceStorage::profile_generation()).
+class FlamegraphCache {
+ public:
+  FlamegraphCache();
+  ~FlamegraphCache();
+
+  const MergedCallsiteTree& GetMergedCallsiteTree(const TraceStorage&);
+
+  // Returns the heap profile allocations of |upid| sorted by timestamp.
+  const std::vector<FlamegraphSample>& GetHeapProfileSamples(
+      const TraceStorage&,
+      UniquePid upid);
+
+  // Returns the perf samples with a callstack of the threads of |upid| sorted
+  // by timestamp.
+  const std::vector<FlamegraphSample>& GetPerfSamples(const TraceStorage&,
+                                                      UniquePid upid);
+
+ private:
+  using SamplesByUpid = std::map<UniquePid, std::vector<FlamegraphSample>>;
+
+  void MaybeInvalidate(const TraceStorage&);
+
+  std::vector<uint32_t> table_row_counts_;
+  uint64_t profile_generation_ = 0;
+  std::unique_ptr<MergedCallsiteTree> merged_callsite_tree_;
+  std::unique_ptr<SamplesByUpid> heap_profile_samples_;
+  std::unique_ptr<SamplesByUpid> perf_samples_;
+  const std::vector<FlamegraphSample> empty_samples_;
+};
+
 std::unique_ptr<tables::ExperimentalFlamegraphNodesTable>
 BuildHeapProfileFlamegraph(TraceStorage* storage,
+                           FlamegraphCache* cache,
                            UniquePid upid,
                            int64_t timestamp);
 
 std::unique_ptr<tables::ExperimentalFlamegraphNodesTable>
 BuildNativeCallStackSamplingFlamegraph(
     TraceStorage* storage,
+    FlamegraphCache* cache,
     base::Optional<UniquePid> upid,
     base::Optional<std::string> upid_group,
     const std::vector<TimeConstraints>& time_constraints);
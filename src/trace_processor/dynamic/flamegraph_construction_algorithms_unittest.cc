@@ -0,0 +1,445 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/dynamic/flamegraph_construction_algorithms.h"
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+constexpr uint32_t kCallsiteCount = 200;
+constexpr uint32_t kAllocationCount = 2000;
+constexpr uint32_t kPerfSampleCount = 2000;
+constexpr int64_t kMaxTs = 1000;
+
+// Aggregated values of a flamegraph node, keyed by the names of the frames
+// from the root to the node (which uniquely identify merged nodes as all the
+// frames share the same mapping).
+struct NodeValues {
+  int64_t size = 0;
+  int64_t count = 0;
+  int64_t alloc_size = 0;
+  int64_t alloc_count = 0;
+  int64_t cumulative_size = 0;
+  int64_t cumulative_count = 0;
+  int64_t cumulative_alloc_size = 0;
+  int64_t cumulative_alloc_count = 0;
+  int64_t ts = 0;
+
+  bool operator==(const NodeValues& o) const {
+    return size == o.size && count == o.count && alloc_size == o.alloc_size &&
+           alloc_count == o.alloc_count &&
+           cumulative_size == o.cumulative_size &&
+           cumulative_count == o.cumulative_count &&
+           cumulative_alloc_size == o.cumulative_alloc_size &&
+           cumulative_alloc_count == o.cumulative_alloc_count && ts == o.ts;
+  }
+};
+using Flamegraph = std::map<std::string, NodeValues>;
+
+std::ostream& operator<<(std::ostream& os, const NodeValues& v) {
+  return os << "{size=" << v.size << " count=" << v.count
+            << " alloc_size=" << v.alloc_size
+            << " alloc_count=" << v.alloc_count
+            << " cumulative_size=" << v.cumulative_size
+            << " cumulative_count=" << v.cumulative_count
+            << " cumulative_alloc_size=" << v.cumulative_alloc_size
+            << " cumulative_alloc_count=" << v.cumulative_alloc_count
+            << " ts=" << v.ts << "}";
+}
+
+class FlamegraphTest : public ::testing::Test {
+ protected:
+  FlamegraphTest() : rnd_(42) {
+    tables::StackProfileMappingTable::Row mapping;
+    mapping.name = storage_.InternString("libfoo.so");
+    auto mapping_id =
+        storage_.mutable_stack_profile_mapping_table()->Insert(mapping).id;
+
+    // Frames 3 and 4 have the same names as frames 0 and 1: callsites using
+    // them are merged into the same nodes.
+    static const char* const kFrameNames[] = {"main", "foo", "bar", "main",
+                                              "foo"};
+    for (const char* name : kFrameNames) {
+      tables::StackProfileFrameTable::Row frame;
+      frame.name = storage_.InternString(name);
+      frame.mapping = mapping_id;
+      frame_ids_.push_back(
+          storage_.mutable_stack_profile_frame_table()->Insert(frame).id);
+    }
+    for (uint32_t i = 0; i < kCallsiteCount; ++i)
+      AddCallsite();
+
+    // Process 1 has two threads, process 2 one and the last thread is not
+    // associated with any process.
+    for (base::Optional<uint32_t> upid :
+         {base::make_optional(1u), base::make_optional(1u),
+          base::make_optional(2u), base::Optional<uint32_t>()}) {
+      tables::ThreadTable::Row thread;
+      thread.upid = upid;
+      storage_.mutable_thread_table()->Insert(thread);
+    }
+
+    for (uint32_t i = 0; i < kAllocationCount; ++i)
+      AddAllocation();
+
+    // perf_sample is sorted by timestamp.
+    std::vector<int64_t> perf_ts;
+    for (uint32_t i = 0; i < kPerfSampleCount; ++i)
+      perf_ts.push_back(Random(kMaxTs));
+    std::sort(perf_ts.begin(), perf_ts.end());
+    for (int64_t ts : perf_ts) {
+      tables::PerfSampleTable::Row sample;
+      sample.ts = ts;
+      sample.utid = static_cast<uint32_t>(Random(4));
+      if (Random(10) != 0)
+        sample.callsite_id = RandomCallsite();
+      storage_.mutable_perf_sample_table()->Insert(sample);
+    }
+  }
+
+  int64_t Random(int64_t n) {
+    return std::uniform_int_distribution<int64_t>(0, n - 1)(rnd_);
+  }
+
+  CallsiteId RandomCallsite() {
+    const auto& callsites = storage_.stack_profile_callsite_table();
+    return callsites.id()[static_cast<uint32_t>(
+        Random(static_cast<int64_t>(callsites.row_count())))];
+  }
+
+  CallsiteId AddCallsite() {
+    auto* callsites = storage_.mutable_stack_profile_callsite_table();
+    tables::StackProfileCallsiteTable::Row callsite;
+    if (callsites->row_count() > 0 && Random(4) != 0)
+      callsite.parent_id = RandomCallsite();
+    callsite.frame_id = frame_ids_[static_cast<size_t>(
+        Random(static_cast<int64_t>(frame_ids_.size())))];
+    return callsites->Insert(callsite).id;
+  }
+
+  void AddAllocation() {
+    tables::HeapProfileAllocationTable::Row alloc;
+    alloc.ts = Random(kMaxTs);
+    alloc.upid = static_cast<uint32_t>(1 + Random(2));
+    alloc.callsite_id = RandomCallsite();
+    alloc.size = 1 + Random(100);
+    alloc.count = 1 + Random(3);
+    if (Random(3) == 0) {
+      alloc.size = -alloc.size;
+      alloc.count = -alloc.count;
+    }
+    storage_.mutable_heap_profile_allocation_table()->Insert(alloc);
+  }
+
+  // Returns the names of the frames from the root to |callsite_row|.
+  std::string CallsitePath(uint32_t callsite_row) const {
+    const auto& callsites = storage_.stack_profile_callsite_table();
+    const auto& frames = storage_.stack_profile_frame_table();
+    uint32_t frame_row =
+        *frames.id().IndexOf(callsites.frame_id()[callsite_row]);
+    std::string name =
+        storage_.GetString(frames.name()[frame_row]).ToStdString();
+    base::Optional<CallsiteId> parent = callsites.parent_id()[callsite_row];
+    if (!parent)
+      return name;
+    return CallsitePath(*callsites.id().IndexOf(*parent)) + "/" + name;
+  }
+
+  // Adds |update| to the node |path| and the cumulative values of |update| to
+  // all its ancestors.
+  static void AddToPath(Flamegraph* graph,
+                        const std::string& path,
+                        const NodeValues& update) {
+    NodeValues& node = (*graph)[path];
+    node.size += update.size;
+    node.count += update.count;
+    node.alloc_size += update.alloc_size;
+    node.alloc_count += update.alloc_count;
+    for (size_t pos = path.size(); pos != std::string::npos;
+         pos = path.rfind('/', pos - 1)) {
+      NodeValues& ancestor = (*graph)[path.substr(0, pos)];
+      ancestor.cumulative_size += update.size;
+      ancestor.cumulative_count += update.count;
+      ancestor.cumulative_alloc_size += update.alloc_size;
+      ancestor.cumulative_alloc_count += update.alloc_count;
+    }
+  }
+
+  // Reference implementation of the heap profile flamegraph: scans all the
+  // allocations for every query, like the flamegraph did before caching.
+  Flamegraph ExpectedHeapProfile(UniquePid upid, int64_t timestamp) const {
+    Flamegraph graph;
+    const auto& allocs = storage_.heap_profile_allocation_table();
+    for (uint32_t i = 0; i < allocs.row_count(); ++i) {
+      if (allocs.upid()[i] != upid || allocs.ts()[i] > timestamp)
+        continue;
+      NodeValues update;
+      update.size = allocs.size()[i];
+      update.count = allocs.count()[i];
+      update.alloc_size = std::max<int64_t>(update.size, 0);
+      update.alloc_count = std::max<int64_t>(update.count, 0);
+      AddToPath(&graph, CallsitePath(allocs.callsite_id()[i].value), update);
+    }
+    for (auto& path_and_node : graph)
+      path_and_node.second.ts = timestamp;
+    return graph;
+  }
+
+  // Reference implementation of the perf flamegraph.
+  Flamegraph ExpectedPerf(const std::set<UniquePid>& upids,
+                          const std::vector<TimeConstraints>& constraints,
+                          int64_t default_ts) const {
+    Flamegraph graph;
+    std::map<std::string, int64_t> last_ts;
+    const auto& samples = storage_.perf_sample_table();
+    const auto& threads = storage_.thread_table();
+    for (uint32_t i = 0; i < samples.row_count(); ++i) {
+      base::Optional<uint32_t> upid = threads.upid()[samples.utid()[i]];
+      if (!samples.callsite_id()[i] || !upid || upids.count(*upid) == 0)
+        continue;
+      int64_t ts = samples.ts()[i];
+      bool matches = true;
+      for (const TimeConstraints& tc : constraints) {
+        matches &= (tc.op == FilterOp::kGt && ts > tc.value) ||
+                   (tc.op == FilterOp::kGe && ts >= tc.value) ||
+                   (tc.op == FilterOp::kLt && ts < tc.value) ||
+                   (tc.op == FilterOp::kLe && ts <= tc.value);
+      }
+      if (!matches)
+        continue;
+      NodeValues update;
+      update.size = 1;
+      update.count = 1;
+      std::string path = CallsitePath(samples.callsite_id()[i]->value);
+      AddToPath(&graph, path, update);
+      last_ts[path] = ts;
+    }
+    for (auto& path_and_node : graph) {
+      auto it = last_ts.find(path_and_node.first);
+      path_and_node.second.ts = it == last_ts.end() ? default_ts : it->second;
+    }
+    return graph;
+  }
+
+  // Converts the nodes of |tbl| which have any samples below them.
+  Flamegraph ToFlamegraph(
+      const tables::ExperimentalFlamegraphNodesTable* tbl) const {
+    Flamegraph graph;
+    if (!tbl)
+      return graph;
+    std::vector<std::string> paths;
+    for (uint32_t i = 0; i < tbl->row_count(); ++i) {
+      std::string name = storage_.GetString(tbl->name()[i]).ToStdString();
+      base::Optional<tables::ExperimentalFlamegraphNodesTable::Id> parent =
+          tbl->parent_id()[i];
+      paths.push_back(parent ? paths[*tbl->id().IndexOf(*parent)] + "/" + name
+                             : name);
+      if (tbl->cumulative_count()[i] == 0 && tbl->cumulative_size()[i] == 0 &&
+          tbl->cumulative_alloc_count()[i] == 0) {
+        continue;
+      }
+      NodeValues& node = graph[paths.back()];
+      node.size = tbl->size()[i];
+      node.count = tbl->count()[i];
+      node.cumulative_size = tbl->cumulative_size()[i];
+      node.cumulative_count = tbl->cumulative_count()[i];
+      node.alloc_size = tbl->alloc_size()[i];
+      node.alloc_count = tbl->alloc_count()[i];
+      node.cumulative_alloc_size = tbl->cumulative_alloc_size()[i];
+      node.cumulative_alloc_count = tbl->cumulative_alloc_count()[i];
+      node.ts = tbl->ts()[i];
+    }
+    return graph;
+  }
+
+  // Drops the nodes of |graph| without any samples below them.
+  static Flamegraph WithoutEmptyNodes(Flamegraph graph) {
+    for (auto it = graph.begin(); it != graph.end();) {
+      const NodeValues& node = it->second;
+      if (node.cumulative_count == 0 && node.cumulative_size == 0 &&
+          node.cumulative_alloc_count == 0) {
+        it = graph.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    return graph;
+  }
+
+  TraceStorage storage_;
+  FlamegraphCache cache_;
+  std::minstd_rand rnd_;
+  std::vector<tables::StackProfileFrameTable::Id> frame_ids_;
+};
+
+TEST_F(FlamegraphTest, ReusesMergedCallsiteTree) {
+  const MergedCallsiteTree* tree = &cache_.GetMergedCallsiteTree(storage_);
+  ASSERT_EQ(tree->callsite_to_merged_callsite.size(), kCallsiteCount);
+  // Merging callsites with the same frame names leaves fewer nodes.
+  ASSERT_LT(tree->nodes.size(), kCallsiteCount);
+
+  for (int64_t ts : std::vector<int64_t>{0, 500, kMaxTs}) {
+    BuildHeapProfileFlamegraph(&storage_, &cache_, 1, ts);
+    BuildNativeCallStackSamplingFlamegraph(&storage_, &cache_, 2u,
+                                           base::nullopt, {});
+    ASSERT_EQ(&cache_.GetMergedCallsiteTree(storage_), tree);
+  }
+  ASSERT_EQ(&cache_.GetHeapProfileSamples(storage_, 1),
+            &cache_.GetHeapProfileSamples(storage_, 1));
+}
+
+TEST_F(FlamegraphTest, InvalidatedWhenTablesGrow) {
+  const MergedCallsiteTree& tree = cache_.GetMergedCallsiteTree(storage_);
+  ASSERT_EQ(tree.callsite_to_merged_callsite.size(), kCallsiteCount);
+  size_t allocs = cache_.GetHeapProfileSamples(storage_, 1).size() +
+                  cache_.GetHeapProfileSamples(storage_, 2).size();
+  ASSERT_EQ(allocs, kAllocationCount);
+
+  AddCallsite();
+  AddAllocation();
+  ASSERT_EQ(cache_.GetMergedCallsiteTree(storage_)
+                .callsite_to_merged_callsite.size(),
+            kCallsiteCount + 1);
+  allocs = cache_.GetHeapProfileSamples(storage_, 1).size() +
+           cache_.GetHeapProfileSamples(storage_, 2).size();
+  ASSERT_EQ(allocs, kAllocationCount + 1);
+}
+
+TEST_F(FlamegraphTest, InvalidatedWhenProfileGenerationChanges) {
+  ASSERT_FALSE(
+      BuildHeapProfileFlamegraph(&storage_, &cache_, 1, kMaxTs) == nullptr);
+
+  // Deobfuscating a frame updates the frame table in place, which is only
+  // noticed through the profile generation.
+  auto* frames = storage_.mutable_stack_profile_frame_table();
+  for (uint32_t i = 0; i < frames->row_count(); ++i)
+    frames->mutable_deobfuscated_name()->Set(i, storage_.InternString("baz"));
+  storage_.IncrementProfileGeneration();
+
+  const MergedCallsiteTree& tree = cache_.GetMergedCallsiteTree(storage_);
+  for (const MergedCallsiteTree::Node& node : tree.nodes)
+    ASSERT_EQ(storage_.GetString(node.name).ToStdString(), "baz");
+}
+
+TEST_F(FlamegraphTest, HeapProfileMatchesReference) {
+  for (UniquePid upid : {1u, 2u}) {
+    for (int64_t ts : std::vector<int64_t>{-1, 0, 1, 250, 500, 999, kMaxTs}) {
+      auto tbl = BuildHeapProfileFlamegraph(&storage_, &cache_, upid, ts);
+      Flamegraph expected = WithoutEmptyNodes(ExpectedHeapProfile(upid, ts));
+      ASSERT_EQ(tbl == nullptr, expected.empty());
+      ASSERT_EQ(ToFlamegraph(tbl.get()), expected)
+          << "upid=" << upid << " ts=" << ts;
+    }
+  }
+  ASSERT_TRUE(BuildHeapProfileFlamegraph(&storage_, &cache_, 3, kMaxTs) ==
+              nullptr);
+}
+
+TEST_F(FlamegraphTest, PerfMatchesReference) {
+  const std::vector<std::vector<TimeConstraints>> kConstraints = {
+      {},
+      {{FilterOp::kGt, 100}},
+      {{FilterOp::kGe, 100}},
+      {{FilterOp::kLt, 900}},
+      {{FilterOp::kLe, 900}},
+      {{FilterOp::kGe, 200}, {FilterOp::kLt, 300}},
+      {{FilterOp::kGt, 200}, {FilterOp::kLe, 300}, {FilterOp::kGe, 250}},
+      {{FilterOp::kGt, 500}, {FilterOp::kLt, 400}},
+      {{FilterOp::kGe, kMaxTs}},
+  };
+  for (const std::vector<TimeConstraints>& constraints : kConstraints) {
+    int64_t default_ts = 0;
+    if (!constraints.empty()) {
+      default_ts = constraints[0].value;
+      if (constraints[0].op == FilterOp::kGt)
+        default_ts++;
+      if (constraints[0].op == FilterOp::kLt)
+        default_ts--;
+    }
+    for (UniquePid upid : {1u, 2u, 3u}) {
+      auto tbl = BuildNativeCallStackSamplingFlamegraph(
+          &storage_, &cache_, upid, base::nullopt, constraints);
+      Flamegraph expected =
+          WithoutEmptyNodes(ExpectedPerf({upid}, constraints, default_ts));
+      ASSERT_EQ(ToFlamegraph(tbl.get()), expected)
+          << "upid=" << upid << " constraints=" << constraints.size();
+    }
+    auto tbl = BuildNativeCallStackSamplingFlamegraph(
+        &storage_, &cache_, base::nullopt, std::string("1,2"), constraints);
+    ASSERT_EQ(ToFlamegraph(tbl.get()),
+              WithoutEmptyNodes(ExpectedPerf({1, 2}, constraints, default_ts)));
+  }
+}
+
+TEST_F(FlamegraphTest, SplitsSamplesByUpid) {
+  const auto& threads = storage_.thread_table();
+  const auto& perf_samples = storage_.perf_sample_table();
+  size_t total_perf_samples = 0;
+  for (UniquePid upid : {1u, 2u}) {
+    const std::vector<FlamegraphSample>& samples =
+        cache_.GetPerfSamples(storage_, upid);
+    ASSERT_FALSE(samples.empty());
+    for (size_t i = 0; i < samples.size(); ++i) {
+      const FlamegraphSample& sample = samples[i];
+      ASSERT_EQ(threads.upid()[perf_samples.utid()[sample.row]], upid);
+      ASSERT_TRUE(perf_samples.callsite_id()[sample.row].has_value());
+      ASSERT_EQ(sample.ts, perf_samples.ts()[sample.row]);
+      if (i > 0)
+        ASSERT_LT(samples[i - 1].row, sample.row);
+    }
+    total_perf_samples += samples.size();
+  }
+  size_t expected_perf_samples = 0;
+  for (uint32_t i = 0; i < perf_samples.row_count(); ++i) {
+    expected_perf_samples += perf_samples.callsite_id()[i].has_value() &&
+                             threads.upid()[perf_samples.utid()[i]];
+  }
+  ASSERT_EQ(total_perf_samples, expected_perf_samples);
+  ASSERT_TRUE(cache_.GetPerfSamples(storage_, 3).empty());
+
+  // Allocations are not inserted in timestamp order: the samples are sorted
+  // with ties kept in row order.
+  const auto& allocs = storage_.heap_profile_allocation_table();
+  for (UniquePid upid : {1u, 2u}) {
+    const std::vector<FlamegraphSample>& samples =
+        cache_.GetHeapProfileSamples(storage_, upid);
+    for (size_t i = 0; i < samples.size(); ++i) {
+      const FlamegraphSample& sample = samples[i];
+      ASSERT_EQ(allocs.upid()[sample.row], upid);
+      ASSERT_EQ(sample.ts, allocs.ts()[sample.row]);
+      ASSERT_EQ(sample.size, allocs.size()[sample.row]);
+      ASSERT_EQ(sample.count, allocs.count()[sample.row]);
+      if (i > 0) {
+        ASSERT_TRUE(samples[i - 1].ts < sample.ts ||
+                    (samples[i - 1].ts == sample.ts &&
+                     samples[i - 1].row < sample.row));
+      }
+    }
+  }
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -501,6 +501,7 @@ void ProcessTracker::ResolvePendingAssociations(UniqueTid utid_arg,
 void ProcessTracker::AssociateThreadToProcess(UniqueTid utid, UniquePid upid) {
   auto* thread_table = context_->storage->mutable_thread_table();
   thread_table->mutable_upid()->Set(utid, upid);
+  context_->storage->IncrementProfileGeneration();
   auto* process_table = context_->storage->mutable_process_table();
   bool main_thread = thread_table->tid()[utid] == process_table->pid()[upid];
   thread_table->mutable_is_main_thread()->Set(utid, main_thread);
@@ -16,10 +16,14 @@
 
 #include "src/trace_processor/importers/proto/heap_graph_tracker.h"
 
+#include <algorithm>
+#include <limits>
+
 #include "perfetto/base/flat_set.h"
 #include "perfetto/ext/base/optional.h"
 #include "perfetto/ext/base/string_splitter.h"
 #include "perfetto/ext/base/string_utils.h"
+#include "src/trace_processor/containers/encoded_int_vector.h"
 #include "src/trace_processor/importers/proto/profiler_util.h"
 #include "src/trace_processor/tables/profiler_tables.h"
 
@@ -46,12 +50,14 @@ void ForReferenceSet(TraceStorage* storage,
   if (!reference_set_id)
     return;
 
+  // All the references of an object are stored in contiguous rows, starting
+  // at the row |reference_set_id|.
   auto* ref = storage->mutable_heap_graph_reference_table();
-  auto it =
-      ref->FilterToIterator({ref->reference_set_id().eq(*reference_set_id)});
-
-  for (; it; ++it) {
-    if (!fn(it.row_reference()))
+  for (uint32_t row = *reference_set_id;
+       row < ref->row_count() &&
+       ref->reference_set_id()[row] == *reference_set_id;
+       ++row) {
+    if (!fn(ReferenceTable::RowNumber(row).ToRowReference(ref)))
       break;
   }
 }
@@ -101,41 +107,249 @@ struct ClassDescriptor {
   }
 };
 
-ClassDescriptor GetClassDescriptor(const TraceStorage& storage,
-                                   ObjectTable::Id obj_id) {
-  auto obj_row_ref = *storage.heap_graph_object_table().FindById(obj_id);
-  auto type_row_ref =
-      *storage.heap_graph_class_table().FindById(obj_row_ref.type_id());
-  return {type_row_ref.name(), type_row_ref.location()};
+// Extract the size from `nar_size`, which is the value of a
+// libcore.util.NativeAllocationRegistry.size field: it encodes the size, but
+// uses the least significant bit to represent the source of the allocation.
+int64_t GetSizeFromNativeAllocationRegistry(int64_t nar_size) {
+  constexpr uint64_t kIsMalloced = 1;
+  return static_cast<int64_t>(static_cast<uint64_t>(nar_size) & ~kIsMalloced);
 }
 
-base::Optional<ObjectTable::Id> GetReferredObj(const TraceStorage& storage,
-                                               uint32_t ref_set_id,
-                                               const std::string& field_name) {
-  const auto& refs_tbl = storage.heap_graph_reference_table();
+}  // namespace
 
-  auto refs_it = refs_tbl.FilterToIterator(
-      {refs_tbl.reference_set_id().eq(ref_set_id),
-       refs_tbl.field_name().eq(NullTermStringView(field_name))});
-  if (!refs_it) {
-    return {};
+// Compressed sparse row (CSR) view of the objects and references of a single
+// heap graph. It is built once the whole graph has been ingested, and lets the
+// passes in FinalizeProfile walk the graph without going through a table
+// lookup for every reference.
+//
+// Objects are addressed by their index in the sorted list of the rows they
+// occupy in the heap_graph_object table. The references of the object at index
+// i are edge(offset(i)) to edge(offset(i + 1) - 1), in the same order as the
+// rows of its reference set in the heap_graph_reference table.
+//
+// The index is kept compact, as it is built for graphs of millions of objects
+// on top of the heap_graph_* tables:
+//  * The objects of a sequence are usually inserted in consecutive rows, in
+//    which case only the first row is kept rather than the list of rows.
+//  * The offsets are sorted, and stored as an EncodedIntVector (deltas from
+//    the first offset of each block).
+//  * The edges are bit-packed, with as many bits per edge as the number of
+//    objects needs, and are written packed rather than converted from a
+//    vector of uint32_t.
+class HeapGraphAdjacency {
+ public:
+  static constexpr uint32_t kNoObject = std::numeric_limits<uint32_t>::max();
+
+  HeapGraphAdjacency(const TraceStorage& storage,
+                     std::vector<uint32_t> object_rows)
+      : storage_(storage),
+        size_(static_cast<uint32_t>(object_rows.size())),
+        object_rows_(std::move(object_rows)) {
+    std::sort(object_rows_.begin(), object_rows_.end());
+    if (size_ > 0 && object_rows_.back() - object_rows_.front() == size_ - 1) {
+      first_row_ = object_rows_.front();
+      object_rows_ = std::vector<uint32_t>();
+    }
+
+    const auto& objects_tbl = storage_.heap_graph_object_table();
+    const auto& refs_tbl = storage_.heap_graph_reference_table();
+    const auto& class_tbl = storage_.heap_graph_class_table();
+
+    base::Optional<StringId> weak_kinds[] = {
+        storage_.string_pool().GetId("KIND_WEAK_REFERENCE"),
+        storage_.string_pool().GetId("KIND_SOFT_REFERENCE"),
+        storage_.string_pool().GetId("KIND_FINALIZER_REFERENCE"),
+        storage_.string_pool().GetId("KIND_PHANTOM_REFERENCE"),
+    };
+    std::vector<bool> weak_class(class_tbl.row_count());
+    for (uint32_t i = 0; i < class_tbl.row_count(); ++i) {
+      StringId kind = class_tbl.kind()[i];
+      for (const base::Optional<StringId>& weak_kind : weak_kinds) {
+        if (weak_kind && kind == *weak_kind)
+          weak_class[i] = true;
+      }
+    }
+
+    // Compute the offsets first, so that the edges are allocated only once,
+    // with their exact size.
+    std::vector<uint32_t> offsets;
+    offsets.reserve(size_ + 1);
+    is_weak_.reserve(size_);
+    offsets.push_back(0);
+    uint32_t edge_count = 0;
+    for (uint32_t idx = 0; idx < size_; ++idx) {
+      uint32_t obj_row = row(idx);
+      base::Optional<uint32_t> class_row =
+          class_tbl.id().IndexOf(objects_tbl.type_id()[obj_row]);
+      is_weak_.push_back(class_row && weak_class[*class_row]);
+
+      base::Optional<uint32_t> ref_set_id =
+          objects_tbl.reference_set_id()[obj_row];
+      if (ref_set_id) {
+        for (uint32_t ref_row = *ref_set_id;
+             ref_row < refs_tbl.row_count() &&
+             refs_tbl.reference_set_id()[ref_row] == *ref_set_id;
+             ++ref_row) {
+          edge_count++;
+        }
+      }
+      offsets.push_back(edge_count);
+    }
+    encoded_offsets_ = EncodedIntVector::Encode(offsets);
+    if (!encoded_offsets_)
+      offsets_ = std::move(offsets);
+    offsets = std::vector<uint32_t>();
+
+    // |size_| stands for a reference to an object outside of the graph. One
+    // more word is allocated, so that reading the last edge does not need a
+    // bounds check.
+    for (uint32_t max = size_; max != 0; max >>= 1)
+      edge_width_++;
+    edge_words_.resize(
+        static_cast<size_t>((uint64_t(edge_count) * edge_width_ + 63) / 64) +
+        1);
+    for (uint32_t idx = 0; idx < size_; ++idx) {
+      uint32_t begin = offset(idx);
+      uint32_t end = offset(idx + 1);
+      uint32_t ref_row =
+          begin == end ? 0 : *objects_tbl.reference_set_id()[row(idx)];
+      for (uint32_t e = begin; e < end; ++e, ++ref_row) {
+        base::Optional<ObjectTable::Id> owned = refs_tbl.owned_id()[ref_row];
+        base::Optional<uint32_t> owned_row;
+        if (owned)
+          owned_row = objects_tbl.id().IndexOf(*owned);
+        uint32_t owned_idx = owned_row ? IndexOf(*owned_row) : kNoObject;
+        SetEdge(e, owned_idx == kNoObject ? size_ : owned_idx);
+      }
+    }
+  }
+
+  uint32_t size() const { return size_; }
+
+  // Returns the heap_graph_object row of the object at |idx|.
+  uint32_t row(uint32_t idx) const {
+    return object_rows_.empty() ? first_row_ + idx : object_rows_[idx];
+  }
+
+  // Returns the index of the object at |row|, or kNoObject if the row does not
+  // belong to this graph.
+  uint32_t IndexOf(uint32_t row) const {
+    if (object_rows_.empty()) {
+      return row >= first_row_ && row - first_row_ < size_ ? row - first_row_
+                                                           : kNoObject;
+    }
+    auto it = std::lower_bound(object_rows_.begin(), object_rows_.end(), row);
+    if (it == object_rows_.end() || *it != row)
+      return kNoObject;
+    return static_cast<uint32_t>(it - object_rows_.begin());
+  }
+
+  // Calls fn(child_idx) for every object kept alive by the object at |idx|.
+  // Weak / soft / finalizer / phantom references are not followed.
+  template <typename F>
+  void ForEachChild(uint32_t idx, F fn) const {
+    if (is_weak_[idx])
+      return;
+    uint32_t end = offset(idx + 1);
+    for (uint32_t e = offset(idx); e < end; ++e) {
+      uint32_t child = edge(e);
+      if (child != kNoObject)
+        fn(child);
+    }
   }
-  return refs_it.owned_id();
+
+  // Returns the index of the object pointed to by `field` in the object at
+  // |idx|, or kNoObject.
+  uint32_t GetReferenceByFieldName(uint32_t idx, StringId field) const {
+    uint32_t begin = offset(idx);
+    uint32_t end = offset(idx + 1);
+    if (begin == end)
+      return kNoObject;
+    uint32_t ref_set_id =
+        *storage_.heap_graph_object_table().reference_set_id()[row(idx)];
+    const auto& field_name = storage_.heap_graph_reference_table().field_name();
+    for (uint32_t e = begin; e < end; ++e) {
+      if (field_name[ref_set_id + (e - begin)] == field)
+        return edge(e);
+    }
+    return kNoObject;
+  }
+
+  // Returns the number of bytes used by the index.
+  size_t SizeBytes() const {
+    return object_rows_.capacity() * sizeof(uint32_t) +
+           (encoded_offsets_ ? encoded_offsets_->SizeBytes()
+                             : offsets_.capacity() * sizeof(uint32_t)) +
+           edge_words_.capacity() * sizeof(uint64_t) + is_weak_.capacity() / 8;
+  }
+
+ private:
+  uint32_t offset(uint32_t idx) const {
+    return encoded_offsets_
+               ? static_cast<uint32_t>(encoded_offsets_->Get(idx))
+               : offsets_[idx];
+  }
+
+  uint32_t edge(uint32_t e) const {
+    uint64_t bit = uint64_t(e) * edge_width_;
+    size_t word = static_cast<size_t>(bit / 64);
+    uint32_t shift = static_cast<uint32_t>(bit % 64);
+    uint64_t value = edge_words_[word] >> shift;
+    if (shift + edge_width_ > 64)
+      value |= edge_words_[word + 1] << (64 - shift);
+    value &= (uint64_t(1) << edge_width_) - 1;
+    return value == size_ ? kNoObject : static_cast<uint32_t>(value);
+  }
+
+  void SetEdge(uint32_t e, uint32_t value) {
+    uint64_t bit = uint64_t(e) * edge_width_;
+    size_t word = static_cast<size_t>(bit / 64);
+    uint32_t shift = static_cast<uint32_t>(bit % 64);
+    edge_words_[word] |= uint64_t(value) << shift;
+    if (shift + edge_width_ > 64)
+      edge_words_[word + 1] |= uint64_t(value) >> (64 - shift);
+  }
+
+  const TraceStorage& storage_;
+  uint32_t size_ = 0;
+  // The first row of the objects if they occupy consecutive rows, in which
+  // case |object_rows_| is empty.
+  uint32_t first_row_ = 0;
+  std::vector<uint32_t> object_rows_;
+  // The offsets are only kept as a plain vector if encoding them would not
+  // save memory.
+  std::unique_ptr<EncodedIntVector> encoded_offsets_;
+  std::vector<uint32_t> offsets_;
+  uint32_t edge_width_ = 0;
+  std::vector<uint64_t> edge_words_;
+  std::vector<bool> is_weak_;
+};
+
+namespace {
+
+ClassDescriptor GetClassDescriptor(const TraceStorage& storage,
+                                   uint32_t obj_row) {
+  const auto& objects_tbl = storage.heap_graph_object_table();
+  auto type_row_ref = *storage.heap_graph_class_table().FindById(
+      objects_tbl.type_id()[obj_row]);
+  return {type_row_ref.name(), type_row_ref.location()};
 }
 
 // Maps from normalized class name and location, to superclass.
-std::map<ClassDescriptor, ClassDescriptor>
-BuildSuperclassMap(UniquePid upid, int64_t ts, TraceStorage* storage) {
+std::map<ClassDescriptor, ClassDescriptor> BuildSuperclassMap(
+    TraceStorage* storage,
+    const HeapGraphAdjacency& graph) {
   std::map<ClassDescriptor, ClassDescriptor> superclass_map;
 
+  base::Optional<StringId> super_class_field =
+      storage->string_pool().GetId("java.lang.Class.superClass");
+  if (!super_class_field)
+    return superclass_map;
+
   // Resolve superclasses by iterating heap graph objects and identifying the
   // superClass field.
-  const auto& objects_tbl = storage->heap_graph_object_table();
-  auto obj_it = objects_tbl.FilterToIterator(
-      {objects_tbl.upid().eq(upid), objects_tbl.graph_sample_ts().eq(ts)});
-  for (; obj_it; ++obj_it) {
-    auto obj_id = obj_it.id();
-    auto class_descriptor = GetClassDescriptor(*storage, obj_id);
+  for (uint32_t idx = 0; idx < graph.size(); ++idx) {
+    auto class_descriptor = GetClassDescriptor(*storage, graph.row(idx));
     auto normalized =
         GetNormalizedType(storage->GetString(class_descriptor.name));
     // superClass ptrs are stored on the static class objects
@@ -143,18 +357,15 @@ BuildSuperclassMap(UniquePid upid, int64_t ts, TraceStorage* storage) {
     if (!normalized.is_static_class || normalized.number_of_arrays > 0)
       continue;
 
-    auto opt_ref_set_id = obj_it.reference_set_id();
-    if (!opt_ref_set_id)
-      continue;
-    auto super_obj_id =
-        GetReferredObj(*storage, *opt_ref_set_id, "java.lang.Class.superClass");
-    if (!super_obj_id) {
+    uint32_t super_idx = graph.GetReferenceByFieldName(idx, *super_class_field);
+    if (super_idx == HeapGraphAdjacency::kNoObject) {
       // This is expected to be missing for Object and primitive types
       continue;
     }
 
     // Lookup the super obj type id
-    auto super_class_descriptor = GetClassDescriptor(*storage, *super_obj_id);
+    auto super_class_descriptor =
+        GetClassDescriptor(*storage, graph.row(super_idx));
     auto super_class_name =
         NormalizeTypeName(storage->GetString(super_class_descriptor.name));
     StringId super_class_id = storage->InternString(super_class_name);
@@ -165,39 +376,34 @@ BuildSuperclassMap(UniquePid upid, int64_t ts, TraceStorage* storage) {
   return superclass_map;
 }
 
-// Extract the size from `nar_size`, which is the value of a
-// libcore.util.NativeAllocationRegistry.size field: it encodes the size, but
-// uses the least significant bit to represent the source of the allocation.
-int64_t GetSizeFromNativeAllocationRegistry(int64_t nar_size) {
-  constexpr uint64_t kIsMalloced = 1;
-  return static_cast<int64_t>(static_cast<uint64_t>(nar_size) & ~kIsMalloced);
-}
-
-}  // namespace
-
 void MarkRoot(TraceStorage* storage,
-              ObjectTable::RowReference row_ref,
+              const HeapGraphAdjacency& graph,
+              uint32_t root_idx,
               StringId type) {
-  row_ref.set_root_type(type);
+  auto* objects_tbl = storage->mutable_heap_graph_object_table();
+  ObjectTable::RowNumber(graph.row(root_idx))
+      .ToRowReference(objects_tbl)
+      .set_root_type(type);
 
   // DFS to mark reachability for all children
-  std::vector<ObjectTable::RowReference> stack({row_ref});
+  std::vector<uint32_t> stack({root_idx});
   while (!stack.empty()) {
-    ObjectTable::RowReference cur_node = stack.back();
+    uint32_t cur_idx = stack.back();
     stack.pop_back();
 
+    auto cur_node =
+        ObjectTable::RowNumber(graph.row(cur_idx)).ToRowReference(objects_tbl);
     if (cur_node.reachable())
       continue;
     cur_node.set_reachable(true);
 
-    for (ObjectTable::Id child_node : GetChildren(storage, cur_node)) {
-      auto child_ref =
-          *storage->mutable_heap_graph_object_table()->FindById(child_node);
-      stack.push_back(child_ref);
-    }
+    graph.ForEachChild(cur_idx,
+                       [&stack](uint32_t child) { stack.push_back(child); });
   }
 }
 
+}  // namespace
+
 void UpdateShortestPaths(TraceStorage* storage,
                          ObjectTable::RowReference row_ref) {
   // Calculate shortest distance to a GC root.
@@ -654,6 +860,12 @@ void HeapGraphTracker::FinalizeProfile(uint32_t seq_id) {
         static_cast<int>(sequence_state.current_upid));
   }
 
+  std::vector<uint32_t> object_rows;
+  object_rows.reserve(sequence_state.object_id_to_db_row.size());
+  for (auto it = sequence_state.object_id_to_db_row.GetIterator(); it; ++it)
+    object_rows.push_back(it.value().row_number());
+
+  std::vector<std::pair<ObjectTable::RowNumber, StringId>> new_roots;
   for (const SourceRoot& root : sequence_state.current_roots) {
     for (uint64_t obj_id : root.object_ids) {
       auto ptr = sequence_state.object_id_to_db_row.Find(obj_id);
@@ -662,38 +874,37 @@ void HeapGraphTracker::FinalizeProfile(uint32_t seq_id) {
       if (!ptr)
         continue;
 
-      ObjectTable::RowReference row_ref =
-          ptr->ToRowReference(storage_->mutable_heap_graph_object_table());
       auto it_and_success = roots_[std::make_pair(sequence_state.current_upid,
                                                   sequence_state.current_ts)]
                                 .emplace(*ptr);
       if (it_and_success.second)
-        MarkRoot(storage_, row_ref, root.root_type);
+        new_roots.emplace_back(*ptr, root.root_type);
     }
   }
 
-  PopulateSuperClasses(sequence_state);
-  PopulateNativeSize(sequence_state);
+  // The interned data and the per-object maps of the sequence are not needed
+  // anymore: drop them before building the adjacency index, so that they are
+  // not alive at the same time.
+  std::map<ObjectTable::Id, int64_t> nar_size_by_obj_id =
+      std::move(sequence_state.nar_size_by_obj_id);
   sequence_state_.erase(seq_id);
-}
 
-base::Optional<ObjectTable::Id> HeapGraphTracker::GetReferenceByFieldName(
-    ObjectTable::Id obj,
-    StringId field) {
-  base::Optional<ObjectTable::Id> referred;
-  auto obj_row_ref = *storage_->heap_graph_object_table().FindById(obj);
-  ForReferenceSet(storage_, obj_row_ref,
-                  [&](ReferenceTable::RowReference ref) -> bool {
-                    if (ref.field_name() == field) {
-                      referred = ref.owned_id();
-                      return false;
-                    }
-                    return true;
-                  });
-  return referred;
+  HeapGraphAdjacency graph(*storage_, std::move(object_rows));
+  PERFETTO_DLOG("Heap graph index of %" PRIu32 " objects: %zu bytes",
+                graph.size(), graph.SizeBytes());
+  for (const auto& row_and_root_type : new_roots) {
+    MarkRoot(storage_, graph,
+             graph.IndexOf(row_and_root_type.first.row_number()),
+             row_and_root_type.second);
+  }
+
+  PopulateSuperClasses(graph);
+  PopulateNativeSize(nar_size_by_obj_id, graph);
 }
 
-void HeapGraphTracker::PopulateNativeSize(const SequenceState& seq) {
+void HeapGraphTracker::PopulateNativeSize(
+    const std::map<ObjectTable::Id, int64_t>& nar_size_by_obj_id,
+    const HeapGraphAdjacency& graph) {
   //             +-------------------------------+  .referent   +--------+
   //             |       sun.misc.Cleaner        | -----------> | Object |
   //             +-------------------------------+              +--------+
@@ -716,67 +927,71 @@ void HeapGraphTracker::PopulateNativeSize(const SequenceState& seq) {
   const auto& class_tbl = storage_->heap_graph_class_table();
   auto& objects_tbl = *storage_->mutable_heap_graph_object_table();
 
+  std::vector<ClassTable::Id> cleaner_classes;
+  auto class_it =
+      class_tbl.FilterToIterator({class_tbl.name().eq("sun.misc.Cleaner")});
+  for (; class_it; ++class_it) {
+    cleaner_classes.push_back(class_it.id());
+  }
+  if (cleaner_classes.empty())
+    return;
+
   struct Cleaner {
-    ObjectTable::Id referent;
-    ObjectTable::Id thunk;
+    uint32_t referent;
+    uint32_t thunk;
   };
   std::vector<Cleaner> cleaners;
 
-  auto class_it =
-      class_tbl.FilterToIterator({class_tbl.name().eq("sun.misc.Cleaner")});
-  for (; class_it; ++class_it) {
-    auto class_id = class_it.id();
-    auto obj_it = objects_tbl.FilterToIterator(
-        {objects_tbl.type_id().eq(class_id.value),
-         objects_tbl.upid().eq(seq.current_upid),
-         objects_tbl.graph_sample_ts().eq(seq.current_ts)});
-    for (; obj_it; ++obj_it) {
-      ObjectTable::Id cleaner_obj_id = obj_it.id();
-      base::Optional<ObjectTable::Id> referent_id =
-          GetReferenceByFieldName(cleaner_obj_id, referent_str_id_);
-      base::Optional<ObjectTable::Id> thunk_id =
-          GetReferenceByFieldName(cleaner_obj_id, cleaner_thunk_str_id_);
-
-      if (!referent_id || !thunk_id) {
-        continue;
-      }
+  constexpr uint32_t kNoObject = HeapGraphAdjacency::kNoObject;
+  for (uint32_t idx = 0; idx < graph.size(); ++idx) {
+    ClassTable::Id type_id = objects_tbl.type_id()[graph.row(idx)];
+    if (std::find(cleaner_classes.begin(), cleaner_classes.end(), type_id) ==
+        cleaner_classes.end()) {
+      continue;
+    }
+    uint32_t referent = graph.GetReferenceByFieldName(idx, referent_str_id_);
+    uint32_t thunk = graph.GetReferenceByFieldName(idx, cleaner_thunk_str_id_);
 
-      base::Optional<ObjectTable::Id> next_id =
-          GetReferenceByFieldName(cleaner_obj_id, cleaner_next_str_id_);
-      if (next_id.has_value() && *next_id == cleaner_obj_id) {
-        // sun.misc.Cleaner.next points to the sun.misc.Cleaner: this means
-        // that the sun.misc.Cleaner.clean() has already been called. Skip this.
-        continue;
-      }
-      cleaners.push_back(Cleaner{*referent_id, *thunk_id});
+    if (referent == kNoObject || thunk == kNoObject) {
+      continue;
+    }
+
+    uint32_t next = graph.GetReferenceByFieldName(idx, cleaner_next_str_id_);
+    if (next == idx) {
+      // sun.misc.Cleaner.next points to the sun.misc.Cleaner: this means
+      // that the sun.misc.Cleaner.clean() has already been called. Skip this.
+      continue;
     }
+    cleaners.push_back(Cleaner{referent, thunk});
   }
 
   for (const auto& cleaner : cleaners) {
-    base::Optional<ObjectTable::Id> this0 =
-        GetReferenceByFieldName(cleaner.thunk, cleaner_thunk_this0_str_id_);
-    if (!this0) {
+    uint32_t this0 = graph.GetReferenceByFieldName(
+        cleaner.thunk, cleaner_thunk_this0_str_id_);
+    if (this0 == kNoObject) {
       continue;
     }
 
-    auto nar_size_it = seq.nar_size_by_obj_id.find(*this0);
-    if (nar_size_it == seq.nar_size_by_obj_id.end()) {
+    auto nar_size_it =
+        nar_size_by_obj_id.find(objects_tbl.id()[graph.row(this0)]);
+    if (nar_size_it == nar_size_by_obj_id.end()) {
       continue;
     }
 
     int64_t native_size =
         GetSizeFromNativeAllocationRegistry(nar_size_it->second);
-    auto referent_row_ref = *objects_tbl.FindById(cleaner.referent);
+    auto referent_row_ref = ObjectTable::RowNumber(graph.row(cleaner.referent))
+                                .ToRowReference(&objects_tbl);
     int64_t total_native_size = referent_row_ref.native_size() + native_size;
     referent_row_ref.set_native_size(total_native_size);
   }
 }
 
 // TODO(fmayer): For Android S+ traces, use the superclass_id from the trace.
-void HeapGraphTracker::PopulateSuperClasses(const SequenceState& seq) {
+void HeapGraphTracker::PopulateSuperClasses(const HeapGraphAdjacency& graph) {
   // Maps from normalized class name and location, to superclass.
   std::map<ClassDescriptor, ClassDescriptor> superclass_map =
-      BuildSuperclassMap(seq.current_upid, seq.current_ts, storage_);
+      BuildSuperclassMap(storage_, graph);
 
   auto* classes_tbl = storage_->mutable_heap_graph_class_table();
   std::map<ClassDescriptor, ClassTable::Id> class_to_id;
@@ -32,6 +32,7 @@
 namespace perfetto {
 namespace trace_processor {
 
+class HeapGraphAdjacency;
 class TraceProcessorContext;
 
 struct NormalizedType {
@@ -55,9 +56,6 @@ struct PathFromRoot {
   std::set<tables::HeapGraphObjectTable::Id> visited;
 };
 
-void MarkRoot(TraceStorage*,
-              tables::HeapGraphObjectTable::RowReference,
-              StringId type);
 void UpdateShortestPaths(TraceStorage* s,
                          tables::HeapGraphObjectTable::RowReference row_ref);
 void FindPathFromRoot(TraceStorage* storage,
@@ -214,22 +212,20 @@ class HeapGraphTracker : public Destructible {
       SequenceState* sequence_state,
       uint64_t type_id);
   bool SetPidAndTimestamp(SequenceState* seq, UniquePid upid, int64_t ts);
-  void PopulateSuperClasses(const SequenceState& seq);
+  void PopulateSuperClasses(const HeapGraphAdjacency& graph);
   InternedType* GetSuperClass(SequenceState* sequence_state,
                               const InternedType* current_type);
   bool IsTruncated(UniquePid upid, int64_t ts);
 
-  // Returns the object pointed to by `field` in `obj`.
-  base::Optional<tables::HeapGraphObjectTable::Id> GetReferenceByFieldName(
-      tables::HeapGraphObjectTable::Id obj,
-      StringId field);
-
-  // Populates HeapGraphObject::native_size by walking the graph for
-  // `seq`.
+  // Populates HeapGraphObject::native_size by walking `graph`, using the
+  // `size` of the NativeAllocationRegistry objects of its sequence.
   //
   // This should be called only once (it is not idempotent) per seq, after the
   // all the other tables have been fully populated.
-  void PopulateNativeSize(const SequenceState& seq);
+  void PopulateNativeSize(
+      const std::map<tables::HeapGraphObjectTable::Id, int64_t>&
+          nar_size_by_obj_id,
+      const HeapGraphAdjacency& graph);
 
   TraceStorage* const storage_;
   std::map<uint32_t, SequenceState> sequence_state_;
@@ -192,6 +192,112 @@ TEST(HeapGraphTrackerTest, PopulateNativeSize) {
   EXPECT_EQ(count_bitmaps, 1u);
 }
 
+TEST(HeapGraphTrackerTest, PopulateSuperClasses) {
+  constexpr uint64_t kSeqId = 1;
+  constexpr UniquePid kPid = 1;
+  constexpr int64_t kTimestamp = 1;
+
+  TraceProcessorContext context;
+  context.storage.reset(new TraceStorage());
+  context.process_tracker.reset(new ProcessTracker(&context));
+  context.process_tracker->GetOrCreateProcess(kPid);
+
+  HeapGraphTracker tracker(context.storage.get());
+
+  StringPool::Id normal_kind = context.storage->InternString("KIND_NORMAL");
+
+  constexpr uint64_t kLocation = 0;
+  tracker.AddInternedLocationName(kSeqId, kLocation,
+                                  context.storage->InternString("location"));
+
+  constexpr uint64_t kSuperClassField = 1;
+  tracker.AddInternedFieldName(kSeqId, kSuperClassField,
+                               "java.lang.Class.superClass");
+
+  enum Types : uint64_t {
+    kTypeObject = 1,
+    kTypeFoo,
+    kTypeObjectClass,
+    kTypeFooClass,
+  };
+
+  tracker.AddInternedType(
+      kSeqId, kTypeObject, context.storage->InternString("java.lang.Object"),
+      kLocation, /*object_size=*/8,
+      /*reference_field_name_ids=*/{}, /*superclass_id=*/0,
+      /*classloader_id=*/0, /*no_reference_fields=*/false,
+      /*kind=*/normal_kind);
+
+  tracker.AddInternedType(
+      kSeqId, kTypeFoo, context.storage->InternString("Foo"), kLocation,
+      /*object_size=*/8,
+      /*reference_field_name_ids=*/{}, /*superclass_id=*/0,
+      /*classloader_id=*/0, /*no_reference_fields=*/false,
+      /*kind=*/normal_kind);
+
+  tracker.AddInternedType(
+      kSeqId, kTypeObjectClass,
+      context.storage->InternString("java.lang.Class<java.lang.Object>"),
+      kLocation, /*object_size=*/8,
+      /*reference_field_name_ids=*/{kSuperClassField}, /*superclass_id=*/0,
+      /*classloader_id=*/0, /*no_reference_fields=*/false,
+      /*kind=*/normal_kind);
+
+  tracker.AddInternedType(
+      kSeqId, kTypeFooClass,
+      context.storage->InternString("java.lang.Class<Foo>"), kLocation,
+      /*object_size=*/8,
+      /*reference_field_name_ids=*/{kSuperClassField}, /*superclass_id=*/0,
+      /*classloader_id=*/0, /*no_reference_fields=*/false,
+      /*kind=*/normal_kind);
+
+  enum Objects : uint64_t {
+    kObjFoo = 1,
+    kObjObjectClass,
+    kObjFooClass,
+  };
+
+  {
+    HeapGraphTracker::SourceObject obj;
+    obj.object_id = kObjFoo;
+    obj.type_id = kTypeFoo;
+    tracker.AddObject(kSeqId, kPid, kTimestamp, std::move(obj));
+  }
+
+  {
+    HeapGraphTracker::SourceObject obj;
+    obj.object_id = kObjObjectClass;
+    obj.type_id = kTypeObjectClass;
+    obj.referred_objects = {0};
+    tracker.AddObject(kSeqId, kPid, kTimestamp, std::move(obj));
+  }
+
+  {
+    HeapGraphTracker::SourceObject obj;
+    obj.object_id = kObjFooClass;
+    obj.type_id = kTypeFooClass;
+    obj.referred_objects = {kObjObjectClass};
+    tracker.AddObject(kSeqId, kPid, kTimestamp, std::move(obj));
+  }
+
+  tracker.FinalizeProfile(kSeqId);
+
+  const auto& class_table = context.storage->heap_graph_class_table();
+  base::Optional<tables::HeapGraphClassTable::Id> object_class_id;
+  base::Optional<tables::HeapGraphClassTable::Id> foo_superclass_id;
+  for (uint32_t row = 0; row < class_table.row_count(); ++row) {
+    NullTermStringView name =
+        context.storage->string_pool().Get(class_table.name()[row]);
+    if (name == "java.lang.Object")
+      object_class_id = class_table.id()[row];
+    if (name == "Foo")
+      foo_superclass_id = class_table.superclass_id()[row];
+  }
+  ASSERT_TRUE(object_class_id.has_value());
+  ASSERT_TRUE(foo_superclass_id.has_value());
+  EXPECT_EQ(*foo_superclass_id, *object_class_id);
+}
+
 TEST(HeapGraphTrackerTest, BuildFlamegraph) {
   //           4@A 5@B
   //             \ /
@@ -335,6 +441,121 @@ TEST(HeapGraphTrackerTest, BuildFlamegraph) {
   EXPECT_THAT(counts, UnorderedElementsAre(1, 2, 1, 1, 1));
 }
 
+TEST(HeapGraphTrackerTest, InterleavedSequences) {
+  // Two graphs 1@X -> 2@X, one per sequence, whose objects are added in turns
+  // so that the rows of each graph are not consecutive. Objects are added
+  // children first, as referring to an object inserts its row.
+  constexpr int64_t kTimestamp = 1;
+  constexpr uint64_t kField = 1;
+  constexpr uint64_t kLocation = 0;
+  constexpr uint64_t kX = 1;
+
+  TraceProcessorContext context;
+  context.storage.reset(new TraceStorage());
+  context.process_tracker.reset(new ProcessTracker(&context));
+
+  HeapGraphTracker tracker(context.storage.get());
+  StringPool::Id normal_kind = context.storage->InternString("KIND_NORMAL");
+  for (uint32_t seq_id = 1; seq_id <= 2; ++seq_id) {
+    context.process_tracker->GetOrCreateProcess(seq_id);
+    tracker.AddInternedFieldName(seq_id, kField, base::StringView("foo"));
+    tracker.AddInternedLocationName(seq_id, kLocation,
+                                    context.storage->InternString("location"));
+    tracker.AddInternedType(seq_id, kX, context.storage->InternString("X"),
+                            kLocation, /*object_size=*/0,
+                            /*field_name_ids=*/{}, /*superclass_id=*/0,
+                            /*classloader_id=*/0, /*no_fields=*/false,
+                            /*kind=*/normal_kind);
+  }
+  for (uint64_t object_id = 2; object_id >= 1; --object_id) {
+    for (uint32_t seq_id = 1; seq_id <= 2; ++seq_id) {
+      HeapGraphTracker::SourceObject obj;
+      obj.object_id = object_id;
+      obj.self_size = 10 * seq_id + object_id;
+      obj.type_id = kX;
+      if (object_id == 1) {
+        obj.field_name_ids = {kField};
+        obj.referred_objects = {2};
+      }
+      tracker.AddObject(seq_id, /*upid=*/seq_id, kTimestamp, std::move(obj));
+    }
+  }
+  for (uint32_t seq_id = 1; seq_id <= 2; ++seq_id) {
+    HeapGraphTracker::SourceRoot root;
+    root.root_type = context.storage->InternString("ROOT");
+    root.object_ids.emplace_back(1);
+    tracker.AddRoot(seq_id, /*upid=*/seq_id, kTimestamp, root);
+    tracker.FinalizeProfile(seq_id);
+  }
+
+  const auto& objects = context.storage->heap_graph_object_table();
+  ASSERT_EQ(objects.row_count(), 4u);
+  for (uint32_t row = 0; row < objects.row_count(); ++row)
+    EXPECT_TRUE(objects.reachable()[row]);
+
+  for (UniquePid upid = 1; upid <= 2; ++upid) {
+    std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> flame =
+        tracker.BuildFlamegraph(kTimestamp, upid);
+    ASSERT_NE(flame, nullptr);
+    int64_t root_size = static_cast<int64_t>(10 * upid + 1);
+    int64_t child_size = static_cast<int64_t>(10 * upid + 2);
+    EXPECT_THAT(flame->cumulative_size().ToVectorForTesting(),
+                UnorderedElementsAre(root_size + child_size, child_size));
+  }
+}
+
+TEST(HeapGraphTrackerTest, LongChain) {
+  // 1@X -> 2@X -> ... -> kLength@X, and an unreachable (kLength + 1)@X. The
+  // references of the chain span many words of the packed edges.
+  constexpr uint64_t kLength = 1000;
+  constexpr uint64_t kSeqId = 1;
+  constexpr UniquePid kPid = 1;
+  constexpr int64_t kTimestamp = 1;
+  constexpr uint64_t kField = 1;
+  constexpr uint64_t kLocation = 0;
+  constexpr uint64_t kX = 1;
+
+  TraceProcessorContext context;
+  context.storage.reset(new TraceStorage());
+  context.process_tracker.reset(new ProcessTracker(&context));
+  context.process_tracker->GetOrCreateProcess(kPid);
+
+  HeapGraphTracker tracker(context.storage.get());
+  tracker.AddInternedFieldName(kSeqId, kField, base::StringView("next"));
+  tracker.AddInternedLocationName(kSeqId, kLocation,
+                                  context.storage->InternString("location"));
+  tracker.AddInternedType(
+      kSeqId, kX, context.storage->InternString("X"), kLocation,
+      /*object_size=*/0, /*field_name_ids=*/{}, /*superclass_id=*/0,
+      /*classloader_id=*/0, /*no_fields=*/false,
+      /*kind=*/context.storage->InternString("KIND_NORMAL"));
+  for (uint64_t object_id = 1; object_id <= kLength + 1; ++object_id) {
+    HeapGraphTracker::SourceObject obj;
+    obj.object_id = object_id;
+    obj.self_size = 1;
+    obj.type_id = kX;
+    if (object_id < kLength) {
+      obj.field_name_ids = {kField};
+      obj.referred_objects = {object_id + 1};
+    }
+    tracker.AddObject(kSeqId, kPid, kTimestamp, std::move(obj));
+  }
+  HeapGraphTracker::SourceRoot root;
+  root.root_type = context.storage->InternString("ROOT");
+  root.object_ids.emplace_back(1);
+  tracker.AddRoot(kSeqId, kPid, kTimestamp, root);
+  tracker.FinalizeProfile(kSeqId);
+
+  const auto& objects = context.storage->heap_graph_object_table();
+  ASSERT_EQ(objects.row_count(), kLength + 1);
+  uint32_t reachable = 0;
+  for (uint32_t row = 0; row < objects.row_count(); ++row) {
+    if (objects.reachable()[row])
+      reachable++;
+  }
+  EXPECT_EQ(reachable, kLength);
+}
+
 static const char kArray[] = "X[]";
 static const char kDoubleArray[] = "X[][]";
 static const char kNoArray[] = "X";
@@ -394,6 +394,13 @@ void ProfileModule::ParseProfilePacket(
     context_->storage->IncrementIndexedStats(
         stats::heapprofd_client_spinlock_blocked, static_cast<int>(entry.pid()),
         static_cast<int64_t>(stats.client_spinlock_blocked_us()));
+    // These are totals, so the last dump of the process has the final value.
+    context_->storage->SetIndexedStats(
+        stats::heapprofd_elf_cache_hits, static_cast<int>(entry.pid()),
+        static_cast<int64_t>(stats.elf_cache_hits()));
+    context_->storage->SetIndexedStats(
+        stats::heapprofd_elf_cache_misses, static_cast<int>(entry.pid()),
+        static_cast<int64_t>(stats.elf_cache_misses()));
 
     // orig_sampling_interval_bytes was introduced slightly after a bug with
     // self_max_count was fixed in the producer. We use this as a proxy
@@ -488,6 +495,7 @@ void ProfileModule::ParseModuleSymbols(ConstBytes blob) {
         auto* frames = context_->storage->mutable_stack_profile_frame_table();
         uint32_t frame_row = *frames->id().IndexOf(frame_id);
         frames->mutable_symbol_set_id()->Set(frame_row, symbol_set_id);
+        context_->storage->IncrementProfileGeneration();
         frame_found = true;
       }
     }
@@ -555,6 +563,7 @@ void ProfileModule::ParseDeobfuscationMapping(int64_t,
             *frames_tbl->id().IndexOf(frame_id),
             context_->storage->InternString(
                 base::StringView(merged_deobfuscated)));
+        context_->storage->IncrementProfileGeneration();
       }
     }
   }
@@ -38,12 +38,31 @@ IteratorImpl::IteratorImpl(TraceProcessorImpl* trace_processor,
       stmt_metadata_(std::move(metadata)),
       sql_stats_row_(sql_stats_row) {}
 
+IteratorImpl::IteratorImpl(TraceProcessorImpl* trace_processor,
+                           sqlite3* db,
+                           std::unique_ptr<ColumnarCursor> cursor,
+                           StmtMetadata metadata,
+                           uint32_t sql_stats_row)
+    : trace_processor_(trace_processor),
+      db_(db),
+      stmt_metadata_(std::move(metadata)),
+      columnar_cursor_(std::move(cursor)),
+      sql_stats_row_(sql_stats_row) {}
+
 IteratorImpl::~IteratorImpl() {
   if (trace_processor_) {
     base::TimeNanos t_end = base::GetWallTimeNs();
-    auto* sql_stats =
-        trace_processor_.get()->context_.storage->mutable_sql_stats();
-    sql_stats->RecordQueryEnd(sql_stats_row_, t_end.count());
+    TraceProcessorImpl* tp = trace_processor_.get();
+    // Columnar queries read the rows of the table without going through its
+    // SQLite cursor: each row they return is a row scanned.
+    if (columnar_cursor_)
+      tp->query_cache_->RecordRowsScanned(
+          static_cast<uint64_t>(rows_returned_));
+    auto* sql_stats = tp->context_.storage->mutable_sql_stats();
+    sql_stats->RecordQueryEnd(
+        sql_stats_row_, t_end.count(), base::GetThreadCPUTimeNs().count(),
+        static_cast<int64_t>(tp->vm_steps_),
+        static_cast<int64_t>(tp->query_cache_->rows_scanned()), rows_returned_);
   }
 }
 
@@ -54,6 +73,27 @@ void IteratorImpl::RecordFirstNextInSqlStats() {
   sql_stats->RecordQueryFirstNext(sql_stats_row_, t_first_next.count());
 }
 
+std::string IteratorImpl::GetColumnarColumnName(uint32_t col) {
+  // SQLite's spelling of a column name depends on how it is written in the
+  // query and on its own configuration, so rather than replicating its rules,
+  // prepare (without running) the query to ask it.
+  if (columnar_column_names_.empty()) {
+    ScopedStmt stmt;
+    const std::string& sql = columnar_cursor_->query().sql();
+    base::Status status =
+        sqlite_utils::PrepareStmt(db_, sql.c_str(), &stmt, nullptr);
+    if (!status.ok() || !stmt) {
+      PERFETTO_DLOG("Unable to prepare %s: %s", sql.c_str(),
+                    status.c_message());
+      return "";
+    }
+    for (int i = 0; i < sqlite3_column_count(stmt.get()); ++i)
+      columnar_column_names_.emplace_back(sqlite3_column_name(stmt.get(), i));
+  }
+  return col < columnar_column_names_.size() ? columnar_column_names_[col]
+                                             : "";
+}
+
 Iterator::Iterator(std::unique_ptr<IteratorImpl> iterator)
     : iterator_(std::move(iterator)) {}
 Iterator::~Iterator() = default;
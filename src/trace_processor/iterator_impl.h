@@ -27,6 +27,7 @@
 #include "perfetto/trace_processor/basic_types.h"
 #include "perfetto/trace_processor/iterator.h"
 #include "perfetto/trace_processor/status.h"
+#include "src/trace_processor/sqlite/columnar_query.h"
 #include "src/trace_processor/sqlite/scoped_db.h"
 #include "src/trace_processor/sqlite/sqlite_utils.h"
 
@@ -49,6 +50,14 @@ class IteratorImpl {
                ScopedStmt,
                StmtMetadata,
                uint32_t sql_stats_row);
+
+  // Creates an iterator which returns the rows of |cursor| instead of the
+  // rows of a SQLite statement.
+  IteratorImpl(TraceProcessorImpl* impl,
+               sqlite3* db,
+               std::unique_ptr<ColumnarCursor> cursor,
+               StmtMetadata,
+               uint32_t sql_stats_row);
   ~IteratorImpl();
 
   IteratorImpl(IteratorImpl&) noexcept = delete;
@@ -59,6 +68,18 @@ class IteratorImpl {
 
   // Methods called by the base Iterator class.
   bool Next() {
+    if (PERFETTO_UNLIKELY(columnar_cursor_)) {
+      if (!called_next_) {
+        RecordFirstNextInSqlStats();
+        called_next_ = true;
+      }
+      bool has_row = columnar_cursor_->Next();
+      if (PERFETTO_UNLIKELY(!has_row))
+        status_ = columnar_cursor_->status();
+      rows_returned_ += has_row;
+      return has_row;
+    }
+
     PERFETTO_DCHECK(stmt_ || !status_.ok());
 
     if (!called_next_) {
@@ -89,10 +110,14 @@ class IteratorImpl {
       stmt_.reset();
       return false;
     }
+    rows_returned_ += ret == SQLITE_ROW;
     return ret == SQLITE_ROW;
   }
 
   SqlValue Get(uint32_t col) {
+    if (PERFETTO_UNLIKELY(columnar_cursor_))
+      return columnar_cursor_->Get(col);
+
     auto column = static_cast<int>(col);
     auto col_type = sqlite3_column_type(*stmt_, column);
     SqlValue value;
@@ -124,6 +149,8 @@ class IteratorImpl {
   }
 
   std::string GetColumnName(uint32_t col) {
+    if (columnar_cursor_)
+      return GetColumnarColumnName(col);
     return stmt_ ? sqlite3_column_name(*stmt_, static_cast<int>(col)) : "";
   }
 
@@ -152,6 +179,9 @@ class IteratorImpl {
 
   void RecordFirstNextInSqlStats();
 
+  // Returns the name SQLite gives to the column |col| of the columnar query.
+  std::string GetColumnarColumnName(uint32_t col);
+
   ScopedTraceProcessor trace_processor_;
   sqlite3* db_ = nullptr;
   base::Status status_;
@@ -159,7 +189,13 @@ class IteratorImpl {
   ScopedStmt stmt_;
   StmtMetadata stmt_metadata_;
 
+  // Set instead of |stmt_| when the query is executed directly on the columns
+  // of a table (see ColumnarQuery).
+  std::unique_ptr<ColumnarCursor> columnar_cursor_;
+  std::vector<std::string> columnar_column_names_;
+
   uint32_t sql_stats_row_ = 0;
+  int64_t rows_returned_ = 0;
   bool called_next_ = false;
 };
 
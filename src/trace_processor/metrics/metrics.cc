@@ -16,6 +16,7 @@
 
 #include "src/trace_processor/metrics/metrics.h"
 
+#include <algorithm>
 #include <regex>
 #include <unordered_map>
 #include <vector>
@@ -86,8 +87,306 @@ base::Status ValidateSingleNonEmptyMessage(const uint8_t* ptr,
   return base::OkStatus();
 }
 
+bool IsIdentifierChar(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_';
+}
+
+struct SqlToken {
+  // Lowercased for identifiers, verbatim for string literals.
+  std::string text;
+  bool is_string;
+};
+
+// Splits |sql| into identifiers (including quoted ones) and string literals,
+// skipping comments, numbers and punctuation.
+std::vector<SqlToken> TokenizeSql(const std::string& sql) {
+  std::vector<SqlToken> tokens;
+  size_t i = 0;
+  // Reads until |close|, where a doubled |close| is an escaped one.
+  auto read_quoted = [&sql, &i](char close) {
+    std::string text;
+    for (++i; i < sql.size(); ++i) {
+      if (sql[i] != close) {
+        text += sql[i];
+        continue;
+      }
+      if (i + 1 < sql.size() && sql[i + 1] == close && close != ']') {
+        text += close;
+        ++i;
+        continue;
+      }
+      ++i;
+      break;
+    }
+    return text;
+  };
+  while (i < sql.size()) {
+    char c = sql[i];
+    if (c == '-' && i + 1 < sql.size() && sql[i + 1] == '-') {
+      size_t end = sql.find('\n', i);
+      i = end == std::string::npos ? sql.size() : end + 1;
+    } else if (c == '/' && i + 1 < sql.size() && sql[i + 1] == '*') {
+      size_t end = sql.find("*/", i + 2);
+      i = end == std::string::npos ? sql.size() : end + 2;
+    } else if (c == '\'') {
+      tokens.push_back(SqlToken{read_quoted('\''), true});
+    } else if (c == '"' || c == '`') {
+      tokens.push_back(SqlToken{base::ToLower(read_quoted(c)), false});
+    } else if (c == '[') {
+      tokens.push_back(SqlToken{base::ToLower(read_quoted(']')), false});
+    } else if (IsIdentifierChar(c)) {
+      size_t start = i;
+      while (i < sql.size() && IsIdentifierChar(sql[i]))
+        ++i;
+      if (c < '0' || c > '9') {
+        tokens.push_back(
+            SqlToken{base::ToLower(sql.substr(start, i - start)), false});
+      }
+    } else {
+      ++i;
+    }
+  }
+  return tokens;
+}
+
+void SortAndDedup(std::vector<std::string>* names) {
+  std::sort(names->begin(), names->end());
+  names->erase(std::unique(names->begin(), names->end()), names->end());
+}
+
+struct SqlObjects {
+  // The (lowercased) names of the tables, views and functions which the SQL
+  // creates, drops or modifies.
+  std::vector<std::string> defined;
+  // All the identifiers of the SQL, which include the names of the objects it
+  // refers to, and the defined ones.
+  std::vector<std::string> referenced;
+};
+
+// Finds the objects defined and referred to by |sql|. This is a purely
+// lexical scan: it can return names which are not really defined or used by
+// |sql| (which only causes files to be run again) but should never miss one.
+SqlObjects ScanSql(const std::string& sql) {
+  std::vector<SqlToken> tokens = TokenizeSql(sql);
+  auto token = [&tokens](size_t i) -> const std::string& {
+    static const std::string kEmpty;
+    return i < tokens.size() && !tokens[i].is_string ? tokens[i].text : kEmpty;
+  };
+
+  SqlObjects objects;
+  for (size_t i = 0; i < tokens.size(); ++i) {
+    if (tokens[i].is_string)
+      continue;
+    const std::string& cur = tokens[i].text;
+    objects.referenced.push_back(cur);
+    size_t name = 0;
+    if (cur == "create") {
+      size_t j = i + 1;
+      while (token(j) == "perfetto" || token(j) == "temp" ||
+             token(j) == "temporary" || token(j) == "virtual") {
+        ++j;
+      }
+      if (token(j) != "table" && token(j) != "view" && token(j) != "function")
+        continue;
+      ++j;
+      // IF NOT EXISTS
+      if (token(j) == "if")
+        j += 3;
+      name = j;
+    } else if (cur == "drop") {
+      size_t j = i + 1;
+      if (token(j) != "table" && token(j) != "view")
+        continue;
+      ++j;
+      // IF EXISTS
+      if (token(j) == "if")
+        j += 2;
+      name = j;
+    } else if (cur == "insert" || cur == "replace") {
+      size_t j = i + 1;
+      // INSERT OR REPLACE/IGNORE/...
+      if (token(j) == "or")
+        j += 2;
+      if (token(j) != "into")
+        continue;
+      name = j + 1;
+    } else if (cur == "update") {
+      size_t j = i + 1;
+      if (token(j) == "or")
+        j += 2;
+      name = j;
+    } else if (cur == "delete" && token(i + 1) == "from") {
+      name = i + 2;
+    } else if (cur == "alter" && token(i + 1) == "table") {
+      name = i + 2;
+    } else if (cur == "create_function" || cur == "create_view_function") {
+      // CREATE_FUNCTION('NAME(args)', 'return type', 'SQL'): the name is the
+      // identifier the first argument starts with, and the other arguments
+      // are scanned for references.
+      for (size_t arg = 0; arg < 3 && i + 1 < tokens.size() &&
+                           tokens[i + 1].is_string;
+           ++arg) {
+        ++i;
+        if (arg == 0) {
+          std::vector<SqlToken> prototype = TokenizeSql(tokens[i].text);
+          if (!prototype.empty() && !prototype[0].is_string)
+            objects.defined.push_back(prototype[0].text);
+          continue;
+        }
+        SqlObjects arg_objects = ScanSql(tokens[i].text);
+        objects.referenced.insert(objects.referenced.end(),
+                                  arg_objects.referenced.begin(),
+                                  arg_objects.referenced.end());
+      }
+      continue;
+    } else {
+      continue;
+    }
+    if (!token(name).empty())
+      objects.defined.push_back(token(name));
+  }
+  objects.referenced.insert(objects.referenced.end(), objects.defined.begin(),
+                            objects.defined.end());
+  SortAndDedup(&objects.defined);
+  SortAndDedup(&objects.referenced);
+  return objects;
+}
+
 }  // namespace
 
+RunMetricTracker::RunMetricTracker() = default;
+RunMetricTracker::~RunMetricTracker() = default;
+
+void RunMetricTracker::EnableOutputReuse(MaterializeViewFn materialize_view) {
+  materialize_view_ = std::move(materialize_view);
+}
+
+void RunMetricTracker::BeginComputation() {
+  // Flush the definitions of the last query as it has now finished running.
+  RecordQuery(std::string());
+}
+
+void RunMetricTracker::EndComputation() {
+  running_.clear();
+}
+
+void RunMetricTracker::Reset() {
+  running_.clear();
+  runs_.clear();
+  last_definition_.clear();
+  definition_references_.clear();
+  last_query_.clear();
+}
+
+bool RunMetricTracker::IsUpToDate(const std::string& key) const {
+  if (!reuse_outputs())
+    return false;
+  auto it = runs_.find(key);
+  if (it == runs_.end())
+    return false;
+  return IsUpToDate(key, it->second.generation);
+}
+
+bool RunMetricTracker::IsUpToDate(const std::string& key,
+                                  uint64_t generation) const {
+  auto it = runs_.find(key);
+  if (it == runs_.end())
+    return false;
+  const FileRun& run = it->second;
+  std::set<std::string> visited;
+  for (const std::string& object : run.referenced_objects) {
+    if (IsChangedSince(object, generation, &visited))
+      return false;
+  }
+  for (const std::string& dependency : run.dependencies) {
+    if (!IsUpToDate(dependency, generation))
+      return false;
+  }
+  return true;
+}
+
+bool RunMetricTracker::IsChangedSince(const std::string& object,
+                                      uint64_t generation,
+                                      std::set<std::string>* visited) const {
+  if (!visited->insert(object).second)
+    return false;
+  auto def_it = last_definition_.find(object);
+  if (def_it == last_definition_.end())
+    return false;
+  if (def_it->second > generation)
+    return true;
+  // A view (or a function) defined before the file ran still changes if the
+  // objects it reads from were redefined since.
+  auto refs_it = definition_references_.find(object);
+  if (refs_it == definition_references_.end())
+    return false;
+  for (const std::string& reference : refs_it->second) {
+    if (IsChangedSince(reference, generation, visited))
+      return true;
+  }
+  return false;
+}
+
+void RunMetricTracker::RecordDefinitions(
+    const std::vector<std::string>& defined,
+    const std::vector<std::string>& referenced,
+    uint64_t generation) {
+  for (const std::string& object : defined) {
+    last_definition_[object] = generation;
+    definition_references_[object] = referenced;
+  }
+}
+
+void RunMetricTracker::AddDependency(const std::string& key) {
+  if (!running_.empty())
+    running_.back().second.push_back(key);
+}
+
+void RunMetricTracker::BeginFile(const std::string& key) {
+  running_.emplace_back(key, std::vector<std::string>());
+}
+
+void RunMetricTracker::EndFile(const std::string& key,
+                               const std::string& sql,
+                               bool success) {
+  PERFETTO_CHECK(!running_.empty() && running_.back().first == key);
+  FileRun run;
+  run.dependencies = std::move(running_.back().second);
+  running_.pop_back();
+
+  // Even a failed file might have defined some objects before failing.
+  SqlObjects objects = ScanSql(sql);
+  run.generation = ++generation_;
+  RecordDefinitions(objects.defined, objects.referenced, run.generation);
+  run.referenced_objects = std::move(objects.referenced);
+
+  if (success) {
+    runs_[key] = std::move(run);
+  } else {
+    runs_.erase(key);
+  }
+}
+
+void RunMetricTracker::MaterializeViews(const std::string& sql) {
+  if (!reuse_outputs())
+    return;
+  for (const std::string& object : ScanSql(sql).defined)
+    materialize_view_(object);
+}
+
+void RunMetricTracker::RecordQuery(const std::string& sql) {
+  if (!reuse_outputs() || !running_.empty())
+    return;
+  uint64_t generation = ++generation_;
+  const std::string* queries[] = {&last_query_, &sql};
+  for (const std::string* query : queries) {
+    SqlObjects objects = ScanSql(*query);
+    RecordDefinitions(objects.defined, objects.referenced, generation);
+  }
+  last_query_ = sql;
+}
+
 ProtoBuilder::ProtoBuilder(const DescriptorPool* pool,
                            const ProtoDescriptor* descriptor)
     : pool_(pool), descriptor_(descriptor) {}
@@ -651,10 +950,32 @@ base::Status RunMetric::Run(RunMetric::Context* ctx,
         metric_it->sql.c_str());
   }
 
+  // With output reuse, files are only run again if something they depend on
+  // changed since they last ran with the same arguments. Prerequisites such as
+  // process_metadata.sql are shared by many metrics.
+  RunMetricTracker* tracker = ctx->tracker;
+  bool tracked = tracker && tracker->reuse_outputs();
+  std::string key = path;
+  if (tracked) {
+    std::map<std::string, std::string> sorted_subs(substitutions.begin(),
+                                                   substitutions.end());
+    for (const auto& sub : sorted_subs)
+      key += "|" + sub.first + "=" + sub.second;
+    tracker->AddDependency(key);
+    if (tracker->IsUpToDate(key))
+      return base::OkStatus();
+    tracker->BeginFile(key);
+  }
+
   auto it = ctx->tp->ExecuteQuery(subbed_sql);
   it.Next();
 
   base::Status status = it.Status();
+  if (tracked) {
+    if (status.ok())
+      tracker->MaterializeViews(subbed_sql);
+    tracker->EndFile(key, subbed_sql, status.ok());
+  }
   if (!status.ok()) {
     return base::ErrStatus("RUN_METRIC: Error when running file %s: %s", path,
                            status.c_message());
@@ -711,9 +1032,14 @@ base::Status UnwrapMetricProto::Run(Context*,
 base::Status ComputeMetrics(TraceProcessor* tp,
                             const std::vector<std::string> metrics_to_compute,
                             const std::vector<SqlMetricFile>& sql_metrics,
+                            RunMetricTracker* tracker,
                             const DescriptorPool& pool,
                             const ProtoDescriptor& root_descriptor,
                             std::vector<uint8_t>* metrics_proto) {
+  tracker->BeginComputation();
+  auto end_computation =
+      base::OnScopeExit([tracker] { tracker->EndComputation(); });
+
   ProtoBuilder metric_builder(&pool, &root_descriptor);
   for (const auto& name : metrics_to_compute) {
     auto metric_it =
@@ -726,9 +1052,18 @@ base::Status ComputeMetrics(TraceProcessor* tp,
       return base::ErrStatus("Unknown metric %s", name.c_str());
 
     const auto& sql_metric = *metric_it;
-    auto prep_it = tp->ExecuteQuery(sql_metric.sql);
-    prep_it.Next();
-    RETURN_IF_ERROR(prep_it.Status());
+    bool tracked = tracker->reuse_outputs();
+    if (!tracked || !tracker->IsUpToDate(sql_metric.path)) {
+      if (tracked)
+        tracker->BeginFile(sql_metric.path);
+      auto prep_it = tp->ExecuteQuery(sql_metric.sql);
+      prep_it.Next();
+      if (tracked) {
+        tracker->EndFile(sql_metric.path, sql_metric.sql,
+                         prep_it.Status().ok());
+      }
+      RETURN_IF_ERROR(prep_it.Status());
+    }
 
     auto output_query =
         "SELECT * FROM " + sql_metric.output_table_name.value() + ";";
@@ -19,7 +19,12 @@
 
 #include <sqlite3.h>
 
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "perfetto/ext/base/string_view.h"
@@ -57,6 +62,100 @@ struct SqlMetricFile {
   std::string sql;
 };
 
+// Memoizes the files run through RUN_METRIC, both from metrics and from
+// queries, when output reuse is enabled (see Config::reuse_metric_outputs).
+// Without it, the tracker does nothing and every file is run each time.
+//
+// Files are identified by a key made of their path followed by their template
+// arguments (if any). A file is run again if any object (table, view or
+// function) it refers to, directly or through the objects those refer to, was
+// redefined since it ran, or if any of the files it ran is out of date. The
+// top-level queries run in between are scanned as well.
+//
+// The objects a file defines and refers to come from a lexical scan of its
+// SQL, which skips comments and string literals. The scan is conservative:
+// every identifier is taken as a reference, so it can cause files to be run
+// again needlessly but never misses a redefinition made through SQL.
+class RunMetricTracker {
+ public:
+  // Called with the name of each view (re)defined by a file run through
+  // RUN_METRIC so that it can be materialized.
+  using MaterializeViewFn = std::function<void(const std::string&)>;
+
+  RunMetricTracker();
+  ~RunMetricTracker();
+
+  // Enables the memoization of RUN_METRIC outputs across computations and
+  // queries.
+  void EnableOutputReuse(MaterializeViewFn materialize_view);
+
+  // Must be called around each metric computation.
+  void BeginComputation();
+  void EndComputation();
+
+  // Forgets about all the files run so far.
+  void Reset();
+
+  bool reuse_outputs() const { return static_cast<bool>(materialize_view_); }
+
+  // Returns whether the file |key| already ran and is still up to date. Always
+  // false if output reuse is disabled.
+  bool IsUpToDate(const std::string& key) const;
+
+  // Records that the file which is currently running depends on |key|.
+  void AddDependency(const std::string& key);
+
+  // Must be called around the execution of |sql|, the SQL of the file |key|.
+  void BeginFile(const std::string& key);
+  void EndFile(const std::string& key, const std::string& sql, bool success);
+
+  // Materializes the views defined by |sql|, the SQL of the file which is
+  // currently running.
+  void MaterializeViews(const std::string& sql);
+
+  // Records the objects defined by |sql|, a query issued outside of any
+  // metric file.
+  void RecordQuery(const std::string& sql);
+
+ private:
+  struct FileRun {
+    // Includes the defined objects.
+    std::vector<std::string> referenced_objects;
+    std::vector<std::string> dependencies;
+    uint64_t generation = 0;
+  };
+
+  bool IsUpToDate(const std::string& key, uint64_t generation) const;
+  // Returns whether |object|, or any object its last definition refers to,
+  // was (re)defined after |generation|.
+  bool IsChangedSince(const std::string& object,
+                      uint64_t generation,
+                      std::set<std::string>* visited) const;
+  void RecordDefinitions(const std::vector<std::string>& defined,
+                         const std::vector<std::string>& referenced,
+                         uint64_t generation);
+
+  uint64_t generation_ = 0;
+
+  // Files currently being run (innermost last) with their dependencies.
+  std::vector<std::pair<std::string, std::vector<std::string>>> running_;
+
+  // Last successful run of each file.
+  std::map<std::string, FileRun> runs_;
+
+  // Generation at which each table, view or function was last (re)defined,
+  // and the objects referred to by the SQL which defined it.
+  std::map<std::string, uint64_t> last_definition_;
+  std::map<std::string, std::vector<std::string>> definition_references_;
+
+  // The last query passed to RecordQuery. The last statement of a query only
+  // runs when its iterator is stepped (i.e. after RecordQuery returns) so its
+  // definitions are recorded again on the next call.
+  std::string last_query_;
+
+  MaterializeViewFn materialize_view_;
+};
+
 // Helper class to build a nested (metric) proto checking the schema against
 // a descriptor.
 // Visible for testing.
@@ -177,6 +276,7 @@ struct RunMetric : public SqlFunction {
   struct Context {
     TraceProcessor* tp;
     std::vector<SqlMetricFile>* metrics;
+    RunMetricTracker* tracker;
   };
   static constexpr bool kVoidReturn = true;
   static base::Status Run(Context* ctx,
@@ -202,6 +302,7 @@ void RepeatedFieldFinal(sqlite3_context* ctx);
 base::Status ComputeMetrics(TraceProcessor* impl,
                             const std::vector<std::string> metrics_to_compute,
                             const std::vector<SqlMetricFile>& metrics,
+                            RunMetricTracker* tracker,
                             const DescriptorPool& pool,
                             const ProtoDescriptor& root_descriptor,
                             std::vector<uint8_t>* metrics_proto);
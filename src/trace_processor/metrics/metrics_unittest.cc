@@ -50,6 +50,142 @@ TEST(MetricsTest, TemplateReplace) {
   ASSERT_NE(TemplateReplace("{{missing}}", {{}}, &unused), 0);
 }
 
+TEST(MetricsTest, RunMetricTrackerDisabledByDefault) {
+  RunMetricTracker tracker;
+  ASSERT_FALSE(tracker.reuse_outputs());
+  tracker.BeginFile("a.sql");
+  tracker.EndFile("a.sql", "CREATE VIEW a_view AS SELECT 1;", true);
+  ASSERT_FALSE(tracker.IsUpToDate("a.sql"));
+}
+
+TEST(MetricsTest, RunMetricTrackerReusesFiles) {
+  RunMetricTracker tracker;
+  tracker.EnableOutputReuse([](const std::string&) {});
+  tracker.BeginComputation();
+  ASSERT_FALSE(tracker.IsUpToDate("a.sql"));
+
+  tracker.BeginFile("a.sql");
+  tracker.EndFile("a.sql",
+                  "DROP VIEW IF EXISTS a_view; CREATE VIEW a_view AS SELECT 1;",
+                  true);
+  ASSERT_TRUE(tracker.IsUpToDate("a.sql"));
+
+  // Defining an unrelated view does not invalidate a.sql.
+  tracker.BeginFile("b.sql");
+  tracker.AddDependency("a.sql");
+  tracker.EndFile("b.sql", "CREATE TABLE b_table AS SELECT * FROM a_view;",
+                  true);
+  ASSERT_TRUE(tracker.IsUpToDate("a.sql"));
+  ASSERT_TRUE(tracker.IsUpToDate("b.sql"));
+
+  // Redefining a view defined by a.sql invalidates both a.sql and the files
+  // which depend on it.
+  tracker.BeginFile("c.sql");
+  tracker.EndFile("c.sql", "create view if not exists A_VIEW as select 2;",
+                  true);
+  ASSERT_FALSE(tracker.IsUpToDate("a.sql"));
+  ASSERT_FALSE(tracker.IsUpToDate("b.sql"));
+  ASSERT_TRUE(tracker.IsUpToDate("c.sql"));
+
+  // Modifying the contents of a table also counts as a redefinition.
+  tracker.BeginFile("d.sql");
+  tracker.EndFile("d.sql", "INSERT OR REPLACE INTO b_table VALUES (3);", true);
+  ASSERT_FALSE(tracker.IsUpToDate("b.sql"));
+
+  // Failed files are never considered up to date.
+  tracker.BeginFile("e.sql");
+  tracker.EndFile("e.sql", "SELECT CREATE_FUNCTION('E_FN()', 'INT', '1');",
+                  false);
+  ASSERT_FALSE(tracker.IsUpToDate("e.sql"));
+  tracker.EndComputation();
+}
+
+TEST(MetricsTest, RunMetricTrackerTracksReads) {
+  RunMetricTracker tracker;
+  tracker.EnableOutputReuse([](const std::string&) {});
+
+  tracker.BeginFile("view.sql");
+  tracker.EndFile("view.sql", "CREATE VIEW v AS SELECT * FROM t;", true);
+  tracker.BeginFile("fn.sql");
+  tracker.EndFile("fn.sql",
+                  "SELECT CREATE_FUNCTION('FN(x INT)', 'INT', "
+                  "'SELECT COUNT(*) FROM u WHERE id = $x');",
+                  true);
+  // Neither reads the other file through RUN_METRIC.
+  tracker.BeginFile("a.sql");
+  tracker.EndFile("a.sql", "CREATE TABLE a AS SELECT * FROM v;", true);
+  tracker.BeginFile("b.sql");
+  tracker.EndFile("b.sql", "CREATE TABLE b AS SELECT FN(1);", true);
+  ASSERT_TRUE(tracker.IsUpToDate("a.sql"));
+  ASSERT_TRUE(tracker.IsUpToDate("b.sql"));
+
+  // Redefining a table read through a view invalidates the file which read
+  // the view, and likewise through a function.
+  tracker.RecordQuery("CREATE TABLE t AS SELECT 1;");
+  ASSERT_FALSE(tracker.IsUpToDate("a.sql"));
+  ASSERT_TRUE(tracker.IsUpToDate("b.sql"));
+  tracker.RecordQuery("DELETE FROM u;");
+  ASSERT_FALSE(tracker.IsUpToDate("b.sql"));
+}
+
+TEST(MetricsTest, RunMetricTrackerSkipsCommentsAndStrings) {
+  RunMetricTracker tracker;
+  tracker.EnableOutputReuse([](const std::string&) {});
+
+  tracker.BeginFile("a.sql");
+  tracker.EndFile("a.sql",
+                  "-- Reads from x.\n"
+                  "/* CREATE TABLE y */\n"
+                  "CREATE TABLE a AS SELECT 'DROP VIEW z' AS \"Quoted\";",
+                  true);
+  tracker.RecordQuery("CREATE TABLE x AS SELECT 1; DROP VIEW y; DROP VIEW z;");
+  ASSERT_TRUE(tracker.IsUpToDate("a.sql"));
+  tracker.RecordQuery("DROP TABLE quoted;");
+  ASSERT_FALSE(tracker.IsUpToDate("a.sql"));
+}
+
+TEST(MetricsTest, RunMetricTrackerReusesOutputs) {
+  std::vector<std::string> materialized;
+  RunMetricTracker tracker;
+  tracker.EnableOutputReuse([&materialized](const std::string& name) {
+    materialized.push_back(name);
+  });
+  ASSERT_TRUE(tracker.reuse_outputs());
+
+  // Files run from a query are tracked even outside of a computation.
+  tracker.RecordQuery("SELECT RUN_METRIC('a.sql', 'arg', '1');");
+  tracker.BeginFile("a.sql|arg=1");
+  tracker.MaterializeViews("CREATE VIEW a_view AS SELECT 1;");
+  tracker.EndFile("a.sql|arg=1", "CREATE VIEW a_view AS SELECT 1;", true);
+  ASSERT_THAT(materialized, testing::ElementsAre("a_view"));
+
+  // Files are remembered across computations.
+  tracker.BeginComputation();
+  ASSERT_TRUE(tracker.IsUpToDate("a.sql|arg=1"));
+  tracker.EndComputation();
+  ASSERT_TRUE(tracker.IsUpToDate("a.sql|arg=1"));
+
+  // Queries redefining an output invalidate the file which created it.
+  tracker.RecordQuery("SELECT 1; DROP VIEW a_view;");
+  ASSERT_FALSE(tracker.IsUpToDate("a.sql|arg=1"));
+
+  // The last statement of the query might only run after the file is run
+  // again so the next query invalidates it once more.
+  tracker.BeginFile("a.sql|arg=1");
+  tracker.EndFile("a.sql|arg=1", "CREATE VIEW a_view AS SELECT 1;", true);
+  ASSERT_TRUE(tracker.IsUpToDate("a.sql|arg=1"));
+  tracker.RecordQuery("SELECT * FROM a_view;");
+  ASSERT_FALSE(tracker.IsUpToDate("a.sql|arg=1"));
+
+  tracker.BeginFile("a.sql|arg=1");
+  tracker.EndFile("a.sql|arg=1", "CREATE VIEW a_view AS SELECT 1;", true);
+  tracker.RecordQuery("SELECT * FROM a_view;");
+  ASSERT_TRUE(tracker.IsUpToDate("a.sql|arg=1"));
+
+  tracker.Reset();
+  ASSERT_FALSE(tracker.IsUpToDate("a.sql|arg=1"));
+}
+
 class ProtoBuilderTest : public ::testing::Test {
  protected:
   template <bool repeated>
@@ -53,13 +53,16 @@ constexpr auto kSliceSize =
 // the RpcResponseFunction (the receiver is expected to deal with arbitrary
 // fragmentation anyways). It also takes care of prefixing each message with
 // the proto preamble and varint size.
+// The seq is only assigned by Send(): responses are not necessarily sent in the
+// order they are created (e.g. query progress updates are sent while a batch of
+// query results is being built).
 class Response {
  public:
-  Response(int64_t seq, int method);
+  explicit Response(int method);
   Response(const Response&) = delete;
   Response& operator=(const Response&) = delete;
   RpcProto* operator->() { return msg_; }
-  void Send(Rpc::RpcResponseFunction);
+  void Send(int64_t seq, Rpc::RpcResponseFunction);
 
  private:
   RpcProto* msg_ = nullptr;
@@ -72,13 +75,13 @@ class Response {
   protozero::HeapBuffered<TraceProcessorRpcStream> buf_;
 };
 
-Response::Response(int64_t seq, int method) : buf_(kSliceSize, kSliceSize) {
+Response::Response(int method) : buf_(kSliceSize, kSliceSize) {
   msg_ = buf_->add_msg();
-  msg_->set_seq(seq);
   msg_->set_response(static_cast<RpcProto::TraceProcessorMethod>(method));
 }
 
-void Response::Send(Rpc::RpcResponseFunction send_fn) {
+void Response::Send(int64_t seq, Rpc::RpcResponseFunction send_fn) {
+  msg_->set_seq(seq);
   buf_->Finalize();
   for (const auto& slice : buf_.GetSlices()) {
     auto range = slice.GetUsedRange();
@@ -154,7 +157,7 @@ void Rpc::ParseRpcRequest(const uint8_t* data, size_t len) {
   static const char kErrFieldNotSet[] = "RPC error: request field not set";
   switch (req_type) {
     case RpcProto::TPM_APPEND_TRACE_DATA: {
-      Response resp(tx_seq_id_++, req_type);
+      Response resp(req_type);
       auto* result = resp->set_append_result();
       if (!req.has_append_trace_data()) {
         result->set_error(kErrFieldNotSet);
@@ -165,35 +168,36 @@ void Rpc::ParseRpcRequest(const uint8_t* data, size_t len) {
           result->set_error(res.message());
         }
       }
-      resp.Send(rpc_response_fn_);
+      resp.Send(tx_seq_id_++, rpc_response_fn_);
       break;
     }
     case RpcProto::TPM_FINALIZE_TRACE_DATA: {
-      Response resp(tx_seq_id_++, req_type);
+      Response resp(req_type);
       NotifyEndOfFile();
-      resp.Send(rpc_response_fn_);
+      resp.Send(tx_seq_id_++, rpc_response_fn_);
       break;
     }
     case RpcProto::TPM_QUERY_STREAMING: {
       if (!req.has_query_args()) {
-        Response resp(tx_seq_id_++, req_type);
+        Response resp(req_type);
         auto* result = resp->set_query_result();
         result->set_error(kErrFieldNotSet);
-        resp.Send(rpc_response_fn_);
+        resp.Send(tx_seq_id_++, rpc_response_fn_);
       } else {
         protozero::ConstBytes args = req.query_args();
-        auto it = QueryInternal(args.data, args.size);
+        auto it = QueryInternal(args.data, args.size, /*report_progress=*/true);
         QueryResultSerializer serializer(std::move(it));
         for (bool has_more = true; has_more;) {
-          Response resp(tx_seq_id_++, req_type);
+          Response resp(req_type);
           has_more = serializer.Serialize(resp->set_query_result());
-          resp.Send(rpc_response_fn_);
+          resp.Send(tx_seq_id_++, rpc_response_fn_);
         }
+        trace_processor_->SetQueryProgressCallback(nullptr);
       }
       break;
     }
     case RpcProto::TPM_COMPUTE_METRIC: {
-      Response resp(tx_seq_id_++, req_type);
+      Response resp(req_type);
       auto* result = resp->set_metric_result();
       if (!req.has_compute_metric_args()) {
         result->set_error(kErrFieldNotSet);
@@ -201,40 +205,40 @@ void Rpc::ParseRpcRequest(const uint8_t* data, size_t len) {
         protozero::ConstBytes args = req.compute_metric_args();
         ComputeMetricInternal(args.data, args.size, result);
       }
-      resp.Send(rpc_response_fn_);
+      resp.Send(tx_seq_id_++, rpc_response_fn_);
       break;
     }
     case RpcProto::TPM_GET_METRIC_DESCRIPTORS: {
-      Response resp(tx_seq_id_++, req_type);
+      Response resp(req_type);
       auto descriptor_set = trace_processor_->GetMetricDescriptors();
       auto* result = resp->set_metric_descriptors();
       result->AppendRawProtoBytes(descriptor_set.data(), descriptor_set.size());
-      resp.Send(rpc_response_fn_);
+      resp.Send(tx_seq_id_++, rpc_response_fn_);
       break;
     }
     case RpcProto::TPM_RESTORE_INITIAL_TABLES: {
       trace_processor_->RestoreInitialTables();
-      Response resp(tx_seq_id_++, req_type);
-      resp.Send(rpc_response_fn_);
+      Response resp(req_type);
+      resp.Send(tx_seq_id_++, rpc_response_fn_);
       break;
     }
     case RpcProto::TPM_ENABLE_METATRACE: {
       trace_processor_->EnableMetatrace();
-      Response resp(tx_seq_id_++, req_type);
-      resp.Send(rpc_response_fn_);
+      Response resp(req_type);
+      resp.Send(tx_seq_id_++, rpc_response_fn_);
       break;
     }
     case RpcProto::TPM_DISABLE_AND_READ_METATRACE: {
-      Response resp(tx_seq_id_++, req_type);
+      Response resp(req_type);
       DisableAndReadMetatraceInternal(resp->set_metatrace());
-      resp.Send(rpc_response_fn_);
+      resp.Send(tx_seq_id_++, rpc_response_fn_);
       break;
     }
     case RpcProto::TPM_GET_STATUS: {
-      Response resp(tx_seq_id_++, req_type);
+      Response resp(req_type);
       std::vector<uint8_t> status = GetStatus();
       resp->set_status()->AppendRawProtoBytes(status.data(), status.size());
-      resp.Send(rpc_response_fn_);
+      resp.Send(tx_seq_id_++, rpc_response_fn_);
       break;
     }
     default: {
@@ -242,10 +246,10 @@ void Rpc::ParseRpcRequest(const uint8_t* data, size_t len) {
       // generic "unkown request" response, so the client can do feature
       // detection
       PERFETTO_DLOG("[RPC] Uknown request type (%d), size=%zu", req_type, len);
-      Response resp(tx_seq_id_++, req_type);
+      Response resp(req_type);
       resp->set_invalid_request(
           static_cast<RpcProto::TraceProcessorMethod>(req_type));
-      resp.Send(rpc_response_fn_);
+      resp.Send(tx_seq_id_++, rpc_response_fn_);
       break;
     }
   }  // switch(req_type)
@@ -294,7 +298,7 @@ void Rpc::MaybePrintProgress() {
 void Rpc::Query(const uint8_t* args,
                 size_t len,
                 QueryResultBatchCallback result_callback) {
-  auto it = QueryInternal(args, len);
+  auto it = QueryInternal(args, len, /*report_progress=*/false);
   QueryResultSerializer serializer(std::move(it));
 
   std::vector<uint8_t> res;
@@ -303,15 +307,49 @@ void Rpc::Query(const uint8_t* args,
     result_callback(res.data(), res.size(), has_more);
     res.clear();
   }
+  trace_processor_->SetQueryProgressCallback(nullptr);
 }
 
-Iterator Rpc::QueryInternal(const uint8_t* args, size_t len) {
+Iterator Rpc::QueryInternal(const uint8_t* args,
+                            size_t len,
+                            bool report_progress) {
   protos::pbzero::QueryArgs::Decoder query(args, len);
   std::string sql = query.sql_query().ToStdString();
   PERFETTO_DLOG("[RPC] Query < %s", sql.c_str());
   PERFETTO_TP_TRACE("RPC_QUERY",
                     [&](metatrace::Record* r) { r->AddArg("SQL", sql); });
 
+  int64_t timeout_ns = static_cast<int64_t>(query.timeout_ms()) * 1000000;
+  int64_t progress_interval_ns =
+      report_progress
+          ? static_cast<int64_t>(query.progress_interval_ms()) * 1000000
+          : 0;
+  if (timeout_ns > 0 || progress_interval_ns > 0) {
+    int64_t t_start = base::GetWallTimeNs().count();
+    int64_t t_last_progress = t_start;
+    uint64_t vm_steps_start = 0;
+    trace_processor_->SetQueryProgressCallback(
+        [this, timeout_ns, progress_interval_ns, t_start, t_last_progress,
+         vm_steps_start](uint64_t vm_steps) mutable {
+          // The callback is first invoked after the query has executed a
+          // few VM instructions: count from there.
+          if (vm_steps_start == 0)
+            vm_steps_start = vm_steps;
+          int64_t now = base::GetWallTimeNs().count();
+          if (timeout_ns > 0 && now - t_start > timeout_ns)
+            return false;
+          if (progress_interval_ns > 0 &&
+              now - t_last_progress >= progress_interval_ns) {
+            t_last_progress = now;
+            Response resp(RpcProto::TPM_QUERY_STREAMING);
+            auto* progress = resp->set_query_result()->set_progress();
+            progress->set_elapsed_ns(static_cast<uint64_t>(now - t_start));
+            progress->set_vm_steps(vm_steps - vm_steps_start);
+            resp.Send(tx_seq_id_++, rpc_response_fn_);
+          }
+          return true;
+        });
+  }
   return trace_processor_->ExecuteQuery(sql.c_str());
 }
 
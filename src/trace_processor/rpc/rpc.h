@@ -133,7 +133,11 @@ class Rpc {
   void ParseRpcRequest(const uint8_t* data, size_t len);
   void ResetTraceProcessor();
   void MaybePrintProgress();
-  Iterator QueryInternal(const uint8_t* args, size_t len);
+  // If |report_progress| is true, the progress of the query is sent through
+  // the RpcResponseFunction as requested by QueryArgs.progress_interval_ms.
+  // The caller must call trace_processor_->SetQueryProgressCallback(nullptr)
+  // once done with the returned iterator.
+  Iterator QueryInternal(const uint8_t* args, size_t len, bool report_progress);
   void ComputeMetricInternal(const uint8_t* args,
                              size_t len,
                              protos::pbzero::ComputeMetricResult*);
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/rpc/rpc.h"
+
+#include <string>
+#include <vector>
+
+#include "perfetto/protozero/scattered_heap_buffer.h"
+#include "perfetto/trace_processor/trace_processor.h"
+#include "test/gtest_and_gmock.h"
+
+#include "protos/perfetto/trace_processor/trace_processor.pbzero.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using ::testing::HasSubstr;
+using ResultProto = protos::pbzero::QueryResult;
+using RpcProto = protos::pbzero::TraceProcessorRpc;
+using RpcStreamProto = protos::pbzero::TraceProcessorRpcStream;
+
+// Counts to |kLongQueryRows|: takes long enough for the SQLite progress
+// handler to be invoked many times.
+constexpr int64_t kLongQueryRows = 1000000;
+constexpr char kLongQuery[] =
+    "with recursive n(x) as (select 1 union all select x + 1 from n "
+    "where x < 1000000) select count(*) from n";
+
+// RpcResponseFunction is a plain function pointer: the responses are
+// accumulated here.
+std::vector<uint8_t>* g_responses = nullptr;
+
+void AppendResponse(const void* data, uint32_t len) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  g_responses->insert(g_responses->end(), bytes, bytes + len);
+}
+
+class RpcTest : public ::testing::Test {
+ public:
+  RpcTest() : rpc_(TraceProcessor::CreateInstance(Config())) {
+    g_responses = &responses_;
+    rpc_.SetRpcResponseFunction(&AppendResponse);
+  }
+  ~RpcTest() override { g_responses = nullptr; }
+
+ protected:
+  std::vector<uint8_t> EncodeQueryArgs(const std::string& sql,
+                                       uint32_t timeout_ms,
+                                       uint32_t progress_interval_ms) {
+    protozero::HeapBuffered<protos::pbzero::QueryArgs> args;
+    args->set_sql_query(sql);
+    if (timeout_ms)
+      args->set_timeout_ms(timeout_ms);
+    if (progress_interval_ms)
+      args->set_progress_interval_ms(progress_interval_ms);
+    return args.SerializeAsArray();
+  }
+
+  // Runs |sql| through the legacy Query() endpoint and returns the
+  // concatenation of the errors of the results.
+  std::string QueryError(const std::string& sql, uint32_t timeout_ms) {
+    std::vector<uint8_t> args = EncodeQueryArgs(sql, timeout_ms, 0);
+    std::string error;
+    rpc_.Query(args.data(), args.size(),
+               [&error](const uint8_t* buf, size_t len, bool) {
+                 ResultProto::Decoder result(buf, len);
+                 error += result.error().ToStdString();
+               });
+    return error;
+  }
+
+  // Sends |sql| as a TPM_QUERY_STREAMING request.
+  void SendStreamingQuery(const std::string& sql,
+                          uint32_t progress_interval_ms) {
+    std::vector<uint8_t> args = EncodeQueryArgs(sql, 0, progress_interval_ms);
+    protozero::HeapBuffered<RpcStreamProto> req;
+    auto* msg = req->add_msg();
+    msg->set_seq(++tx_seq_);
+    msg->set_request(RpcProto::TPM_QUERY_STREAMING);
+    msg->set_query_args()->AppendRawProtoBytes(args.data(), args.size());
+    std::vector<uint8_t> buf = req.SerializeAsArray();
+    rpc_.OnRpcRequest(buf.data(), buf.size());
+  }
+
+  std::vector<uint8_t> responses_;
+  int64_t tx_seq_ = 0;
+  Rpc rpc_;
+};
+
+TEST_F(RpcTest, QueryTimeout) {
+  EXPECT_THAT(QueryError(kLongQuery, /*timeout_ms=*/1),
+              HasSubstr("interrupted"));
+
+  // Queries completing in time, or without a timeout, are not affected.
+  EXPECT_EQ(QueryError("select 1", /*timeout_ms=*/60000), "");
+  EXPECT_EQ(QueryError(kLongQuery, /*timeout_ms=*/0), "");
+
+  // The timeout only applies to the query it was passed with.
+  EXPECT_EQ(QueryError(kLongQuery, /*timeout_ms=*/60000), "");
+}
+
+TEST_F(RpcTest, QueryProgress) {
+  for (uint32_t progress_interval_ms : {0u, 1u}) {
+    responses_.clear();
+    SendStreamingQuery(kLongQuery, progress_interval_ms);
+
+    uint32_t progress_count = 0;
+    uint64_t last_elapsed_ns = 0;
+    uint64_t last_vm_steps = 0;
+    bool has_result = false;
+    int64_t count = 0;
+    int64_t last_seq = -1;
+    RpcStreamProto::Decoder stream(responses_.data(), responses_.size());
+    for (auto msg_it = stream.msg(); msg_it; ++msg_it) {
+      RpcProto::Decoder msg(msg_it->as_bytes());
+      ASSERT_EQ(msg.response(), RpcProto::TPM_QUERY_STREAMING);
+      ASSERT_TRUE(last_seq == -1 || msg.seq() == last_seq + 1);
+      last_seq = msg.seq();
+
+      ResultProto::Decoder result(msg.query_result());
+      ASSERT_EQ(result.error().ToStdString(), "");
+      if (result.has_progress()) {
+        // Progress updates are sent before the results.
+        ASSERT_FALSE(has_result);
+        ResultProto::Progress::Decoder progress(result.progress());
+        ASSERT_GE(progress.elapsed_ns(), last_elapsed_ns);
+        ASSERT_GE(progress.vm_steps(), last_vm_steps);
+        last_elapsed_ns = progress.elapsed_ns();
+        last_vm_steps = progress.vm_steps();
+        ++progress_count;
+        continue;
+      }
+      has_result = true;
+      for (auto batch_it = result.batch(); batch_it; ++batch_it) {
+        ResultProto::CellsBatch::Decoder batch(batch_it->as_bytes());
+        bool parse_error = false;
+        for (auto it = batch.varint_cells(&parse_error); it; ++it)
+          count = *it;
+        ASSERT_FALSE(parse_error);
+      }
+    }
+    ASSERT_TRUE(has_result);
+    ASSERT_EQ(count, kLongQueryRows);
+    if (progress_interval_ms) {
+      ASSERT_GT(progress_count, 0u);
+    } else {
+      ASSERT_EQ(progress_count, 0u);
+    }
+  }
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
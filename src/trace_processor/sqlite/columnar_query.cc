@@ -0,0 +1,414 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/sqlite/columnar_query.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "perfetto/ext/base/string_utils.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+// Integer literals with more digits than this may not fit in an int64_t; let
+// SQLite deal with them.
+constexpr size_t kMaxIntegerDigits = 18;
+
+struct Token {
+  enum class Type {
+    kIdentifier,
+    kInteger,
+    kFloat,
+    kString,
+    kPunctuation,
+    kEnd,
+  };
+  Type type = Type::kEnd;
+  std::string text;
+};
+
+// Minimal tokenizer for the subset of SQL accepted by ColumnarQuery. Any
+// input it does not understand (comments, quoted identifiers, blobs,
+// parameters etc.) makes it fail, causing the query to be given to SQLite.
+class Tokenizer {
+ public:
+  explicit Tokenizer(const std::string& sql) : sql_(sql) {}
+
+  bool Tokenize(std::vector<Token>* tokens) {
+    for (;;) {
+      while (pos_ < sql_.size() && isspace(Peek()))
+        pos_++;
+      Token token;
+      if (pos_ == sql_.size()) {
+        tokens->push_back(token);
+        return true;
+      }
+      if (!NextToken(&token))
+        return false;
+      tokens->push_back(std::move(token));
+    }
+  }
+
+ private:
+  bool NextToken(Token* token) {
+    char c = Peek();
+    size_t start = pos_;
+    if (isalpha(c) || c == '_') {
+      while (pos_ < sql_.size() && (isalnum(Peek()) || Peek() == '_'))
+        pos_++;
+      token->type = Token::Type::kIdentifier;
+      token->text = sql_.substr(start, pos_ - start);
+      return true;
+    }
+    if (isdigit(c) || (c == '.' && isdigit(Peek(1)))) {
+      token->type = Token::Type::kInteger;
+      while (isdigit(Peek()))
+        pos_++;
+      if (Peek() == '.') {
+        token->type = Token::Type::kFloat;
+        pos_++;
+        while (isdigit(Peek()))
+          pos_++;
+      }
+      if (Peek() == 'e' || Peek() == 'E') {
+        token->type = Token::Type::kFloat;
+        pos_++;
+        if (Peek() == '+' || Peek() == '-')
+          pos_++;
+        if (!isdigit(Peek()))
+          return false;
+        while (isdigit(Peek()))
+          pos_++;
+      }
+      // Reject things like hex literals or "1abc".
+      if (isalnum(Peek()) || Peek() == '_' || Peek() == '.')
+        return false;
+      token->text = sql_.substr(start, pos_ - start);
+      return true;
+    }
+    if (c == '\'') {
+      token->type = Token::Type::kString;
+      for (pos_++; pos_ < sql_.size(); pos_++) {
+        if (Peek() != '\'') {
+          token->text.push_back(Peek());
+          continue;
+        }
+        if (Peek(1) != '\'') {
+          pos_++;
+          return true;
+        }
+        token->text.push_back('\'');
+        pos_++;
+      }
+      return false;
+    }
+    static const char* const kPunctuation[] = {
+        "==", "!=", "<>", "<=", ">=", "=", "<", ">", ",", "*", ";", "-",
+    };
+    for (const char* p : kPunctuation) {
+      size_t len = strlen(p);
+      if (sql_.compare(pos_, len, p) == 0) {
+        token->type = Token::Type::kPunctuation;
+        token->text = p;
+        pos_ += len;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  char Peek(size_t offset = 0) const {
+    return pos_ + offset < sql_.size() ? sql_[pos_ + offset] : '\0';
+  }
+
+  const std::string& sql_;
+  size_t pos_ = 0;
+};
+
+class Parser {
+ public:
+  explicit Parser(std::vector<Token> tokens) : tokens_(std::move(tokens)) {}
+
+  bool IsKeyword(const char* keyword) const {
+    const Token& t = tokens_[pos_];
+    return t.type == Token::Type::kIdentifier &&
+           base::CaseInsensitiveEqual(t.text, keyword);
+  }
+
+  bool IsPunctuation(const char* p) const {
+    const Token& t = tokens_[pos_];
+    return t.type == Token::Type::kPunctuation && t.text == p;
+  }
+
+  bool ConsumeKeyword(const char* keyword) {
+    if (!IsKeyword(keyword))
+      return false;
+    pos_++;
+    return true;
+  }
+
+  bool ConsumePunctuation(const char* p) {
+    if (!IsPunctuation(p))
+      return false;
+    pos_++;
+    return true;
+  }
+
+  // Returns the next token if it is an identifier which is not one of the
+  // keywords with a meaning in the accepted grammar.
+  const Token* ConsumeIdentifier() {
+    static const char* const kKeywords[] = {
+        "all",  "and",   "as",     "between", "by",    "distinct",
+        "from", "glob",  "group",  "having",  "in",    "is",
+        "join", "like",  "limit",  "not",     "null",  "offset",
+        "or",   "order", "select", "union",   "where",
+    };
+    const Token& t = tokens_[pos_];
+    if (t.type != Token::Type::kIdentifier)
+      return nullptr;
+    for (const char* keyword : kKeywords) {
+      if (base::CaseInsensitiveEqual(t.text, keyword))
+        return nullptr;
+    }
+    pos_++;
+    return &t;
+  }
+
+  const Token* ConsumeToken() {
+    const Token* t = &tokens_[pos_];
+    if (t->type != Token::Type::kEnd)
+      pos_++;
+    return t;
+  }
+
+  bool AtEnd() const { return tokens_[pos_].type == Token::Type::kEnd; }
+
+ private:
+  std::vector<Token> tokens_;
+  size_t pos_ = 0;
+};
+
+base::Optional<uint32_t> FindColumn(const Table& table,
+                                    const std::string& name) {
+  for (uint32_t i = 0; i < table.GetColumnCount(); ++i) {
+    if (base::CaseInsensitiveEqual(table.GetColumn(i).name(), name))
+      return i;
+  }
+  return base::nullopt;
+}
+
+base::Optional<FilterOp> ParseOp(const std::string& op) {
+  if (op == "=" || op == "==")
+    return FilterOp::kEq;
+  if (op == "!=" || op == "<>")
+    return FilterOp::kNe;
+  if (op == "<")
+    return FilterOp::kLt;
+  if (op == "<=")
+    return FilterOp::kLe;
+  if (op == ">")
+    return FilterOp::kGt;
+  if (op == ">=")
+    return FilterOp::kGe;
+  return base::nullopt;
+}
+
+}  // namespace
+
+std::unique_ptr<ColumnarQuery> ColumnarQuery::Parse(
+    const std::string& sql,
+    const std::map<std::string, const Table*>& tables) {
+  std::vector<Token> tokens;
+  if (!Tokenizer(sql).Tokenize(&tokens))
+    return nullptr;
+  Parser parser(std::move(tokens));
+
+  if (!parser.ConsumeKeyword("select"))
+    return nullptr;
+
+  // The columns cannot be resolved until the table is known so just store
+  // their names for now. Aliases only change the names of the columns, which
+  // are computed by SQLite (see ColumnarQuery::sql()).
+  std::vector<std::string> projections;
+  bool select_all = parser.ConsumePunctuation("*");
+  if (!select_all) {
+    do {
+      const Token* col = parser.ConsumeIdentifier();
+      if (!col)
+        return nullptr;
+      if (parser.ConsumeKeyword("as") && !parser.ConsumeIdentifier())
+        return nullptr;
+      projections.push_back(col->text);
+    } while (parser.ConsumePunctuation(","));
+  }
+
+  if (!parser.ConsumeKeyword("from"))
+    return nullptr;
+  const Token* table_name = parser.ConsumeIdentifier();
+  if (!table_name)
+    return nullptr;
+  auto table_it = tables.find(base::ToLower(table_name->text));
+  if (table_it == tables.end())
+    return nullptr;
+
+  std::unique_ptr<ColumnarQuery> query(new ColumnarQuery());
+  const Table& table = *table_it->second;
+  query->sql_ = sql;
+  query->table_ = &table;
+
+  if (select_all) {
+    Table::Schema schema = table.ComputeSchema();
+    for (uint32_t i = 0; i < schema.columns.size(); ++i) {
+      if (schema.columns[i].is_hidden)
+        continue;
+      query->columns_.push_back(i);
+    }
+  } else {
+    for (const std::string& projection : projections) {
+      base::Optional<uint32_t> col = FindColumn(table, projection);
+      if (!col)
+        return nullptr;
+      query->columns_.push_back(*col);
+    }
+  }
+
+  if (parser.ConsumeKeyword("where")) {
+    do {
+      const Token* col_name = parser.ConsumeIdentifier();
+      if (!col_name)
+        return nullptr;
+      base::Optional<uint32_t> col = FindColumn(table, col_name->text);
+      if (!col)
+        return nullptr;
+
+      if (parser.ConsumeKeyword("is")) {
+        bool is_not = parser.ConsumeKeyword("not");
+        if (!parser.ConsumeKeyword("null"))
+          return nullptr;
+        query->constraints_.push_back(Constraint{
+            *col, is_not ? FilterOp::kIsNotNull : FilterOp::kIsNull,
+            SqlValue()});
+        continue;
+      }
+
+      const Token* op_token = parser.ConsumeToken();
+      if (op_token->type != Token::Type::kPunctuation)
+        return nullptr;
+      base::Optional<FilterOp> op = ParseOp(op_token->text);
+      if (!op)
+        return nullptr;
+
+      bool negative = parser.ConsumePunctuation("-");
+      const Token* literal = parser.ConsumeToken();
+      SqlValue value;
+      switch (literal->type) {
+        case Token::Type::kInteger: {
+          if (literal->text.size() > kMaxIntegerDigits)
+            return nullptr;
+          base::Optional<int64_t> parsed = base::StringToInt64(literal->text);
+          if (!parsed)
+            return nullptr;
+          value = SqlValue::Long(negative ? -*parsed : *parsed);
+          break;
+        }
+        case Token::Type::kFloat: {
+          base::Optional<double> parsed = base::StringToDouble(literal->text);
+          if (!parsed)
+            return nullptr;
+          value = SqlValue::Double(negative ? -*parsed : *parsed);
+          break;
+        }
+        case Token::Type::kString: {
+          if (negative)
+            return nullptr;
+          query->strings_.push_back(literal->text);
+          value = SqlValue::String(query->strings_.back().c_str());
+          break;
+        }
+        case Token::Type::kIdentifier:
+        case Token::Type::kPunctuation:
+        case Token::Type::kEnd:
+          return nullptr;
+      }
+
+      // Only accept literals of the same type as the column: SQLite would
+      // otherwise apply the affinity of the column to the literal before
+      // comparing.
+      bool is_string_col = table.GetColumn(*col).type() == SqlValue::kString;
+      if (is_string_col != (value.type == SqlValue::kString))
+        return nullptr;
+      query->constraints_.push_back(Constraint{*col, *op, value});
+    } while (parser.ConsumeKeyword("and"));
+  }
+
+  if (parser.ConsumeKeyword("limit")) {
+    const Token* limit = parser.ConsumeToken();
+    if (limit->type != Token::Type::kInteger)
+      return nullptr;
+    base::Optional<uint32_t> parsed = base::StringToUInt32(limit->text);
+    if (!parsed)
+      return nullptr;
+    query->limit_ = *parsed;
+  }
+
+  parser.ConsumePunctuation(";");
+  if (!parser.AtEnd())
+    return nullptr;
+  return query;
+}
+
+// static
+constexpr uint32_t ColumnarCursor::kBatchSize;
+
+ColumnarCursor::ColumnarCursor(std::unique_ptr<ColumnarQuery> query,
+                               const std::atomic<bool>* interrupted)
+    : query_(std::move(query)),
+      interrupted_(interrupted),
+      filtered_(query_->table().Filter(query_->constraints())) {
+  row_count_ = filtered_.row_count();
+  if (query_->limit())
+    row_count_ = std::min(row_count_, *query_->limit());
+  batches_.resize(query_->columns().size());
+}
+
+ColumnarCursor::~ColumnarCursor() = default;
+
+bool ColumnarCursor::NextBatch() {
+  batch_row_ = 0;
+  if (PERFETTO_UNLIKELY(interrupted_ && interrupted_->load())) {
+    status_ = base::ErrStatus("interrupted");
+    next_row_ = row_count_;
+  }
+  batch_row_count_ = std::min(kBatchSize, row_count_ - next_row_);
+  if (batch_row_count_ == 0)
+    return false;
+
+  for (uint32_t i = 0; i < batches_.size(); ++i) {
+    const Column& col = filtered_.GetColumn(query_->columns()[i]);
+    batches_[i].resize(batch_row_count_);
+    col.GetBatch(next_row_, batch_row_count_, batches_[i].data());
+  }
+  next_row_ += batch_row_count_;
+  return true;
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_SQLITE_COLUMNAR_QUERY_H_
+#define SRC_TRACE_PROCESSOR_SQLITE_COLUMNAR_QUERY_H_
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "perfetto/base/status.h"
+#include "perfetto/ext/base/optional.h"
+#include "src/trace_processor/db/table.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// A query which only projects and filters the columns of a single db Table.
+// Such queries can be executed directly on the columns of the table (see
+// ColumnarCursor) instead of going through SQLite, which avoids the cost of
+// calling into the virtual table and sqlite3_result_* for every cell.
+//
+// Only queries of the form
+//   SELECT (* | col [AS name], ...) FROM table
+//     [WHERE col op literal [AND col op literal ...]] [LIMIT n]
+// where op is one of =, ==, !=, <>, <, <=, >, >=, IS NULL or IS NOT NULL are
+// recognised; anything else should be executed by SQLite.
+class ColumnarQuery {
+ public:
+  // Returns the query if |sql| has the form above and names one of the
+  // |tables| or null otherwise.
+  static std::unique_ptr<ColumnarQuery> Parse(
+      const std::string& sql,
+      const std::map<std::string, const Table*>& tables);
+
+  // The text of the query. The names of the projected columns are not
+  // computed here: SQLite's spelling of them depends on its configuration, so
+  // they are asked to SQLite by preparing this query when needed.
+  const std::string& sql() const { return sql_; }
+
+  const Table& table() const { return *table_; }
+
+  // Indices of the projected columns in |table()|.
+  const std::vector<uint32_t>& columns() const { return columns_; }
+
+  const std::vector<Constraint>& constraints() const { return constraints_; }
+
+  const base::Optional<uint32_t>& limit() const { return limit_; }
+
+ private:
+  ColumnarQuery() = default;
+
+  std::string sql_;
+  const Table* table_ = nullptr;
+  std::vector<uint32_t> columns_;
+  std::vector<Constraint> constraints_;
+  base::Optional<uint32_t> limit_;
+
+  // Backing storage for the string values in |constraints_|. A deque is used
+  // as it does not move its elements when growing.
+  std::deque<std::string> strings_;
+};
+
+// Executes a ColumnarQuery, returning the rows in batches of |kBatchSize|
+// rows with one vector of values per column.
+//
+// If |interrupted| is not null, it is checked before filling each batch and
+// the iteration stops with an error once it is set, mirroring the effect of
+// sqlite3_interrupt on queries executed by SQLite.
+class ColumnarCursor {
+ public:
+  static constexpr uint32_t kBatchSize = 1024;
+
+  explicit ColumnarCursor(std::unique_ptr<ColumnarQuery> query,
+                          const std::atomic<bool>* interrupted = nullptr);
+  ~ColumnarCursor();
+
+  // Moves to the next row, returning false if there are no more rows.
+  bool Next() {
+    if (PERFETTO_LIKELY(batch_row_ + 1 < batch_row_count_)) {
+      batch_row_++;
+      return true;
+    }
+    return NextBatch();
+  }
+
+  // Returns the value of |col| in the current row.
+  SqlValue Get(uint32_t col) const { return batches_[col][batch_row_]; }
+
+  // Fills the column vectors with the next batch of rows, returning false if
+  // there are no more rows or the query was interrupted. After this call, the
+  // current row is the first row of the batch.
+  bool NextBatch();
+
+  // Returns the values of |col| for all the rows in the current batch.
+  const SqlValue* batch(uint32_t col) const { return batches_[col].data(); }
+
+  // Returns the number of rows in the current batch.
+  uint32_t batch_row_count() const { return batch_row_count_; }
+
+  uint32_t column_count() const {
+    return static_cast<uint32_t>(query_->columns().size());
+  }
+
+  const ColumnarQuery& query() const { return *query_; }
+
+  // Returns an error if the iteration stopped because the query was
+  // interrupted.
+  const base::Status& status() const { return status_; }
+
+ private:
+  std::unique_ptr<ColumnarQuery> query_;
+  const std::atomic<bool>* interrupted_ = nullptr;
+  base::Status status_;
+  Table filtered_;
+  uint32_t row_count_ = 0;
+
+  std::vector<std::vector<SqlValue>> batches_;
+  uint32_t next_row_ = 0;
+  uint32_t batch_row_ = 0;
+  uint32_t batch_row_count_ = 0;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_SQLITE_COLUMNAR_QUERY_H_
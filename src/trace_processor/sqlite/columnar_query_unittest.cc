@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/sqlite/columnar_query.h"
+
+#include "src/trace_processor/tables/macros.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+#define PERFETTO_TP_TEST_COLUMNAR_TABLE_DEF(NAME, PARENT, C) \
+  NAME(TestColumnarTable, "test_columnar")                  \
+  PARENT(PERFETTO_TP_ROOT_TABLE_PARENT_DEF, C)              \
+  C(int64_t, ts, Column::Flag::kSorted)                     \
+  C(base::Optional<int64_t>, dur)                           \
+  C(StringPool::Id, name)                                   \
+  C(uint32_t, arg, Column::Flag::kHidden)
+PERFETTO_TP_TABLE(PERFETTO_TP_TEST_COLUMNAR_TABLE_DEF);
+
+TestColumnarTable::~TestColumnarTable() = default;
+
+class ColumnarQueryTest : public ::testing::Test {
+ protected:
+  ColumnarQueryTest() : table_(&pool_, nullptr) {
+    tables_["test_columnar"] = &table_;
+    for (uint32_t i = 0; i < 3000; ++i) {
+      base::Optional<int64_t> dur;
+      if (i % 3 != 0)
+        dur = i * 10;
+      StringPool::Id name = pool_.InternString(i % 2 ? "odd" : "even");
+      table_.Insert(TestColumnarTable::Row(i, dur, name, i));
+    }
+  }
+
+  std::unique_ptr<ColumnarQuery> Parse(const std::string& sql) {
+    return ColumnarQuery::Parse(sql, tables_);
+  }
+
+  StringPool pool_;
+  TestColumnarTable table_;
+  std::map<std::string, const Table*> tables_;
+};
+
+TEST_F(ColumnarQueryTest, ParsesSimpleQueries) {
+  auto all = Parse("select * from test_columnar");
+  ASSERT_TRUE(all);
+  // Hidden columns are not part of *.
+  ASSERT_THAT(all->columns(), testing::ElementsAre(0u, 1u, 2u, 3u, 4u));
+  ASSERT_TRUE(all->constraints().empty());
+  ASSERT_FALSE(all->limit());
+
+  auto projected = Parse(
+      "SELECT TS, dur AS d FROM Test_Columnar "
+      "WHERE ts >= 10 AND name = 'it''s' AND dur IS NOT NULL LIMIT 5;");
+  ASSERT_TRUE(projected);
+  ASSERT_THAT(projected->columns(), testing::ElementsAre(2u, 3u));
+  ASSERT_EQ(projected->constraints().size(), 3u);
+  ASSERT_EQ(projected->constraints()[0].op, FilterOp::kGe);
+  ASSERT_EQ(projected->constraints()[0].value.AsLong(), 10);
+  ASSERT_STREQ(projected->constraints()[1].value.AsString(), "it's");
+  ASSERT_EQ(projected->constraints()[2].op, FilterOp::kIsNotNull);
+  ASSERT_EQ(*projected->limit(), 5u);
+
+  auto negative = Parse("select ts from test_columnar where dur > -1.5e2");
+  ASSERT_TRUE(negative);
+  ASSERT_DOUBLE_EQ(negative->constraints()[0].value.AsDouble(), -150);
+}
+
+TEST_F(ColumnarQueryTest, RejectsOtherQueries) {
+  ASSERT_FALSE(Parse("select * from other_table"));
+  ASSERT_FALSE(Parse("select missing from test_columnar"));
+  ASSERT_FALSE(Parse("select ts + 1 from test_columnar"));
+  ASSERT_FALSE(Parse("select count(*) from test_columnar"));
+  ASSERT_FALSE(Parse("select ts from test_columnar order by ts"));
+  ASSERT_FALSE(Parse("select ts from test_columnar where ts = 1 or ts = 2"));
+  ASSERT_FALSE(Parse("select ts from test_columnar where ts = '1'"));
+  ASSERT_FALSE(Parse("select ts from test_columnar where name = 1"));
+  ASSERT_FALSE(Parse("select ts from test_columnar where ts = 0x10"));
+  ASSERT_FALSE(Parse("select ts from test_columnar; select 1"));
+  ASSERT_FALSE(Parse("select ts from test_columnar -- comment"));
+  ASSERT_FALSE(Parse("select ts from test_columnar where ts = ?"));
+}
+
+TEST_F(ColumnarQueryTest, IteratesInBatches) {
+  ColumnarCursor cursor(Parse("select ts, dur, name from test_columnar"));
+  ASSERT_EQ(cursor.column_count(), 3u);
+
+  uint32_t rows = 0;
+  for (; cursor.Next(); ++rows) {
+    ASSERT_EQ(cursor.Get(0).AsLong(), rows);
+    if (rows % 3 == 0) {
+      ASSERT_TRUE(cursor.Get(1).is_null());
+    } else {
+      ASSERT_EQ(cursor.Get(1).AsLong(), rows * 10);
+    }
+    ASSERT_STREQ(cursor.Get(2).AsString(), rows % 2 ? "odd" : "even");
+  }
+  ASSERT_EQ(rows, 3000u);
+  ASSERT_FALSE(cursor.Next());
+}
+
+TEST_F(ColumnarQueryTest, FiltersAndLimits) {
+  ColumnarCursor cursor(
+      Parse("select id, ts from test_columnar where ts >= 1500 and "
+            "name = 'odd' and dur is not null and arg != 1601 limit 100"));
+  ASSERT_TRUE(cursor.NextBatch());
+  ASSERT_EQ(cursor.batch_row_count(), 100u);
+
+  // Odd rows which are not a multiple of 3 (null dur) and not 1601.
+  const SqlValue* ts = cursor.batch(1);
+  ASSERT_EQ(ts[0].AsLong(), 1501);
+  ASSERT_EQ(ts[1].AsLong(), 1505);
+  ASSERT_EQ(ts[2].AsLong(), 1507);
+  ASSERT_EQ(ts[3].AsLong(), 1511);
+  ASSERT_EQ(cursor.batch(0)[0].AsLong(), 1501);
+  ASSERT_FALSE(cursor.NextBatch());
+  ASSERT_TRUE(cursor.status().ok());
+}
+
+TEST_F(ColumnarQueryTest, StopsWhenInterrupted) {
+  std::atomic<bool> interrupted{false};
+  ColumnarCursor cursor(Parse("select ts from test_columnar"), &interrupted);
+  ASSERT_TRUE(cursor.NextBatch());
+  ASSERT_EQ(cursor.batch_row_count(), ColumnarCursor::kBatchSize);
+
+  // The current batch is still returned in full.
+  interrupted.store(true);
+  for (uint32_t i = 1; i < ColumnarCursor::kBatchSize; ++i)
+    ASSERT_TRUE(cursor.Next());
+  ASSERT_FALSE(cursor.Next());
+  ASSERT_FALSE(cursor.status().ok());
+
+  // Clearing the flag does not resume the query.
+  interrupted.store(false);
+  ASSERT_FALSE(cursor.NextBatch());
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -169,9 +169,16 @@ SqliteTable::Schema DbSqliteTable::ComputeSchema(const Table::Schema& schema,
 
 int DbSqliteTable::BestIndex(const QueryConstraints& qc, BestIndexInfo* info) {
   switch (computation_) {
-    case TableComputation::kStatic:
-      BestIndex(schema_, static_table_->row_count(), qc, info);
+    case TableComputation::kStatic: {
+      const std::vector<ColumnStats>* column_stats = nullptr;
+      if (cache_ && !qc.constraints().empty()) {
+        column_stats = &cache_->table_stats()->GetOrCompute(*static_table_);
+        if (column_stats->size() != schema_.columns.size())
+          column_stats = nullptr;
+      }
+      BestIndex(schema_, static_table_->row_count(), qc, info, column_stats);
       break;
+    }
     case TableComputation::kDynamic:
       base::Status status = generator_->ValidateConstraints(qc);
       if (!status.ok())
@@ -185,8 +192,10 @@ int DbSqliteTable::BestIndex(const QueryConstraints& qc, BestIndexInfo* info) {
 void DbSqliteTable::BestIndex(const Table::Schema& schema,
                               uint32_t row_count,
                               const QueryConstraints& qc,
-                              BestIndexInfo* info) {
-  auto cost_and_rows = EstimateCost(schema, row_count, qc);
+                              BestIndexInfo* info,
+                              const std::vector<ColumnStats>* column_stats) {
+  auto cost_and_rows = EstimateCost(schema, row_count, qc, column_stats,
+                                    &info->constraint_values);
   info->estimated_cost = cost_and_rows.cost;
   info->estimated_rows = cost_and_rows.rows;
 
@@ -270,7 +279,9 @@ void DbSqliteTable::ModifyConstraints(const Table::Schema& schema,
 DbSqliteTable::QueryCost DbSqliteTable::EstimateCost(
     const Table::Schema& schema,
     uint32_t row_count,
-    const QueryConstraints& qc) {
+    const QueryConstraints& qc,
+    const std::vector<ColumnStats>* column_stats,
+    const std::vector<base::Optional<SqlValue>>* constraint_values) {
   // Currently our cost estimation algorithm is quite simplistic but is good
   // enough for the simplest cases.
   // TODO(lalitm): replace hardcoded constants with either more heuristics
@@ -292,13 +303,68 @@ DbSqliteTable::QueryCost DbSqliteTable::EstimateCost(
   if (current_row_count == 0)
     return QueryCost{kFixedQueryCost, 0};
 
+  // Returns the number of rows expected to be left after filtering by the
+  // |i|-th constraint, based on the statistics of the column, or nullopt if
+  // the statistics don't say anything about it. Range constraints can only be
+  // estimated from the histogram when SQLite knows their value while planning
+  // the query (i.e. it is a literal rather than e.g. a column of a join).
+  const auto& cs = qc.constraints();
+  auto rows_from_stats = [column_stats, constraint_values, &cs](
+                             size_t i,
+                             uint32_t rows) -> base::Optional<uint32_t> {
+    if (!column_stats)
+      return base::nullopt;
+    const QueryConstraints::Constraint& c = cs[i];
+    const ColumnStats& stats = (*column_stats)[static_cast<uint32_t>(c.column)];
+    if (stats.row_count == 0)
+      return base::nullopt;
+    const base::Optional<SqlValue>* value = nullptr;
+    if (constraint_values && i < constraint_values->size() &&
+        (*constraint_values)[i]) {
+      value = &(*constraint_values)[i];
+    }
+
+    double non_null =
+        static_cast<double>(stats.row_count - stats.null_count) /
+        stats.row_count;
+    double distinct = std::max(stats.distinct_count, 1u);
+    double selectivity;
+    if (sqlite_utils::IsOpEq(c.op)) {
+      selectivity = non_null / distinct;
+    } else if (c.op == SQLITE_INDEX_CONSTRAINT_NE) {
+      selectivity = non_null * (1.0 - 1.0 / distinct);
+    } else if (c.op == SQLITE_INDEX_CONSTRAINT_ISNULL) {
+      selectivity = stats.null_fraction();
+    } else if (c.op == SQLITE_INDEX_CONSTRAINT_ISNOTNULL) {
+      selectivity = non_null;
+    } else if (value && (sqlite_utils::IsOpLt(c.op) ||
+                         sqlite_utils::IsOpLe(c.op))) {
+      base::Optional<double> below =
+          stats.FractionBelow(**value, sqlite_utils::IsOpLe(c.op));
+      if (!below)
+        return base::nullopt;
+      selectivity = non_null * *below;
+    } else if (value && (sqlite_utils::IsOpGt(c.op) ||
+                         sqlite_utils::IsOpGe(c.op))) {
+      base::Optional<double> not_above =
+          stats.FractionBelow(**value, sqlite_utils::IsOpGt(c.op));
+      if (!not_above)
+        return base::nullopt;
+      selectivity = non_null * (1.0 - *not_above);
+    } else {
+      return base::nullopt;
+    }
+    return std::max(static_cast<uint32_t>(rows * selectivity), 1u);
+  };
+
   // Setup the variables for estimating the cost of filtering.
   double filter_cost = 0.0;
-  const auto& cs = qc.constraints();
-  for (const auto& c : cs) {
+  for (size_t i = 0; i < cs.size(); ++i) {
     if (current_row_count < 2)
       break;
+    const auto& c = cs[i];
     const auto& col_schema = schema.columns[static_cast<uint32_t>(c.column)];
+    base::Optional<uint32_t> stats_rows = rows_from_stats(i, current_row_count);
     if (sqlite_utils::IsOpEq(c.op) && col_schema.is_id) {
       // If we have an id equality constraint, we can very efficiently filter
       // down to a single row in C++. However, if we're joining with another
@@ -320,11 +386,16 @@ DbSqliteTable::QueryCost DbSqliteTable::EstimateCost(
                          ? log2(current_row_count)
                          : current_row_count;
 
-      // As an extremely rough heuristic, assume that an equalty constraint will
-      // cut down the number of rows by approximately double log of the number
-      // of rows.
-      double estimated_rows = current_row_count / (2 * log2(current_row_count));
-      current_row_count = std::max(static_cast<uint32_t>(estimated_rows), 1u);
+      if (stats_rows) {
+        current_row_count = *stats_rows;
+      } else {
+        // As an extremely rough heuristic, assume that an equalty constraint
+        // will cut down the number of rows by approximately double log of the
+        // number of rows.
+        double estimated_rows =
+            current_row_count / (2 * log2(current_row_count));
+        current_row_count = std::max(static_cast<uint32_t>(estimated_rows), 1u);
+      }
     } else if (col_schema.is_sorted &&
                (sqlite_utils::IsOpLe(c.op) || sqlite_utils::IsOpLt(c.op) ||
                 sqlite_utils::IsOpGt(c.op) || sqlite_utils::IsOpGe(c.op))) {
@@ -333,16 +404,23 @@ DbSqliteTable::QueryCost DbSqliteTable::EstimateCost(
       // rows as a good approximation.
       filter_cost += log2(current_row_count);
 
-      // As an extremely rough heuristic, assume that an partition constraint
-      // will cut down the number of rows by approximately double log of the
-      // number of rows.
-      double estimated_rows = current_row_count / (2 * log2(current_row_count));
-      current_row_count = std::max(static_cast<uint32_t>(estimated_rows), 1u);
+      if (stats_rows) {
+        current_row_count = *stats_rows;
+      } else {
+        // As an extremely rough heuristic, assume that an partition constraint
+        // will cut down the number of rows by approximately double log of the
+        // number of rows.
+        double estimated_rows =
+            current_row_count / (2 * log2(current_row_count));
+        current_row_count = std::max(static_cast<uint32_t>(estimated_rows), 1u);
+      }
     } else {
-      // Otherwise, we will need to do a full table scan and we estimate we will
-      // maybe (at best) halve the number of rows.
+      // Otherwise, we will need to do a full table scan and, without
+      // statistics, we estimate we will maybe (at best) halve the number of
+      // rows.
       filter_cost += current_row_count;
-      current_row_count = std::max(current_row_count / 2u, 1u);
+      current_row_count =
+          stats_rows ? *stats_rows : std::max(current_row_count / 2u, 1u);
     }
   }
 
@@ -363,6 +441,45 @@ DbSqliteTable::QueryCost DbSqliteTable::EstimateCost(
   return QueryCost{final_cost, current_row_count};
 }
 
+void DbSqliteTable::MaybeCreateIndexes(const std::vector<Constraint>& cs) {
+  // Like the sorted cache of cursors, an index is only worth building for
+  // columns which are filtered repeatedly (e.g. by the inner side of a join)
+  // and whose table is large enough for a full scan to be noticeable.
+  constexpr uint32_t kRepeatedThreshold = 3;
+  constexpr uint32_t kMinRowCount = 1024;
+
+  // Each index uses around 12 bytes per row: bound the memory used by the
+  // indexes created automatically on a table.
+  constexpr uint32_t kMaxIndexedColumns = 4;
+
+  if (!cache_ || static_table_->row_count() < kMinRowCount)
+    return;
+
+  filter_counts_.resize(schema_.columns.size());
+  for (const Constraint& c : cs) {
+    const auto& col = static_table_->GetColumn(c.col_idx);
+    if (col.IsDummy() || col.IsId() || col.IsSorted() || col.HasIndex())
+      continue;
+
+    // Indexes on strings only support equality.
+    bool indexable_op = c.op == FilterOp::kEq;
+    if (col.type() != SqlValue::Type::kString) {
+      indexable_op |= c.op == FilterOp::kLt || c.op == FilterOp::kLe ||
+                      c.op == FilterOp::kGt || c.op == FilterOp::kGe;
+    }
+    if (!indexable_op)
+      continue;
+    if (++filter_counts_[c.col_idx] < kRepeatedThreshold)
+      continue;
+
+    uint32_t indexed_columns = 0;
+    for (const auto& other : static_table_->columns())
+      indexed_columns += other.HasIndex();
+    if (indexed_columns < kMaxIndexedColumns)
+      col.CreateIndex();
+  }
+}
+
 std::unique_ptr<SqliteTable::Cursor> DbSqliteTable::CreateCursor() {
   return std::unique_ptr<Cursor>(new Cursor(this, cache_));
 }
@@ -412,9 +529,12 @@ void DbSqliteTable::Cursor::TryCacheCreateSortedTable(
   if (!sqlite_utils::IsOpEq(c.op))
     return;
 
-  // If the column is already sorted, we don't need to cache at all.
+  // If the column is already sorted or has an index (see MaybeCreateIndexes),
+  // we don't need to cache at all: looking up the value in the index is as
+  // fast as in a sorted table and doesn't need another copy of the table.
   uint32_t col = static_cast<uint32_t>(c.column);
-  if (upstream_table_->GetColumn(col).IsSorted())
+  const auto& column = upstream_table_->GetColumn(col);
+  if (column.IsSorted() || column.HasIndex())
     return;
 
   // Try again to get the result or start caching it.
@@ -464,6 +584,11 @@ int DbSqliteTable::Cursor::Filter(const QueryConstraints& qc,
       // table.
       upstream_table_ = db_sqlite_table_->static_table_;
 
+      // Tries to create indexes on the columns which are filtered repeatedly.
+      // This happens first as no sorted cached table is created for columns
+      // with an index.
+      db_sqlite_table_->MaybeCreateIndexes(constraints_);
+
       // Tries to create a sorted cached table which can be used to speed up
       // filters below.
       TryCacheCreateSortedTable(qc, history);
@@ -599,6 +724,8 @@ int DbSqliteTable::Cursor::Filter(const QueryConstraints& qc,
     eof_ = !*iterator_;
   }
 
+  if (cache_ && !eof_)
+    cache_->RecordRowsScanned(1);
   return SQLITE_OK;
 }
 
@@ -609,6 +736,8 @@ int DbSqliteTable::Cursor::Next() {
     iterator_->Next();
     eof_ = !*iterator_;
   }
+  if (cache_ && !eof_)
+    cache_->RecordRowsScanned(1);
   return SQLITE_OK;
 }
 
@@ -18,6 +18,7 @@
 #define SRC_TRACE_PROCESSOR_SQLITE_DB_SQLITE_TABLE_H_
 
 #include "src/trace_processor/containers/bit_vector.h"
+#include "src/trace_processor/db/column_stats.h"
 #include "src/trace_processor/db/table.h"
 #include "src/trace_processor/dynamic/dynamic_table_generator.h"
 #include "src/trace_processor/sqlite/query_cache.h"
@@ -146,17 +147,32 @@ class DbSqliteTable : public SqliteTable {
   static SqliteTable::Schema ComputeSchema(const Table::Schema&,
                                            const char* table_name);
   static void ModifyConstraints(const Table::Schema&, QueryConstraints*);
-  static void BestIndex(const Table::Schema&,
-                        uint32_t row_count,
-                        const QueryConstraints&,
-                        BestIndexInfo*);
+  static void BestIndex(
+      const Table::Schema&,
+      uint32_t row_count,
+      const QueryConstraints&,
+      BestIndexInfo*,
+      const std::vector<ColumnStats>* column_stats = nullptr);
 
   // static for testing.
-  static QueryCost EstimateCost(const Table::Schema&,
-                                uint32_t row_count,
-                                const QueryConstraints& qc);
+  // |column_stats|, if not null, contains the statistics of each column in
+  // |schema| and is used to estimate the number of rows matching the
+  // constraints. |constraint_values|, if not null, contains the value of each
+  // constraint in |qc| when known (see BestIndexInfo::constraint_values) and
+  // is used with |column_stats| to estimate range constraints.
+  static QueryCost EstimateCost(
+      const Table::Schema&,
+      uint32_t row_count,
+      const QueryConstraints& qc,
+      const std::vector<ColumnStats>* column_stats = nullptr,
+      const std::vector<base::Optional<SqlValue>>* constraint_values =
+          nullptr);
 
  private:
+  // Creates indexes on the columns of |static_table_| which are filtered
+  // repeatedly by |cs| (see Column::CreateIndex).
+  void MaybeCreateIndexes(const std::vector<Constraint>& cs);
+
   QueryCache* cache_ = nullptr;
   Table::Schema schema_;
 
@@ -165,6 +181,10 @@ class DbSqliteTable : public SqliteTable {
   // Only valid when computation_ == TableComputation::kStatic.
   const Table* static_table_ = nullptr;
 
+  // Only valid when computation_ == TableComputation::kStatic.
+  // The number of filters seen on each column of |static_table_|.
+  std::vector<uint32_t> filter_counts_;
+
   // Only valid when computation_ == TableComputation::kDynamic.
   std::unique_ptr<DynamicTableGenerator> generator_;
 };
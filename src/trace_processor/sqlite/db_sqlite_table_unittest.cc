@@ -158,6 +158,76 @@ TEST(DbSqliteTable, OrderByOnSortedCheaper) {
   ASSERT_EQ(sorted_cost.rows, a_cost.rows);
 }
 
+TEST(DbSqliteTable, ColumnStatsSelectivity) {
+  auto schema = CreateSchema();
+  constexpr uint32_t kRowCount = 10000;
+
+  // test2 has few distinct values while test3 is almost unique and mostly
+  // null.
+  std::vector<ColumnStats> stats(schema.columns.size());
+  for (ColumnStats& col_stats : stats) {
+    col_stats.row_count = kRowCount;
+    col_stats.distinct_count = kRowCount;
+  }
+  stats[3].distinct_count = 4;
+  stats[4].distinct_count = 1000;
+  stats[4].null_count = 9000;
+
+  QueryConstraints test2_eq;
+  test2_eq.AddConstraint(3u, SQLITE_INDEX_CONSTRAINT_EQ, 0u);
+  auto test2_cost =
+      DbSqliteTable::EstimateCost(schema, kRowCount, test2_eq, &stats);
+  ASSERT_EQ(test2_cost.rows, 2500u);
+
+  QueryConstraints test3_eq;
+  test3_eq.AddConstraint(4u, SQLITE_INDEX_CONSTRAINT_EQ, 0u);
+  auto test3_cost =
+      DbSqliteTable::EstimateCost(schema, kRowCount, test3_eq, &stats);
+  ASSERT_EQ(test3_cost.rows, 1u);
+  ASSERT_LT(test3_cost.cost, test2_cost.cost);
+
+  QueryConstraints test3_not_null;
+  test3_not_null.AddConstraint(4u, SQLITE_INDEX_CONSTRAINT_ISNOTNULL, 0u);
+  auto not_null_cost =
+      DbSqliteTable::EstimateCost(schema, kRowCount, test3_not_null, &stats);
+  ASSERT_EQ(not_null_cost.rows, 1000u);
+}
+
+TEST(DbSqliteTable, ColumnStatsRangeSelectivity) {
+  auto schema = CreateSchema();
+  constexpr uint32_t kRowCount = 10000;
+
+  // The values of test2 are uniformly distributed in [0, 1000].
+  std::vector<ColumnStats> stats(schema.columns.size());
+  for (ColumnStats& col_stats : stats) {
+    col_stats.row_count = kRowCount;
+    col_stats.distinct_count = kRowCount;
+  }
+  for (int64_t i = 0; i <= 10; ++i)
+    stats[3].histogram.push_back(SqlValue::Long(i * 100));
+
+  QueryConstraints test2_lt;
+  test2_lt.AddConstraint(3u, SQLITE_INDEX_CONSTRAINT_LT, 0u);
+  std::vector<base::Optional<SqlValue>> values = {SqlValue::Long(250)};
+  auto lt_cost = DbSqliteTable::EstimateCost(schema, kRowCount, test2_lt,
+                                             &stats, &values);
+  ASSERT_EQ(lt_cost.rows, 2500u);
+
+  QueryConstraints test2_ge;
+  test2_ge.AddConstraint(3u, SQLITE_INDEX_CONSTRAINT_GE, 0u);
+  values = {SqlValue::Double(900.0)};
+  auto ge_cost = DbSqliteTable::EstimateCost(schema, kRowCount, test2_ge,
+                                             &stats, &values);
+  ASSERT_NEAR(ge_cost.rows, 1000u, 1);
+  ASSERT_LT(ge_cost.cost, lt_cost.cost);
+
+  // Without the value of the constraint, the fixed heuristic is used.
+  values = {base::nullopt};
+  auto unknown_cost = DbSqliteTable::EstimateCost(schema, kRowCount, test2_ge,
+                                                  &stats, &values);
+  ASSERT_EQ(unknown_cost.rows, kRowCount / 2);
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -19,6 +19,7 @@
 
 #include "perfetto/ext/base/optional.h"
 
+#include "src/trace_processor/db/column_stats.h"
 #include "src/trace_processor/db/table.h"
 #include "src/trace_processor/sqlite/query_constraints.h"
 
@@ -64,6 +65,23 @@ class QueryCache {
     return cached_.table;
   }
 
+  // Drops everything cached for |source|, which is about to be destroyed.
+  void Invalidate(const Table* source) {
+    if (cached_.source == source)
+      cached_ = CachedTable();
+    table_stats_.Erase(source);
+  }
+
+  // Returns the cache of the column statistics of the tables queried through
+  // the same connection, used to estimate the cost of queries.
+  TableStatsCache* table_stats() { return &table_stats_; }
+
+  // Counts the rows returned to SQLite by the cursors of the tables queried
+  // through the same connection, i.e. after the filters on the table have been
+  // applied natively. Used for the rows_scanned column of sqlstats.
+  void RecordRowsScanned(uint64_t rows) { rows_scanned_ += rows; }
+  uint64_t rows_scanned() const { return rows_scanned_; }
+
  private:
   struct CachedTable {
     std::shared_ptr<Table> table;
@@ -73,6 +91,8 @@ class QueryCache {
   };
 
   CachedTable cached_;
+  TableStatsCache table_stats_;
+  uint64_t rows_scanned_ = 0;
 };
 
 }  // namespace trace_processor
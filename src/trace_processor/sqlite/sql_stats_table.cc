@@ -45,6 +45,14 @@ base::Status SqlStatsTable::Init(int, const char* const*, Schema* schema) {
                               SqlValue::Type::kLong),
           SqliteTable::Column(Column::kTimeEnded, "ended",
                               SqlValue::Type::kLong),
+          SqliteTable::Column(Column::kCpuTime, "cpu_time",
+                              SqlValue::Type::kLong),
+          SqliteTable::Column(Column::kVmSteps, "vm_steps",
+                              SqlValue::Type::kLong),
+          SqliteTable::Column(Column::kRowsReturned, "rows_returned",
+                              SqlValue::Type::kLong),
+          SqliteTable::Column(Column::kRowsScanned, "rows_scanned",
+                              SqlValue::Type::kLong),
       },
       {Column::kTimeStarted});
   return util::OkStatus();
@@ -96,6 +104,18 @@ int SqlStatsTable::Cursor::Column(sqlite3_context* context, int col) {
     case Column::kTimeEnded:
       sqlite3_result_int64(context, stats.times_ended()[row_]);
       break;
+    case Column::kCpuTime:
+      sqlite3_result_int64(context, stats.cpu_times()[row_]);
+      break;
+    case Column::kVmSteps:
+      sqlite3_result_int64(context, stats.vm_steps()[row_]);
+      break;
+    case Column::kRowsReturned:
+      sqlite3_result_int64(context, stats.rows_returned()[row_]);
+      break;
+    case Column::kRowsScanned:
+      sqlite3_result_int64(context, stats.rows_scanned()[row_]);
+      break;
   }
   return SQLITE_OK;
 }
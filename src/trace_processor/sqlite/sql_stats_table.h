@@ -37,6 +37,10 @@ class SqlStatsTable : public SqliteTable {
     kTimeStarted = 1,
     kTimeFirstNext = 2,
     kTimeEnded = 3,
+    kCpuTime = 4,
+    kVmSteps = 5,
+    kRowsReturned = 6,
+    kRowsScanned = 7,
   };
 
   // Implementation of the SQLite cursor interface.
@@ -22,6 +22,7 @@
 #include <map>
 
 #include "perfetto/base/logging.h"
+#include "src/trace_processor/sqlite/sqlite_utils.h"
 
 namespace perfetto {
 namespace trace_processor {
@@ -116,6 +117,24 @@ bool SqliteTable::debug = false;
 SqliteTable::SqliteTable() = default;
 SqliteTable::~SqliteTable() = default;
 
+// static
+void SqliteTable::Unregister(sqlite3* db, const std::string& table_name) {
+  // Registering a null module removes the module with this name.
+  int res = sqlite3_create_module_v2(db, table_name.c_str(), nullptr, nullptr,
+                                     nullptr);
+  PERFETTO_CHECK(res == SQLITE_OK);
+
+  char* delete_sql = sqlite3_mprintf(
+      "DELETE FROM perfetto_tables WHERE name = '%q'", table_name.c_str());
+  char* error = nullptr;
+  sqlite3_exec(db, delete_sql, nullptr, nullptr, &error);
+  sqlite3_free(delete_sql);
+  if (error) {
+    PERFETTO_ELOG("Error unregistering table: %s", error);
+    sqlite3_free(error);
+  }
+}
+
 int SqliteTable::OpenInternal(sqlite3_vtab_cursor** ppCursor) {
   // Freed in xClose().
   *ppCursor = static_cast<sqlite3_vtab_cursor*>(CreateCursor().release());
@@ -147,6 +166,17 @@ int SqliteTable::BestIndexInternal(sqlite3_index_info* idx) {
   info.estimated_rows = idx->estimatedRows;
   info.sqlite_omit_constraint.resize(qc.constraints().size());
 
+  // SQLite knows the values of the constraints which are literals: these make
+  // it possible to estimate the selectivity of range constraints.
+  info.constraint_values.resize(qc.constraints().size());
+  for (uint32_t i = 0; i < qc.constraints().size(); ++i) {
+    sqlite3_value* value = nullptr;
+    int res = sqlite3_vtab_rhs_value(idx, qc.constraints()[i].a_constraint_idx,
+                                     &value);
+    if (res == SQLITE_OK && value)
+      info.constraint_values[i] = sqlite_utils::SqliteValueToSqlValue(value);
+  }
+
   ret = BestIndex(qc, &info);
 
   if (ret != SQLITE_OK)
@@ -73,6 +73,10 @@ class SqliteTable : public sqlite3_vtab {
   // Public for unique_ptr destructor calls.
   virtual ~SqliteTable();
 
+  // Removes a table registered with Register(). The table object is
+  // destroyed once the statements using it are finalized.
+  static void Unregister(sqlite3* db, const std::string& table_name);
+
   // Abstract base class representing an SQLite Cursor. Presents a friendlier
   // API for subclasses to implement.
   class Cursor : public sqlite3_vtab_cursor {
@@ -176,6 +180,13 @@ class SqliteTable : public sqlite3_vtab {
 
     // Estimated row count.
     int64_t estimated_rows = 0;
+
+    // The values of the right-hand side of the constraints, in the same order
+    // as QueryConstraints::constraints(), or nullopt if they are not known
+    // while planning the query (e.g. they come from a join). Filled in before
+    // BestIndex is called: strings and bytes are owned by SQLite and only
+    // valid until BestIndex returns.
+    std::vector<base::Optional<SqlValue>> constraint_values;
   };
 
   template <typename Context>
@@ -20,19 +20,33 @@
 // chasing of what an upper-bound can be for a virtual table implementation.
 
 #include <array>
+#include <map>
+#include <memory>
 #include <random>
 
 #include <benchmark/benchmark.h>
 #include <sqlite3.h>
 
 #include "perfetto/base/compiler.h"
+#include "src/trace_processor/containers/string_pool.h"
+#include "src/trace_processor/db/runtime_table.h"
+#include "src/trace_processor/sqlite/columnar_query.h"
+#include "src/trace_processor/sqlite/db_sqlite_table.h"
+#include "src/trace_processor/sqlite/query_cache.h"
 #include "src/trace_processor/sqlite/scoped_db.h"
 
 namespace {
 
 using benchmark::Counter;
+using perfetto::trace_processor::ColumnarCursor;
+using perfetto::trace_processor::ColumnarQuery;
+using perfetto::trace_processor::DbSqliteTable;
+using perfetto::trace_processor::QueryCache;
+using perfetto::trace_processor::RuntimeTable;
 using perfetto::trace_processor::ScopedDb;
 using perfetto::trace_processor::ScopedStmt;
+using perfetto::trace_processor::StringPool;
+using perfetto::trace_processor::Table;
 
 bool IsBenchmarkFunctionalOnly() {
   return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
@@ -267,4 +281,98 @@ static void BM_SqliteCountOne(benchmark::State& state) {
 
 BENCHMARK(BM_SqliteCountOne)->Apply(SizeBenchmarkArgs);
 
+// Creates a db Table with |num_cols| integer columns and |rows| rows.
+std::unique_ptr<RuntimeTable> CreateDbTable(StringPool* pool,
+                                            size_t num_cols,
+                                            size_t rows) {
+  std::vector<std::string> col_names;
+  for (size_t col = 0; col < num_cols; col++)
+    col_names.push_back("c" + std::to_string(col));
+  std::unique_ptr<RuntimeTable> table(new RuntimeTable(pool, col_names));
+
+  std::minstd_rand0 rnd_engine(476);
+  for (size_t row = 0; row < rows; row++) {
+    for (uint32_t col = 0; col < num_cols; col++) {
+      auto value = static_cast<int64_t>(rnd_engine());
+      PERFETTO_CHECK(table->AddInteger(col, value).ok());
+    }
+  }
+  PERFETTO_CHECK(
+      table->AddColumnsAndOverlays(static_cast<uint32_t>(rows)).ok());
+  return table;
+}
+
+// Reads all the cells of a db Table through its SQLite virtual table, i.e. the
+// path taken by TraceProcessor::ExecuteQuery for queries on db tables.
+static void BM_DbTableSqliteStepAndResult(benchmark::State& state) {
+  size_t rows = static_cast<size_t>(state.range(0));
+  size_t num_cols = static_cast<size_t>(state.range(1));
+
+  StringPool pool;
+  std::unique_ptr<RuntimeTable> table = CreateDbTable(&pool, num_cols, rows);
+
+  sqlite3_initialize();
+  ScopedDb db;
+  sqlite3* raw_db = nullptr;
+  PERFETTO_CHECK(sqlite3_open(":memory:", &raw_db) == SQLITE_OK);
+  db.reset(raw_db);
+
+  QueryCache cache;
+  DbSqliteTable::RegisterTable(*db, &cache, table->ComputeSchema(),
+                               table.get(), "benchmark");
+
+  ScopedStmt stmt;
+  sqlite3_stmt* raw_stmt;
+  std::string sql = "SELECT * from benchmark";
+  int err = sqlite3_prepare_v2(*db, sql.c_str(), static_cast<int>(sql.size()),
+                               &raw_stmt, nullptr);
+  PERFETTO_CHECK(err == SQLITE_OK);
+  stmt.reset(raw_stmt);
+
+  int col_count = sqlite3_column_count(*stmt);
+  for (auto _ : state) {
+    sqlite3_reset(raw_stmt);
+    while (sqlite3_step(*stmt) == SQLITE_ROW) {
+      for (int col = 0; col < col_count; col++) {
+        benchmark::DoNotOptimize(sqlite3_column_int64(*stmt, col));
+      }
+    }
+  }
+
+  state.counters["s/row"] =
+      Counter(static_cast<double>(rows),
+              Counter::kIsIterationInvariantRate | Counter::kInvert);
+}
+
+BENCHMARK(BM_DbTableSqliteStepAndResult)->Apply(BenchmarkArgs);
+
+// Reads all the cells of the same db Table as above using ColumnarCursor,
+// i.e. the path taken by TraceProcessor::ExecuteQuery when the query can be
+// executed directly on the columns of the table.
+static void BM_DbTableColumnarCursor(benchmark::State& state) {
+  size_t rows = static_cast<size_t>(state.range(0));
+  size_t num_cols = static_cast<size_t>(state.range(1));
+
+  StringPool pool;
+  std::unique_ptr<RuntimeTable> table = CreateDbTable(&pool, num_cols, rows);
+  std::map<std::string, const Table*> tables{{"benchmark", table.get()}};
+
+  for (auto _ : state) {
+    ColumnarCursor cursor(
+        ColumnarQuery::Parse("SELECT * from benchmark", tables));
+    uint32_t col_count = cursor.column_count();
+    while (cursor.Next()) {
+      for (uint32_t col = 0; col < col_count; col++) {
+        benchmark::DoNotOptimize(cursor.Get(col).long_value);
+      }
+    }
+  }
+
+  state.counters["s/row"] =
+      Counter(static_cast<double>(rows),
+              Counter::kIsIterationInvariantRate | Counter::kInvert);
+}
+
+BENCHMARK(BM_DbTableColumnarCursor)->Apply(BenchmarkArgs);
+
 }  // namespace
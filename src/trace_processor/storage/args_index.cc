@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/storage/args_index.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace perfetto {
+namespace trace_processor {
+
+// static
+constexpr uint32_t ArgsIndex::kDenseKeyMinFraction;
+// static
+constexpr uint32_t ArgsIndex::kMaxDenseKeys;
+// static
+constexpr uint32_t ArgsIndex::kNoRow;
+
+ArgsIndex::ArgsIndex(const tables::ArgTable& args)
+    : row_count_(args.row_count()) {
+  if (row_count_ == 0)
+    return;
+
+  // Arg set ids are allocated densely so they can index vectors directly.
+  uint32_t arg_set_count = args.arg_set_id()[row_count_ - 1] + 1;
+  set_start_.resize(arg_set_count + 1);
+
+  base::FlatHashMap<StringPool::Id, uint32_t> key_counts;
+  for (uint32_t row = 0; row < row_count_; ++row) {
+    uint32_t arg_set_id = args.arg_set_id()[row];
+    StringPool::Id key = args.key()[row];
+    set_start_[arg_set_id + 1]++;
+    key_counts[key]++;
+
+    // The args of an arg set are sorted by key so duplicate keys are in
+    // consecutive rows.
+    PERFETTO_DCHECK(row == 0 || args.arg_set_id()[row - 1] <= arg_set_id);
+    if (row > 0 && args.arg_set_id()[row - 1] == arg_set_id &&
+        args.key()[row - 1] == key) {
+      has_duplicate_keys_ = true;
+    }
+  }
+  for (uint32_t i = 0; i < arg_set_count; ++i)
+    set_start_[i + 1] += set_start_[i];
+
+  std::vector<std::pair<uint32_t, StringPool::Id>> frequent_keys;
+  for (auto it = key_counts.GetIterator(); it; ++it) {
+    if (it.value() * kDenseKeyMinFraction >= arg_set_count)
+      frequent_keys.emplace_back(it.value(), it.key());
+  }
+  std::sort(frequent_keys.begin(), frequent_keys.end(),
+            [](const std::pair<uint32_t, StringPool::Id>& a,
+               const std::pair<uint32_t, StringPool::Id>& b) {
+              if (a.first != b.first)
+                return a.first > b.first;
+              return a.second.raw_id() < b.second.raw_id();
+            });
+  if (frequent_keys.size() > kMaxDenseKeys)
+    frequent_keys.resize(kMaxDenseKeys);
+  if (frequent_keys.empty())
+    return;
+
+  for (const auto& count_and_key : frequent_keys) {
+    dense_key_idx_.Insert(count_and_key.second,
+                          static_cast<uint32_t>(dense_rows_.size()));
+    dense_rows_.emplace_back(arg_set_count, kNoRow);
+  }
+  for (uint32_t row = 0; row < row_count_; ++row) {
+    uint32_t* dense_idx = dense_key_idx_.Find(args.key()[row]);
+    if (!dense_idx)
+      continue;
+    uint32_t& dense_row = dense_rows_[*dense_idx][args.arg_set_id()[row]];
+    if (dense_row == kNoRow)
+      dense_row = row;
+  }
+}
+
+ArgsIndex::~ArgsIndex() = default;
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_STORAGE_ARGS_INDEX_H_
+#define SRC_TRACE_PROCESSOR_STORAGE_ARGS_INDEX_H_
+
+#include <stdint.h>
+
+#include <limits>
+#include <vector>
+
+#include "perfetto/ext/base/flat_hash_map.h"
+#include "perfetto/ext/base/optional.h"
+#include "src/trace_processor/containers/string_pool.h"
+#include "src/trace_processor/tables/metadata_tables.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Index to find the arg with a given key in an arg set of the arg table
+// without filtering the whole table.
+//
+// The args of each arg set are stored in consecutive rows (the arg_set_id
+// column is sorted) so the index remembers the first row of each arg set: the
+// arg is then found by scanning the few args of its arg set. On top of this,
+// the keys used by many arg sets (e.g. an arg set on every slice of a kind)
+// get a dense column storing, for each arg set id, the row of the arg with
+// this key: looking up these keys is O(1).
+//
+// All the methods of this class operate on row numbers of the arg table.
+class ArgsIndex {
+ public:
+  // Keys which are in at least 1/|kDenseKeyMinFraction| of the arg sets get
+  // a dense column, up to |kMaxDenseKeys| of them.
+  static constexpr uint32_t kDenseKeyMinFraction = 8;
+  static constexpr uint32_t kMaxDenseKeys = 32;
+
+  // Builds the index for all the rows in |args|.
+  explicit ArgsIndex(const tables::ArgTable& args);
+  ~ArgsIndex();
+
+  // Returns the number of rows of the arg table when the index was built.
+  uint32_t row_count() const { return row_count_; }
+
+  // Returns whether an arg set contains several args with the same key. The
+  // index only returns one of them in this case.
+  bool has_duplicate_keys() const { return has_duplicate_keys_; }
+
+  // Returns the row of |args| holding the arg of |arg_set_id| with |key| or
+  // base::nullopt if there is no such arg. |args| must be the table the
+  // index was built for.
+  base::Optional<uint32_t> Find(const tables::ArgTable& args,
+                                uint32_t arg_set_id,
+                                StringPool::Id key) const {
+    // |set_start_| has one more entry than there are arg set ids. Computing
+    // |arg_set_id| + 1 instead would wrap for the largest ids.
+    if (set_start_.empty() || arg_set_id >= set_start_.size() - 1)
+      return base::nullopt;
+
+    uint32_t* dense_idx = dense_key_idx_.Find(key);
+    if (dense_idx) {
+      uint32_t row = dense_rows_[*dense_idx][arg_set_id];
+      return row == kNoRow ? base::nullopt : base::make_optional(row);
+    }
+    for (uint32_t row = set_start_[arg_set_id];
+         row < set_start_[arg_set_id + 1]; ++row) {
+      if (args.key()[row] == key)
+        return row;
+    }
+    return base::nullopt;
+  }
+
+  // Returns the number of keys with a dense column.
+  uint32_t dense_key_count() const {
+    return static_cast<uint32_t>(dense_rows_.size());
+  }
+
+ private:
+  static constexpr uint32_t kNoRow = std::numeric_limits<uint32_t>::max();
+
+  uint32_t row_count_ = 0;
+  bool has_duplicate_keys_ = false;
+
+  // The first row of each arg set id, followed by |row_count_|.
+  std::vector<uint32_t> set_start_;
+
+  // For each key with a dense column, the index of the column in
+  // |dense_rows_|. Each column stores, for each arg set id, the row of the
+  // arg with the key or kNoRow.
+  base::FlatHashMap<StringPool::Id, uint32_t> dense_key_idx_;
+  std::vector<std::vector<uint32_t>> dense_rows_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_STORAGE_ARGS_INDEX_H_
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/storage/args_index.h"
+
+#include <limits>
+
+#include "src/trace_processor/storage/trace_storage.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+class ArgsIndexTest : public ::testing::Test {
+ protected:
+  // Adds an int arg: arg set ids must be added in increasing order and the
+  // keys of each arg set in sorted order.
+  void AddArg(uint32_t arg_set_id, const char* key, int64_t value) {
+    tables::ArgTable::Row row;
+    row.arg_set_id = arg_set_id;
+    row.key = row.flat_key = storage_.InternString(key);
+    row.int_value = value;
+    row.value_type = storage_.GetIdForVariadicType(Variadic::Type::kInt);
+    storage_.mutable_arg_table()->Insert(row);
+  }
+
+  base::Optional<int64_t> Extract(uint32_t arg_set_id, const char* key) {
+    base::Optional<Variadic> value;
+    EXPECT_TRUE(storage_.ExtractArg(arg_set_id, key, &value).ok());
+    if (!value)
+      return base::nullopt;
+    EXPECT_EQ(value->type, Variadic::Type::kInt);
+    return value->int_value;
+  }
+
+  TraceStorage storage_;
+};
+
+TEST_F(ArgsIndexTest, DenseAndSparseKeys) {
+  // "common" is in every arg set and gets a dense column while "rare" is only
+  // in one arg set out of 100.
+  for (uint32_t i = 1; i <= 100; ++i) {
+    AddArg(i, "common", i * 10);
+    if (i % 100 == 50)
+      AddArg(i, "rare", i);
+    if (i % 2 == 0)
+      AddArg(i, "z_even", i * 2);
+  }
+
+  ASSERT_EQ(storage_.args_index().dense_key_count(), 2u);
+  ASSERT_FALSE(storage_.args_index().has_duplicate_keys());
+
+  ASSERT_EQ(Extract(1, "common"), 10);
+  ASSERT_EQ(Extract(100, "common"), 1000);
+  ASSERT_EQ(Extract(50, "rare"), 50);
+  ASSERT_EQ(Extract(51, "rare"), base::nullopt);
+  ASSERT_EQ(Extract(4, "z_even"), 8);
+  ASSERT_EQ(Extract(5, "z_even"), base::nullopt);
+  ASSERT_EQ(Extract(5, "unknown"), base::nullopt);
+  ASSERT_EQ(Extract(0, "common"), base::nullopt);
+  ASSERT_EQ(Extract(101, "common"), base::nullopt);
+  ASSERT_EQ(Extract(std::numeric_limits<uint32_t>::max(), "common"),
+            base::nullopt);
+  ASSERT_EQ(Extract(std::numeric_limits<uint32_t>::max(), "rare"),
+            base::nullopt);
+}
+
+TEST_F(ArgsIndexTest, EmptyTable) {
+  // Intern the key so that the lookup reaches the index.
+  storage_.InternString("a");
+  ASSERT_EQ(Extract(0, "a"), base::nullopt);
+  ASSERT_EQ(Extract(std::numeric_limits<uint32_t>::max(), "a"), base::nullopt);
+}
+
+TEST_F(ArgsIndexTest, RebuiltWhenArgsAdded) {
+  AddArg(1, "a", 1);
+  ASSERT_EQ(Extract(1, "a"), 1);
+  ASSERT_EQ(Extract(2, "a"), base::nullopt);
+
+  AddArg(2, "a", 2);
+  ASSERT_EQ(storage_.args_index().row_count(), 2u);
+  ASSERT_EQ(Extract(2, "a"), 2);
+}
+
+TEST_F(ArgsIndexTest, DuplicateKeys) {
+  AddArg(1, "a", 1);
+  AddArg(1, "a", 2);
+  ASSERT_TRUE(storage_.args_index().has_duplicate_keys());
+
+  base::Optional<Variadic> value;
+  ASSERT_FALSE(storage_.ExtractArg(1, "a", &value).ok());
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/storage/slice_tree_index.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace perfetto {
+namespace trace_processor {
+
+// static
+constexpr uint32_t SliceTreeIndex::kNoParent;
+
+SliceTreeIndex::SliceTreeIndex(const tables::SliceTable& slices) {
+  const uint32_t row_count = slices.row_count();
+  parent_.resize(row_count, kNoParent);
+  pre_.resize(row_count, kNoParent);
+  end_.resize(row_count, kNoParent);
+  rows_by_pre_.resize(row_count);
+
+  // Store the children of each slice contiguously, in row order.
+  std::vector<uint32_t> child_start(row_count + 1);
+  for (uint32_t i = 0; i < row_count; ++i) {
+    base::Optional<tables::SliceTable::Id> parent_id = slices.parent_id()[i];
+    if (!parent_id)
+      continue;
+    base::Optional<uint32_t> parent_row = slices.id().IndexOf(*parent_id);
+    if (!parent_row)
+      continue;
+    parent_[i] = *parent_row;
+    child_start[*parent_row + 1]++;
+  }
+  for (uint32_t i = 0; i < row_count; ++i)
+    child_start[i + 1] += child_start[i];
+  std::vector<uint32_t> children(child_start[row_count]);
+  std::vector<uint32_t> next_child(child_start.begin(), child_start.end() - 1);
+  for (uint32_t i = 0; i < row_count; ++i) {
+    if (parent_[i] != kNoParent)
+      children[next_child[parent_[i]]++] = i;
+  }
+
+  // Number the slices in pre-order with an explicit stack of (row, index of
+  // the next child to visit) to avoid recursing for deeply nested slices.
+  uint32_t pre = 0;
+  std::vector<std::pair<uint32_t, uint32_t>> stack;
+  auto visit = [&](uint32_t row) {
+    pre_[row] = pre;
+    rows_by_pre_[pre++] = row;
+    stack.emplace_back(row, child_start[row]);
+  };
+  auto visit_tree = [&](uint32_t root) {
+    visit(root);
+    while (!stack.empty()) {
+      std::pair<uint32_t, uint32_t>& top = stack.back();
+      uint32_t row = top.first;
+      if (top.second == child_start[row + 1]) {
+        end_[row] = pre;
+        stack.pop_back();
+        continue;
+      }
+      uint32_t child = children[top.second++];
+      if (pre_[child] == kNoParent)
+        visit(child);
+    }
+  };
+  for (uint32_t row = 0; row < row_count; ++row) {
+    if (parent_[row] == kNoParent)
+      visit_tree(row);
+  }
+
+  // Rows which are part of a parent_id cycle are not reachable from any root:
+  // number them as if the first row of the cycle was a root.
+  for (uint32_t row = 0; row < row_count; ++row) {
+    if (pre_[row] == kNoParent)
+      visit_tree(row);
+  }
+}
+
+SliceTreeIndex::~SliceTreeIndex() = default;
+
+void SliceTreeIndex::GetDescendants(uint32_t row,
+                                    std::vector<uint32_t>* out) const {
+  size_t start = out->size();
+  out->insert(out->end(), rows_by_pre_.begin() + pre_[row] + 1,
+              rows_by_pre_.begin() + end_[row]);
+  std::sort(out->begin() + static_cast<std::ptrdiff_t>(start), out->end());
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_STORAGE_SLICE_TREE_INDEX_H_
+#define SRC_TRACE_PROCESSOR_STORAGE_SLICE_TREE_INDEX_H_
+
+#include <stdint.h>
+
+#include <limits>
+#include <vector>
+
+#include "src/trace_processor/tables/slice_tables.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Euler tour (a.k.a. nested set) index over the forest of slices defined by
+// the parent_id column of the slice table.
+//
+// Every slice is numbered in depth-first pre-order (with the children of a
+// slice visited in row order) and remembers the number one past its last
+// descendant. The descendants of a slice are then exactly the slices whose
+// pre-order number is inside this range: this makes finding the descendants
+// of a slice proportional to the number of descendants, independent of the
+// number of slices on the track.
+//
+// All the methods of this class operate on row numbers of the slice table.
+class SliceTreeIndex {
+ public:
+  // Builds the index for all the rows in |slices|.
+  explicit SliceTreeIndex(const tables::SliceTable& slices);
+  ~SliceTreeIndex();
+
+  // Returns the number of rows of the slice table when the index was built.
+  uint32_t row_count() const { return static_cast<uint32_t>(pre_.size()); }
+
+  // Appends the ancestors of |row| to |out|, starting from the parent. A
+  // slice has at most row_count() - 1 ancestors: stopping there makes this
+  // terminate on parent_id cycles.
+  void GetAncestors(uint32_t row, std::vector<uint32_t>* out) const {
+    uint32_t remaining = row_count() - 1;
+    for (uint32_t p = parent_[row]; p != kNoParent && remaining > 0;
+         p = parent_[p], --remaining) {
+      out->push_back(p);
+    }
+  }
+
+  // Appends the descendants of |row| to |out|, sorted by row number.
+  void GetDescendants(uint32_t row, std::vector<uint32_t>* out) const;
+
+ private:
+  static constexpr uint32_t kNoParent = std::numeric_limits<uint32_t>::max();
+
+  // For each row: the row of its parent or kNoParent, its pre-order number and
+  // one past the pre-order number of its last descendant.
+  std::vector<uint32_t> parent_;
+  std::vector<uint32_t> pre_;
+  std::vector<uint32_t> end_;
+
+  // The rows of the slice table, sorted by pre-order number.
+  std::vector<uint32_t> rows_by_pre_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_STORAGE_SLICE_TREE_INDEX_H_
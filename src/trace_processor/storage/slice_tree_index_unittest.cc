@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/storage/slice_tree_index.h"
+
+#include "src/trace_processor/storage/trace_storage.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+class SliceTreeIndexTest : public ::testing::Test {
+ protected:
+  uint32_t AddSlice(int64_t ts, base::Optional<uint32_t> parent_row) {
+    tables::SliceTable::Row row;
+    row.ts = ts;
+    row.dur = 10;
+    row.track_id = TrackId(0);
+    if (parent_row)
+      row.parent_id = SliceId(*parent_row);
+    return storage_.mutable_slice_table()->Insert(row).row;
+  }
+
+  std::vector<uint32_t> Ancestors(uint32_t row) {
+    std::vector<uint32_t> out;
+    storage_.slice_tree_index().GetAncestors(row, &out);
+    return out;
+  }
+
+  std::vector<uint32_t> Descendants(uint32_t row) {
+    std::vector<uint32_t> out;
+    storage_.slice_tree_index().GetDescendants(row, &out);
+    return out;
+  }
+
+  TraceStorage storage_;
+};
+
+TEST_F(SliceTreeIndexTest, Forest) {
+  // 0
+  // |- 1
+  // |  |- 2
+  // |  |- 3
+  // |- 4
+  // 5
+  // |- 6
+  uint32_t a = AddSlice(0, base::nullopt);
+  uint32_t b = AddSlice(1, a);
+  uint32_t c = AddSlice(2, b);
+  uint32_t d = AddSlice(3, b);
+  uint32_t e = AddSlice(4, a);
+  uint32_t f = AddSlice(5, base::nullopt);
+  uint32_t g = AddSlice(6, f);
+
+  const SliceTreeIndex& index = storage_.slice_tree_index();
+  ASSERT_EQ(index.row_count(), 7u);
+
+  ASSERT_THAT(Ancestors(d), ElementsAre(b, a));
+  ASSERT_THAT(Ancestors(e), ElementsAre(a));
+  ASSERT_THAT(Ancestors(g), ElementsAre(f));
+  ASSERT_THAT(Ancestors(a), IsEmpty());
+  ASSERT_THAT(Descendants(a), ElementsAre(b, c, d, e));
+  ASSERT_THAT(Descendants(b), ElementsAre(c, d));
+  ASSERT_THAT(Descendants(f), ElementsAre(g));
+  ASSERT_THAT(Descendants(g), IsEmpty());
+}
+
+TEST_F(SliceTreeIndexTest, RebuiltWhenSlicesAdded) {
+  uint32_t a = AddSlice(0, base::nullopt);
+  ASSERT_THAT(Descendants(a), IsEmpty());
+
+  uint32_t b = AddSlice(1, a);
+  ASSERT_EQ(storage_.slice_tree_index().row_count(), 2u);
+  ASSERT_THAT(Descendants(a), ElementsAre(b));
+  ASSERT_THAT(Ancestors(b), ElementsAre(a));
+}
+
+TEST_F(SliceTreeIndexTest, DeepNesting) {
+  // Deep enough that a recursive traversal would be a problem.
+  constexpr uint32_t kDepth = 100000;
+  base::Optional<uint32_t> parent;
+  for (uint32_t i = 0; i < kDepth; ++i)
+    parent = AddSlice(i, parent);
+
+  ASSERT_EQ(Descendants(0).size(), kDepth - 1);
+  ASSERT_EQ(Ancestors(kDepth - 1).size(), kDepth - 1);
+}
+
+TEST_F(SliceTreeIndexTest, ParentCycle) {
+  // Corrupt traces can make slices their own ancestors: 0 -> 1 -> 2 -> 0.
+  uint32_t a = AddSlice(0, 2u);
+  uint32_t b = AddSlice(1, a);
+  uint32_t c = AddSlice(2, b);
+  uint32_t d = AddSlice(3, c);
+
+  ASSERT_EQ(Ancestors(d).size(), 3u);
+  ASSERT_EQ(Ancestors(a).size(), 3u);
+  ASSERT_THAT(Descendants(a), ElementsAre(b, c, d));
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
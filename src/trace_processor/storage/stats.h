@@ -188,6 +188,10 @@ namespace stats {
       "Number of samples unwound."),                                           \
   F(heapprofd_client_spinlock_blocked,  kIndexed, kInfo,     kTrace,           \
        "Time (us) the heapprofd client was blocked on the spinlock."),         \
+  F(heapprofd_elf_cache_hits,           kIndexed, kInfo,     kTrace,           \
+       "Mappings whose unwinding info was reused from the heapprofd cache."),  \
+  F(heapprofd_elf_cache_misses,         kIndexed, kInfo,     kTrace,           \
+       "Libraries whose unwinding info heapprofd had to parse."),              \
   F(heapprofd_last_profile_timestamp,   kIndexed, kInfo,     kTrace,           \
        "The timestamp (in trace time) for the last dump for a process"),       \
   F(symbolization_tmp_build_id_not_found,   kSingle,  kError,    kAnalysis,    \
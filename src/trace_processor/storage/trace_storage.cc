@@ -78,19 +78,37 @@ TraceStorage::TraceStorage(const Config&) {
 
 TraceStorage::~TraceStorage() {}
 
-uint32_t TraceStorage::SqlStats::RecordQueryBegin(const std::string& query,
-                                                  int64_t time_started) {
+uint32_t TraceStorage::SqlStats::RecordQueryBegin(
+    const std::string& query,
+    int64_t time_started,
+    int64_t thread_cpu_time_started,
+    int64_t vm_steps_started,
+    int64_t rows_scanned_started) {
   if (queries_.size() >= kMaxLogEntries) {
     queries_.pop_front();
     times_started_.pop_front();
     times_first_next_.pop_front();
     times_ended_.pop_front();
+    thread_cpu_times_started_.pop_front();
+    vm_steps_started_.pop_front();
+    rows_scanned_started_.pop_front();
+    cpu_times_.pop_front();
+    vm_steps_.pop_front();
+    rows_scanned_.pop_front();
+    rows_returned_.pop_front();
     popped_queries_++;
   }
   queries_.push_back(query);
   times_started_.push_back(time_started);
   times_first_next_.push_back(0);
   times_ended_.push_back(0);
+  thread_cpu_times_started_.push_back(thread_cpu_time_started);
+  vm_steps_started_.push_back(vm_steps_started);
+  rows_scanned_started_.push_back(rows_scanned_started);
+  cpu_times_.push_back(0);
+  vm_steps_.push_back(0);
+  rows_scanned_.push_back(0);
+  rows_returned_.push_back(0);
   return static_cast<uint32_t>(popped_queries_ + queries_.size() - 1);
 }
 
@@ -105,7 +123,12 @@ void TraceStorage::SqlStats::RecordQueryFirstNext(uint32_t row,
   times_first_next_[queue_row] = time_first_next;
 }
 
-void TraceStorage::SqlStats::RecordQueryEnd(uint32_t row, int64_t time_ended) {
+void TraceStorage::SqlStats::RecordQueryEnd(uint32_t row,
+                                            int64_t time_ended,
+                                            int64_t thread_cpu_time_end,
+                                            int64_t vm_steps_end,
+                                            int64_t rows_scanned_end,
+                                            int64_t rows_returned) {
   // This means we've popped this query off the queue of queries before it had
   // a chance to finish. Just silently drop this number.
   if (popped_queries_ > row)
@@ -113,6 +136,26 @@ void TraceStorage::SqlStats::RecordQueryEnd(uint32_t row, int64_t time_ended) {
   uint32_t queue_row = row - popped_queries_;
   PERFETTO_DCHECK(queue_row < queries_.size());
   times_ended_[queue_row] = time_ended;
+  cpu_times_[queue_row] =
+      thread_cpu_time_end - thread_cpu_times_started_[queue_row];
+  vm_steps_[queue_row] = vm_steps_end - vm_steps_started_[queue_row];
+  rows_scanned_[queue_row] =
+      rows_scanned_end - rows_scanned_started_[queue_row];
+  rows_returned_[queue_row] = rows_returned;
+}
+
+const SliceTreeIndex& TraceStorage::slice_tree_index() const {
+  if (!slice_tree_index_ ||
+      slice_tree_index_->row_count() != slice_table_.row_count()) {
+    slice_tree_index_.reset(new SliceTreeIndex(slice_table_));
+  }
+  return *slice_tree_index_;
+}
+
+const ArgsIndex& TraceStorage::args_index() const {
+  if (!args_index_ || args_index_->row_count() != arg_table_.row_count())
+    args_index_.reset(new ArgsIndex(arg_table_));
+  return *args_index_;
 }
 
 std::pair<int64_t, int64_t> TraceStorage::GetTraceTimestampBoundsNs() const {
@@ -20,6 +20,7 @@
 #include <array>
 #include <deque>
 #include <map>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <utility>
@@ -34,7 +35,9 @@
 #include "perfetto/trace_processor/basic_types.h"
 #include "perfetto/trace_processor/status.h"
 #include "src/trace_processor/containers/string_pool.h"
+#include "src/trace_processor/storage/args_index.h"
 #include "src/trace_processor/storage/metadata.h"
+#include "src/trace_processor/storage/slice_tree_index.h"
 #include "src/trace_processor/storage/stats.h"
 #include "src/trace_processor/tables/android_tables.h"
 #include "src/trace_processor/tables/counter_tables.h"
@@ -188,9 +191,22 @@ class TraceStorage {
   class SqlStats {
    public:
     static constexpr size_t kMaxLogEntries = 100;
-    uint32_t RecordQueryBegin(const std::string& query, int64_t time_started);
+    // |thread_cpu_time_*|, |vm_steps_*| and |rows_scanned_*| are the CPU
+    // time of the thread, the number of SQLite VM instructions executed and
+    // the number of rows read from the tables at the beginning and end of the
+    // query: only their differences are stored.
+    uint32_t RecordQueryBegin(const std::string& query,
+                              int64_t time_started,
+                              int64_t thread_cpu_time_started,
+                              int64_t vm_steps_started,
+                              int64_t rows_scanned_started);
     void RecordQueryFirstNext(uint32_t row, int64_t time_first_next);
-    void RecordQueryEnd(uint32_t row, int64_t time_end);
+    void RecordQueryEnd(uint32_t row,
+                        int64_t time_end,
+                        int64_t thread_cpu_time_end,
+                        int64_t vm_steps_end,
+                        int64_t rows_scanned_end,
+                        int64_t rows_returned);
     size_t size() const { return queries_.size(); }
     const std::deque<std::string>& queries() const { return queries_; }
     const std::deque<int64_t>& times_started() const { return times_started_; }
@@ -198,6 +214,10 @@ class TraceStorage {
       return times_first_next_;
     }
     const std::deque<int64_t>& times_ended() const { return times_ended_; }
+    const std::deque<int64_t>& cpu_times() const { return cpu_times_; }
+    const std::deque<int64_t>& rows_scanned() const { return rows_scanned_; }
+    const std::deque<int64_t>& rows_returned() const { return rows_returned_; }
+    const std::deque<int64_t>& vm_steps() const { return vm_steps_; }
 
    private:
     uint32_t popped_queries_ = 0;
@@ -206,6 +226,13 @@ class TraceStorage {
     std::deque<int64_t> times_started_;
     std::deque<int64_t> times_first_next_;
     std::deque<int64_t> times_ended_;
+    std::deque<int64_t> thread_cpu_times_started_;
+    std::deque<int64_t> vm_steps_started_;
+    std::deque<int64_t> rows_scanned_started_;
+    std::deque<int64_t> cpu_times_;
+    std::deque<int64_t> vm_steps_;
+    std::deque<int64_t> rows_scanned_;
+    std::deque<int64_t> rows_returned_;
   };
 
   struct Stats {
@@ -450,6 +477,10 @@ class TraceStorage {
   const tables::SliceTable& slice_table() const { return slice_table_; }
   tables::SliceTable* mutable_slice_table() { return &slice_table_; }
 
+  // Returns the ancestor/descendant index of the slices in |slice_table()|.
+  // The index is built on first use and rebuilt if slices were added since.
+  const SliceTreeIndex& slice_tree_index() const;
+
   const tables::FlowTable& flow_table() const { return flow_table_; }
   tables::FlowTable* mutable_flow_table() { return &flow_table_; }
 
@@ -503,6 +534,11 @@ class TraceStorage {
   const tables::ArgTable& arg_table() const { return arg_table_; }
   tables::ArgTable* mutable_arg_table() { return &arg_table_; }
 
+  // Returns the index to look up args by arg set id and key in
+  // |arg_table()|. The index is built on first use and rebuilt if args were
+  // added since.
+  const ArgsIndex& args_index() const;
+
   const tables::RawTable& raw_table() const { return raw_table_; }
   tables::RawTable* mutable_raw_table() { return &raw_table_; }
 
@@ -534,6 +570,13 @@ class TraceStorage {
     return &stack_profile_callsite_table_;
   }
 
+  // Incremented whenever existing rows of the stack profile tables or the
+  // upid of a thread are updated in place. Together with the row counts of
+  // these tables, this tells caches of data computed from them (e.g.
+  // FlamegraphCache) whether they are stale.
+  uint64_t profile_generation() const { return profile_generation_; }
+  void IncrementProfileGeneration() { ++profile_generation_; }
+
   const tables::HeapProfileAllocationTable& heap_profile_allocation_table()
       const {
     return heap_profile_allocation_table_;
@@ -720,6 +763,16 @@ class TraceStorage {
   util::Status ExtractArg(uint32_t arg_set_id,
                           const char* key,
                           base::Optional<Variadic>* result) {
+    const ArgsIndex& index = args_index();
+    if (PERFETTO_LIKELY(!index.has_duplicate_keys())) {
+      base::Optional<StringId> key_id = string_pool_.GetId(key);
+      base::Optional<uint32_t> row =
+          key_id ? index.Find(arg_table_, arg_set_id, *key_id) : base::nullopt;
+      *result = row ? base::make_optional(GetArgValue(*row)) : base::nullopt;
+      return util::OkStatus();
+    }
+
+    // Filter the table to report arg sets with duplicate keys.
     const auto& args = arg_table();
     RowMap filtered = args.FilterToRowMap(
         {args.arg_set_id().eq(arg_set_id), args.key().eq(key)});
@@ -846,6 +899,9 @@ class TraceStorage {
   // Args for all other tables.
   tables::ArgTable arg_table_{&string_pool_, nullptr};
 
+  // Lazily built index over |arg_table_| (see args_index()).
+  mutable std::unique_ptr<ArgsIndex> args_index_;
+
   // Information about all the threads and processes in the trace.
   tables::ThreadTable thread_table_{&string_pool_, nullptr};
   tables::ProcessTable process_table_{&string_pool_, nullptr};
@@ -853,6 +909,9 @@ class TraceStorage {
   // Slices coming from userspace events (e.g. Chromium TRACE_EVENT macros).
   tables::SliceTable slice_table_{&string_pool_, nullptr};
 
+  // Lazily built index over |slice_table_| (see slice_tree_index()).
+  mutable std::unique_ptr<SliceTreeIndex> slice_tree_index_;
+
   // Flow events from userspace events (e.g. Chromium TRACE_EVENT macros).
   tables::FlowTable flow_table_{&string_pool_, nullptr};
 
@@ -894,6 +953,7 @@ class TraceStorage {
                                                             nullptr};
   tables::StackProfileCallsiteTable stack_profile_callsite_table_{&string_pool_,
                                                                   nullptr};
+  uint64_t profile_generation_ = 0;
   tables::StackSampleTable stack_sample_table_{&string_pool_, nullptr};
   tables::HeapProfileAllocationTable heap_profile_allocation_table_{
       &string_pool_, nullptr};
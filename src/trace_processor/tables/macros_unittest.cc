@@ -461,6 +461,35 @@ TEST_F(TableMacrosUnittest, Sort) {
   ASSERT_EQ(arg_set_id->Get(2).long_value, 100);
 }
 
+TEST_F(TableMacrosUnittest, FilterAfterShrinkToFit) {
+  for (uint32_t i = 0; i < 4096; ++i) {
+    TestCpuSliceTable::Row row;
+    row.cpu = i % 8;
+    row.priority = 120;
+    cpu_slice_.Insert(row);
+  }
+  cpu_slice_.ShrinkToFit();
+
+  Table out = cpu_slice_.Filter({cpu_slice_.cpu().eq(3)});
+  ASSERT_EQ(out.row_count(), 512u);
+  ASSERT_EQ(out.GetColumnByName("cpu")->Get(0).long_value, 3);
+
+  out = cpu_slice_.Filter({cpu_slice_.cpu().ne(3)});
+  ASSERT_EQ(out.row_count(), 4096u - 512u);
+
+  out = cpu_slice_.Filter({cpu_slice_.cpu().ge(6)});
+  ASSERT_EQ(out.row_count(), 1024u);
+
+  out = cpu_slice_.Filter({cpu_slice_.priority().lt(120)});
+  ASSERT_EQ(out.row_count(), 0u);
+
+  // Modifying a column after shrinking it must still work.
+  cpu_slice_.mutable_cpu()->Set(0, 3);
+  out = cpu_slice_.Filter({cpu_slice_.cpu().eq(3)});
+  ASSERT_EQ(out.row_count(), 513u);
+  ASSERT_EQ(cpu_slice_.cpu()[1], 1);
+}
+
 TEST_F(TableMacrosUnittest, ChildDoesntInheritArgsSetFlag) {
   ASSERT_FALSE(args_child_.arg_set_id().IsSetId());
   ASSERT_FALSE(TestArgsChildTable::Schema()
@@ -418,6 +418,118 @@ TEST_F(TraceProcessorIntegrationTest, RestoreInitialTables) {
   }
 }
 
+TEST_F(TraceProcessorIntegrationTest, QueryProgressCallback) {
+  constexpr char kLongQuery[] =
+      "with recursive n(x) as (select 1 union all select x + 1 from n "
+      "where x < 1000000) select count(*) from n";
+
+  uint64_t last_vm_steps = 0;
+  uint32_t calls = 0;
+  Processor()->SetQueryProgressCallback([&](uint64_t vm_steps) {
+    EXPECT_GT(vm_steps, last_vm_steps);
+    last_vm_steps = vm_steps;
+    return ++calls < 10;
+  });
+  {
+    auto it = Query(kLongQuery);
+    ASSERT_FALSE(it.Next());
+    ASSERT_FALSE(it.Status().ok());
+  }
+  ASSERT_EQ(calls, 10u);
+
+  Processor()->SetQueryProgressCallback(nullptr);
+  auto it = Query(kLongQuery);
+  ASSERT_TRUE(it.Next());
+  ASSERT_EQ(it.Get(0).long_value, 1000000);
+}
+
+TEST_F(TraceProcessorIntegrationTest, SqlStatsExecutionCounters) {
+  {
+    auto it = Query(
+        "with recursive n(x) as (select 1 union all select x + 1 from n "
+        "where x < 100000) select x from n");
+    while (it.Next()) {
+    }
+    ASSERT_TRUE(it.Status().ok());
+  }
+  auto it = Query(
+      "select rows_returned, vm_steps, cpu_time, rows_scanned from sqlstats "
+      "where query like 'with recursive%'");
+  ASSERT_TRUE(it.Next());
+  ASSERT_EQ(it.Get(0).long_value, 100000);
+  ASSERT_GT(it.Get(1).long_value, 100000);
+  ASSERT_GE(it.Get(2).long_value, 0);
+  ASSERT_EQ(it.Get(3).long_value, 0);
+  ASSERT_FALSE(it.Next());
+}
+
+TEST_F(TraceProcessorIntegrationTest, SqlStatsRowsScanned) {
+  ASSERT_TRUE(LoadTrace("ninja_log", 1024).ok());
+  int64_t slice_count = 0;
+  {
+    auto it = Query("select count(*) from slice");
+    ASSERT_TRUE(it.Next());
+    slice_count = it.Get(0).long_value;
+    ASSERT_GT(slice_count, 0);
+  }
+  {
+    // Executed directly on the columns of the table, without SQLite.
+    auto it = Query("select id from slice");
+    while (it.Next()) {
+    }
+    ASSERT_TRUE(it.Status().ok());
+  }
+  auto it = Query(
+      "select rows_returned, rows_scanned from sqlstats "
+      "where query like '%from slice' order by started");
+  ASSERT_TRUE(it.Next());
+  ASSERT_EQ(it.Get(0).long_value, 1);
+  ASSERT_EQ(it.Get(1).long_value, slice_count);
+  ASSERT_TRUE(it.Next());
+  ASSERT_EQ(it.Get(0).long_value, slice_count);
+  ASSERT_EQ(it.Get(1).long_value, slice_count);
+  ASSERT_FALSE(it.Next());
+}
+
+TEST_F(TraceProcessorIntegrationTest, ColumnStats) {
+  ASSERT_TRUE(LoadTrace("ninja_log", 1024).ok());
+  auto it = Query(
+      "select row_count, null_count, distinct_count from column_stats "
+      "where table_name = 'process' and column_name = 'id'");
+  ASSERT_TRUE(it.Next());
+  int64_t row_count = it.Get(0).long_value;
+  ASSERT_GT(row_count, 0);
+  ASSERT_EQ(it.Get(1).long_value, 0);
+  ASSERT_EQ(it.Get(2).long_value, row_count);
+  ASSERT_FALSE(it.Next());
+  ASSERT_TRUE(it.Status().ok());
+}
+
+TEST_F(TraceProcessorIntegrationTest, ColumnarQuery) {
+  ASSERT_TRUE(LoadTrace("ninja_log", 1024).ok());
+
+  // The first query is executed on the columns of the table while the ORDER BY
+  // makes SQLite execute the second one: both should name columns the same.
+  auto columnar = Query("SELECT TS, dur AS Dur, * FROM slice");
+  auto sqlite = Query("SELECT TS, dur AS Dur, * FROM slice ORDER BY id");
+  ASSERT_GT(columnar.ColumnCount(), 2u);
+  ASSERT_EQ(columnar.ColumnCount(), sqlite.ColumnCount());
+  for (uint32_t i = 0; i < columnar.ColumnCount(); ++i)
+    ASSERT_EQ(columnar.GetColumnName(i), sqlite.GetColumnName(i));
+
+  auto it = Query("SELECT ts FROM slice");
+  ASSERT_TRUE(it.Next());
+  Processor()->InterruptQuery();
+  while (it.Next()) {
+  }
+  ASSERT_FALSE(it.Status().ok());
+
+  // Interrupting a query does not affect the following ones.
+  it = Query("SELECT ts FROM slice");
+  ASSERT_TRUE(it.Next());
+  ASSERT_TRUE(it.Status().ok());
+}
+
 // This test checks that a ninja trace is tokenized properly even if read in
 // small chunks of 1KB each. The values used in the test have been cross-checked
 // with opening the same trace with ninjatracing + chrome://tracing.
@@ -16,6 +16,8 @@
 
 #include "src/trace_processor/trace_processor_impl.h"
 
+#include <ctype.h>
+
 #include <algorithm>
 #include <memory>
 
@@ -26,10 +28,13 @@
 #include "perfetto/ext/base/string_splitter.h"
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/trace_processor/demangle.h"
+#include "src/trace_processor/db/runtime_table.h"
 #include "src/trace_processor/dynamic/ancestor_generator.h"
+#include "src/trace_processor/dynamic/column_stats_generator.h"
 #include "src/trace_processor/dynamic/connected_flow_generator.h"
 #include "src/trace_processor/dynamic/descendant_generator.h"
 #include "src/trace_processor/dynamic/describe_slice_generator.h"
+#include "src/trace_processor/dynamic/experimental_aggregate_generator.h"
 #include "src/trace_processor/dynamic/experimental_annotated_stack_generator.h"
 #include "src/trace_processor/dynamic/experimental_counter_dur_generator.h"
 #include "src/trace_processor/dynamic/experimental_flamegraph_generator.h"
@@ -50,6 +55,7 @@
 #include "src/trace_processor/importers/proto/metadata_tracker.h"
 #include "src/trace_processor/importers/systrace/systrace_trace_parser.h"
 #include "src/trace_processor/iterator_impl.h"
+#include "src/trace_processor/sqlite/columnar_query.h"
 #include "src/trace_processor/sqlite/create_function.h"
 #include "src/trace_processor/sqlite/create_view_function.h"
 #include "src/trace_processor/sqlite/pprof_functions.h"
@@ -90,6 +96,9 @@ namespace perfetto {
 namespace trace_processor {
 namespace {
 
+// How often SQLite invokes TraceProcessorImpl::OnSqliteProgress.
+constexpr int kProgressHandlerVmSteps = 10000;
+
 const char kAllTablesQuery[] =
     "SELECT tbl_name, type FROM (SELECT * FROM sqlite_master UNION ALL SELECT "
     "* FROM sqlite_temp_master)";
@@ -664,6 +673,53 @@ base::Status ExtractArg::Run(TraceStorage* storage,
   PERFETTO_FATAL("For GCC");
 }
 
+// Hints that the given column of a db table is going to be filtered often:
+// builds an index on the column to speed up these filters (see
+// Column::CreateIndex). Does nothing if the column cannot use an index (e.g.
+// because it is already sorted).
+struct CreateColumnIndex : public SqlFunction {
+  using Context = std::map<std::string, const Table*>;
+  static base::Status Run(Context* tables,
+                          size_t argc,
+                          sqlite3_value** argv,
+                          SqlValue& out,
+                          Destructors& destructors);
+};
+
+base::Status CreateColumnIndex::Run(Context* tables,
+                                    size_t argc,
+                                    sqlite3_value** argv,
+                                    SqlValue&,
+                                    Destructors&) {
+  if (argc != 2)
+    return base::ErrStatus("CREATE_COLUMN_INDEX: 2 args required");
+
+  if (sqlite3_value_type(argv[0]) != SQLITE_TEXT)
+    return base::ErrStatus(
+        "CREATE_COLUMN_INDEX: 1st argument should be a table");
+
+  if (sqlite3_value_type(argv[1]) != SQLITE_TEXT)
+    return base::ErrStatus(
+        "CREATE_COLUMN_INDEX: 2nd argument should be a column");
+
+  const char* table_name =
+      reinterpret_cast<const char*>(sqlite3_value_text(argv[0]));
+  const char* column_name =
+      reinterpret_cast<const char*>(sqlite3_value_text(argv[1]));
+
+  auto it = tables->find(table_name);
+  if (it == tables->end())
+    return base::ErrStatus("CREATE_COLUMN_INDEX: unknown table %s", table_name);
+
+  const Column* column = it->second->GetColumnByName(column_name);
+  if (!column) {
+    return base::ErrStatus("CREATE_COLUMN_INDEX: unknown column %s in %s",
+                           column_name, table_name);
+  }
+  column->CreateIndex();
+  return base::OkStatus();
+}
+
 struct AbsTimeStr : public SqlFunction {
   using Context = ClockTracker;
   static base::Status Run(ClockTracker* tracker,
@@ -749,6 +805,7 @@ struct Glob : public SqlFunction {
 void SetupMetrics(TraceProcessor* tp,
                   sqlite3* db,
                   std::vector<metrics::SqlMetricFile>* sql_metrics,
+                  metrics::RunMetricTracker* run_metric_tracker,
                   const std::vector<std::string>& extension_paths) {
   const std::vector<std::string> sanitized_extension_paths =
       SanitizeMetricMountPaths(extension_paths);
@@ -780,7 +837,8 @@ void SetupMetrics(TraceProcessor* tp,
   RegisterFunction<metrics::RunMetric>(
       db, "RUN_METRIC", -1,
       std::unique_ptr<metrics::RunMetric::Context>(
-          new metrics::RunMetric::Context{tp, sql_metrics}));
+          new metrics::RunMetric::Context{tp, sql_metrics,
+                                          run_metric_tracker}));
 
   // TODO(lalitm): migrate this over to using RegisterFunction once aggregate
   // functions are supported.
@@ -962,6 +1020,47 @@ const char* TraceTypeToString(TraceType trace_type) {
   PERFETTO_FATAL("For GCC");
 }
 
+// Looks up the view called |name| (case insensitively). |view_name| is left
+// empty if there is no such view.
+base::Status FindView(sqlite3* db,
+                      const std::string& name,
+                      std::string* view_name,
+                      std::string* view_sql) {
+  ScopedStmt stmt;
+  RETURN_IF_ERROR(sqlite_utils::PrepareStmt(
+      db,
+      "SELECT name, sql FROM sqlite_master WHERE type = 'view' AND "
+      "LOWER(name) = LOWER(?)",
+      &stmt, nullptr));
+  sqlite3_bind_text(stmt.get(), 1, name.c_str(), -1,
+                    sqlite_utils::kSqliteTransient);
+  view_name->clear();
+  view_sql->clear();
+  int err = sqlite3_step(stmt.get());
+  if (err == SQLITE_DONE)
+    return base::OkStatus();
+  if (err != SQLITE_ROW)
+    return base::ErrStatus("%s (errcode: %d)", sqlite3_errmsg(db), err);
+  *view_name =
+      reinterpret_cast<const char*>(sqlite3_column_text(stmt.get(), 0));
+  const unsigned char* sql = sqlite3_column_text(stmt.get(), 1);
+  if (sql)
+    *view_sql = reinterpret_cast<const char*>(sql);
+  return base::OkStatus();
+}
+
+// Runs |sql| without recording it in the sqlstats table.
+base::Status ExecuteInternalSql(sqlite3* db, const std::string& sql) {
+  char* error = nullptr;
+  sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &error);
+  if (error) {
+    base::Status status = base::ErrStatus("%s", error);
+    sqlite3_free(error);
+    return status;
+  }
+  return base::OkStatus();
+}
+
 }  // namespace
 
 template <typename View>
@@ -997,6 +1096,8 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
   CreateBuiltinTables(db);
   CreateBuiltinViews(db);
   db_.reset(std::move(db));
+  sqlite3_progress_handler(db, kProgressHandlerVmSteps, &OnSqliteProgress,
+                           this);
 
   // New style function registration.
   RegisterFunction<Glob>(db, "glob", 2);
@@ -1007,6 +1108,8 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
   RegisterFunction<ExportJson>(db, "EXPORT_JSON", 1, context_.storage.get(),
                                false);
   RegisterFunction<ExtractArg>(db, "EXTRACT_ARG", 2, context_.storage.get());
+  RegisterFunction<CreateColumnIndex>(db, "CREATE_COLUMN_INDEX", 2, &db_tables_,
+                                      false);
   RegisterFunction<AbsTimeStr>(db, "ABS_TIME_STR", 1,
                                context_.clock_tracker.get());
   RegisterFunction<CreateFunction>(
@@ -1030,7 +1133,18 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
     }
   }
 
-  SetupMetrics(this, *db_, &sql_metrics_, cfg.skip_builtin_metric_paths);
+  SetupMetrics(this, *db_, &sql_metrics_, &run_metric_tracker_,
+               cfg.skip_builtin_metric_paths);
+  if (cfg.reuse_metric_outputs) {
+    run_metric_tracker_.EnableOutputReuse([this](const std::string& name) {
+      // Views which cannot be materialized are simply left as they are.
+      base::Status status = MaterializeView(name);
+      if (!status.ok()) {
+        PERFETTO_DLOG("Not materializing view %s: %s", name.c_str(),
+                      status.c_message());
+      }
+    });
+  }
 
   // Setup the query cache.
   query_cache_.reset(new QueryCache());
@@ -1087,6 +1201,11 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
       new ExperimentalAnnotatedStackGenerator(&context_)));
   RegisterDynamicTable(std::unique_ptr<ExperimentalFlatSliceGenerator>(
       new ExperimentalFlatSliceGenerator(&context_)));
+  RegisterDynamicTable(std::unique_ptr<ExperimentalAggregateGenerator>(
+      new ExperimentalAggregateGenerator(&db_tables_)));
+  RegisterDynamicTable(std::unique_ptr<ColumnStatsGenerator>(
+      new ColumnStatsGenerator(context_.storage->mutable_string_pool(),
+                               &db_tables_, query_cache_->table_stats())));
 
   // Views.
   RegisterView(storage->thread_slice_view());
@@ -1266,6 +1385,13 @@ size_t TraceProcessorImpl::RestoreInitialTables() {
     if (!it.Status().ok() && tn.first != "index")
       PERFETTO_FATAL("%s -> %s", query.c_str(), it.Status().c_message());
   }
+
+  // The views materialized for RUN_METRIC were deleted above.
+  run_metric_tracker_.Reset();
+  materialized_views_.clear();
+  for (const auto& view_and_table : materialized_tables_)
+    DropMaterializedTable(view_and_table.second);
+  materialized_tables_.clear();
   return deletion_list.size();
 }
 
@@ -1274,7 +1400,32 @@ Iterator TraceProcessorImpl::ExecuteQuery(const std::string& sql) {
 
   uint32_t sql_stats_row =
       context_.storage->mutable_sql_stats()->RecordQueryBegin(
-          sql, base::GetWallTimeNs().count());
+          sql, base::GetWallTimeNs().count(),
+          base::GetThreadCPUTimeNs().count(), static_cast<int64_t>(vm_steps_),
+          static_cast<int64_t>(query_cache_->rows_scanned()));
+  run_metric_tracker_.RecordQuery(sql);
+
+  // Like sqlite3_interrupt, InterruptQuery only affects the queries running
+  // when it is called.
+  query_interrupted_.store(false);
+
+  // Simple projections and filters of db tables are executed directly on the
+  // columns of the table, bypassing SQLite.
+  std::unique_ptr<ColumnarQuery> columnar =
+      ColumnarQuery::Parse(sql, db_tables_);
+  if (columnar) {
+    PERFETTO_TP_TRACE("QUERY_EXECUTE_COLUMNAR");
+    IteratorImpl::StmtMetadata metadata;
+    metadata.column_count = static_cast<uint32_t>(columnar->columns().size());
+    metadata.statement_count = 1;
+    metadata.statement_count_with_output = 1;
+    std::unique_ptr<ColumnarCursor> cursor(
+        new ColumnarCursor(std::move(columnar), &query_interrupted_));
+    std::unique_ptr<IteratorImpl> impl(
+        new IteratorImpl(this, *db_, std::move(cursor), std::move(metadata),
+                         sql_stats_row));
+    return Iterator(std::move(impl));
+  }
 
   ScopedStmt stmt;
   IteratorImpl::StmtMetadata metadata;
@@ -1294,6 +1445,131 @@ void TraceProcessorImpl::InterruptQuery() {
   sqlite3_interrupt(db_.get());
 }
 
+void TraceProcessorImpl::SetQueryProgressCallback(
+    QueryProgressCallback callback) {
+  query_progress_callback_ = std::move(callback);
+}
+
+// static
+int TraceProcessorImpl::OnSqliteProgress(void* ctx) {
+  auto* impl = static_cast<TraceProcessorImpl*>(ctx);
+  impl->vm_steps_ += static_cast<uint64_t>(kProgressHandlerVmSteps);
+  if (impl->query_progress_callback_ &&
+      !impl->query_progress_callback_(impl->vm_steps_)) {
+    return 1;
+  }
+  return 0;
+}
+
+base::Status TraceProcessorImpl::MaterializeView(const std::string& name) {
+  // This runs on behalf of RUN_METRIC so, like the rest of the metric
+  // machinery, it talks to SQLite directly instead of going through
+  // ExecuteQuery: none of these queries should show up in sqlstats or be
+  // seen by the RUN_METRIC tracker.
+  std::string view_name;
+  std::string view_sql;
+  RETURN_IF_ERROR(FindView(*db_, name, &view_name, &view_sql));
+  if (view_name.empty())
+    return base::OkStatus();
+
+  auto mat_it = materialized_views_.find(view_name);
+  if (mat_it != materialized_views_.end() && mat_it->second == view_sql)
+    return base::OkStatus();
+
+  ScopedStmt stmt;
+  std::string select_view = "SELECT * FROM " + view_name;
+  RETURN_IF_ERROR(sqlite_utils::PrepareStmt(*db_, select_view.c_str(), &stmt,
+                                            nullptr));
+  std::vector<std::string> col_names;
+  for (int i = 0; i < sqlite3_column_count(stmt.get()); ++i) {
+    std::string col_name = sqlite3_column_name(stmt.get(), i);
+    bool is_identifier =
+        !col_name.empty() &&
+        !isdigit(static_cast<unsigned char>(col_name[0])) &&
+        std::all_of(col_name.begin(), col_name.end(), [](char c) {
+          return isalnum(static_cast<unsigned char>(c)) || c == '_';
+        });
+    if (!is_identifier)
+      return base::ErrStatus("Unsupported column name %s", col_name.c_str());
+    col_names.push_back(col_name);
+  }
+
+  std::unique_ptr<RuntimeTable> table(
+      new RuntimeTable(context_.storage->mutable_string_pool(), col_names));
+  uint32_t rows = 0;
+  int err;
+  for (err = sqlite3_step(stmt.get()); err == SQLITE_ROW;
+       err = sqlite3_step(stmt.get()), ++rows) {
+    for (uint32_t i = 0; i < col_names.size(); ++i) {
+      SqlValue value = sqlite_utils::SqliteValueToSqlValue(
+          sqlite3_column_value(stmt.get(), static_cast<int>(i)));
+      switch (value.type) {
+        case SqlValue::Type::kNull:
+          RETURN_IF_ERROR(table->AddNull(i));
+          break;
+        case SqlValue::Type::kLong:
+          RETURN_IF_ERROR(table->AddInteger(i, value.long_value));
+          break;
+        case SqlValue::Type::kDouble:
+          RETURN_IF_ERROR(table->AddFloat(i, value.double_value));
+          break;
+        case SqlValue::Type::kString:
+          RETURN_IF_ERROR(table->AddText(i, value.string_value));
+          break;
+        case SqlValue::Type::kBytes:
+          return base::ErrStatus("Bytes columns are not supported");
+      }
+    }
+  }
+  if (err != SQLITE_DONE) {
+    return base::ErrStatus("%s (errcode: %d)", sqlite3_errmsg(*db_), err);
+  }
+  stmt.reset();
+  RETURN_IF_ERROR(table->AddColumnsAndOverlays(rows));
+
+  MaterializedTable materialized;
+  materialized.name =
+      "__metric_output_" + std::to_string(materialized_table_count_++);
+  materialized.table = std::move(table);
+  DbSqliteTable::RegisterTable(*db_, query_cache_.get(),
+                               materialized.table->ComputeSchema(),
+                               materialized.table.get(), materialized.name);
+
+  std::string select =
+      "SELECT " + base::Join(col_names, ", ") + " FROM " + materialized.name;
+  // Make sure the table is usable before dropping the view.
+  base::Status status = ExecuteInternalSql(*db_, select + " LIMIT 0");
+  if (status.ok()) {
+    status = ExecuteInternalSql(*db_, "DROP VIEW " + view_name +
+                                          "; CREATE VIEW " + view_name +
+                                          " AS " + select);
+  }
+  if (!status.ok()) {
+    DropMaterializedTable(materialized);
+    return status;
+  }
+
+  // The view does not use the table it was previously materialized into
+  // anymore.
+  auto old_it = materialized_tables_.find(view_name);
+  if (old_it != materialized_tables_.end())
+    DropMaterializedTable(old_it->second);
+  materialized_tables_[view_name] = std::move(materialized);
+
+  std::string new_view_name;
+  std::string new_view_sql;
+  RETURN_IF_ERROR(FindView(*db_, view_name, &new_view_name, &new_view_sql));
+  if (!new_view_name.empty())
+    materialized_views_[view_name] = new_view_sql;
+  return base::OkStatus();
+}
+
+void TraceProcessorImpl::DropMaterializedTable(
+    const MaterializedTable& table) {
+  SqliteTable::Unregister(*db_, table.name);
+  query_cache_->Invalidate(table.table.get());
+}
+
 bool TraceProcessorImpl::IsRootMetricField(const std::string& metric_name) {
   base::Optional<uint32_t> desc_idx =
       pool_.FindDescriptorIdx(".perfetto.protos.TraceMetrics");
@@ -1400,8 +1676,9 @@ base::Status TraceProcessorImpl::ComputeMetric(
     return base::Status("Root metrics proto descriptor not found");
 
   const auto& root_descriptor = pool_.descriptors()[opt_idx.value()];
-  return metrics::ComputeMetrics(this, metric_names, sql_metrics_, pool_,
-                                 root_descriptor, metrics_proto);
+  return metrics::ComputeMetrics(this, metric_names, sql_metrics_,
+                                 &run_metric_tracker_, pool_, root_descriptor,
+                                 metrics_proto);
 }
 
 base::Status TraceProcessorImpl::ComputeMetricText(
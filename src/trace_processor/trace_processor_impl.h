@@ -29,6 +29,7 @@
 #include "perfetto/trace_processor/basic_types.h"
 #include "perfetto/trace_processor/status.h"
 #include "perfetto/trace_processor/trace_processor.h"
+#include "src/trace_processor/db/runtime_table.h"
 #include "src/trace_processor/sqlite/create_function.h"
 #include "src/trace_processor/sqlite/create_view_function.h"
 #include "src/trace_processor/sqlite/db_sqlite_table.h"
@@ -86,6 +87,8 @@ class TraceProcessorImpl : public TraceProcessor,
 
   void InterruptQuery() override;
 
+  void SetQueryProgressCallback(QueryProgressCallback) override;
+
   size_t RestoreInitialTables() override;
 
   std::string GetCurrentTraceName() override;
@@ -104,6 +107,7 @@ class TraceProcessorImpl : public TraceProcessor,
   void RegisterDbTable(const Table& table) {
     DbSqliteTable::RegisterTable(*db_, query_cache_.get(), Table::Schema(),
                                  &table, Table::Name());
+    db_tables_[Table::Name()] = &table;
   }
 
   void RegisterDynamicTable(std::unique_ptr<DynamicTableGenerator> generator) {
@@ -116,6 +120,20 @@ class TraceProcessorImpl : public TraceProcessor,
 
   bool IsRootMetricField(const std::string& metric_name);
 
+  // Invoked by SQLite every kProgressHandlerVmSteps VM instructions.
+  static int OnSqliteProgress(void* ctx);
+
+  // Replaces the view |name| by a view over a native table holding its
+  // current contents.
+  base::Status MaterializeView(const std::string& name);
+
+  struct MaterializedTable {
+    std::string name;
+    std::unique_ptr<RuntimeTable> table;
+  };
+  // Unregisters a table created by MaterializeView.
+  void DropMaterializedTable(const MaterializedTable& table);
+
   // Keep this first: we need this to be destroyed after we clean up
   // everything else.
   ScopedDb db_;
@@ -126,14 +144,30 @@ class TraceProcessorImpl : public TraceProcessor,
 
   std::unique_ptr<QueryCache> query_cache_;
 
+  // The db tables registered with SQLite by name (see RegisterDbTable).
+  std::map<std::string, const Table*> db_tables_;
+
+  // Tables backing the views materialized for RUN_METRIC outputs (see
+  // Config::reuse_metric_outputs), keyed by view name, and the SQL of these
+  // views.
+  std::map<std::string, MaterializedTable> materialized_tables_;
+  std::map<std::string, std::string> materialized_views_;
+  uint32_t materialized_table_count_ = 0;
+
   DescriptorPool pool_;
   std::vector<metrics::SqlMetricFile> sql_metrics_;
+  metrics::RunMetricTracker run_metric_tracker_;
   std::unordered_map<std::string, std::string> proto_field_to_sql_metric_path_;
 
   // This is atomic because it is set by the CTRL-C signal handler and we need
   // to prevent single-flow compiler optimizations in ExecuteQuery().
   std::atomic<bool> query_interrupted_{false};
 
+  // Number of SQLite VM instructions executed so far, counted with a
+  // granularity of kProgressHandlerVmSteps.
+  uint64_t vm_steps_ = 0;
+  QueryProgressCallback query_progress_callback_;
+
   // Keeps track of the tables created by the ingestion process. This is used
   // by RestoreInitialTables() to delete all the tables/view that have been
   // created after that point.
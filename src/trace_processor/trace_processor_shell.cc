@@ -18,9 +18,12 @@
 #include <stdio.h>
 #include <sys/stat.h>
 
+#include <atomic>
 #include <cinttypes>
 #include <functional>
 #include <iostream>
+#include <mutex>
+#include <thread>
 #include <unordered_set>
 #include <vector>
 
@@ -516,6 +519,26 @@ void PrintQueryResultInteractively(Iterator* it,
          static_cast<double>((t_end - t_start).count()) / 1E6);
 }
 
+void PrintCsvValue(const SqlValue& value, FILE* output) {
+  switch (value.type) {
+    case SqlValue::Type::kNull:
+      fprintf(output, "\"%s\"", "[NULL]");
+      break;
+    case SqlValue::Type::kDouble:
+      fprintf(output, "%f", value.double_value);
+      break;
+    case SqlValue::Type::kLong:
+      fprintf(output, "%" PRIi64, value.long_value);
+      break;
+    case SqlValue::Type::kString:
+      fprintf(output, "\"%s\"", value.string_value);
+      break;
+    case SqlValue::Type::kBytes:
+      fprintf(output, "\"%s\"", "<raw bytes>");
+      break;
+  }
+}
+
 base::Status PrintQueryResultAsCsv(Iterator* it, bool has_more, FILE* output) {
   for (uint32_t c = 0; c < it->ColumnCount(); c++) {
     if (c > 0)
@@ -528,25 +551,7 @@ base::Status PrintQueryResultAsCsv(Iterator* it, bool has_more, FILE* output) {
     for (uint32_t c = 0; c < it->ColumnCount(); c++) {
       if (c > 0)
         fprintf(output, ",");
-
-      auto value = it->Get(c);
-      switch (value.type) {
-        case SqlValue::Type::kNull:
-          fprintf(output, "\"%s\"", "[NULL]");
-          break;
-        case SqlValue::Type::kDouble:
-          fprintf(output, "%f", value.double_value);
-          break;
-        case SqlValue::Type::kLong:
-          fprintf(output, "%" PRIi64, value.long_value);
-          break;
-        case SqlValue::Type::kString:
-          fprintf(output, "\"%s\"", value.string_value);
-          break;
-        case SqlValue::Type::kBytes:
-          fprintf(output, "\"%s\"", "<raw bytes>");
-          break;
-      }
+      PrintCsvValue(it->Get(c), output);
     }
     fprintf(output, "\n");
   }
@@ -659,7 +664,7 @@ struct CommandLineOptions {
   std::string sqlite_file_path;
   std::string metric_names;
   std::string metric_output;
-  std::string trace_file_path;
+  std::vector<std::string> trace_file_paths;
   std::string port_number;
   std::vector<std::string> raw_metric_extensions;
   bool launch_shell = false;
@@ -669,12 +674,18 @@ struct CommandLineOptions {
   std::string metatrace_path;
   bool dev = false;
   bool no_ftrace_raw = false;
+  bool metrics_reuse = false;
 };
 
 void PrintUsage(char** argv) {
   PERFETTO_ELOG(R"(
 Interactive trace processor shell.
-Usage: %s [OPTIONS] trace_file.pb
+Usage: %s [OPTIONS] trace_file.pb [trace_file.pb...]
+
+When more than one trace file is given, the traces are read in parallel and
+the query passed with -q is run on each of them. The results are printed as a
+single CSV with an additional leading trace_id column, which is the index of
+the trace on the command line. No other mode is supported with multiple traces.
 
 Options:
  -h, --help                           Prints this guide.
@@ -711,6 +722,10 @@ Options:
                                       specified in either proto binary, proto
                                       text format or JSON format (default: proto
                                       text).
+ --metrics-reuse                      Memoizes RUN_METRIC calls by file and
+                                      arguments across metrics and queries and
+                                      materializes the views they create into
+                                      native tables.
  -m, --metatrace FILE                 Enables metatracing of trace processor
                                       writing the resulting trace into FILE.
  --full-sort                          Forces the trace processor into performing
@@ -745,6 +760,7 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
     OPT_METRIC_EXTENSION,
     OPT_DEV,
     OPT_NO_FTRACE_RAW,
+    OPT_METRICS_REUSE,
   };
 
   static const option long_options[] = {
@@ -766,6 +782,7 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
       {"metric-extension", required_argument, nullptr, OPT_METRIC_EXTENSION},
       {"dev", no_argument, nullptr, OPT_DEV},
       {"no-ftrace-raw", no_argument, nullptr, OPT_NO_FTRACE_RAW},
+      {"metrics-reuse", no_argument, nullptr, OPT_METRICS_REUSE},
       {nullptr, 0, nullptr, 0}};
 
   bool explicit_interactive = false;
@@ -867,6 +884,11 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
       continue;
     }
 
+    if (option == OPT_METRICS_REUSE) {
+      command_line_options.metrics_reuse = true;
+      continue;
+    }
+
     PrintUsage(argv);
     exit(option == 'h' ? 0 : 1);
   }
@@ -885,11 +907,27 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
   }
 
   // The only case where we allow omitting the trace file path is when running
-  // in --http mode. In all other cases, the last argument must be the trace
-  // file.
-  if (optind == argc - 1 && argv[optind]) {
-    command_line_options.trace_file_path = argv[optind];
-  } else if (!command_line_options.enable_httpd) {
+  // in --http mode. In all other cases, the last arguments must be the trace
+  // files.
+  for (int i = optind; i < argc; ++i)
+    command_line_options.trace_file_paths.push_back(argv[i]);
+  if (command_line_options.trace_file_paths.empty() &&
+      !command_line_options.enable_httpd) {
+    PrintUsage(argv);
+    exit(1);
+  }
+
+  // Multiple traces can only be queried with a query file: everything else
+  // (metrics, export, the shell and the RPC server) works on a single trace.
+  if (command_line_options.trace_file_paths.size() > 1 &&
+      (command_line_options.query_file_path.empty() ||
+       command_line_options.launch_shell ||
+       command_line_options.enable_httpd ||
+       !command_line_options.pre_metrics_path.empty() ||
+       !command_line_options.metric_names.empty() ||
+       !command_line_options.sqlite_file_path.empty() ||
+       !command_line_options.raw_metric_extensions.empty() ||
+       !command_line_options.metatrace_path.empty())) {
     PrintUsage(argv);
     exit(1);
   }
@@ -910,13 +948,25 @@ void ExtendPoolWithBinaryDescriptor(google::protobuf::DescriptorPool& pool,
   }
 }
 
-base::Status LoadTrace(const std::string& trace_file_path, double* size_mb) {
+// Loads |trace_file_path| into |tp|. If |sqlite_lock| is not null, it is held
+// from the end of the read: everything after this point (flushing, which
+// rebuilds the trace_bounds table, symbolization and NotifyEndOfFile) runs SQL.
+base::Status LoadTrace(TraceProcessor* tp,
+                       const std::string& trace_file_path,
+                       double* size_mb,
+                       bool print_progress,
+                       std::mutex* sqlite_lock = nullptr) {
   base::Status read_status = ReadTraceUnfinalized(
-      g_tp, trace_file_path.c_str(), [&size_mb](size_t parsed_size) {
+      tp, trace_file_path.c_str(),
+      [size_mb, print_progress](size_t parsed_size) {
         *size_mb = static_cast<double>(parsed_size) / 1E6;
-        fprintf(stderr, "\rLoading trace: %.2f MB\r", *size_mb);
+        if (print_progress)
+          fprintf(stderr, "\rLoading trace: %.2f MB\r", *size_mb);
       });
-  g_tp->Flush();
+  std::unique_lock<std::mutex> lock;
+  if (sqlite_lock)
+    lock = std::unique_lock<std::mutex>(*sqlite_lock);
+  tp->Flush();
   if (!read_status.ok()) {
     return base::ErrStatus("Could not read trace file (path: %s): %s",
                            trace_file_path.c_str(), read_status.c_message());
@@ -924,30 +974,31 @@ base::Status LoadTrace(const std::string& trace_file_path, double* size_mb) {
 
   std::unique_ptr<profiling::Symbolizer> symbolizer =
       profiling::LocalSymbolizerOrDie(profiling::GetPerfettoBinaryPath(),
-                                      getenv("PERFETTO_SYMBOLIZER_MODE"));
+                                      getenv("PERFETTO_SYMBOLIZER_MODE"),
+                                      getenv("PERFETTO_SYMBOLIZER_INDEX_FILE"));
 
   if (symbolizer) {
     profiling::SymbolizeDatabase(
-        g_tp, symbolizer.get(), [](const std::string& trace_proto) {
+        tp, symbolizer.get(), [tp](const std::string& trace_proto) {
           std::unique_ptr<uint8_t[]> buf(new uint8_t[trace_proto.size()]);
           memcpy(buf.get(), trace_proto.data(), trace_proto.size());
-          auto status = g_tp->Parse(std::move(buf), trace_proto.size());
+          auto status = tp->Parse(std::move(buf), trace_proto.size());
           if (!status.ok()) {
             PERFETTO_DFATAL_OR_ELOG("Failed to parse: %s",
                                     status.message().c_str());
             return;
           }
         });
-    g_tp->Flush();
+    tp->Flush();
   }
 
   auto maybe_map = profiling::GetPerfettoProguardMapPath();
   if (!maybe_map.empty()) {
     profiling::ReadProguardMapsToDeobfuscationPackets(
-        maybe_map, [](const std::string& trace_proto) {
+        maybe_map, [tp](const std::string& trace_proto) {
           std::unique_ptr<uint8_t[]> buf(new uint8_t[trace_proto.size()]);
           memcpy(buf.get(), trace_proto.data(), trace_proto.size());
-          auto status = g_tp->Parse(std::move(buf), trace_proto.size());
+          auto status = tp->Parse(std::move(buf), trace_proto.size());
           if (!status.ok()) {
             PERFETTO_DFATAL_OR_ELOG("Failed to parse: %s",
                                     status.message().c_str());
@@ -955,7 +1006,7 @@ base::Status LoadTrace(const std::string& trace_file_path, double* size_mb) {
           }
         });
   }
-  g_tp->NotifyEndOfFile();
+  tp->NotifyEndOfFile();
   return base::OkStatus();
 }
 
@@ -1294,6 +1345,132 @@ base::Status StartInteractiveShell(const InteractiveOptions& options) {
   return base::OkStatus();
 }
 
+base::Status LoadTracesInParallel(
+    const Config& config,
+    const std::vector<std::string>& trace_file_paths,
+    std::vector<std::unique_ptr<TraceProcessor>>* tps) {
+  const size_t trace_count = trace_file_paths.size();
+  for (size_t i = 0; i < trace_count; ++i)
+    tps->emplace_back(TraceProcessor::CreateInstance(config));
+
+  // Each trace is ingested into its own instance and the threads pick the
+  // next trace to load until none is left. Only reading and tokenizing the
+  // traces (and the parsing the sorter does not hold back until the end) run
+  // in parallel: SQLite is built with SQLITE_THREADSAFE=0, so even separate
+  // connections must not be used concurrently and every phase which runs SQL
+  // holds |sqlite_lock|. The instances were created on this thread above.
+  std::vector<base::Status> statuses(trace_count);
+  std::vector<double> sizes_mb(trace_count);
+  std::atomic<size_t> next_trace{0};
+  std::mutex sqlite_lock;
+  auto load_traces = [&]() {
+    for (size_t i = next_trace++; i < trace_count; i = next_trace++) {
+      statuses[i] = LoadTrace((*tps)[i].get(), trace_file_paths[i],
+                              &sizes_mb[i], /*print_progress=*/false,
+                              &sqlite_lock);
+    }
+  };
+  size_t thread_count = std::min<size_t>(
+      std::max(std::thread::hardware_concurrency(), 1u), trace_count);
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < thread_count; ++i)
+    threads.emplace_back(load_traces);
+  load_traces();
+  for (std::thread& thread : threads)
+    thread.join();
+
+  for (size_t i = 0; i < trace_count; ++i) {
+    RETURN_IF_ERROR(statuses[i]);
+    PERFETTO_ILOG("Trace %zu loaded: %s (%.2f MB)", i,
+                  trace_file_paths[i].c_str(), sizes_mb[i]);
+  }
+  return base::OkStatus();
+}
+
+base::Status RunQueriesOnTraces(
+    const std::vector<std::unique_ptr<TraceProcessor>>& tps,
+    const std::vector<std::string>& trace_file_paths,
+    const std::string& query_file_path,
+    FILE* output) {
+  std::string queries;
+  base::ReadFile(query_file_path.c_str(), &queries);
+
+  std::vector<std::string> column_names;
+  for (size_t i = 0; i < tps.size(); ++i) {
+    auto it = tps[i]->ExecuteQuery(queries);
+    bool has_more = it.Next();
+    base::Status status = it.Status();
+    uint32_t prev_with_output = has_more ? it.StatementWithOutputCount() - 1
+                                         : it.StatementWithOutputCount();
+    if (status.ok() && prev_with_output > 0) {
+      status = base::ErrStatus(
+          "Result rows were returned for multiples queries. Ensure that only "
+          "the final statement is a SELECT statment.");
+    }
+    if (!status.ok()) {
+      return base::ErrStatus(
+          "Encountered error while running queries on trace %zu (path: %s): "
+          "%s",
+          i, trace_file_paths[i].c_str(), status.c_message());
+    }
+
+    std::vector<std::string> names;
+    for (uint32_t c = 0; c < it.ColumnCount(); c++)
+      names.push_back(it.GetColumnName(c));
+    if (i == 0) {
+      column_names = names;
+      fprintf(output, "\"trace_id\"");
+      for (const std::string& name : column_names)
+        fprintf(output, ",\"%s\"", name.c_str());
+      fprintf(output, "\n");
+    } else if (names != column_names) {
+      return base::ErrStatus(
+          "Query returned different columns for trace %zu (path: %s) than for "
+          "trace 0",
+          i, trace_file_paths[i].c_str());
+    }
+
+    for (; has_more; has_more = it.Next()) {
+      fprintf(output, "%zu", i);
+      for (uint32_t c = 0; c < it.ColumnCount(); c++) {
+        fprintf(output, ",");
+        PrintCsvValue(it.Get(c), output);
+      }
+      fprintf(output, "\n");
+    }
+    RETURN_IF_ERROR(it.Status());
+  }
+  return base::OkStatus();
+}
+
+// Loads each trace into its own TraceProcessor and runs the query on each of
+// them, merging the results into a single CSV keyed by trace_id.
+//
+// Note that the traces do not share a StringPool or a DescriptorPool, the
+// core tables have no trace_id column and there are no union views across
+// traces: these are single-threaded and the row ids of the tables are only
+// unique within a trace. Queries comparing traces have to aggregate per trace
+// and compare the merged output. The queries run on one trace at a time.
+base::Status MultiTraceMain(const Config& config,
+                            const CommandLineOptions& options) {
+  base::TimeNanos t_load_start = base::GetWallTimeNs();
+  std::vector<std::unique_ptr<TraceProcessor>> tps;
+  RETURN_IF_ERROR(
+      LoadTracesInParallel(config, options.trace_file_paths, &tps));
+  base::TimeNanos t_load = base::GetWallTimeNs() - t_load_start;
+  PERFETTO_ILOG("%zu traces loaded in %.2fs", tps.size(),
+                static_cast<double>(t_load.count()) / 1E9);
+
+  base::TimeNanos t_query_start = base::GetWallTimeNs();
+  RETURN_IF_ERROR(RunQueriesOnTraces(tps, options.trace_file_paths,
+                                     options.query_file_path, stdout));
+  base::TimeNanos t_query = base::GetWallTimeNs() - t_query_start;
+
+  if (!options.perf_file_path.empty())
+    RETURN_IF_ERROR(PrintPerfFile(options.perf_file_path, t_load, t_query));
+  return base::OkStatus();
+}
+
 base::Status TraceProcessorMain(int argc, char** argv) {
   CommandLineOptions options = ParseCommandLineOptions(argc, argv);
 
@@ -1302,6 +1479,7 @@ base::Status TraceProcessorMain(int argc, char** argv) {
                             ? SortingMode::kForceFullSort
                             : SortingMode::kDefaultHeuristics;
   config.ingest_ftrace_in_raw_table = !options.no_ftrace_raw;
+  config.reuse_metric_outputs = options.metrics_reuse;
 
   std::vector<MetricExtension> metric_extensions;
   RETURN_IF_ERROR(ParseMetricExtensionPaths(
@@ -1311,6 +1489,9 @@ base::Status TraceProcessorMain(int argc, char** argv) {
     config.skip_builtin_metric_paths.push_back(extension.virtual_path());
   }
 
+  if (options.trace_file_paths.size() > 1)
+    return MultiTraceMain(config, options);
+
   std::unique_ptr<TraceProcessor> tp = TraceProcessor::CreateInstance(config);
   g_tp = tp.get();
 
@@ -1327,10 +1508,11 @@ base::Status TraceProcessorMain(int argc, char** argv) {
   }
 
   base::TimeNanos t_load{};
-  if (!options.trace_file_path.empty()) {
+  if (!options.trace_file_paths.empty()) {
     base::TimeNanos t_load_start = base::GetWallTimeNs();
     double size_mb = 0;
-    RETURN_IF_ERROR(LoadTrace(options.trace_file_path, &size_mb));
+    RETURN_IF_ERROR(LoadTrace(g_tp, options.trace_file_paths[0], &size_mb,
+                              /*print_progress=*/true));
     t_load = base::GetWallTimeNs() - t_load_start;
 
     double t_load_s = static_cast<double>(t_load.count()) / 1E9;